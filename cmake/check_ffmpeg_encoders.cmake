@@ -0,0 +1,27 @@
+# 检查预编译的ffmpeg是否带了libx264/libx265. 软件编码器(硬件编码器全部失败时的回退，或者
+# 配置了video_software_encoder)按名字找这两个编码器，缺了只能在运行时才发现，所以在配置时提醒.
+# 编码器名以'\0'结尾的字符串存在avcodec的二进制里，不需要运行任何程序就能查到.
+function(check_ffmpeg_encoders ffmpeg_dir)
+    file(GLOB_RECURSE avcodec_binaries
+        ${ffmpeg_dir}/*avcodec*.dll
+        ${ffmpeg_dir}/*avcodec.so*
+        ${ffmpeg_dir}/*avcodec.a
+        ${ffmpeg_dir}/*avcodec.lib
+    )
+    if (NOT avcodec_binaries)
+        message(WARNING "avcodec not found under ${ffmpeg_dir}, can't check for libx264/libx265")
+        return()
+    endif()
+    set(found_encoders)
+    foreach(binary ${avcodec_binaries})
+        file(STRINGS ${binary} encoders REGEX "^libx26[45]$")
+        list(APPEND found_encoders ${encoders})
+    endforeach()
+    foreach(encoder libx264 libx265)
+        if (${encoder} IN_LIST found_encoders)
+            message(STATUS "ffmpeg has ${encoder}")
+        else()
+            message(WARNING "ffmpeg under ${ffmpeg_dir} was built without ${encoder}, software encoder won't work")
+        endif()
+    endforeach()
+endfunction()
@@ -30,6 +30,7 @@
 
 #include "audio_capturer.h"
 
+#include <algorithm>
 #include <fstream>
 
 #include <ltlib/logging.h>
@@ -41,6 +42,23 @@
 
 #include "win_audio_capturer.h"
 
+namespace {
+
+// 码率按声道计算
+constexpr uint32_t kDefaultBitratePerChannel = 48'000;
+constexpr uint32_t kMinBitratePerChannel = 12'000;
+constexpr uint32_t kMaxBitratePerChannel = 64'000;
+// 音频最多占用带宽估计的比例
+constexpr float kAudioBandwidthShare = 0.05f;
+// 码率较高时降低复杂度，省下采集线程的编码耗时
+constexpr uint32_t kHighBitratePerChannel = 32'000;
+constexpr int32_t kHighBitrateComplexity = 8;
+constexpr int32_t kLowBitrateComplexity = 10;
+// opus文档建议的单包上限
+constexpr size_t kMaxOpusPacketSize = 4000;
+
+} // namespace
+
 namespace lt {
 
 std::unique_ptr<AudioCapturer> AudioCapturer::create(const Params& params) {
@@ -74,9 +92,17 @@ void AudioCapturer::stop() {
     stoped_ = true;
 }
 
+void AudioCapturer::updateNetworkStat(float loss_rate, uint32_t bwe_bps) {
+    loss_rate_ = loss_rate;
+    bwe_bps_ = bwe_bps;
+    network_stat_changed_ = true;
+}
+
 AudioCapturer::AudioCapturer(const Params& params)
     : type_{params.type}
-    , on_audio_data_{params.on_audio_data} {}
+    , on_audio_data_{params.on_audio_data}
+    , frame_duration_us_{params.frame_duration_us}
+    , low_delay_{params.low_delay} {}
 
 bool AudioCapturer::init() {
     if (!initPlatform()) {
@@ -93,25 +119,63 @@ bool AudioCapturer::needEncode() const {
 }
 
 bool AudioCapturer::initEncoder() {
+    switch (frame_duration_us_) {
+    case 2'500:
+    case 5'000:
+    case 10'000:
+    case 20'000:
+        break;
+    default:
+        LOG(ERR) << "Unsupported audio frame duration " << frame_duration_us_ << "us";
+        return false;
+    }
+    pcm_buffer_.resize(bytesPerPacket());
     if (type_ != AudioCodecType::OPUS) {
         LOG(INFO) << "No need OPUS";
         return true;
     }
     int error = 0;
-    OpusEncoder* encoder =
-        opus_encoder_create(framesPerSec(), channels(), OPUS_APPLICATION_AUDIO, &error);
+    const int application =
+        low_delay_ ? OPUS_APPLICATION_RESTRICTED_LOWDELAY : OPUS_APPLICATION_AUDIO;
+    OpusEncoder* encoder = opus_encoder_create(framesPerSec(), channels(), application, &error);
     if (encoder == nullptr || error != OPUS_OK) {
         LOG(ERR) << "opus_encoder_create failed with " << error;
         return false;
     }
-    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(framesPerSec() * bytesPerFrame() * 8));
-    LOGF(INFO, "OPUS encoder created. fs:%u, channels:%u, bitrate:%u", framesPerSec(), channels(),
-         framesPerSec() * bytesPerFrame() * 8);
-    opus_buffer_.resize(framesPer10ms() * bytesPerFrame());
+    LOGF(INFO, "OPUS encoder created. fs:%u, channels:%u, frame_duration:%uus, low_delay:%d",
+         framesPerSec(), channels(), frame_duration_us_, low_delay_);
+    opus_buffer_.resize(kMaxOpusPacketSize);
     opus_encoder_ = encoder;
+    adjustEncoder();
     return true;
 }
 
+void AudioCapturer::adjustEncoder() {
+    const float loss_rate = loss_rate_;
+    const uint32_t bwe_bps = bwe_bps_;
+    uint32_t bitrate = kDefaultBitratePerChannel * channels();
+    if (bwe_bps != 0) {
+        bitrate = std::clamp(static_cast<uint32_t>(bwe_bps * kAudioBandwidthShare),
+                             kMinBitratePerChannel * channels(),
+                             kMaxBitratePerChannel * channels());
+    }
+    const int32_t complexity = bitrate >= kHighBitratePerChannel * channels()
+                                   ? kHighBitrateComplexity
+                                   : kLowBitrateComplexity;
+    // 不开in-band FEC: 传给控制端的只有opus裸数据，没有序号，控制端发现不了丢包，
+    // 也就没法用decode_fec=1把冗余解出来，开了只会白白挤占码率
+    if (bitrate == bitrate_bps_ && complexity == complexity_) {
+        return;
+    }
+    auto encoder = reinterpret_cast<OpusEncoder*>(opus_encoder_);
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(static_cast<opus_int32>(bitrate)));
+    opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(complexity));
+    LOGF(INFO, "OPUS encoder bitrate:%u, complexity:%d, loss:%.3f, bwe:%u", bitrate, complexity,
+         loss_rate, bwe_bps);
+    bitrate_bps_ = bitrate;
+    complexity_ = complexity;
+}
+
 void AudioCapturer::onCapturedData(const uint8_t* data, uint32_t frames) {
     if (data == nullptr) {
         return;
@@ -119,62 +183,54 @@ void AudioCapturer::onCapturedData(const uint8_t* data, uint32_t frames) {
     // static std::ofstream out1{"./audio_pcm", std::ios::binary | std::ios::trunc};
     // out1.write(reinterpret_cast<const char*>(data), frames * bytesPerFrame());
     // out1.flush();
-    std::shared_ptr<uint8_t> first_fragment;
-    std::vector<const uint8_t*> fragments;
-    uint32_t total_size = frames * bytesPerFrame();
+    if (needEncode() && network_stat_changed_.exchange(false)) {
+        adjustEncoder();
+    }
+    const uint32_t total_size = frames * bytesPerFrame();
+    const uint32_t bytes_per_packet = bytesPerPacket();
     uint32_t index = 0;
-    const uint32_t bytes_per_10ms = bytesPer10ms();
-    if (pcm_buffer_) {
-        uint32_t bytes_need = bytes_per_10ms - pcm_buffer_size_;
-        if (bytes_need <= total_size) {
-            memcpy(pcm_buffer_.get() + pcm_buffer_size_, data, bytes_need);
-            index -= bytes_need;
-            first_fragment = std::move(pcm_buffer_);
-            fragments.push_back(first_fragment.get());
-        }
-        else {
-            memcpy(pcm_buffer_.get() + pcm_buffer_size_, data, total_size);
+    if (pcm_buffer_size_ != 0) {
+        uint32_t bytes_need = bytes_per_packet - pcm_buffer_size_;
+        if (bytes_need > total_size) {
+            memcpy(pcm_buffer_.data() + pcm_buffer_size_, data, total_size);
             pcm_buffer_size_ += total_size;
             return;
         }
+        memcpy(pcm_buffer_.data() + pcm_buffer_size_, data, bytes_need);
+        pcm_buffer_size_ = 0;
+        index = bytes_need;
+        sendPacket(pcm_buffer_.data());
     }
-    for (index; index < total_size; index += bytes_per_10ms) {
-        if (index + bytes_per_10ms >= total_size) {
-            break;
-        }
-        fragments.push_back(data + index);
+    // 完整的包直接从采集数据编码，不拷贝
+    for (; index + bytes_per_packet <= total_size; index += bytes_per_packet) {
+        sendPacket(data + index);
     }
     if (index < total_size) {
-        pcm_buffer_ = std::shared_ptr<uint8_t>{new uint8_t[bytes_per_10ms]};
-        memcpy(pcm_buffer_.get(), data + index, total_size - index);
+        memcpy(pcm_buffer_.data(), data + index, total_size - index);
         pcm_buffer_size_ = total_size - index;
     }
+}
 
+void AudioCapturer::sendPacket(const uint8_t* pcm) {
+    auto msg = std::make_shared<ltproto::client2worker::AudioData>();
     if (needEncode()) {
         auto encoder = reinterpret_cast<OpusEncoder*>(opus_encoder_);
-        for (auto& fragment : fragments) {
-            auto pcm_data = reinterpret_cast<const opus_int16*>(fragment);
-            auto len = opus_encode(encoder, pcm_data, framesPer10ms(), opus_buffer_.data(),
-                                   static_cast<opus_int32>(opus_buffer_.size()));
-            if (len < 0) {
-                LOG(ERR) << "opus_encode failed with " << len;
-                return;
-            }
-            auto msg = std::make_shared<ltproto::client2worker::AudioData>();
-            msg->set_data(opus_buffer_.data(), len);
-            on_audio_data_(msg);
-            // static std::ofstream out{"./audio_src", std::ios::binary | std::ios::trunc};
-            // out.write(reinterpret_cast<const char*>(opus_buffer_.data()), len);
-            // out.flush();
+        auto pcm_data = reinterpret_cast<const opus_int16*>(pcm);
+        auto len = opus_encode(encoder, pcm_data, framesPerPacket(), opus_buffer_.data(),
+                               static_cast<opus_int32>(opus_buffer_.size()));
+        if (len < 0) {
+            LOG(ERR) << "opus_encode failed with " << len;
+            return;
         }
+        msg->set_data(opus_buffer_.data(), len);
+        // static std::ofstream out{"./audio_src", std::ios::binary | std::ios::trunc};
+        // out.write(reinterpret_cast<const char*>(opus_buffer_.data()), len);
+        // out.flush();
     }
     else {
-        for (auto& fragment : fragments) {
-            auto msg = std::make_shared<ltproto::client2worker::AudioData>();
-            msg->set_data(fragment, bytes_per_10ms);
-            on_audio_data_(msg);
-        }
+        msg->set_data(pcm, bytesPerPacket());
     }
+    on_audio_data_(msg);
 }
 
 void AudioCapturer::setBytesPerFrame(uint32_t value) {
@@ -209,4 +265,13 @@ uint32_t AudioCapturer::bytesPer10ms() const {
     return bytesPerFrame() * framesPer10ms();
 }
 
+uint32_t AudioCapturer::framesPerPacket() const {
+    return static_cast<uint32_t>(static_cast<uint64_t>(frames_per_sec_) * frame_duration_us_ /
+                                 1'000'000);
+}
+
+uint32_t AudioCapturer::bytesPerPacket() const {
+    return bytesPerFrame() * framesPerPacket();
+}
+
 } // namespace lt
\ No newline at end of file
@@ -29,9 +29,11 @@
  */
 
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <vector>
 
 #include <google/protobuf/message_lite.h>
 
@@ -46,6 +48,10 @@ public:
     struct Params {
         AudioCodecType type;
         std::function<void(const std::shared_ptr<google::protobuf::MessageLite>&)> on_audio_data;
+        // 每个包的时长，可选2500/5000/10000/20000
+        uint32_t frame_duration_us = 10'000;
+        // 使用OPUS_APPLICATION_RESTRICTED_LOWDELAY，适合游戏. 该模式下只有CELT
+        bool low_delay = false;
     };
 
 public:
@@ -53,11 +59,15 @@ public:
     virtual ~AudioCapturer();
     void start();
     void stop();
+    // 线程安全，实际的调整在采集线程下一次编码前进行
+    void updateNetworkStat(float loss_rate, uint32_t bwe_bps);
     uint32_t bytesPerFrame() const;
     uint32_t channels() const;
     uint32_t framesPerSec() const;
     uint32_t framesPer10ms() const;
     uint32_t bytesPer10ms() const;
+    uint32_t framesPerPacket() const;
+    uint32_t bytesPerPacket() const;
 
 protected:
     AudioCapturer(const Params& params);
@@ -73,6 +83,8 @@ private:
     bool init();
     bool needEncode() const;
     bool initEncoder();
+    void adjustEncoder();
+    void sendPacket(const uint8_t* pcm);
 
 private:
     const AudioCodecType type_;
@@ -82,10 +94,18 @@ private:
     uint32_t bytes_per_frame_ = 0;
     uint32_t channels_ = 0;
     uint32_t frames_per_sec_ = 0;
-    std::shared_ptr<uint8_t> pcm_buffer_;
+    const uint32_t frame_duration_us_;
+    const bool low_delay_;
+    // 采集回调给的数据长度和包长对不上，不够一个包的部分暂存在这里，复用不重新分配
+    std::vector<uint8_t> pcm_buffer_;
     uint32_t pcm_buffer_size_ = 0;
     std::vector<uint8_t> opus_buffer_;
     void* opus_encoder_ = nullptr;
+    std::atomic<float> loss_rate_{0.f};
+    std::atomic<uint32_t> bwe_bps_{0};
+    std::atomic<bool> network_stat_changed_{false};
+    uint32_t bitrate_bps_ = 0;
+    int32_t complexity_ = 0;
 };
 
 } // namespace lt
\ No newline at end of file
@@ -58,7 +58,8 @@ AudioPlayer::AudioPlayer(const Params& params)
     : type_{params.type}
     , frames_per_sec_{params.frames_per_second}
     , channels_{params.channels} {
-    buffer_.resize(framesPer10ms() * channels() * 2);
+    // 发送端可以配置2.5~20ms的包长，这里按最大的20ms准备
+    buffer_.resize(framesPer10ms() * 2 * channels() * sizeof(int16_t));
 }
 
 bool AudioPlayer::init() {
@@ -112,7 +113,8 @@ int32_t AudioPlayer::decode(const void* data, uint32_t input_size) {
     auto decoder = reinterpret_cast<OpusDecoder*>(opus_decoder_);
     auto input = reinterpret_cast<const unsigned char*>(data);
     auto output = reinterpret_cast<opus_int16*>(buffer_.data());
-    auto output_capacity = static_cast<int>(buffer_.size());
+    // opus_decode()的frame_size参数是每声道的采样数，不是字节数
+    auto output_capacity = static_cast<int>(buffer_.size() / channels() / sizeof(opus_int16));
     int frames = opus_decode(decoder, input, input_size, output, output_capacity, 0);
     if (frames < 0) {
         LOG(ERR) << "opus_decode failed with " << frames;
@@ -31,6 +31,7 @@
 #include "client.h"
 
 #include <filesystem>
+#include <future>
 #include <sstream>
 
 #include <ltproto/client2app/client_status.pb.h>
@@ -50,11 +51,15 @@
 #include <ltproto/signaling/signaling_message.pb.h>
 #include <ltproto/signaling/signaling_message_ack.pb.h>
 
+#include <ltlib/frame_trace.h>
 #include <ltlib/logging.h>
+#include <ltlib/startup_tasks.h>
 #include <ltlib/system.h>
 #include <ltlib/time_sync.h>
 #include <string_keys.h>
 
+#include <graphics/keyframe_request.h>
+
 #include <transport/transport_rtc.h>
 #include <transport/transport_rtc2.h>
 #include <transport/transport_tcp.h>
@@ -237,32 +242,85 @@ Client::~Client() {
 }
 
 bool Client::init() {
-    if (!initSettings()) {
-        LOG(ERR) << "Init settings failed";
+    ltlib::StartupTasks startup{"client"};
+    // GPU探测比较慢，和其它初始化并发执行，也不让ioloop等它
+    startup.run("gpu_probe", [this]() {
+        // 失败了不要紧，创建解码渲染管线时会再探测一次
+        gpu_probed_ = gpu_info_.init();
+        return true;
+    });
+    // 打开sqlite读设置也放到单独线程，信令和app管道用不到这些设置.
+    // ioloop跑起来之前要等它结束，加入房间后创建transport会用到settings_
+    std::promise<bool> settings_promise;
+    auto settings_future = settings_promise.get_future();
+    startup.run("settings", [this, &settings_promise]() {
+        const bool success = initSettings();
+        if (success) {
+            loadSettings();
+        }
+        settings_promise.set_value(success);
+        return success;
+    });
+    // 信令和app两个Client共用一个IOLoop，libuv的句柄初始化不是线程安全的，只能串行.
+    // SDL窗口等加入房间成功后再创建，加入失败不会留下一个空窗口
+    bool success = startup.measure("ioloop", [this]() {
+        ioloop_ = ltlib::IOLoop::create();
+        return ioloop_ != nullptr;
+    });
+    if (success) {
+        success = startup.measure("signaling", std::bind(&Client::initSignalingClient, this));
+    }
+    if (success) {
+        success = startup.measure("app_pipe", std::bind(&Client::initAppClient, this));
+    }
+    success = settings_future.get() && success;
+    if (!success) {
+        startup.wait();
+        LOG(INFO) << startup.report();
+        LOG(ERR) << "Init client failed";
         return false;
     }
+    hb_thread_ = ltlib::TaskThread::create("heart_beat");
+    main_thread_ = ltlib::BlockingThread::create(
+        "main_thread", [this](const std::function<void()>& i_am_alive) { mainLoop(i_am_alive); });
+    should_exit_ = false;
+    // ioloop已经在跑了，这里等GPU探测结束只阻塞调用者，为了输出完整的耗时
+    startup.wait();
+    LOG(INFO) << startup.report();
+    return true;
+}
+
+void Client::loadSettings() {
     auto wf = settings_->getBoolean("windowed_fullscreen");
     if (!wf.has_value() || wf.value()) {
         // 没有设置 或者 设置为真，即默认窗口化全屏
         windowed_fullscreen_ = true;
     }
-    ioloop_ = ltlib::IOLoop::create();
-    if (ioloop_ == nullptr) {
-        LOG(ERR) << "Init IOLoop failed";
-        return false;
-    }
-    if (!initSignalingClient()) {
-        LOG(ERR) << "Create signaling client failed";
-        return false;
+    // 记录每一帧各阶段的时间点，Win+Shift+T导出
+    auto frame_trace = settings_->getBoolean("enable_frame_trace");
+    ltlib::FrameTracer::instance()->setProcess(1, "client");
+    ltlib::FrameTracer::instance()->enable(frame_trace.has_value() && frame_trace.value());
+    // 鼠标移动、摇杆合并发送的频率，不设置则跟随RTT
+    auto flush_rate = settings_->getInteger("input_flush_rate");
+    if (flush_rate.has_value() && flush_rate.value() > 0) {
+        input_params_.flush_rate_hz = static_cast<uint32_t>(flush_rate.value());
     }
-    if (!initAppClient()) {
-        LOG(ERR) << "Create app client failed";
+}
+
+bool Client::initSdl() {
+    PcSdl::Params params{};
+    params.on_reset = std::bind(&Client::onPlatformRenderTargetReset, this);
+    params.on_exit = std::bind(&Client::onPlatformExit, this);
+    params.windowed_fullscreen = windowed_fullscreen_;
+    sdl_ = PcSdl::create(params);
+    if (sdl_ == nullptr) {
+        LOG(INFO) << "Initialize sdl failed";
         return false;
     }
-    hb_thread_ = ltlib::TaskThread::create("heart_beat");
-    main_thread_ = ltlib::BlockingThread::create(
-        "main_thread", [this](const std::function<void()>& i_am_alive) { mainLoop(i_am_alive); });
-    should_exit_ = false;
+    LOG(INFO) << "Initialize SDL success";
+    sdl_->setTitle("Connecting....");
+    video_params_.sdl = sdl_.get();
+    input_params_.sdl = sdl_.get();
     return true;
 }
 
@@ -394,6 +452,20 @@ void Client::switchMouseMode() {
     sendMessageToHost(ltproto::id(msg), msg, true);
 }
 
+void Client::dumpFrameTrace() {
+    // NOTE: 这运行在platform线程，写文件挪到main thread去
+    postTask([]() {
+        std::filesystem::path path = ltlib::getConfigPath(false);
+        path /= "trace";
+        if (!std::filesystem::exists(path) && !std::filesystem::create_directories(path)) {
+            LOG(ERR) << "Create frame trace directory '" << path.string() << "' failed";
+            return;
+        }
+        path /= "frame_trace_" + std::to_string(ltlib::utc_now_ms()) + ".json";
+        ltlib::FrameTracer::instance()->dumpChromeTrace(path.string());
+    });
+}
+
 void Client::checkWorkerTimeout() {
     constexpr int64_t kFiveSeconds = 5'000;
     constexpr int64_t k500ms = 500;
@@ -496,21 +568,13 @@ void Client::onJoinRoomAck(std::shared_ptr<google::protobuf::MessageLite> _msg)
         return;
     }
     LOG(INFO) << "Join signaling room success";
-    PcSdl::Params params{};
-    params.on_reset = std::bind(&Client::onPlatformRenderTargetReset, this);
-    params.on_exit = std::bind(&Client::onPlatformExit, this);
-    params.windowed_fullscreen = windowed_fullscreen_;
-    sdl_ = PcSdl::create(params);
-    if (sdl_ == nullptr) {
-        LOG(INFO) << "Initialize sdl failed";
+    if (!initSdl()) {
         return;
     }
-    LOG(INFO) << "Initialize SDL success";
-    sdl_->setTitle("Connecting....");
-    video_params_.sdl = sdl_.get();
-    input_params_.sdl = sdl_.get();
     if (!initTransport()) {
         LOG(INFO) << "Initialize rtc failed";
+        // 不留下一个一直显示"Connecting...."的窗口，走正常的退出流程
+        sdl_->stop();
         return;
     }
     LOG(INFO) << "Initialize rtc success";
@@ -698,6 +762,10 @@ void Client::onTpVideoFrame(void* user_data, const lt::VideoFrame& frame) {
     case VideoDecodeRenderPipeline::Action::REQUEST_KEY_FRAME:
     {
         auto req = std::make_shared<ltproto::client2worker::RequestKeyframe>();
+        // 带上解码失败前最后正确解码的帧，服务端能从长期参考帧恢复，不用等IDR
+        KeyframeRequestInfo info;
+        info.last_decoded_frame_id = that->video_pipeline_->lastDecodedFrameID();
+        writeKeyframeRequestInfo(*req, info);
         that->sendMessageToHost(ltproto::id(req), req, true);
         break;
     }
@@ -719,6 +787,9 @@ void Client::onTpAudioData(void* user_data, const lt::AudioData& audio_data) {
 void Client::onTpConnected(void* user_data, lt::LinkType link_type) {
     auto that = reinterpret_cast<Client*>(user_data);
     (void)link_type;
+    if (that->gpu_probed_) {
+        that->video_params_.gpu_info = &that->gpu_info_;
+    }
     that->video_pipeline_ = VideoDecodeRenderPipeline::create(that->video_params_);
     if (that->video_pipeline_ == nullptr) {
         LOG(ERR) << "Create VideoDecodeRenderPipeline failed";
@@ -731,6 +802,7 @@ void Client::onTpConnected(void* user_data, lt::LinkType link_type) {
     that->input_params_.host_width = that->video_params_.width;
     that->input_params_.toggle_fullscreen = std::bind(&Client::toggleFullscreen, that);
     that->input_params_.switch_mouse_mode = std::bind(&Client::switchMouseMode, that);
+    that->input_params_.dump_frame_trace = std::bind(&Client::dumpFrameTrace, that);
     that->input_capturer_ = InputCapturer::create(that->input_params_);
     if (that->input_capturer_ == nullptr) {
         LOG(ERR) << "Create InputCapturer failed";
@@ -857,6 +929,9 @@ void Client::onTimeSync(std::shared_ptr<google::protobuf::MessageLite> _msg) {
             video_pipeline_->setTimeDiff(time_diff_);
             video_pipeline_->setRTT(rtt_);
         }
+        if (input_capturer_) {
+            input_capturer_->setRTT(rtt_);
+        }
     }
 }
 
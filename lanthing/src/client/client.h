@@ -31,12 +31,14 @@
 #pragma once
 #include <cstdint>
 
+#include <atomic>
 #include <condition_variable>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include <ltlib/io/client.h>
 #include <ltlib/io/ioloop.h>
@@ -97,6 +99,8 @@ private:
     Client(const Params& params);
     bool init();
     bool initSettings();
+    void loadSettings();
+    bool initSdl();
     bool initSignalingClient();
     bool initAppClient();
     void mainLoop(const std::function<void()>& i_am_alive);
@@ -108,6 +112,7 @@ private:
     void syncTime();
     void toggleFullscreen();
     void switchMouseMode();
+    void dumpFrameTrace();
     void checkWorkerTimeout();
     void tellAppKeepAliveTimeout();
 
@@ -163,6 +168,8 @@ private:
     SignalingParams signaling_params_;
     InputCapturer::Params input_params_{};
     VideoDecodeRenderPipeline::Params video_params_;
+    GpuInfo gpu_info_;
+    std::atomic<bool> gpu_probed_{false};
     AudioPlayer::Params audio_params_{};
     std::vector<std::string> reflex_servers_;
     std::mutex dr_mutex_;
@@ -0,0 +1,211 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "capability_cache.h"
+
+#if defined(LT_WINDOWS)
+#include <Windows.h>
+#include <dxgi.h>
+#include <wrl/client.h>
+#endif // LT_WINDOWS
+
+#include <sstream>
+
+#include <ltlib/logging.h>
+
+namespace {
+
+#if defined(LT_WINDOWS)
+
+std::string osVersion() {
+    // GetVersionEx会被兼容性清单骗，直接问ntdll
+    using RtlGetVersionFunc = LONG(WINAPI*)(PRTL_OSVERSIONINFOW);
+    HMODULE ntdll = GetModuleHandleW(L"ntdll.dll");
+    if (ntdll == nullptr) {
+        return "";
+    }
+    auto rtl_get_version =
+        reinterpret_cast<RtlGetVersionFunc>(GetProcAddress(ntdll, "RtlGetVersion"));
+    if (rtl_get_version == nullptr) {
+        return "";
+    }
+    RTL_OSVERSIONINFOW info{};
+    info.dwOSVersionInfoSize = sizeof(info);
+    if (rtl_get_version(&info) != 0) {
+        return "";
+    }
+    return std::to_string(info.dwMajorVersion) + "." + std::to_string(info.dwMinorVersion) + "." +
+           std::to_string(info.dwBuildNumber);
+}
+
+#else // LT_WINDOWS
+
+std::string osVersion() {
+    return "";
+}
+
+#endif // LT_WINDOWS
+
+} // namespace
+
+namespace lt {
+
+std::string CapabilityCache::Fingerprint::to_str() const {
+    char buf[256] = {0};
+    snprintf(buf, sizeof(buf) - 1, "%04x-%04x-%s-%s", vendor_id, device_id, driver.c_str(),
+             os.c_str());
+    return buf;
+}
+
+std::unique_ptr<CapabilityCache> CapabilityCache::create() {
+    auto settings = ltlib::Settings::create(ltlib::Settings::Storage::Sqlite);
+    if (settings == nullptr) {
+        return nullptr;
+    }
+    std::unique_ptr<CapabilityCache> cache{new CapabilityCache};
+    cache->settings_ = std::move(settings);
+    return cache;
+}
+
+CapabilityCache::Fingerprint CapabilityCache::fingerprint(uint32_t vendor_id, uint32_t device_id,
+                                                          const std::string& driver) {
+    Fingerprint fingerprint{};
+    fingerprint.vendor_id = vendor_id;
+    fingerprint.device_id = device_id;
+    fingerprint.driver = driver;
+    fingerprint.os = osVersion();
+    return fingerprint;
+}
+
+#if defined(LT_WINDOWS)
+
+CapabilityCache::Fingerprint CapabilityCache::fingerprintByLuid(int64_t luid) {
+    using Microsoft::WRL::ComPtr;
+    ComPtr<IDXGIFactory1> factory;
+    HRESULT hr = CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)factory.GetAddressOf());
+    if (FAILED(hr)) {
+        LOGF(WARNING, "CreateDXGIFactory1 failed with %#x", hr);
+        return {};
+    }
+    ComPtr<IDXGIAdapter> adapter;
+    UINT i = 0;
+    while (factory->EnumAdapters(i++, adapter.ReleaseAndGetAddressOf()) != DXGI_ERROR_NOT_FOUND) {
+        DXGI_ADAPTER_DESC desc;
+        if (FAILED(adapter->GetDesc(&desc))) {
+            continue;
+        }
+        int64_t adapter_luid =
+            ((int64_t)desc.AdapterLuid.HighPart << 32) + desc.AdapterLuid.LowPart;
+        if (adapter_luid == luid) {
+            return fingerprint(desc.VendorId, desc.DeviceId, driverVersion(adapter.Get()));
+        }
+    }
+    return {};
+}
+
+std::string CapabilityCache::driverVersion(IDXGIAdapter* adapter) {
+    LARGE_INTEGER umd_version{};
+    if (FAILED(adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umd_version))) {
+        return "";
+    }
+    return std::to_string(HIWORD(umd_version.HighPart)) + "." +
+           std::to_string(LOWORD(umd_version.HighPart)) + "." +
+           std::to_string(HIWORD(umd_version.LowPart)) + "." +
+           std::to_string(LOWORD(umd_version.LowPart));
+}
+
+#else // LT_WINDOWS
+
+CapabilityCache::Fingerprint CapabilityCache::fingerprintByLuid(int64_t luid) {
+    (void)luid;
+    return {};
+}
+
+#endif // LT_WINDOWS
+
+std::string CapabilityCache::codecsToString(const std::vector<lt::VideoCodecType>& codecs) {
+    std::string str;
+    for (auto codec : codecs) {
+        if (!str.empty()) {
+            str += ",";
+        }
+        str += std::to_string(static_cast<int>(codec));
+    }
+    return str;
+}
+
+std::vector<lt::VideoCodecType> CapabilityCache::codecsFromString(const std::string& str) {
+    std::vector<lt::VideoCodecType> codecs;
+    std::stringstream ss(str);
+    std::string codec;
+    while (std::getline(ss, codec, ',')) {
+        auto type = static_cast<lt::VideoCodecType>(std::atoi(codec.c_str()));
+        if (type == lt::VideoCodecType::H264 || type == lt::VideoCodecType::H265) {
+            codecs.push_back(type);
+        }
+    }
+    return codecs;
+}
+
+std::optional<std::string> CapabilityCache::load(const std::string& name,
+                                                 const Fingerprint& fingerprint) {
+    if (!fingerprint.valid()) {
+        return std::nullopt;
+    }
+    auto record = settings_->getString(key(name, fingerprint));
+    if (!record.has_value()) {
+        return std::nullopt;
+    }
+    // 记录格式: 指纹|探测结果
+    const std::string prefix = fingerprint.to_str() + "|";
+    if (record->compare(0, prefix.size(), prefix) != 0) {
+        LOG(INFO) << "Capability cache '" << name << "' is stale, fingerprint changed to "
+                  << fingerprint.to_str();
+        return std::nullopt;
+    }
+    return record->substr(prefix.size());
+}
+
+void CapabilityCache::save(const std::string& name, const Fingerprint& fingerprint,
+                           const std::string& value) {
+    if (!fingerprint.valid()) {
+        return;
+    }
+    settings_->setString(key(name, fingerprint), fingerprint.to_str() + "|" + value);
+}
+
+std::string CapabilityCache::key(const std::string& name, const Fingerprint& fingerprint) {
+    // 同一块显卡只留一条，驱动升级后覆盖旧的
+    char buf[64] = {0};
+    snprintf(buf, sizeof(buf) - 1, "_%04x_%04x", fingerprint.vendor_id, fingerprint.device_id);
+    return "capability_" + name + buf;
+}
+
+} // namespace lt
@@ -0,0 +1,86 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <ltlib/settings.h>
+#include <transport/transport.h>
+
+#if defined(LT_WINDOWS)
+struct IDXGIAdapter;
+#endif // LT_WINDOWS
+
+namespace lt {
+
+// 创建编解码器、D3D设备这类能力探测很慢，结果存进设置，下次启动直接用.
+// 每块显卡一条记录，带上显卡型号、驱动版本、系统版本组成的指纹，换显卡、升级驱动或系统后
+// 指纹对不上，缓存自动失效.
+class CapabilityCache {
+public:
+    struct Fingerprint {
+        uint32_t vendor_id = 0;
+        uint32_t device_id = 0;
+        std::string driver;
+        std::string os;
+        // 拿不到指纹时不读也不写缓存
+        bool valid() const { return vendor_id != 0 && !driver.empty() && !os.empty(); }
+        std::string to_str() const;
+    };
+
+public:
+    static std::unique_ptr<CapabilityCache> create();
+    static Fingerprint fingerprint(uint32_t vendor_id, uint32_t device_id,
+                                   const std::string& driver);
+    static Fingerprint fingerprintByLuid(int64_t luid);
+#if defined(LT_WINDOWS)
+    static std::string driverVersion(IDXGIAdapter* adapter);
+#endif // LT_WINDOWS
+    static std::string codecsToString(const std::vector<lt::VideoCodecType>& codecs);
+    static std::vector<lt::VideoCodecType> codecsFromString(const std::string& str);
+
+    // name区分不同的探测
+    std::optional<std::string> load(const std::string& name, const Fingerprint& fingerprint);
+    void save(const std::string& name, const Fingerprint& fingerprint, const std::string& value);
+
+private:
+    CapabilityCache() = default;
+    static std::string key(const std::string& name, const Fingerprint& fingerprint);
+
+private:
+    std::unique_ptr<ltlib::Settings> settings_;
+};
+
+} // namespace lt
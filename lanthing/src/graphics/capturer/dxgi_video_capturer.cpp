@@ -125,20 +125,68 @@ bool DxgiVideoCapturer::initD3D11() {
 }
 
 std::optional<VideoCapturer::Frame> DxgiVideoCapturer::capture() {
-    FRAME_DATA frame;
+    FRAME_DATA frame{};
     bool timeout = false;
     RECORD_T(point1);
     auto hr = impl_->GetFrame(&frame, &timeout);
     if (hr == DUPL_RETURN::DUPL_RETURN_SUCCESS && !timeout) {
         RECORD_T(point2);
+        if (frame.FrameInfo.LastPresentTime.QuadPart == 0) {
+            // 只有鼠标变了，画面没变
+            impl_->DoneWithFrame();
+            return {};
+        }
         VideoCapturer::Frame out_frame{};
         out_frame.data = frame.Frame;
         out_frame.capture_timestamp_us = ltlib::steady_now_us();
+        auto move_rects = reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(frame.MetaData);
+        for (UINT i = 0; i < frame.MoveCount; i++) {
+            const RECT& rect = move_rects[i].DestinationRect;
+            out_frame.dirty_rects.push_back(
+                {rect.left, rect.top, static_cast<uint32_t>(rect.right - rect.left),
+                 static_cast<uint32_t>(rect.bottom - rect.top)});
+        }
+        auto dirty_rects = reinterpret_cast<RECT*>(
+            frame.MetaData + frame.MoveCount * sizeof(DXGI_OUTDUPL_MOVE_RECT));
+        for (UINT i = 0; i < frame.DirtyCount; i++) {
+            const RECT& rect = dirty_rects[i];
+            out_frame.dirty_rects.push_back(
+                {rect.left, rect.top, static_cast<uint32_t>(rect.right - rect.left),
+                 static_cast<uint32_t>(rect.bottom - rect.top)});
+        }
+        saveLastFrame(frame.Frame);
         return out_frame;
     }
     return {};
 }
 
+std::optional<VideoCapturer::Frame> DxgiVideoCapturer::lastFrame() {
+    if (last_frame_ == nullptr) {
+        return {};
+    }
+    VideoCapturer::Frame out_frame{};
+    out_frame.data = last_frame_.Get();
+    out_frame.capture_timestamp_us = ltlib::steady_now_us();
+    return out_frame;
+}
+
+void DxgiVideoCapturer::saveLastFrame(ID3D11Texture2D* frame) {
+    // DXGI的帧ReleaseFrame()后就不能再用，留一份拷贝给静止时的刷新帧. 显存内拷贝，开销很小
+    if (last_frame_ == nullptr) {
+        D3D11_TEXTURE2D_DESC desc{};
+        frame->GetDesc(&desc);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        HRESULT hr = d3d11_dev_->CreateTexture2D(&desc, nullptr, last_frame_.GetAddressOf());
+        if (FAILED(hr)) {
+            LOGF(ERR, "Create last frame texture failed with %#x", hr);
+            return;
+        }
+    }
+    d3d11_ctx_->CopyResource(last_frame_.Get(), frame);
+}
+
 void DxgiVideoCapturer::doneWithFrame() {
     impl_->DoneWithFrame();
 }
@@ -45,6 +45,7 @@ public:
     ~DxgiVideoCapturer() override;
     bool init() override;
     std::optional<VideoCapturer::Frame> capture() override;
+    std::optional<VideoCapturer::Frame> lastFrame() override;
     void doneWithFrame() override;
     void waitForVBlank() override;
     Backend backend() const override;
@@ -55,12 +56,14 @@ public:
 
 private:
     bool initD3D11();
+    void saveLastFrame(ID3D11Texture2D* frame);
 
 private:
     std::unique_ptr<DUPLICATIONMANAGER> impl_;
     Microsoft::WRL::ComPtr<IDXGIFactory1> dxgi_factory_;
     Microsoft::WRL::ComPtr<ID3D11Device> d3d11_dev_;
     Microsoft::WRL::ComPtr<ID3D11DeviceContext> d3d11_ctx_;
+    Microsoft::WRL::ComPtr<ID3D11Texture2D> last_frame_;
     int64_t luid_ = 0;
     uint32_t vendor_id_ = 0;
 };
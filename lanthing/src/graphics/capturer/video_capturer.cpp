@@ -34,16 +34,30 @@
 
 #include <ltlib/times.h>
 
+#if LT_WINDOWS
 #include "dxgi_video_capturer.h"
+#elif LT_LINUX
+#include "x11_video_capturer.h"
+#endif
 
 namespace lt {
 
 std::unique_ptr<VideoCapturer> VideoCapturer::create(const Backend& backend) {
-    if (backend != Backend::Dxgi) {
-        LOG(FATAL) << "Only support dxgi video capturer!";
+    std::unique_ptr<VideoCapturer> capturer;
+    switch (backend) {
+#if LT_WINDOWS
+    case Backend::Dxgi:
+        capturer = std::make_unique<DxgiVideoCapturer>();
+        break;
+#elif LT_LINUX
+    case Backend::X11:
+        capturer = std::make_unique<X11VideoCapturer>();
+        break;
+#endif
+    default:
+        LOG(ERR) << "Unsupported video capturer backend " << static_cast<int>(backend);
         return nullptr;
     }
-    auto capturer = std::make_unique<DxgiVideoCapturer>();
     if (!capturer->init()) {
         return nullptr;
     }
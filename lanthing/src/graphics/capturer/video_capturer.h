@@ -34,6 +34,7 @@
 #include <future>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include <ltlib/threads.h>
 
@@ -43,16 +44,33 @@ class VideoCapturer {
 public:
     enum class Backend {
         Dxgi,
+        X11,
+    };
+    struct DirtyRect {
+        int32_t x;
+        int32_t y;
+        uint32_t width;
+        uint32_t height;
     };
     struct Frame {
+        // Dxgi是ID3D11Texture2D*，X11是内存里的BGRX像素
         void* data;
         int64_t capture_timestamp_us;
+        // 以下仅内存里的帧(X11采集、软件编码前的回读)有效
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t stride = 0;
+        // 相对上一帧变化的区域，为空表示整帧
+        std::vector<DirtyRect> dirty_rects;
     };
 
 public:
     static std::unique_ptr<VideoCapturer> create(const Backend& backend);
     virtual ~VideoCapturer();
+    // 画面没有变化时返回空
     virtual std::optional<Frame> capture() = 0;
+    // 最近一次capture()成功的画面，用于静止一段时间后补发一帧高质量的刷新帧
+    virtual std::optional<Frame> lastFrame() = 0;
     virtual void doneWithFrame() = 0;
     virtual Backend backend() const = 0;
     virtual int64_t luid() { return -1; }
@@ -0,0 +1,82 @@
+// X11采集耗时基准. 在Xvfb下跑:
+//   Xvfb :99 -screen 0 1920x1080x24 & DISPLAY=:99 ./bench_x11_capture
+//   Xvfb :99 -screen 0 3840x2160x24 & DISPLAY=:99 ./bench_x11_capture
+// Xvfb没人画图时XDamage不会报告变化，这里每帧在root window上画一个小方块制造变化.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <X11/Xlib.h>
+
+#include <g3log/logworker.hpp>
+
+#include <graphics/capturer/video_capturer.h>
+#include <ltlib/times.h>
+
+namespace {
+
+constexpr uint32_t kFrameCount = 600;
+
+struct NullSink {
+    void receive(g3::LogMessageMover message) { (void)message; }
+};
+
+} // namespace
+
+int main() {
+    auto worker = g3::LogWorker::createLogWorker();
+    worker->addSink(std::make_unique<NullSink>(), &NullSink::receive);
+    g3::initializeLogging(worker.get());
+
+    auto capturer = lt::VideoCapturer::create(lt::VideoCapturer::Backend::X11);
+    if (capturer == nullptr) {
+        printf("Create X11 capturer failed, is DISPLAY set?\n");
+        return 1;
+    }
+    Display* display = XOpenDisplay(nullptr);
+    Window root = DefaultRootWindow(display);
+    GC gc = XCreateGC(display, root, 0, nullptr);
+
+    std::vector<int64_t> costs;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t no_change = 0;
+    for (uint32_t i = 0; i < kFrameCount; i++) {
+        XSetForeground(display, gc, i * 2654435761u);
+        XFillRectangle(display, root, gc, static_cast<int>(i % 64) * 16, 0, 64, 64);
+        XSync(display, False);
+        capturer->waitForVBlank();
+        int64_t start = ltlib::steady_now_us();
+        auto frame = capturer->capture();
+        int64_t end = ltlib::steady_now_us();
+        if (!frame.has_value()) {
+            no_change++;
+            continue;
+        }
+        width = frame->width;
+        height = frame->height;
+        costs.push_back(end - start);
+        capturer->doneWithFrame();
+    }
+    XFreeGC(display, gc);
+    XCloseDisplay(display);
+    if (costs.empty()) {
+        printf("No frame captured\n");
+        return 1;
+    }
+    std::sort(costs.begin(), costs.end());
+    int64_t sum = 0;
+    for (auto cost : costs) {
+        sum += cost;
+    }
+    printf("%ux%u frames:%zu no_change:%u avg:%lldus p50:%lldus p99:%lldus max:%lldus\n", width,
+           height, costs.size(), no_change, static_cast<long long>(sum / costs.size()),
+           static_cast<long long>(costs[costs.size() / 2]),
+           static_cast<long long>(costs[costs.size() * 99 / 100]),
+           static_cast<long long>(costs.back()));
+    return 0;
+}
@@ -0,0 +1,272 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "x11_video_capturer.h"
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include <X11/Xutil.h>
+#include <X11/extensions/Xfixes.h>
+
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+namespace {
+
+// X11拿不到可靠的vblank通知，按这个刷新率用软件定时器打节拍
+constexpr int64_t kDefaultRefreshRate = 60;
+
+} // namespace
+
+namespace lt {
+
+X11VideoCapturer::X11VideoCapturer()
+    : vblank_interval_us_{1'000'000 / kDefaultRefreshRate} {}
+
+X11VideoCapturer::~X11VideoCapturer() {
+    if (display_ == nullptr) {
+        return;
+    }
+    if (damage_region_ != 0) {
+        XFixesDestroyRegion(display_, damage_region_);
+    }
+    if (damage_ != 0) {
+        XDamageDestroy(display_, damage_);
+    }
+    if (use_shm_) {
+        XShmDetach(display_, &shm_info_);
+    }
+    if (image_ != nullptr) {
+        XDestroyImage(image_);
+    }
+    if (shm_info_.shmaddr != nullptr) {
+        shmdt(shm_info_.shmaddr);
+    }
+    XCloseDisplay(display_);
+}
+
+bool X11VideoCapturer::init() {
+    display_ = XOpenDisplay(nullptr);
+    if (display_ == nullptr) {
+        LOG(ERR) << "XOpenDisplay failed, DISPLAY=" << (getenv("DISPLAY") ? getenv("DISPLAY") : "");
+        return false;
+    }
+    root_ = DefaultRootWindow(display_);
+    XWindowAttributes attributes{};
+    if (!XGetWindowAttributes(display_, root_, &attributes)) {
+        LOG(ERR) << "XGetWindowAttributes failed";
+        return false;
+    }
+    width_ = static_cast<uint32_t>(attributes.width);
+    height_ = static_cast<uint32_t>(attributes.height);
+    if (attributes.depth != 24 && attributes.depth != 32) {
+        LOG(ERR) << "Unsupported root window depth " << attributes.depth;
+        return false;
+    }
+    if (!initShm()) {
+        // 远程X之类的场景没有MIT-SHM，退回XGetImage，能用但每帧多一次拷贝
+        LOG(WARNING) << "MIT-SHM unavailable, fallback to XGetImage";
+    }
+    initDamage();
+    LOGF(INFO, "X11VideoCapturer %ux%u, shm:%d, damage:%d", width_, height_, use_shm_,
+         has_damage_);
+    return true;
+}
+
+bool X11VideoCapturer::initShm() {
+    if (!XShmQueryExtension(display_)) {
+        return false;
+    }
+    int screen = DefaultScreen(display_);
+    image_ = XShmCreateImage(display_, DefaultVisual(display_, screen),
+                             DefaultDepth(display_, screen), ZPixmap, nullptr, &shm_info_, width_,
+                             height_);
+    if (image_ == nullptr) {
+        LOG(ERR) << "XShmCreateImage failed";
+        return false;
+    }
+    shm_info_.shmid =
+        shmget(IPC_PRIVATE, static_cast<size_t>(image_->bytes_per_line) * image_->height,
+               IPC_CREAT | 0600);
+    if (shm_info_.shmid < 0) {
+        LOG(ERR) << "shmget failed with " << errno;
+        XDestroyImage(image_);
+        image_ = nullptr;
+        return false;
+    }
+    shm_info_.shmaddr = reinterpret_cast<char*>(shmat(shm_info_.shmid, nullptr, 0));
+    // 标记删除，两边都detach后自动释放，进程崩溃也不会泄漏
+    shmctl(shm_info_.shmid, IPC_RMID, nullptr);
+    if (shm_info_.shmaddr == reinterpret_cast<char*>(-1)) {
+        LOG(ERR) << "shmat failed with " << errno;
+        shm_info_.shmaddr = nullptr;
+        XDestroyImage(image_);
+        image_ = nullptr;
+        return false;
+    }
+    image_->data = shm_info_.shmaddr;
+    shm_info_.readOnly = False;
+    if (!XShmAttach(display_, &shm_info_)) {
+        LOG(ERR) << "XShmAttach failed";
+        XDestroyImage(image_);
+        image_ = nullptr;
+        shmdt(shm_info_.shmaddr);
+        shm_info_.shmaddr = nullptr;
+        return false;
+    }
+    XSync(display_, False);
+    use_shm_ = true;
+    return true;
+}
+
+void X11VideoCapturer::initDamage() {
+    int damage_error_base = 0;
+    if (!XDamageQueryExtension(display_, &damage_event_base_, &damage_error_base)) {
+        LOG(WARNING) << "XDamage unavailable, every frame is treated as dirty";
+        return;
+    }
+    int fixes_event_base = 0;
+    int fixes_error_base = 0;
+    if (!XFixesQueryExtension(display_, &fixes_event_base, &fixes_error_base)) {
+        LOG(WARNING) << "XFixes unavailable, every frame is treated as dirty";
+        return;
+    }
+    damage_ = XDamageCreate(display_, root_, XDamageReportNonEmpty);
+    damage_region_ = XFixesCreateRegion(display_, nullptr, 0);
+    has_damage_ = damage_ != 0 && damage_region_ != 0;
+}
+
+bool X11VideoCapturer::collectDamage(std::vector<DirtyRect>& rects) {
+    if (!has_damage_) {
+        return true;
+    }
+    // 只关心有没有变化，事件本身丢掉，避免队列越积越多
+    while (XPending(display_) > 0) {
+        XEvent event;
+        XNextEvent(display_, &event);
+    }
+    XDamageSubtract(display_, damage_, None, damage_region_);
+    int count = 0;
+    XRectangle* xrects = XFixesFetchRegion(display_, damage_region_, &count);
+    for (int i = 0; i < count; i++) {
+        rects.push_back(DirtyRect{xrects[i].x, xrects[i].y, xrects[i].width, xrects[i].height});
+    }
+    if (xrects != nullptr) {
+        XFree(xrects);
+    }
+    if (first_frame_) {
+        // 第一帧整帧都要
+        first_frame_ = false;
+        rects.clear();
+        return true;
+    }
+    return count != 0;
+}
+
+std::optional<VideoCapturer::Frame> X11VideoCapturer::capture() {
+    VideoCapturer::Frame out_frame{};
+    if (!collectDamage(out_frame.dirty_rects)) {
+        return {};
+    }
+    out_frame.capture_timestamp_us = ltlib::steady_now_us();
+    if (use_shm_) {
+        if (!XShmGetImage(display_, root_, image_, 0, 0, AllPlanes)) {
+            LOG(ERR) << "XShmGetImage failed";
+            return {};
+        }
+    }
+    else {
+        // 上一帧保留到这里才释放，doneWithFrame()之后编码器和lastFrame()还要用
+        if (image_ != nullptr) {
+            XDestroyImage(image_);
+            has_last_frame_ = false;
+        }
+        image_ = XGetImage(display_, root_, 0, 0, width_, height_, AllPlanes, ZPixmap);
+        if (image_ == nullptr) {
+            LOG(ERR) << "XGetImage failed";
+            return {};
+        }
+    }
+    has_last_frame_ = true;
+    out_frame.data = image_->data;
+    out_frame.width = width_;
+    out_frame.height = height_;
+    out_frame.stride = static_cast<uint32_t>(image_->bytes_per_line);
+    return out_frame;
+}
+
+std::optional<VideoCapturer::Frame> X11VideoCapturer::lastFrame() {
+    if (!has_last_frame_) {
+        return {};
+    }
+    VideoCapturer::Frame out_frame{};
+    out_frame.data = image_->data;
+    out_frame.capture_timestamp_us = ltlib::steady_now_us();
+    out_frame.width = width_;
+    out_frame.height = height_;
+    out_frame.stride = static_cast<uint32_t>(image_->bytes_per_line);
+    return out_frame;
+}
+
+void X11VideoCapturer::doneWithFrame() {}
+
+void X11VideoCapturer::waitForVBlank() {
+    const int64_t now_us = ltlib::steady_now_us();
+    if (next_vblank_us_ + vblank_interval_us_ < now_us) {
+        // 第一次调用或者落后超过一个周期，重新对齐，不追帧
+        next_vblank_us_ = now_us;
+    }
+    next_vblank_us_ += vblank_interval_us_;
+    std::this_thread::sleep_for(std::chrono::microseconds{next_vblank_us_ - now_us});
+}
+
+VideoCapturer::Backend X11VideoCapturer::backend() const {
+    return Backend::X11;
+}
+
+void* X11VideoCapturer::device() {
+    return nullptr;
+}
+
+void* X11VideoCapturer::deviceContext() {
+    return nullptr;
+}
+
+uint32_t X11VideoCapturer::vendorID() {
+    return 0;
+}
+
+} // namespace lt
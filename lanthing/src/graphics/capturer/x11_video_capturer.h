@@ -0,0 +1,83 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+
+#include <graphics/capturer/video_capturer.h>
+
+namespace lt {
+
+// 通过MIT-SHM抓取整个root window，XDamage提供变化区域. Xvfb下同样可用.
+class X11VideoCapturer : public VideoCapturer {
+public:
+    X11VideoCapturer();
+    ~X11VideoCapturer() override;
+    bool init() override;
+    std::optional<VideoCapturer::Frame> capture() override;
+    std::optional<VideoCapturer::Frame> lastFrame() override;
+    void doneWithFrame() override;
+    void waitForVBlank() override;
+    Backend backend() const override;
+    void* device() override;
+    void* deviceContext() override;
+    uint32_t vendorID() override;
+
+private:
+    bool initShm();
+    void initDamage();
+    // 返回false表示自上一帧以来画面没有变化
+    bool collectDamage(std::vector<DirtyRect>& rects);
+
+private:
+    Display* display_ = nullptr;
+    Window root_ = 0;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    XImage* image_ = nullptr;
+    XShmSegmentInfo shm_info_{};
+    bool use_shm_ = false;
+    bool has_damage_ = false;
+    int damage_event_base_ = 0;
+    Damage damage_ = 0;
+    XserverRegion damage_region_ = 0;
+    bool first_frame_ = true;
+    bool has_last_frame_ = false;
+    int64_t vblank_interval_us_;
+    int64_t next_vblank_us_ = 0;
+};
+
+} // namespace lt
@@ -0,0 +1,137 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "frame_readback.h"
+
+#include <cstring>
+#include <vector>
+
+#include <d3d11.h>
+#include <wrl/client.h>
+
+#include <ltlib/logging.h>
+
+using Microsoft::WRL::ComPtr;
+
+namespace {
+
+class D3D11FrameReadback : public lt::FrameReadback {
+public:
+    D3D11FrameReadback(ID3D11Device* device, ID3D11DeviceContext* context)
+        : d3d11_dev_{device}
+        , d3d11_ctx_{context} {}
+    std::optional<lt::VideoCapturer::Frame> read(const lt::VideoCapturer::Frame& frame) override;
+
+private:
+    bool initStagingTexture(ID3D11Texture2D* texture);
+
+private:
+    ComPtr<ID3D11Device> d3d11_dev_;
+    ComPtr<ID3D11DeviceContext> d3d11_ctx_;
+    ComPtr<ID3D11Texture2D> staging_;
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    std::vector<uint8_t> buffer_;
+};
+
+bool D3D11FrameReadback::initStagingTexture(ID3D11Texture2D* texture) {
+    D3D11_TEXTURE2D_DESC desc{};
+    texture->GetDesc(&desc);
+    if (desc.Format != DXGI_FORMAT_B8G8R8A8_UNORM) {
+        LOGF(ERR, "FrameReadback only supports BGRA texture, got format %d", desc.Format);
+        return false;
+    }
+    // 自适应分辨率会换成缩小后的纹理，尺寸不变就复用
+    if (staging_ != nullptr && desc.Width == width_ && desc.Height == height_) {
+        return true;
+    }
+    staging_.Reset();
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.BindFlags = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    desc.MiscFlags = 0;
+    HRESULT hr = d3d11_dev_->CreateTexture2D(&desc, nullptr, staging_.GetAddressOf());
+    if (FAILED(hr)) {
+        LOGF(ERR, "Create staging texture %ux%u failed with %#x", desc.Width, desc.Height, hr);
+        return false;
+    }
+    width_ = desc.Width;
+    height_ = desc.Height;
+    buffer_.resize(static_cast<size_t>(width_) * 4 * height_);
+    LOGF(INFO, "FrameReadback staging texture %ux%u created", width_, height_);
+    return true;
+}
+
+std::optional<lt::VideoCapturer::Frame>
+D3D11FrameReadback::read(const lt::VideoCapturer::Frame& frame) {
+    auto texture = reinterpret_cast<ID3D11Texture2D*>(frame.data);
+    if (texture == nullptr || !initStagingTexture(texture)) {
+        return std::nullopt;
+    }
+    d3d11_ctx_->CopySubresourceRegion(staging_.Get(), 0, 0, 0, 0, texture, 0, nullptr);
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    HRESULT hr = d3d11_ctx_->Map(staging_.Get(), 0, D3D11_MAP_READ, 0, &mapped);
+    if (FAILED(hr)) {
+        LOGF(ERR, "Map staging texture failed with %#x", hr);
+        return std::nullopt;
+    }
+    // RowPitch可能有对齐，按紧凑的stride拷出来
+    const size_t row_bytes = static_cast<size_t>(width_) * 4;
+    auto src = reinterpret_cast<const uint8_t*>(mapped.pData);
+    for (uint32_t row = 0; row < height_; row++) {
+        memcpy(buffer_.data() + row * row_bytes, src + row * mapped.RowPitch, row_bytes);
+    }
+    d3d11_ctx_->Unmap(staging_.Get(), 0);
+    lt::VideoCapturer::Frame out_frame{};
+    out_frame.data = buffer_.data();
+    out_frame.capture_timestamp_us = frame.capture_timestamp_us;
+    out_frame.width = width_;
+    out_frame.height = height_;
+    out_frame.stride = static_cast<uint32_t>(row_bytes);
+    out_frame.dirty_rects = frame.dirty_rects;
+    return out_frame;
+}
+
+} // namespace
+
+namespace lt {
+
+std::unique_ptr<FrameReadback> FrameReadback::create(void* d3d11_dev, void* d3d11_ctx) {
+    if (d3d11_dev == nullptr || d3d11_ctx == nullptr) {
+        LOG(ERR) << "FrameReadback needs a D3D11 device";
+        return nullptr;
+    }
+    return std::make_unique<D3D11FrameReadback>(reinterpret_cast<ID3D11Device*>(d3d11_dev),
+                                                reinterpret_cast<ID3D11DeviceContext*>(d3d11_ctx));
+}
+
+} // namespace lt
@@ -0,0 +1,221 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "frame_scaler.h"
+
+#include <vector>
+
+#if LT_WINDOWS
+#include <d3d11.h>
+#include <wrl/client.h>
+#endif // LT_WINDOWS
+
+#include <ltlib/color_convert.h>
+#include <ltlib/logging.h>
+
+namespace {
+
+class MemoryFrameScaler : public lt::FrameScaler {
+public:
+    MemoryFrameScaler(uint32_t src_width, uint32_t src_height, uint32_t shift)
+        : FrameScaler{src_width, src_height, shift} {}
+    std::optional<lt::VideoCapturer::Frame> scale(const lt::VideoCapturer::Frame& frame) override;
+
+private:
+    // 多级缩小时两块缓冲轮流作为输入和输出
+    std::vector<uint8_t> buffers_[2];
+};
+
+std::optional<lt::VideoCapturer::Frame>
+MemoryFrameScaler::scale(const lt::VideoCapturer::Frame& frame) {
+    if (frame.width != src_width_ || frame.height != src_height_) {
+        LOGF(ERR, "FrameScaler expects %ux%u frame, got %ux%u", src_width_, src_height_,
+             frame.width, frame.height);
+        return std::nullopt;
+    }
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(frame.data);
+    uint32_t stride = frame.stride;
+    uint32_t width = frame.width & ~1u;
+    uint32_t height = frame.height & ~1u;
+    for (uint32_t level = 0; level < shift_; level++) {
+        std::vector<uint8_t>& dst = buffers_[level % 2];
+        const uint32_t dst_width = width / 2;
+        const uint32_t dst_height = height / 2;
+        dst.resize(static_cast<size_t>(dst_width) * 4 * dst_height);
+        ltlib::downscaleBGRAHalf(src, static_cast<int>(stride), dst.data(),
+                                 static_cast<int>(dst_width * 4), static_cast<int>(width),
+                                 static_cast<int>(height));
+        src = dst.data();
+        stride = dst_width * 4;
+        width = dst_width & ~1u;
+        height = dst_height & ~1u;
+    }
+    lt::VideoCapturer::Frame out_frame{};
+    out_frame.data = const_cast<uint8_t*>(src);
+    out_frame.capture_timestamp_us = frame.capture_timestamp_us;
+    out_frame.width = this->width();
+    out_frame.height = this->height();
+    out_frame.stride = stride;
+    out_frame.dirty_rects = scaleDirtyRects(frame.dirty_rects);
+    return out_frame;
+}
+
+#if LT_WINDOWS
+
+using Microsoft::WRL::ComPtr;
+
+class D3D11FrameScaler : public lt::FrameScaler {
+public:
+    D3D11FrameScaler(ID3D11Device* device, ID3D11DeviceContext* context, uint32_t src_width,
+                     uint32_t src_height, uint32_t shift)
+        : FrameScaler{src_width, src_height, shift}
+        , d3d11_dev_{device}
+        , d3d11_ctx_{context} {}
+    std::optional<lt::VideoCapturer::Frame> scale(const lt::VideoCapturer::Frame& frame) override;
+
+private:
+    bool initTextures(ID3D11Texture2D* frame);
+
+private:
+    ComPtr<ID3D11Device> d3d11_dev_;
+    ComPtr<ID3D11DeviceContext> d3d11_ctx_;
+    // 第0级是原始画面，第shift_级就是缩小后的画面
+    ComPtr<ID3D11Texture2D> mip_texture_;
+    ComPtr<ID3D11ShaderResourceView> mip_view_;
+    ComPtr<ID3D11Texture2D> output_;
+};
+
+bool D3D11FrameScaler::initTextures(ID3D11Texture2D* frame) {
+    D3D11_TEXTURE2D_DESC desc{};
+    frame->GetDesc(&desc);
+    if (desc.Width != src_width_ || desc.Height != src_height_) {
+        LOGF(ERR, "FrameScaler expects %ux%u texture, got %ux%u", src_width_, src_height_,
+             desc.Width, desc.Height);
+        return false;
+    }
+    desc.MipLevels = shift_ + 1;
+    desc.ArraySize = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = 0;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+    HRESULT hr = d3d11_dev_->CreateTexture2D(&desc, nullptr, mip_texture_.GetAddressOf());
+    if (FAILED(hr)) {
+        LOGF(ERR, "Create mipmap texture failed with %#x", hr);
+        return false;
+    }
+    hr = d3d11_dev_->CreateShaderResourceView(mip_texture_.Get(), nullptr,
+                                              mip_view_.GetAddressOf());
+    if (FAILED(hr)) {
+        LOGF(ERR, "Create mipmap shader resource view failed with %#x", hr);
+        return false;
+    }
+    desc.Width = width();
+    desc.Height = height();
+    desc.MipLevels = 1;
+    desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+    desc.MiscFlags = 0;
+    hr = d3d11_dev_->CreateTexture2D(&desc, nullptr, output_.GetAddressOf());
+    if (FAILED(hr)) {
+        LOGF(ERR, "Create scaled texture failed with %#x", hr);
+        return false;
+    }
+    return true;
+}
+
+std::optional<lt::VideoCapturer::Frame>
+D3D11FrameScaler::scale(const lt::VideoCapturer::Frame& frame) {
+    auto texture = reinterpret_cast<ID3D11Texture2D*>(frame.data);
+    if (output_ == nullptr && !initTextures(texture)) {
+        return std::nullopt;
+    }
+    // 2:1的mipmap生成等价于2x2盒式滤波，全在GPU上做
+    d3d11_ctx_->CopySubresourceRegion(mip_texture_.Get(), 0, 0, 0, 0, texture, 0, nullptr);
+    d3d11_ctx_->GenerateMips(mip_view_.Get());
+    const D3D11_BOX box{0, 0, 0, width(), height(), 1};
+    d3d11_ctx_->CopySubresourceRegion(output_.Get(), 0, 0, 0, 0, mip_texture_.Get(), shift_, &box);
+    lt::VideoCapturer::Frame out_frame{};
+    out_frame.data = output_.Get();
+    out_frame.capture_timestamp_us = frame.capture_timestamp_us;
+    out_frame.dirty_rects = scaleDirtyRects(frame.dirty_rects);
+    return out_frame;
+}
+
+#endif // LT_WINDOWS
+
+} // namespace
+
+namespace lt {
+
+std::unique_ptr<FrameScaler> FrameScaler::create(void* d3d11_dev, void* d3d11_ctx,
+                                                 uint32_t src_width, uint32_t src_height,
+                                                 uint32_t shift) {
+    if (shift == 0 || scaledSize(src_width, shift) == 0 || scaledSize(src_height, shift) == 0) {
+        LOGF(ERR, "Invalid FrameScaler parameters %ux%u>>%u", src_width, src_height, shift);
+        return nullptr;
+    }
+    if (d3d11_dev == nullptr) {
+        return std::make_unique<MemoryFrameScaler>(src_width, src_height, shift);
+    }
+#if LT_WINDOWS
+    return std::make_unique<D3D11FrameScaler>(reinterpret_cast<ID3D11Device*>(d3d11_dev),
+                                              reinterpret_cast<ID3D11DeviceContext*>(d3d11_ctx),
+                                              src_width, src_height, shift);
+#else
+    (void)d3d11_ctx;
+    LOG(ERR) << "FrameScaler: D3D11 texture is not supported on this platform";
+    return nullptr;
+#endif // LT_WINDOWS
+}
+
+FrameScaler::FrameScaler(uint32_t src_width, uint32_t src_height, uint32_t shift)
+    : src_width_{src_width}
+    , src_height_{src_height}
+    , shift_{shift} {}
+
+std::vector<VideoCapturer::DirtyRect>
+FrameScaler::scaleDirtyRects(const std::vector<VideoCapturer::DirtyRect>& rects) const {
+    std::vector<VideoCapturer::DirtyRect> scaled;
+    scaled.reserve(rects.size());
+    for (const auto& rect : rects) {
+        // 向外取整，保证缩小后仍然盖住变化的区域
+        const int32_t left = rect.x >> shift_;
+        const int32_t top = rect.y >> shift_;
+        const int32_t right =
+            (rect.x + static_cast<int32_t>(rect.width) + (1 << shift_) - 1) >> shift_;
+        const int32_t bottom =
+            (rect.y + static_cast<int32_t>(rect.height) + (1 << shift_) - 1) >> shift_;
+        scaled.push_back({left, top, static_cast<uint32_t>(right - left),
+                          static_cast<uint32_t>(bottom - top)});
+    }
+    return scaled;
+}
+
+} // namespace lt
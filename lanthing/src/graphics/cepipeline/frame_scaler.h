@@ -0,0 +1,67 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+#include <graphics/capturer/video_capturer.h>
+
+namespace lt {
+
+// 在编码前把采集到的帧每个方向缩小到1/2^shift，用于低带宽时降分辨率编码.
+// DXGI采集的帧在显存里用mipmap缩小，X11采集的内存帧用ltlib的SIMD实现缩小
+class FrameScaler {
+public:
+    // d3d11_dev为空时处理内存里的BGRX帧
+    static std::unique_ptr<FrameScaler> create(void* d3d11_dev, void* d3d11_ctx,
+                                               uint32_t src_width, uint32_t src_height,
+                                               uint32_t shift);
+    // 编码器要求宽高是偶数，缩小后向下取偶
+    static uint32_t scaledSize(uint32_t size, uint32_t shift) { return (size >> shift) & ~1u; }
+    virtual ~FrameScaler() = default;
+    // 返回的帧引用内部的缓冲，下一次scale()之前有效
+    virtual std::optional<VideoCapturer::Frame> scale(const VideoCapturer::Frame& frame) = 0;
+    uint32_t width() const { return scaledSize(src_width_, shift_); }
+    uint32_t height() const { return scaledSize(src_height_, shift_); }
+
+protected:
+    FrameScaler(uint32_t src_width, uint32_t src_height, uint32_t shift);
+    std::vector<VideoCapturer::DirtyRect>
+    scaleDirtyRects(const std::vector<VideoCapturer::DirtyRect>& rects) const;
+
+protected:
+    const uint32_t src_width_;
+    const uint32_t src_height_;
+    const uint32_t shift_;
+};
+
+} // namespace lt
@@ -33,9 +33,12 @@
 #include <Windows.h>
 #include <winuser.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
+#include <cstdlib>
 #include <future>
+#include <optional>
 
 #include <google/protobuf/message_lite.h>
 
@@ -47,9 +50,39 @@
 #include <ltlib/logging.h>
 #include <ltlib/system.h>
 #include <ltlib/threads.h>
+#include <ltlib/times.h>
 
+#include <graphics/capability_cache.h>
 #include <graphics/capturer/video_capturer.h>
 #include <graphics/encoder/video_encoder.h>
+#include <graphics/keyframe_request.h>
+
+#include "frame_readback.h"
+#include "frame_scaler.h"
+
+namespace {
+
+constexpr uint32_t kInitialBitrate = 4 * 1024 * 1024;
+// 和VideoEncoder内部使用的帧率一致
+constexpr int64_t kDefaultFps = 60;
+// 画面静止这么久之后补发一帧高质量的关键帧
+constexpr int64_t kIdleRefreshDelayUS = 500'000;
+constexpr uint32_t kIdleRefreshBitrateScale = 4;
+constexpr int64_t kFpsStatIntervalUS = 5'000'000;
+// 客户端在收到恢复帧之前每解码失败一次就会请求一次，两次响应之间至少间隔这么久
+constexpr int64_t kMinKeyframeIntervalUS = 500'000;
+// 每像素分到的比特低于kDownscaleBitsPerPixel时宽高各减半，放大回去要求更高，避免在临界值来回切换
+constexpr double kDownscaleBitsPerPixel = 0.025;
+constexpr double kUpscaleBitsPerPixel = 0.04;
+constexpr uint32_t kMaxScaleShift = 2;
+constexpr uint32_t kMinScaledHeight = 540;
+// 每次切换都要重建编码器并发关键帧
+constexpr int64_t kMinResolutionChangeIntervalUS = 5'000'000;
+constexpr char kEncoderCacheName[] = "encoder_unsupported";
+// 失败记录过了这么久就不再采信，重新探测一次
+constexpr int64_t kEncoderCacheExpireMS = 7 * 24 * 3600 * 1000LL;
+
+} // namespace
 
 namespace lt {
 
@@ -69,14 +102,30 @@ private:
     void consumeTasks();
     void captureAndSendCursor();
     void captureAndSendVideoFrame();
+    void sendIdleRefreshFrame();
+    void encodeAndSendVideoFrame(const VideoCapturer::Frame& frame);
+    void printFpsStats();
+    void handleKeyframeRequest();
+    std::optional<uint64_t> toPictureID(uint64_t client_frame_id) const;
+    bool createInitialEncoder();
+    std::unique_ptr<VideoEncoder> createEncoder(VideoCodecType codec, uint32_t width,
+                                                uint32_t height);
+    double bitsPerPixel(uint32_t shift) const;
+    uint32_t targetScaleShift() const;
+    void adaptResolution();
 
     // 从service收到的消息
     void onReconfigure(std::shared_ptr<google::protobuf::MessageLite> msg);
     void onRequestKeyframe(std::shared_ptr<google::protobuf::MessageLite> msg);
 
 private:
+    // 采集的分辨率，编码分辨率是它缩小scale_shift_次
     uint32_t width_;
     uint32_t height_;
+    const uint32_t intra_refresh_period_;
+    bool adaptive_resolution_;
+    const bool report_psnr_;
+    bool software_encoder_;
     std::function<bool(uint32_t, const MessageHandler&)> register_message_handler_;
     std::function<bool(uint32_t, const std::shared_ptr<google::protobuf::MessageLite>&)>
         send_message_;
@@ -84,6 +133,13 @@ private:
     std::unique_ptr<ltlib::BlockingThread> thread_;
     std::unique_ptr<VideoCapturer> capturer_;
     std::unique_ptr<VideoEncoder> encoder_;
+    std::unique_ptr<FrameScaler> scaler_;
+    // 软件编码时把显存里的帧读回内存
+    std::unique_ptr<FrameReadback> readback_;
+    uint32_t scale_shift_ = 0;
+    uint32_t fps_ = kDefaultFps;
+    int64_t last_resolution_change_us_ = 0;
+    uint64_t next_frame_id_ = 0;
     uint64_t frame_no_ = 0;
     std::atomic<bool> stoped_{true};
     std::unique_ptr<std::promise<void>> stop_promise_;
@@ -93,11 +149,30 @@ private:
     bool manual_bitrate_ = false;
     std::map<HCURSOR, int32_t> cursors_;
     bool get_cursor_failed_ = false;
+    uint32_t bitrate_bps_ = kInitialBitrate;
+    int64_t last_change_time_us_ = 0;
+    bool idle_refreshed_ = true;
+    uint32_t encoded_frames_ = 0;
+    uint32_t unchanged_frames_ = 0;
+    int64_t last_fps_stat_time_us_ = 0;
+    uint64_t stat_bytes_ = 0;
+    uint32_t stat_max_frame_bytes_ = 0;
+    int64_t keyframe_interval_us_ = kMinKeyframeIntervalUS;
+    int64_t last_keyframe_request_us_ = 0;
+    bool pending_keyframe_request_ = false;
+    // 客户端最后正确解码的帧，已经换算成本端的picture_id
+    std::optional<uint64_t> pending_recovery_frame_id_;
+    uint32_t stat_keyframe_requests_ = 0;
+    uint32_t stat_keyframe_responses_ = 0;
 };
 
 VCEPipeline::VCEPipeline(const VideoCaptureEncodePipeline::Params& params)
     : width_{params.width}
     , height_{params.height}
+    , intra_refresh_period_{params.intra_refresh_period}
+    , adaptive_resolution_{params.adaptive_resolution}
+    , report_psnr_{params.report_psnr}
+    , software_encoder_{params.software_encoder}
     , register_message_handler_{params.register_message_handler}
     , send_message_{params.send_message}
     , client_supported_codecs_{params.codecs} {}
@@ -111,32 +186,39 @@ bool VCEPipeline::init() {
     if (!registerHandlers()) {
         return false;
     }
-    auto capturer = VideoCapturer::create(VideoCapturer::Backend::Dxgi);
-    if (capturer == nullptr) {
+    // 这个文件只在Windows上编译，Linux目前只有X11采集后端(bench_x11_capture)，没有worker
+    capturer_ = VideoCapturer::create(VideoCapturer::Backend::Dxgi);
+    if (capturer_ == nullptr) {
         return false;
     }
-    VideoEncoder::InitParams encode_params{};
-    encode_params.bitrate_bps = 4 * 1024 * 1024;
-    encode_params.width = width_;
-    encode_params.height = height_;
-    encode_params.luid = capturer->luid();
-    encode_params.device = capturer->device();
-    encode_params.context = capturer->deviceContext();
-    encode_params.vendor_id = capturer->vendorID();
-    std::unique_ptr<VideoEncoder> encoder;
-    for (auto codec : client_supported_codecs_) {
-        encode_params.codec_type = codec;
-        encoder = VideoEncoder::create(encode_params);
-        if (encoder) {
-            codec_type_ = codec;
-            break;
+    if (adaptive_resolution_ && capturer_->device() == nullptr) {
+        // FrameScaler只支持显存里的帧
+        LOG(INFO) << "Adaptive resolution disabled, capturer has no gpu device";
+        adaptive_resolution_ = false;
+    }
+    if (!createInitialEncoder()) {
+        if (software_encoder_) {
+            return false;
+        }
+        // 不认识的显卡、驱动太旧、编码会话满了，都还能用CPU编码撑着
+        LOG(WARNING) << "Create hardware encoder failed, fallback to software encoder";
+        software_encoder_ = true;
+        if (!createInitialEncoder()) {
+            return false;
         }
     }
-    if (encoder == nullptr) {
-        return false;
+    if (software_encoder_) {
+        readback_ = FrameReadback::create(capturer_->device(), capturer_->deviceContext());
+        if (readback_ == nullptr) {
+            return false;
+        }
     }
-    encoder_ = std::move(encoder);
-    capturer_ = std::move(capturer);
+    // 一次帧内刷新要持续intra_refresh_period_帧，刷新完之前再来的请求没有意义
+    keyframe_interval_us_ =
+        std::max(kMinKeyframeIntervalUS,
+                 static_cast<int64_t>(intra_refresh_period_) * 1'000'000 / kDefaultFps);
+    // 起步码率只是个估计值，等带宽估计跑一段时间再考虑改分辨率
+    last_resolution_change_us_ = ltlib::steady_now_us();
     return true;
 }
 
@@ -273,19 +355,104 @@ void VCEPipeline::captureAndSendCursor() {
 }
 
 void VCEPipeline::captureAndSendVideoFrame() {
+    printFpsStats();
+    adaptResolution();
+    if (pending_keyframe_request_) {
+        handleKeyframeRequest();
+    }
     auto captured_frame = capturer_->capture();
     if (!captured_frame.has_value()) {
+        // 画面没变化(或者超时)，不编码不发送
+        unchanged_frames_++;
+        sendIdleRefreshFrame();
         return;
     }
     capturer_->doneWithFrame();
-    auto encoded_frame = encoder_->encode(captured_frame.value());
+    last_change_time_us_ = ltlib::steady_now_us();
+    idle_refreshed_ = false;
+    encodeAndSendVideoFrame(captured_frame.value());
+}
+
+void VCEPipeline::sendIdleRefreshFrame() {
+    if (idle_refreshed_ || ltlib::steady_now_us() - last_change_time_us_ < kIdleRefreshDelayUS) {
+        return;
+    }
+    idle_refreshed_ = true;
+    auto frame = capturer_->lastFrame();
+    if (!frame.has_value()) {
+        return;
+    }
+    // 静止画面用更高的码率出一个关键帧，把运动时损失的画质补回来
+    VideoEncoder::ReconfigureParams params{};
+    params.bitrate_bps = bitrate_bps_ * kIdleRefreshBitrateScale;
+    encoder_->reconfigure(params);
+    encoder_->requestKeyframe();
+    encodeAndSendVideoFrame(frame.value());
+    params.bitrate_bps = bitrate_bps_;
+    encoder_->reconfigure(params);
+    LOG(DEBUG) << "Sent idle refresh frame";
+}
+
+void VCEPipeline::encodeAndSendVideoFrame(const VideoCapturer::Frame& _frame) {
+    std::optional<VideoCapturer::Frame> scaled_frame;
+    if (scaler_ != nullptr) {
+        scaled_frame = scaler_->scale(_frame);
+        if (!scaled_frame.has_value()) {
+            return;
+        }
+    }
+    const VideoCapturer::Frame& gpu_frame =
+        scaled_frame.has_value() ? scaled_frame.value() : _frame;
+    std::optional<VideoCapturer::Frame> cpu_frame;
+    if (readback_ != nullptr) {
+        cpu_frame = readback_->read(gpu_frame);
+        if (!cpu_frame.has_value()) {
+            return;
+        }
+    }
+    const VideoCapturer::Frame& frame = cpu_frame.has_value() ? cpu_frame.value() : gpu_frame;
+    auto encoded_frame = encoder_->encode(frame);
     if (encoded_frame == nullptr) {
         return;
     }
+    next_frame_id_ = encoded_frame->picture_id() + 1;
+    encoded_frames_++;
+    const auto frame_bytes = static_cast<uint32_t>(encoded_frame->frame().size());
+    stat_bytes_ += frame_bytes;
+    stat_max_frame_bytes_ = std::max(stat_max_frame_bytes_, frame_bytes);
     // TODO: 计算编码完成距离上一次vblank时间
     send_message_(ltproto::id(encoded_frame), encoded_frame);
 }
 
+void VCEPipeline::printFpsStats() {
+    const int64_t now_us = ltlib::steady_now_us();
+    if (last_fps_stat_time_us_ == 0) {
+        last_fps_stat_time_us_ = now_us;
+        return;
+    }
+    const int64_t duration_us = now_us - last_fps_stat_time_us_;
+    if (duration_us < kFpsStatIntervalUS) {
+        return;
+    }
+    // 峰值/平均帧大小用来对比IDR和帧内刷新两种丢包恢复方式对码流平滑程度的影响
+    const double avg_frame_bytes =
+        encoded_frames_ == 0 ? 0. : static_cast<double>(stat_bytes_) / encoded_frames_;
+    const double peak_ratio = avg_frame_bytes == 0. ? 0. : stat_max_frame_bytes_ / avg_frame_bytes;
+    LOGF(INFO,
+         "Effective video fps %.1f, unchanged %u, frame bytes avg:%.0f peak:%u(%.1fx), keyframe "
+         "request:%u responded:%u",
+         encoded_frames_ * 1'000'000.0 / duration_us, unchanged_frames_, avg_frame_bytes,
+         stat_max_frame_bytes_, peak_ratio,
+         stat_keyframe_requests_, stat_keyframe_responses_);
+    encoded_frames_ = 0;
+    unchanged_frames_ = 0;
+    stat_bytes_ = 0;
+    stat_max_frame_bytes_ = 0;
+    stat_keyframe_requests_ = 0;
+    stat_keyframe_responses_ = 0;
+    last_fps_stat_time_us_ = now_us;
+}
+
 void VCEPipeline::onReconfigure(std::shared_ptr<google::protobuf::MessageLite> _msg) {
     std::lock_guard lock{mutex_};
     tasks_.push_back([_msg, this]() {
@@ -315,10 +482,12 @@ void VCEPipeline::onReconfigure(std::shared_ptr<google::protobuf::MessageLite> _
         if (msg->has_bitrate_bps()) {
             LOG(DEBUG) << "Set bitrate " << msg->bitrate_bps();
             params.bitrate_bps = msg->bitrate_bps();
+            bitrate_bps_ = msg->bitrate_bps();
             changed = true;
         }
         if (msg->has_fps()) {
             params.fps = msg->fps();
+            fps_ = msg->fps();
             changed = true;
         }
         if (changed) {
@@ -327,10 +496,223 @@ void VCEPipeline::onReconfigure(std::shared_ptr<google::protobuf::MessageLite> _
     });
 }
 
-void VCEPipeline::onRequestKeyframe(std::shared_ptr<google::protobuf::MessageLite> msg) {
-    (void)msg;
+void VCEPipeline::onRequestKeyframe(std::shared_ptr<google::protobuf::MessageLite> _msg) {
+    auto msg = std::static_pointer_cast<ltproto::client2worker::RequestKeyframe>(_msg);
+    const KeyframeRequestInfo info = readKeyframeRequestInfo(*msg);
     std::lock_guard lock{mutex_};
-    tasks_.push_back([this] { encoder_->requestKeyframe(); });
+    tasks_.push_back([this, info] {
+        stat_keyframe_requests_++;
+        if (info.full_keyframe) {
+            // 新观看者没有任何参考帧，刷新波救不了，也不能被恢复请求的间隔挡住
+            stat_keyframe_responses_++;
+            encoder_->requestKeyframe();
+            return;
+        }
+        pending_keyframe_request_ = true;
+        if (info.last_decoded_frame_id.has_value()) {
+            pending_recovery_frame_id_ = toPictureID(info.last_decoded_frame_id.value());
+        }
+        handleKeyframeRequest();
+    });
+}
+
+void VCEPipeline::handleKeyframeRequest() {
+    const int64_t now_us = ltlib::steady_now_us();
+    if (now_us - last_keyframe_request_us_ < keyframe_interval_us_) {
+        // 上一个恢复帧可能还在路上，先留着，间隔到了再响应
+        return;
+    }
+    last_keyframe_request_us_ = now_us;
+    stat_keyframe_responses_++;
+    pending_keyframe_request_ = false;
+    // 丢包引起的请求: 能从客户端确定持有的长期参考帧恢复就用它，其次是帧内刷新波，最后才是IDR
+    if (pending_recovery_frame_id_.has_value()) {
+        encoder_->requestRecovery(pending_recovery_frame_id_.value());
+    }
+    else {
+        encoder_->requestRefresh();
+    }
+    pending_recovery_frame_id_ = std::nullopt;
+}
+
+std::optional<uint64_t> VCEPipeline::toPictureID(uint64_t client_frame_id) const {
+    // rtc2在线上只传16位帧ID，客户端从收到的第一帧开始展开，和这边的picture_id只有低16位可靠.
+    // 取不超过最新picture_id、低16位相同的那个
+    constexpr uint64_t kMask = 0xFFFF;
+    if (next_frame_id_ == 0) {
+        return std::nullopt;
+    }
+    const uint64_t latest = next_frame_id_ - 1;
+    const uint64_t id = (latest & ~kMask) | (client_frame_id & kMask);
+    if (id <= latest) {
+        return id;
+    }
+    if (latest <= kMask) {
+        return std::nullopt;
+    }
+    return id - (kMask + 1);
+}
+
+bool VCEPipeline::createInitialEncoder() {
+    if (software_encoder_) {
+        // 软件编码和显卡无关，不用能力缓存
+        for (auto codec : client_supported_codecs_) {
+            encoder_ = createEncoder(codec, width_, height_);
+            if (encoder_) {
+                codec_type_ = codec;
+                return true;
+            }
+        }
+        return false;
+    }
+    // 在这块显卡上创建失败过的编码格式记下来，下次启动直接跳过，不再白白创建一次编码器.
+    // 有的显卡只在大分辨率下不支持HEVC，所以按分辨率分开记.
+    // 记录格式: 写入时的UTC毫秒;编码格式列表
+    const std::string cache_name = std::string(kEncoderCacheName) + "_" +
+                                   std::to_string(width_) + "x" + std::to_string(height_);
+    auto cache = CapabilityCache::create();
+    auto fingerprint = CapabilityCache::fingerprintByLuid(capturer_->luid());
+    std::vector<VideoCodecType> cached_unsupported;
+    if (cache != nullptr) {
+        auto cached = cache->load(cache_name, fingerprint);
+        size_t pos = cached.has_value() ? cached->find(';') : std::string::npos;
+        if (pos != std::string::npos &&
+            ltlib::utc_now_ms() - std::atoll(cached->substr(0, pos).c_str()) <
+                kEncoderCacheExpireMS) {
+            cached_unsupported = CapabilityCache::codecsFromString(cached->substr(pos + 1));
+        }
+    }
+    std::vector<VideoCodecType> unsupported = cached_unsupported;
+    auto is_cached = [&cached_unsupported](VideoCodecType codec) {
+        return std::find(cached_unsupported.cbegin(), cached_unsupported.cend(), codec) !=
+               cached_unsupported.cend();
+    };
+    for (auto codec : client_supported_codecs_) {
+        if (is_cached(codec)) {
+            LOGF(INFO, "Skip video codec %d, it failed on this gpu before",
+                 static_cast<int>(codec));
+            continue;
+        }
+        encoder_ = createEncoder(codec, width_, height_);
+        if (encoder_) {
+            codec_type_ = codec;
+            break;
+        }
+        unsupported.push_back(codec);
+    }
+    if (encoder_ == nullptr) {
+        // 缓存里的失败也可能只是当时碰巧失败，全都不行时把跳过的再试一遍
+        for (auto codec : client_supported_codecs_) {
+            if (!is_cached(codec)) {
+                continue;
+            }
+            encoder_ = createEncoder(codec, width_, height_);
+            if (encoder_) {
+                codec_type_ = codec;
+                unsupported.erase(std::find(unsupported.begin(), unsupported.end(), codec));
+                break;
+            }
+        }
+    }
+    if (encoder_ == nullptr) {
+        // 一个都创建不了，多半是编码会话数满了、设备丢失这类运行时的问题，不是显卡不支持，
+        // 不能记下来
+        return false;
+    }
+    if (cache != nullptr && unsupported != cached_unsupported) {
+        cache->save(cache_name, fingerprint,
+                    std::to_string(ltlib::utc_now_ms()) + ";" +
+                        CapabilityCache::codecsToString(unsupported));
+    }
+    return true;
+}
+
+std::unique_ptr<VideoEncoder> VCEPipeline::createEncoder(VideoCodecType codec, uint32_t width,
+                                                         uint32_t height) {
+    VideoEncoder::InitParams encode_params{};
+    encode_params.codec_type = codec;
+    encode_params.bitrate_bps = bitrate_bps_;
+    encode_params.width = width;
+    encode_params.height = height;
+    encode_params.luid = capturer_->luid();
+    encode_params.device = capturer_->device();
+    encode_params.context = capturer_->deviceContext();
+    encode_params.vendor_id = capturer_->vendorID();
+    encode_params.intra_refresh_period = intra_refresh_period_;
+    encode_params.first_frame_id = next_frame_id_;
+    encode_params.report_psnr = report_psnr_;
+    encode_params.software = software_encoder_;
+    auto encoder = VideoEncoder::create(encode_params);
+    if (encoder != nullptr && fps_ != kDefaultFps) {
+        VideoEncoder::ReconfigureParams params{};
+        params.fps = fps_;
+        encoder->reconfigure(params);
+    }
+    return encoder;
+}
+
+double VCEPipeline::bitsPerPixel(uint32_t shift) const {
+    const double pixels = static_cast<double>(FrameScaler::scaledSize(width_, shift)) *
+                          FrameScaler::scaledSize(height_, shift);
+    return bitrate_bps_ / (pixels * std::max(fps_, 1u));
+}
+
+uint32_t VCEPipeline::targetScaleShift() const {
+    uint32_t shift = scale_shift_;
+    while (shift < kMaxScaleShift &&
+           FrameScaler::scaledSize(height_, shift + 1) >= kMinScaledHeight &&
+           bitsPerPixel(shift) < kDownscaleBitsPerPixel) {
+        shift++;
+    }
+    if (shift != scale_shift_) {
+        return shift;
+    }
+    while (shift > 0 && bitsPerPixel(shift - 1) >= kUpscaleBitsPerPixel) {
+        shift--;
+    }
+    return shift;
+}
+
+void VCEPipeline::adaptResolution() {
+    if (!adaptive_resolution_) {
+        return;
+    }
+    const uint32_t shift = targetScaleShift();
+    const int64_t now_us = ltlib::steady_now_us();
+    if (shift == scale_shift_ ||
+        now_us - last_resolution_change_us_ < kMinResolutionChangeIntervalUS) {
+        return;
+    }
+    last_resolution_change_us_ = now_us;
+    const uint32_t width = FrameScaler::scaledSize(width_, shift);
+    const uint32_t height = FrameScaler::scaledSize(height_, shift);
+    std::unique_ptr<FrameScaler> scaler;
+    if (shift != 0) {
+        scaler = FrameScaler::create(capturer_->device(), capturer_->deviceContext(), width_,
+                                     height_, shift);
+        if (scaler == nullptr) {
+            return;
+        }
+    }
+    // 编码器都不支持运行时改分辨率，只能重建. 新编码器的第一帧是关键帧，客户端靠它切换分辨率
+    auto encoder = createEncoder(codec_type_, width, height);
+    if (encoder == nullptr) {
+        LOGF(WARNING, "Create %ux%u encoder failed, keep current resolution", width, height);
+        return;
+    }
+    LOGF(INFO, "Encode resolution %ux%u -> %ux%u, bitrate:%u fps:%u",
+         FrameScaler::scaledSize(width_, scale_shift_),
+         FrameScaler::scaledSize(height_, scale_shift_), width, height, bitrate_bps_, fps_);
+    encoder_ = std::move(encoder);
+    // 客户端要从关键帧开始解新分辨率的码流，开着帧内刷新时新编码器也不一定先出IDR
+    encoder_->requestKeyframe();
+    scaler_ = std::move(scaler);
+    scale_shift_ = shift;
+    // 旧码流的恢复请求不用再响应了
+    pending_keyframe_request_ = false;
+    pending_recovery_frame_id_ = std::nullopt;
+    // 画面静止时也要尽快发一帧新分辨率的画面
+    idle_refreshed_ = false;
 }
 
 std::unique_ptr<VideoCaptureEncodePipeline>
@@ -46,6 +46,14 @@ public:
         std::vector<VideoCodecType> codecs;
         uint32_t width;
         uint32_t height;
+        // 非0时丢包恢复使用渐进帧内刷新，值为刷新完整帧所需的帧数
+        uint32_t intra_refresh_period = 0;
+        // 带宽不够时自动降低编码分辨率，客户端放大显示. 需要新版本客户端，默认关闭
+        bool adaptive_resolution = false;
+        // 编码器统计PSNR，做画质对比时打开
+        bool report_psnr = false;
+        // 不用显卡编码，采集到的纹理读回内存后用软件编码器编码. 硬件编码器都创建失败时也会自动切过去
+        bool software_encoder = false;
         std::function<bool(uint32_t, const MessageHandler&)> register_message_handler;
         std::function<bool(uint32_t, const std::shared_ptr<google::protobuf::MessageLite>&)>
             send_message;
@@ -64,4 +72,4 @@ private:
     std::shared_ptr<VCEPipeline> impl_;
 };
 
-} // namespace lt
\ No newline at end of file
+} // namespace lt
\ No newline at end of file
@@ -42,6 +42,7 @@ class CTSmoother {
 public:
     struct Frame {
         int64_t no;
+        uint64_t ltframe_id = 0;
 
         int64_t at_time = 0;
         int64_t capture_time = 0;
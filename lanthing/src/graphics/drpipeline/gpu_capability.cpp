@@ -43,6 +43,18 @@
 
 #include <ltlib/strings.h>
 
+#include <graphics/capability_cache.h>
+
+#if defined(LT_WINDOWS)
+
+namespace {
+
+constexpr char kDecoderCacheName[] = "decoder";
+
+} // namespace
+
+#endif // LT_WINDOWS
+
 namespace lt {
 
 std::string GpuInfo::Ability::to_str() const {
@@ -56,6 +68,47 @@ std::string GpuInfo::Ability::to_str() const {
 
 using namespace Microsoft::WRL;
 
+bool GpuInfo::probeDecodeAbility(IDXGIAdapter* adapter, Ability& ability) {
+    UINT flag = D3D11_CREATE_DEVICE_VIDEO_SUPPORT;
+#ifdef _DEBUG
+    flag |= D3D11_CREATE_DEVICE_DEBUG;
+#endif
+    HRESULT hr;
+    ComPtr<ID3D11Device> d3d11_dev;
+    ComPtr<ID3D11DeviceContext> d3d11_ctx;
+    hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr, flag, nullptr, 0,
+                           D3D11_SDK_VERSION, d3d11_dev.GetAddressOf(), nullptr,
+                           d3d11_ctx.GetAddressOf());
+    if (FAILED(hr)) {
+        LOGF(ERR, "Failed to create d3d11 device on %s, err:%08lx", ability.to_str().c_str(), hr);
+        return false;
+    }
+    ComPtr<ID3D11VideoDevice> video_device;
+    hr = d3d11_dev->QueryInterface(__uuidof(ID3D11VideoDevice),
+                                   (void**)video_device.GetAddressOf());
+    if (FAILED(hr)) {
+        LOGF(ERR, "Failed to get ID3D11VideoDevice on %s, hr:%08lx", ability.to_str().c_str(), hr);
+        return false;
+    }
+    GUID guid;
+    DXGI_FORMAT format;
+    guid = D3D11_DECODER_PROFILE_H264_VLD_NOFGT;
+    format = DXGI_FORMAT_NV12;
+    BOOL supported = false;
+    hr = video_device->CheckVideoDecoderFormat(&guid, format, &supported);
+    if (!FAILED(hr) && supported) {
+        ability.codecs.push_back(lt::VideoCodecType::H264);
+    }
+    supported = false;
+    guid = D3D11_DECODER_PROFILE_HEVC_VLD_MAIN;
+    format = DXGI_FORMAT_NV12;
+    hr = video_device->CheckVideoDecoderFormat(&guid, format, &supported);
+    if (!FAILED(hr) && supported) {
+        ability.codecs.push_back(lt::VideoCodecType::H265);
+    }
+    return true;
+}
+
 bool GpuInfo::init() {
     HRESULT hr;
     // 用最高版本
@@ -75,10 +128,8 @@ bool GpuInfo::init() {
         ++i;
     }
     // IDXGISwapChain4* swap_chain = nullptr;
-    UINT flag = D3D11_CREATE_DEVICE_VIDEO_SUPPORT;
-#ifdef _DEBUG
-    flag |= D3D11_CREATE_DEVICE_DEBUG;
-#endif
+    // 换了显卡、驱动或系统才需要重新创建D3D设备去探测
+    auto cache = CapabilityCache::create();
     for (auto& adapter : adapters) {
         Ability ability;
         DXGI_ADAPTER_DESC desc;
@@ -86,43 +137,28 @@ bool GpuInfo::init() {
         ability.vendor = desc.VendorId;
         ability.desc = ltlib::utf16To8(desc.Description);
         ability.device_id = desc.DeviceId;
-        ability.driver = "0.0.0.0";
+        ability.driver = CapabilityCache::driverVersion(adapter.Get());
         ability.video_memory_mb = static_cast<uint32_t>(desc.DedicatedVideoMemory / 1024 / 1024);
         ability.luid = ((uint64_t)desc.AdapterLuid.HighPart << 32) + desc.AdapterLuid.LowPart;
 
-        ComPtr<ID3D11Device> d3d11_dev;
-        ComPtr<ID3D11DeviceContext> d3d11_ctx;
-        hr = D3D11CreateDevice(adapter.Get(), D3D_DRIVER_TYPE_UNKNOWN, nullptr, flag, nullptr, 0,
-                               D3D11_SDK_VERSION, d3d11_dev.GetAddressOf(), nullptr,
-                               d3d11_ctx.GetAddressOf());
-        if (FAILED(hr)) {
-            LOGF(ERR, "Failed to create d3d11 device on %s, err:%08lx", ability.to_str().c_str(),
-                 hr);
-            continue;
-        }
-        ComPtr<ID3D11VideoDevice> video_device;
-        hr = d3d11_dev->QueryInterface(__uuidof(ID3D11VideoDevice),
-                                       (void**)video_device.GetAddressOf());
-        if (FAILED(hr)) {
-            LOGF(ERR, "Failed to get ID3D11VideoDevice on %s, hr:%08lx", ability.to_str().c_str(),
-                 hr);
-            continue;
+        auto fingerprint =
+            CapabilityCache::fingerprint(ability.vendor, ability.device_id, ability.driver);
+        std::optional<std::string> cached;
+        if (cache != nullptr) {
+            cached = cache->load(kDecoderCacheName, fingerprint);
         }
-        GUID guid;
-        DXGI_FORMAT format;
-        guid = D3D11_DECODER_PROFILE_H264_VLD_NOFGT;
-        format = DXGI_FORMAT_NV12;
-        BOOL supported = false;
-        hr = video_device->CheckVideoDecoderFormat(&guid, format, &supported);
-        if (!FAILED(hr) && supported) {
-            ability.codecs.push_back(lt::VideoCodecType::H264);
+        if (cached.has_value()) {
+            ability.codecs = CapabilityCache::codecsFromString(cached.value());
+            LOGF(INFO, "Use cached decode abilities for %s", ability.to_str().c_str());
         }
-        supported = false;
-        guid = D3D11_DECODER_PROFILE_HEVC_VLD_MAIN;
-        format = DXGI_FORMAT_NV12;
-        hr = video_device->CheckVideoDecoderFormat(&guid, format, &supported);
-        if (!FAILED(hr) && supported) {
-            ability.codecs.push_back(lt::VideoCodecType::H265);
+        else {
+            if (!probeDecodeAbility(adapter.Get(), ability)) {
+                continue;
+            }
+            if (cache != nullptr) {
+                cache->save(kDecoderCacheName, fingerprint,
+                            CapabilityCache::codecsToString(ability.codecs));
+            }
         }
         // TODO: check DXGI_FORMAT_AYUV;
         if (!ability.codecs.empty()) {
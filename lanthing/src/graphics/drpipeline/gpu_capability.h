@@ -35,6 +35,10 @@
 
 #include <transport/transport.h>
 
+#if defined(LT_WINDOWS)
+struct IDXGIAdapter;
+#endif // LT_WINDOWS
+
 namespace lt {
 class GpuInfo {
 public:
@@ -56,6 +60,11 @@ public:
 
     std::vector<Ability>& get() { return abilities_; }
 
+private:
+#if defined(LT_WINDOWS)
+    static bool probeDecodeAbility(IDXGIAdapter* adapter, Ability& ability);
+#endif // LT_WINDOWS
+
 private:
     std::vector<Ability> abilities_;
 };
@@ -44,6 +44,7 @@
 #include <ltproto/ltproto.h>
 #include <ltproto/worker2service/reconfigure_video_encoder.pb.h>
 
+#include <ltlib/frame_trace.h>
 #include <ltlib/threads.h>
 #include <ltlib/times.h>
 
@@ -69,6 +70,7 @@ public:
     ~VDRPipeline();
     bool init();
     VideoDecodeRenderPipeline::Action submit(const lt::VideoFrame& frame);
+    std::optional<uint64_t> lastDecodedFrameID();
     void setTimeDiff(int64_t diff_us);
     void setRTT(int64_t rtt_us);
     void setBWE(uint32_t bps);
@@ -85,6 +87,7 @@ private:
     bool waitForDecode(std::vector<VideoFrameInternal>& frames,
                        std::chrono::microseconds max_delay);
     bool waitForRender(std::chrono::microseconds ms);
+    bool resizeVideo(uint32_t width, uint32_t height);
     void onStat();
     void onUserSetBitrate(uint32_t bps);
     std::tuple<int32_t, float, float> getCursorInfo();
@@ -101,6 +104,12 @@ private:
     void* window_;
 
     std::atomic<bool> request_i_frame_ = false;
+    // 只在解码线程访问，用于统计从解码失败到恢复的时间
+    int64_t decode_failed_time_us_ = 0;
+    // 只在解码线程访问，-1表示还没有正确解码过
+    int64_t last_decoded_frame_id_ = -1;
+    // 解码失败时记下的last_decoded_frame_id_. 失败之后"解码成功"的帧可能参考了坏掉的帧，不能用
+    std::atomic<int64_t> recovery_frame_id_{-1};
     std::vector<VideoFrameInternal> encoded_frames_;
 
     bool decode_signal_ = false;
@@ -112,8 +121,12 @@ private:
     std::condition_variable waiting_for_render_;
 
     GpuInfo gpu_info_;
+    bool gpu_info_probed_ = false;
     std::unique_ptr<VideoRenderer> video_renderer_;
     std::unique_ptr<VideoDecoder> video_decoder_;
+    VideoDecoder::Params decode_params_{};
+    // 服务端自适应分辨率时要换解码器并重新绑定纹理，这期间不能渲染
+    std::mutex video_mtx_;
     CTSmoother smoother_;
     std::atomic<bool> stoped_{true};
     std::unique_ptr<ltlib::BlockingThread> decode_thread_;
@@ -146,6 +159,10 @@ VDRPipeline::VDRPipeline(const VideoDecodeRenderPipeline::Params& params)
     , sdl_{params.sdl}
     , statistics_{new VideoStatistics} {
     window_ = params.sdl->window();
+    if (params.gpu_info != nullptr) {
+        gpu_info_ = *params.gpu_info;
+        gpu_info_probed_ = true;
+    }
 }
 
 VDRPipeline::~VDRPipeline() {
@@ -159,7 +176,7 @@ VDRPipeline::~VDRPipeline() {
 bool VDRPipeline::init() {
     VideoRenderer::Params render_params{};
 #if LT_WINDOWS
-    if (!gpu_info_.init()) {
+    if (!gpu_info_probed_ && !gpu_info_.init()) {
         return false;
     }
     std::map<uint32_t, GpuInfo::Ability> sorted_by_memory;
@@ -202,6 +219,7 @@ bool VDRPipeline::init() {
     if (video_decoder_ == nullptr) {
         return false;
     }
+    decode_params_ = decode_params;
     if (!video_renderer_->bindTextures(video_decoder_->textures())) {
         return false;
     }
@@ -246,6 +264,14 @@ VideoDecodeRenderPipeline::Action VDRPipeline::submit(const lt::VideoFrame& _fra
         statistics_->updateNetDelay(ltlib::steady_now_us() - _frame.end_encode_timestamp_us -
                                     time_diff_);
     }
+    auto tracer = ltlib::FrameTracer::instance();
+    tracer->stampRemote(_frame.ltframe_id, ltlib::FrameTracer::Stage::Capture,
+                        _frame.capture_timestamp_us);
+    tracer->stampRemote(_frame.ltframe_id, ltlib::FrameTracer::Stage::StartEncode,
+                        _frame.start_encode_timestamp_us);
+    tracer->stampRemote(_frame.ltframe_id, ltlib::FrameTracer::Stage::EndEncode,
+                        _frame.end_encode_timestamp_us);
+    tracer->stamp(_frame.ltframe_id, ltlib::FrameTracer::Stage::Arrival);
 
     VideoFrameInternal frame{};
     frame.is_keyframe = _frame.is_keyframe;
@@ -270,9 +296,18 @@ VideoDecodeRenderPipeline::Action VDRPipeline::submit(const lt::VideoFrame& _fra
                            : VideoDecodeRenderPipeline::Action::NONE;
 }
 
+std::optional<uint64_t> VDRPipeline::lastDecodedFrameID() {
+    const int64_t frame_id = recovery_frame_id_.exchange(-1);
+    if (frame_id < 0) {
+        return std::nullopt;
+    }
+    return static_cast<uint64_t>(frame_id);
+}
+
 void VDRPipeline::setTimeDiff(int64_t diff_us) {
     LOG(DEBUG) << "TIME DIFF " << diff_us;
     time_diff_ = diff_us;
+    ltlib::FrameTracer::instance()->setClockOffset(diff_us);
 }
 
 void VDRPipeline::setRTT(int64_t rtt_us) {
@@ -329,11 +364,23 @@ void VDRPipeline::decodeLoop(const std::function<void()>& i_am_alive) {
             continue;
         }
         for (auto& frame : frames) {
+            if (frame.width != 0 && (frame.width != video_decoder_->width() ||
+                                     frame.height != video_decoder_->height())) {
+                // 新分辨率的码流要从关键帧开始解
+                if (!frame.is_keyframe || !resizeVideo(frame.width, frame.height)) {
+                    request_i_frame_ = true;
+                    continue;
+                }
+            }
             auto start = ltlib::steady_now_us();
             DecodedFrame decoded_frame = video_decoder_->decode(frame.data, frame.size);
             auto end = ltlib::steady_now_us();
             if (decoded_frame.status == DecodeStatus::Failed) {
                 LOG(ERR) << "Failed to call decode(), reqesut i frame";
+                if (decode_failed_time_us_ == 0) {
+                    decode_failed_time_us_ = start;
+                    recovery_frame_id_ = last_decoded_frame_id_;
+                }
                 request_i_frame_ = true;
                 break;
             }
@@ -341,11 +388,21 @@ void VDRPipeline::decodeLoop(const std::function<void()>& i_am_alive) {
                 LOG(FATAL) << "Should not be reach here";
             }
             else {
+                if (decode_failed_time_us_ != 0) {
+                    LOG(INFO) << "Recovered from decode failure after "
+                              << (end - decode_failed_time_us_) / 1000 << "ms";
+                    decode_failed_time_us_ = 0;
+                }
                 LOG(DEBUG) << "CAPTURE-AFTER_DECODE "
                            << ltlib::steady_now_us() - frame.capture_timestamp_us - time_diff_;
                 statistics_->updateDecodeTime(end - start);
+                last_decoded_frame_id_ = static_cast<int64_t>(frame.ltframe_id);
+                auto tracer = ltlib::FrameTracer::instance();
+                tracer->stamp(frame.ltframe_id, ltlib::FrameTracer::Stage::StartDecode, start);
+                tracer->stamp(frame.ltframe_id, ltlib::FrameTracer::Stage::EndDecode, end);
                 CTSmoother::Frame f;
                 f.no = decoded_frame.frame;
+                f.ltframe_id = frame.ltframe_id;
                 f.capture_time = frame.capture_timestamp_us;
                 f.at_time = ltlib::steady_now_us();
                 {
@@ -358,6 +415,34 @@ void VDRPipeline::decodeLoop(const std::function<void()>& i_am_alive) {
     }
 }
 
+bool VDRPipeline::resizeVideo(uint32_t width, uint32_t height) {
+    VideoDecoder::Params params = decode_params_;
+    params.width = width;
+    params.height = height;
+    auto decoder = VideoDecoder::create(params);
+    if (decoder == nullptr) {
+        LOGF(ERR, "Create %ux%u video decoder failed", width, height);
+        return false;
+    }
+    std::lock_guard video_lock{video_mtx_};
+    if (!video_renderer_->bindTextures(decoder->textures()) ||
+        !video_renderer_->setVideoSize(width, height)) {
+        LOGF(ERR, "Rebind %ux%u video textures failed", width, height);
+        video_renderer_->bindTextures(video_decoder_->textures());
+        video_renderer_->setVideoSize(video_decoder_->width(), video_decoder_->height());
+        return false;
+    }
+    {
+        // 还没渲染的帧引用的是旧解码器的纹理
+        std::lock_guard render_lock{render_mtx_};
+        smoother_.clear();
+    }
+    LOGF(INFO, "Video resolution %ux%u -> %ux%u", video_decoder_->width(),
+         video_decoder_->height(), width, height);
+    video_decoder_ = std::move(decoder);
+    return true;
+}
+
 bool VDRPipeline::waitForRender(std::chrono::microseconds ms) {
     std::unique_lock<std::mutex> lock(render_mtx_);
     bool ret = waiting_for_render_.wait_for(lock, ms, [this]() { return smoother_.size() > 0; });
@@ -402,9 +487,11 @@ void VDRPipeline::renderLoop(const std::function<void()>& i_am_alive) {
         i_am_alive();
         ltlib::Timestamp cur_time = ltlib::Timestamp::now();
         if (video_renderer_->waitForPipeline(16) && waitForRender(2ms)) {
+            std::unique_lock video_lock{video_mtx_};
             auto frame = smoother_.get(cur_time.microseconds());
             smoother_.pop();
             video_renderer_->switchMouseMode(isAbsoluteMouse());
+            auto tracer = ltlib::FrameTracer::instance();
             if (frame.has_value()) {
                 auto [cursor, x, y] = getCursorInfo();
                 video_renderer_->updateCursor(cursor, x, y, visible_);
@@ -414,6 +501,7 @@ void VDRPipeline::renderLoop(const std::function<void()>& i_am_alive) {
                 auto start = ltlib::steady_now_us();
                 auto result = video_renderer_->render(frame->no);
                 auto end = ltlib::steady_now_us();
+                tracer->stamp(frame->ltframe_id, ltlib::FrameTracer::Stage::Render, start);
                 switch (result) {
                 case VideoRenderer::RenderResult::Failed:
                     // TODO: 更好地通知退出
@@ -428,11 +516,15 @@ void VDRPipeline::renderLoop(const std::function<void()>& i_am_alive) {
                 }
                 statistics_->updateRenderVideoTime(end - start);
             }
+            video_lock.unlock();
             auto start = ltlib::steady_now_us();
             widgets_->render();
             auto mid = ltlib::steady_now_us();
             video_renderer_->present();
             auto end = ltlib::steady_now_us();
+            if (frame.has_value()) {
+                tracer->stamp(frame->ltframe_id, ltlib::FrameTracer::Stage::Present, end);
+            }
             statistics_->addPresent();
             statistics_->updateRenderWidgetsTime(mid - start);
             statistics_->updatePresentTime(end - mid);
@@ -479,6 +571,10 @@ VideoDecodeRenderPipeline::Action VideoDecodeRenderPipeline::submit(const lt::Vi
     return impl_->submit(frame);
 }
 
+std::optional<uint64_t> VideoDecodeRenderPipeline::lastDecodedFrameID() {
+    return impl_->lastDecodedFrameID();
+}
+
 void VideoDecodeRenderPipeline::resetRenderTarget() {
     impl_->resetRenderTarget();
 }
@@ -32,9 +32,11 @@
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <optional>
 
 #include <google/protobuf/message_lite.h>
 
+#include <graphics/drpipeline/gpu_capability.h>
 #include <platforms/pc_sdl.h>
 #include <transport/transport.h>
 
@@ -57,6 +59,8 @@ public:
         PcSdl* sdl = nullptr;
         std::function<void(uint32_t, std::shared_ptr<google::protobuf::MessageLite>, bool)>
             send_message_to_host;
+        // 启动时提前探测好的GPU信息，为空则在create()里探测
+        const GpuInfo* gpu_info = nullptr;
     };
 
     enum class Action {
@@ -67,6 +71,8 @@ public:
 public:
     static std::unique_ptr<VideoDecodeRenderPipeline> create(const Params& params);
     Action submit(const lt::VideoFrame& frame);
+    // 最近一次解码失败前最后正确解码的帧ID，随REQUEST_KEY_FRAME发给服务端. 取一次后清空
+    std::optional<uint64_t> lastDecodedFrameID();
     void resetRenderTarget();
     void setTimeDiff(int64_t diff_us);
     void setRTT(int64_t rtt_us);
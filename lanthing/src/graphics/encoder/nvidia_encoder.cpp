@@ -33,6 +33,7 @@
 #include <d3d11_1.h>
 #include <wrl/client.h>
 
+#include <array>
 #include <cassert>
 #include <memory>
 #include <sstream>
@@ -46,6 +47,10 @@
 
 namespace {
 
+// 两个长期参考帧轮流标记，保证总有一个足够老、客户端已经确认收到的
+constexpr uint32_t kLtrNumFrames = 2;
+constexpr uint64_t kLtrMarkInterval = 30;
+
 #if LT_WINDOWS
 const char* kNvEncLibName = "nvEncodeAPI64.dll";
 #else
@@ -77,6 +82,7 @@ public:
     std::optional<int> vbvbufsize() const { return params_.vbvbufsize(); }
     std::optional<int> vbvinit() const { return params_.vbvinit(); }
     int gop() const { return params_.gop(); }
+    uint32_t intraRefreshPeriod() const { return params_.intra_refresh_period(); }
     NV_ENC_PARAMS_RC_MODE rc() const;
     GUID preset() const;
     GUID codec() const;
@@ -146,14 +152,19 @@ public:
     ~NvD3d11EncoderImpl();
     bool init(const VideoEncodeParamsHelper& params);
     void reconfigure(const VideoEncoder::ReconfigureParams& params);
-    std::shared_ptr<ltproto::client2worker::VideoFrame> encodeOneFrame(void* input_frame,
-                                                                       bool request_iframe);
+    std::shared_ptr<ltproto::client2worker::VideoFrame>
+    encodeOneFrame(void* input_frame, bool request_iframe, bool request_refresh,
+                   std::optional<uint64_t> recover_from, uint64_t frame_id);
+    bool supportLTR() const { return ltr_enabled_; }
+    bool supportIntraRefresh() const { return intra_refresh_period_ != 0; }
 
 private:
     bool loadNvApi();
     NV_ENC_INITIALIZE_PARAMS generateEncodeParams(const NvEncParamsHelper& helper,
                                                   NV_ENC_CONFIG& config);
     bool initBuffers();
+    int getCaps(GUID codec, NV_ENC_CAPS caps);
+    std::optional<uint32_t> findLtrIndex(uint64_t last_decoded_frame_id);
     std::optional<NV_ENC_MAP_INPUT_RESOURCE> initInputFrame(void* frame);
     bool uninitInputFrame(NV_ENC_MAP_INPUT_RESOURCE& resource);
     void releaseResources();
@@ -173,6 +184,14 @@ private:
     void* event_ = nullptr;
     // 因为编码需求是一帧都不延迟，这个async似乎没有意义，只是想测试一下async似乎会玄学地缩短编码latency
     bool async_ = false;
+    // 非0时持续做周期为这么多帧的帧内刷新，丢包后不用等IDR也能恢复
+    uint32_t intra_refresh_period_ = 0;
+    bool first_frame_ = true;
+    bool ltr_enabled_ = false;
+    // 下标是LTR index，值是被标记为长期参考帧的picture_id
+    std::array<std::optional<uint64_t>, kLtrNumFrames> ltr_frames_;
+    uint32_t next_ltr_index_ = 0;
+    uint64_t last_ltr_mark_frame_id_ = 0;
     struct EncodeResource {
         NV_ENC_REGISTER_RESOURCE reg = {NV_ENC_REGISTER_RESOURCE_VER};
         NV_ENC_MAP_INPUT_RESOURCE mapped = {NV_ENC_MAP_INPUT_RESOURCE_VER};
@@ -280,7 +299,8 @@ void NvD3d11EncoderImpl::reconfigure(const VideoEncoder::ReconfigureParams& para
 }
 
 std::shared_ptr<ltproto::client2worker::VideoFrame>
-NvD3d11EncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
+NvD3d11EncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe, bool request_refresh,
+                                   std::optional<uint64_t> recover_from, uint64_t frame_id) {
     auto mapped_resource = initInputFrame(input_frame);
     if (!mapped_resource.has_value()) {
         return nullptr;
@@ -288,8 +308,59 @@ NvD3d11EncoderImpl::encodeOneFrame(void* input_frame, bool request_iframe) {
 
     NV_ENC_PIC_PARAMS params{};
     params.version = NV_ENC_PIC_PARAMS_VER;
-    params.encodePicFlags =
-        request_iframe ? (NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS) : 0;
+    // 明确要求的关键帧(新观看者、改分辨率、静止刷新)开着帧内刷新也要出IDR
+    const bool force_idr = request_iframe;
+    const bool ltr_recovery = ltr_enabled_ && recover_from.has_value() && !request_iframe;
+    std::optional<uint32_t> use_ltr_index;
+    if (ltr_recovery) {
+        use_ltr_index = findLtrIndex(recover_from.value());
+    }
+    // 客户端持有的LTR都不可用时，开着帧内刷新就重新开始一轮刷新波，否则只能出IDR
+    const bool ltr_failed = ltr_recovery && !use_ltr_index.has_value();
+    const bool idr = force_idr || (ltr_failed && intra_refresh_period_ == 0);
+    // 丢包恢复从当前帧开始一轮完整的刷新波，intra_refresh_period_帧后整帧恢复，
+    // 不用等正在滚动的那一轮，码率也不会像IDR那样突然冲高
+    const bool refresh = !idr && !use_ltr_index.has_value() && intra_refresh_period_ != 0 &&
+                         (request_refresh || ltr_failed);
+    if (idr) {
+        // IDR会清空DPB里的长期参考帧
+        ltr_frames_.fill(std::nullopt);
+    }
+    const bool mark_ltr = ltr_enabled_ && (idr || first_frame_ || use_ltr_index.has_value() ||
+                                           frame_id - last_ltr_mark_frame_id_ >= kLtrMarkInterval);
+    uint32_t mark_ltr_index = next_ltr_index_;
+    if (use_ltr_index.has_value() && use_ltr_index.value() == mark_ltr_index) {
+        // 恢复帧本身也可能丢，不能覆盖掉唯一确认可用的那个LTR
+        mark_ltr_index = (mark_ltr_index + 1) % kLtrNumFrames;
+    }
+    auto set_pic_params = [&](auto& pic_params) {
+        if (use_ltr_index.has_value()) {
+            pic_params.ltrUseFrames = 1;
+            pic_params.ltrUseFrameBitmap = 1u << use_ltr_index.value();
+        }
+        if (mark_ltr) {
+            pic_params.ltrMarkFrame = 1;
+            pic_params.ltrMarkFrameIdx = mark_ltr_index;
+        }
+        if (refresh) {
+            pic_params.forceIntraRefreshWithFrameCnt = intra_refresh_period_;
+        }
+    };
+    if (codec_type_ == lt::VideoCodecType::H264) {
+        set_pic_params(params.codecPicParams.h264PicParams);
+    }
+    else {
+        set_pic_params(params.codecPicParams.hevcPicParams);
+    }
+    if (idr) {
+        params.encodePicFlags = NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS;
+    }
+    if (mark_ltr) {
+        ltr_frames_[mark_ltr_index] = frame_id;
+        next_ltr_index_ = (mark_ltr_index + 1) % kLtrNumFrames;
+        last_ltr_mark_frame_id_ = frame_id;
+    }
+    first_frame_ = false;
     params.pictureStruct = NV_ENC_PIC_STRUCT_FRAME;
     params.inputBuffer = mapped_resource->mappedResource;
     params.bufferFmt = buffer_format_;
@@ -432,6 +503,18 @@ NvD3d11EncoderImpl::generateEncodeParams(const NvEncParamsHelper& helper,
         params.encodeConfig->rcParams.constQP = {28, 31, 25};
     }
 
+    intra_refresh_period_ = helper.intraRefreshPeriod();
+    if (intra_refresh_period_ != 0 &&
+        getCaps(params.encodeGUID, NV_ENC_CAPS_SUPPORT_INTRA_REFRESH) == 0) {
+        LOG(WARNING) << "NvEnc doesn't support intra refresh, fallback to IDR";
+        intra_refresh_period_ = 0;
+    }
+    ltr_enabled_ = getCaps(params.encodeGUID, NV_ENC_CAPS_NUM_MAX_LTR_FRAMES) >=
+                   static_cast<int>(kLtrNumFrames);
+    if (!ltr_enabled_) {
+        LOG(INFO) << "NvEnc doesn't support " << kLtrNumFrames << " LTR frames";
+    }
+
     if (params.encodeGUID == NV_ENC_CODEC_H264_GUID) {
         if (buffer_format_ == NV_ENC_BUFFER_FORMAT_YUV444 ||
             buffer_format_ == NV_ENC_BUFFER_FORMAT_YUV444_10BIT) {
@@ -442,6 +525,21 @@ NvD3d11EncoderImpl::generateEncodeParams(const NvEncParamsHelper& helper,
         params.encodeConfig->encodeCodecConfig.h264Config.maxNumRefFrames = 0;
         params.encodeConfig->encodeCodecConfig.h264Config.sliceMode = 3;
         params.encodeConfig->encodeCodecConfig.h264Config.sliceModeData = 1;
+        if (intra_refresh_period_ != 0) {
+            // 刷新波首尾相接，和x264的intra-refresh一样一直在滚动
+            params.encodeConfig->encodeCodecConfig.h264Config.enableIntraRefresh = 1;
+            params.encodeConfig->encodeCodecConfig.h264Config.intraRefreshPeriod =
+                intra_refresh_period_;
+            params.encodeConfig->encodeCodecConfig.h264Config.intraRefreshCnt =
+                intra_refresh_period_;
+            params.encodeConfig->encodeCodecConfig.h264Config.outputRecoveryPointSEI = 1;
+        }
+        if (ltr_enabled_) {
+            // 逐帧手动标记LTR，由客户端的反馈决定用哪一个来恢复
+            params.encodeConfig->encodeCodecConfig.h264Config.enableLTR = 1;
+            params.encodeConfig->encodeCodecConfig.h264Config.ltrTrustMode = 0;
+            params.encodeConfig->encodeCodecConfig.h264Config.ltrNumFrames = kLtrNumFrames;
+        }
     }
     else if (params.encodeGUID == NV_ENC_CODEC_HEVC_GUID) {
         params.encodeConfig->encodeCodecConfig.hevcConfig.pixelBitDepthMinus8 =
@@ -458,10 +556,52 @@ NvD3d11EncoderImpl::generateEncodeParams(const NvEncParamsHelper& helper,
         params.encodeConfig->encodeCodecConfig.hevcConfig.maxNumRefFramesInDPB = 0;
         params.encodeConfig->encodeCodecConfig.hevcConfig.sliceMode = 3;
         params.encodeConfig->encodeCodecConfig.hevcConfig.sliceModeData = 1;
+        if (intra_refresh_period_ != 0) {
+            params.encodeConfig->encodeCodecConfig.hevcConfig.enableIntraRefresh = 1;
+            params.encodeConfig->encodeCodecConfig.hevcConfig.intraRefreshPeriod =
+                intra_refresh_period_;
+            params.encodeConfig->encodeCodecConfig.hevcConfig.intraRefreshCnt =
+                intra_refresh_period_;
+        }
+        if (ltr_enabled_) {
+            params.encodeConfig->encodeCodecConfig.hevcConfig.enableLTR = 1;
+            params.encodeConfig->encodeCodecConfig.hevcConfig.ltrTrustMode = 0;
+            params.encodeConfig->encodeCodecConfig.hevcConfig.ltrNumFrames = kLtrNumFrames;
+        }
     }
     return params;
 }
 
+int NvD3d11EncoderImpl::getCaps(GUID codec, NV_ENC_CAPS caps) {
+    NV_ENC_CAPS_PARAM caps_param{NV_ENC_CAPS_PARAM_VER};
+    caps_param.capsToQuery = caps;
+    int value = 0;
+    NVENCSTATUS status = nvfuncs_.nvEncGetEncodeCaps(nvencoder_, codec, &caps_param, &value);
+    if (status != NV_ENC_SUCCESS) {
+        LOG(WARNING) << "nvEncGetEncodeCaps(" << caps << ") failed with " << status;
+        return 0;
+    }
+    return value;
+}
+
+std::optional<uint32_t> NvD3d11EncoderImpl::findLtrIndex(uint64_t last_decoded_frame_id) {
+    std::optional<uint32_t> index;
+    for (uint32_t i = 0; i < kLtrNumFrames; i++) {
+        if (!ltr_frames_[i].has_value()) {
+            continue;
+        }
+        if (ltr_frames_[i].value() > last_decoded_frame_id) {
+            // 客户端没有正确解码这一帧，以后也不能再用它
+            ltr_frames_[i] = std::nullopt;
+            continue;
+        }
+        if (!index.has_value() || ltr_frames_[i].value() > ltr_frames_[index.value()].value()) {
+            index = i;
+        }
+    }
+    return index;
+}
+
 bool NvD3d11EncoderImpl::initBuffers() {
     NV_ENC_CREATE_BITSTREAM_BUFFER bits_params = {NV_ENC_CREATE_BITSTREAM_BUFFER_VER};
     NVENCSTATUS status = nvfuncs_.nvEncCreateBitstreamBuffer(nvencoder_, &bits_params);
@@ -528,7 +668,16 @@ void NvD3d11Encoder::reconfigure(const ReconfigureParams& params) {
 }
 
 std::shared_ptr<ltproto::client2worker::VideoFrame> NvD3d11Encoder::encodeFrame(void* input_frame) {
-    return impl_->encodeOneFrame(input_frame, needKeyframe());
+    return impl_->encodeOneFrame(input_frame, needKeyframe(), needRefresh(), needRecovery(),
+                                 currentFrameID());
+}
+
+bool NvD3d11Encoder::supportLTR() const {
+    return impl_->supportLTR();
+}
+
+bool NvD3d11Encoder::supportIntraRefresh() const {
+    return impl_->supportIntraRefresh();
 }
 
 } // namespace lt
\ No newline at end of file
@@ -50,6 +50,8 @@ public:
     bool init(const VideoEncodeParamsHelper& params);
     void reconfigure(const ReconfigureParams& params) override;
     std::shared_ptr<ltproto::client2worker::VideoFrame> encodeFrame(void* input_frame) override;
+    bool supportLTR() const override;
+    bool supportIntraRefresh() const override;
 
 private:
     std::shared_ptr<NvD3d11EncoderImpl> impl_;
@@ -36,14 +36,15 @@
 namespace lt {
 VideoEncodeParamsHelper::VideoEncodeParamsHelper(lt::VideoCodecType c, uint32_t width,
                                                  uint32_t height, int fps, uint32_t bitrate_kbps,
-                                                 bool enable_vbv)
+                                                 bool enable_vbv, uint32_t intra_refresh_period)
     : codec_type_{c}
     , width_{width}
     , height_{height}
     , fps_{fps}
     , bitrate_kbps_{bitrate_kbps}
     , enable_vbv_{enable_vbv}
-    , profile_{c == lt::VideoCodecType::H264 ? Profile::AvcMain : Profile::HevcMain} {
+    , profile_{c == lt::VideoCodecType::H264 ? Profile::AvcMain : Profile::HevcMain}
+    , intra_refresh_period_{intra_refresh_period} {
     assert(c == lt::VideoCodecType::H264 || c == lt::VideoCodecType::H265);
     uint32_t bitrate_bps = bitrate_kbps_ * 1024;
     if (enable_vbv) {
@@ -69,6 +70,7 @@ VideoEncodeParamsHelper::VideoEncodeParamsHelper(lt::VideoCodecType c, uint32_t
     params_["-qmin"] = ssQmin.str();
     params_["-qmax"] = ssQmax.str();
     params_["-fps"] = std::to_string(fps);
+    params_["-intrarefresh"] = std::to_string(intra_refresh_period);
 }
 
 std::string VideoEncodeParamsHelper::params() const {
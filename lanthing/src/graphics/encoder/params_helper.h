@@ -60,7 +60,8 @@ public:
 
 public:
     VideoEncodeParamsHelper(lt::VideoCodecType c, uint32_t width, uint32_t height, int fps,
-                            uint32_t bitrate_kbps, bool enable_vbv);
+                            uint32_t bitrate_kbps, bool enable_vbv,
+                            uint32_t intra_refresh_period = 0);
 
     uint32_t width() const { return width_; }
     uint32_t height() const { return height_; }
@@ -78,6 +79,8 @@ public:
     Preset preset() const { return preset_; }
     lt::VideoCodecType codec() const { return codec_type_; }
     Profile profile() const { return profile_; }
+    // 非0时持续做周期为N帧的渐进帧内刷新，丢包后不用等IDR也能恢复。请求关键帧仍然出IDR
+    uint32_t intra_refresh_period() const { return intra_refresh_period_; }
 
     std::string params() const;
 
@@ -92,6 +95,7 @@ private:
     const RcMode rc_ = RcMode::VBR;
     const Preset preset_ = Preset::Speed;
     const Profile profile_;
+    const uint32_t intra_refresh_period_;
     std::array<uint32_t, 3> qmin_ = {10, 10, 25};
     std::array<uint32_t, 3> qmax_ = {40, 40, 42};
     std::optional<int> vbvbufsize_;
@@ -0,0 +1,329 @@
+// 离线比较SoftwareEncoder开/关ROI的码率和画质. 输入是录好的BGRA原始序列，比如
+//   ffmpeg -f gdigrab -framerate 60 -i desktop -t 10 -pix_fmt bgra -f rawvideo desktop.bgra
+// 用法:
+//   roi_quality_tool <file.bgra> <width> <height> [bitrate_kbps] [h264|h265]
+// 变化区域按64x64的块和上一帧比较得出，和DXGI给的dirty rect粒度相近. 同一个序列各编一遍，
+// 用ffmpeg解码后和编码器的输入(同样的BGRA->I420转换)比较，输出码率、整帧和变化区域的Y分量
+// PSNR、整帧的Y分量SSIM.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ltlib/pragma_warning.h>
+WARNING_DISABLE(4244)
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+} // extern "C"
+WARNING_ENABLE(4244)
+
+#include <g3log/logworker.hpp>
+
+#include <graphics/encoder/video_encoder.h>
+#include <ltlib/color_convert.h>
+
+namespace {
+
+constexpr int64_t kFrameIntervalUS = 16'667;
+constexpr uint32_t kTileSize = 64;
+// 和SoftwareEncoder的kMaxRegionsOfInterest一致，超过就合并成一个外接矩形
+constexpr size_t kMaxDirtyRects = 64;
+
+struct NullSink {
+    void receive(g3::LogMessageMover) {}
+};
+
+struct I420Frame {
+    I420Frame(uint32_t width, uint32_t height)
+        : y(static_cast<size_t>(width) * height)
+        , u(static_cast<size_t>(width / 2) * (height / 2))
+        , v(static_cast<size_t>(width / 2) * (height / 2)) {}
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> u;
+    std::vector<uint8_t> v;
+};
+
+struct RunResult {
+    uint64_t bytes = 0;
+    uint32_t frames = 0;
+    double psnr = 0.;
+    double ssim = 0.;
+    double dirty_psnr = 0.;
+    uint32_t dirty_frames = 0;
+};
+
+std::vector<lt::VideoCapturer::DirtyRect> diffTiles(const std::vector<uint8_t>& prev,
+                                                    const std::vector<uint8_t>& curr,
+                                                    uint32_t width, uint32_t height) {
+    std::vector<lt::VideoCapturer::DirtyRect> rects;
+    const uint32_t stride = width * 4;
+    for (uint32_t ty = 0; ty < height; ty += kTileSize) {
+        const uint32_t th = std::min(kTileSize, height - ty);
+        // 同一行相邻的变化块合成一个矩形
+        uint32_t run_start = width;
+        for (uint32_t tx = 0; tx < width; tx += kTileSize) {
+            const uint32_t tw = std::min(kTileSize, width - tx);
+            bool dirty = false;
+            for (uint32_t y = ty; y < ty + th && !dirty; y++) {
+                const size_t offset = static_cast<size_t>(y) * stride + tx * 4;
+                dirty = memcmp(prev.data() + offset, curr.data() + offset, tw * 4) != 0;
+            }
+            if (dirty && run_start == width) {
+                run_start = tx;
+            }
+            else if (!dirty && run_start != width) {
+                rects.push_back({static_cast<int32_t>(run_start), static_cast<int32_t>(ty),
+                                 tx - run_start, th});
+                run_start = width;
+            }
+        }
+        if (run_start != width) {
+            rects.push_back({static_cast<int32_t>(run_start), static_cast<int32_t>(ty),
+                             width - run_start, th});
+        }
+    }
+    if (rects.size() > kMaxDirtyRects) {
+        int32_t left = static_cast<int32_t>(width), top = static_cast<int32_t>(height);
+        int32_t right = 0, bottom = 0;
+        for (const auto& rect : rects) {
+            left = std::min(left, rect.x);
+            top = std::min(top, rect.y);
+            right = std::max(right, rect.x + static_cast<int32_t>(rect.width));
+            bottom = std::max(bottom, rect.y + static_cast<int32_t>(rect.height));
+        }
+        rects = {{left, top, static_cast<uint32_t>(right - left),
+                  static_cast<uint32_t>(bottom - top)}};
+    }
+    return rects;
+}
+
+double psnr(uint64_t sse, uint64_t pixels) {
+    return sse == 0 ? 100. : 10. * std::log10(255. * 255. * pixels / sse);
+}
+
+uint64_t sumSquaredError(const uint8_t* ref, int ref_stride, const uint8_t* dec, int dec_stride,
+                         uint32_t x0, uint32_t y0, uint32_t width, uint32_t height) {
+    uint64_t sse = 0;
+    for (uint32_t y = y0; y < y0 + height; y++) {
+        for (uint32_t x = x0; x < x0 + width; x++) {
+            const int diff = ref[y * ref_stride + x] - dec[y * dec_stride + x];
+            sse += static_cast<uint64_t>(diff * diff);
+        }
+    }
+    return sse;
+}
+
+// 8x8窗口，步长4，常数取SSIM论文的K1=0.01、K2=0.03
+double ssim(const uint8_t* ref, int ref_stride, const uint8_t* dec, int dec_stride,
+            uint32_t width, uint32_t height) {
+    constexpr double kC1 = (0.01 * 255) * (0.01 * 255);
+    constexpr double kC2 = (0.03 * 255) * (0.03 * 255);
+    constexpr uint32_t kWindow = 8;
+    double total = 0.;
+    uint64_t windows = 0;
+    for (uint32_t wy = 0; wy + kWindow <= height; wy += 4) {
+        for (uint32_t wx = 0; wx + kWindow <= width; wx += 4) {
+            uint64_t sum_a = 0, sum_b = 0, sum_aa = 0, sum_bb = 0, sum_ab = 0;
+            for (uint32_t y = wy; y < wy + kWindow; y++) {
+                for (uint32_t x = wx; x < wx + kWindow; x++) {
+                    const uint32_t a = ref[y * ref_stride + x];
+                    const uint32_t b = dec[y * dec_stride + x];
+                    sum_a += a;
+                    sum_b += b;
+                    sum_aa += a * a;
+                    sum_bb += b * b;
+                    sum_ab += a * b;
+                }
+            }
+            const double n = kWindow * kWindow;
+            const double mean_a = sum_a / n;
+            const double mean_b = sum_b / n;
+            const double var_a = sum_aa / n - mean_a * mean_a;
+            const double var_b = sum_bb / n - mean_b * mean_b;
+            const double cov = sum_ab / n - mean_a * mean_b;
+            total += ((2 * mean_a * mean_b + kC1) * (2 * cov + kC2)) /
+                     ((mean_a * mean_a + mean_b * mean_b + kC1) * (var_a + var_b + kC2));
+            windows++;
+        }
+    }
+    return windows == 0 ? 1. : total / windows;
+}
+
+class Decoder {
+public:
+    ~Decoder() {
+        if (frame_ != nullptr) {
+            av_frame_free(&frame_);
+        }
+        if (packet_ != nullptr) {
+            av_packet_free(&packet_);
+        }
+        if (ctx_ != nullptr) {
+            avcodec_free_context(&ctx_);
+        }
+    }
+    bool init(bool hevc) {
+        const AVCodec* codec =
+            avcodec_find_decoder(hevc ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264);
+        if (codec == nullptr) {
+            return false;
+        }
+        ctx_ = avcodec_alloc_context3(codec);
+        packet_ = av_packet_alloc();
+        frame_ = av_frame_alloc();
+        if (ctx_ == nullptr || packet_ == nullptr || frame_ == nullptr) {
+            return false;
+        }
+        // 帧级多线程会攒帧，逐帧比较要求送一帧出一帧
+        ctx_->thread_count = 1;
+        return avcodec_open2(ctx_, codec, nullptr) == 0;
+    }
+    const AVFrame* decode(const std::string& data) {
+        // 解码器要求输入后面有AV_INPUT_BUFFER_PADDING_SIZE字节的0
+        buffer_.assign(data.size() + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+        memcpy(buffer_.data(), data.data(), data.size());
+        packet_->data = buffer_.data();
+        packet_->size = static_cast<int>(data.size());
+        if (avcodec_send_packet(ctx_, packet_) < 0) {
+            return nullptr;
+        }
+        if (avcodec_receive_frame(ctx_, frame_) < 0) {
+            return nullptr;
+        }
+        return frame_;
+    }
+
+private:
+    AVCodecContext* ctx_ = nullptr;
+    AVPacket* packet_ = nullptr;
+    AVFrame* frame_ = nullptr;
+    std::vector<uint8_t> buffer_;
+};
+
+bool runOnce(const std::string& path, uint32_t width, uint32_t height, uint32_t bitrate_kbps,
+             bool hevc, bool roi, RunResult& result) {
+    std::ifstream file{path, std::ios::binary};
+    if (!file) {
+        printf("Open %s failed\n", path.c_str());
+        return false;
+    }
+    lt::VideoEncoder::InitParams params{};
+    params.software = true;
+    params.codec_type = hevc ? lt::VideoCodecType::H265 : lt::VideoCodecType::H264;
+    params.width = width;
+    params.height = height;
+    params.bitrate_bps = bitrate_kbps * 1024;
+    auto encoder = lt::VideoEncoder::create(params);
+    Decoder decoder;
+    if (encoder == nullptr || !decoder.init(hevc)) {
+        printf("Create encoder/decoder failed\n");
+        return false;
+    }
+    const size_t frame_bytes = static_cast<size_t>(width) * height * 4;
+    std::vector<uint8_t> prev(frame_bytes);
+    std::vector<uint8_t> curr(frame_bytes);
+    I420Frame ref{width, height};
+    const int y_stride = static_cast<int>(width);
+    const int uv_stride = static_cast<int>(width / 2);
+    while (file.read(reinterpret_cast<char*>(curr.data()),
+                     static_cast<std::streamsize>(frame_bytes))) {
+        lt::VideoCapturer::Frame frame{};
+        frame.data = curr.data();
+        frame.capture_timestamp_us = result.frames * kFrameIntervalUS;
+        frame.width = width;
+        frame.height = height;
+        frame.stride = width * 4;
+        // 不带变化区域时编码器按整帧变化处理，不做ROI. 画质统计两遍都按变化区域算
+        std::vector<lt::VideoCapturer::DirtyRect> dirty_rects;
+        if (result.frames != 0) {
+            dirty_rects = diffTiles(prev, curr, width, height);
+        }
+        if (roi) {
+            frame.dirty_rects = dirty_rects;
+        }
+        auto encoded = encoder->encode(frame);
+        if (encoded == nullptr) {
+            printf("Encode frame %u failed\n", result.frames);
+            return false;
+        }
+        const AVFrame* decoded = decoder.decode(encoded->frame());
+        if (decoded == nullptr) {
+            printf("Decode frame %u failed\n", result.frames);
+            return false;
+        }
+        ltlib::bgraToI420(curr.data(), static_cast<int>(width * 4), ref.y.data(), y_stride,
+                          ref.u.data(), uv_stride, ref.v.data(), uv_stride,
+                          static_cast<int>(width), static_cast<int>(height));
+        result.bytes += encoded->frame().size();
+        result.psnr += psnr(sumSquaredError(ref.y.data(), y_stride, decoded->data[0],
+                                            decoded->linesize[0], 0, 0, width, height),
+                            static_cast<uint64_t>(width) * height);
+        result.ssim += ssim(ref.y.data(), y_stride, decoded->data[0], decoded->linesize[0],
+                            width, height);
+        if (!dirty_rects.empty()) {
+            uint64_t sse = 0;
+            uint64_t pixels = 0;
+            for (const auto& rect : dirty_rects) {
+                sse += sumSquaredError(ref.y.data(), y_stride, decoded->data[0],
+                                       decoded->linesize[0], static_cast<uint32_t>(rect.x),
+                                       static_cast<uint32_t>(rect.y), rect.width, rect.height);
+                pixels += static_cast<uint64_t>(rect.width) * rect.height;
+            }
+            result.dirty_psnr += psnr(sse, pixels);
+            result.dirty_frames++;
+        }
+        result.frames++;
+        prev.swap(curr);
+    }
+    return result.frames != 0;
+}
+
+void printResult(const char* name, const RunResult& result) {
+    const double seconds = result.frames * kFrameIntervalUS / 1'000'000.0;
+    printf("%-8s frames:%u bitrate:%.0fkbps psnr_y:%.2f dirty_psnr_y:%.2f ssim_y:%.4f\n", name,
+           result.frames, result.bytes * 8 / 1024.0 / seconds, result.psnr / result.frames,
+           result.dirty_frames ? result.dirty_psnr / result.dirty_frames : 0.,
+           result.ssim / result.frames);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        printf("Usage: %s <file.bgra> <width> <height> [bitrate_kbps] [h264|h265]\n", argv[0]);
+        return 1;
+    }
+    const std::string path = argv[1];
+    const uint32_t width = static_cast<uint32_t>(atoi(argv[2]));
+    const uint32_t height = static_cast<uint32_t>(atoi(argv[3]));
+    const uint32_t bitrate_kbps = argc > 4 ? static_cast<uint32_t>(atoi(argv[4])) : 8000;
+    const bool hevc = argc > 5 && std::string{argv[5]} == "h265";
+    if (width == 0 || height == 0 || width % 2 != 0 || height % 2 != 0) {
+        printf("Invalid resolution %ux%u\n", width, height);
+        return 1;
+    }
+
+    // 编码器每5秒的统计日志会打乱输出，这里不需要
+    auto worker = g3::LogWorker::createLogWorker();
+    worker->addSink(std::make_unique<NullSink>(), &NullSink::receive);
+    g3::initializeLogging(worker.get());
+
+    RunResult without_roi;
+    RunResult with_roi;
+    if (!runOnce(path, width, height, bitrate_kbps, hevc, false, without_roi) ||
+        !runOnce(path, width, height, bitrate_kbps, hevc, true, with_roi)) {
+        return 1;
+    }
+    printf("%s %ux%u target:%ukbps\n", hevc ? "h265" : "h264", width, height, bitrate_kbps);
+    printResult("no-roi", without_roi);
+    printResult("roi", with_roi);
+    return 0;
+}
@@ -0,0 +1,465 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// ffmpeg头文件的警告
+#include <ltlib/pragma_warning.h>
+WARNING_DISABLE(4244)
+#include "software_encoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/opt.h>
+} // extern "C"
+
+#include <ltlib/color_convert.h>
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+WARNING_ENABLE(4244)
+
+namespace {
+
+constexpr uint32_t kMaxEncodeThreads = 8;
+constexpr int64_t kStatIntervalUS = 5'000'000;
+// 变化区域(打字、拖窗口)降QP，静止背景升QP. x264/x265把qoffset乘以约25换算成QP差值
+constexpr AVRational kDirtyQOffset = {-1, 5};
+constexpr AVRational kStaticQOffset = {1, 10};
+constexpr size_t kMaxRegionsOfInterest = 64;
+// 变化面积超过一半(视频、游戏)时ROI没有意义
+constexpr uint64_t kMaxDirtyAreaPercent = 50;
+
+const char* toX26xPreset(lt::VideoEncodeParamsHelper::Preset preset) {
+    switch (preset) {
+    case lt::VideoEncodeParamsHelper::Preset::Quality:
+        return "faster";
+    case lt::VideoEncodeParamsHelper::Preset::Balanced:
+        return "veryfast";
+    case lt::VideoEncodeParamsHelper::Preset::Speed:
+    default:
+        return "superfast";
+    }
+}
+
+} // namespace
+
+namespace lt {
+
+class SoftwareEncoderImpl {
+public:
+    SoftwareEncoderImpl(uint32_t width, uint32_t height, bool report_psnr);
+    ~SoftwareEncoderImpl();
+    bool init(const VideoEncodeParamsHelper& params);
+    void reconfigure(const VideoEncoder::ReconfigureParams& params);
+    std::shared_ptr<ltproto::client2worker::VideoFrame>
+    encodeOneFrame(const VideoCapturer::Frame& input_frame, bool request_iframe,
+                   bool request_refresh);
+    bool supportIntraRefresh() const { return intra_refresh_period_ != 0; }
+
+private:
+    bool openCodec();
+    void closeCodec();
+    void setRateControl();
+    void setRegionsOfInterest(const std::vector<VideoCapturer::DirtyRect>& rects);
+    void updateStats(int64_t encode_time_us, const AVPacket* packet);
+
+private:
+    const uint32_t width_;
+    const uint32_t height_;
+    const bool report_psnr_;
+    lt::VideoCodecType codec_type_ = lt::VideoCodecType::H264;
+    VideoEncodeParamsHelper::Preset preset_ = VideoEncodeParamsHelper::Preset::Speed;
+    uint32_t bitrate_bps_ = 0;
+    int fps_ = 60;
+    uint32_t intra_refresh_period_ = 0;
+    const AVCodec* codec_ = nullptr;
+    // 只有libx264会在编码时检查码率变化，其它的要重新打开编码器
+    bool live_reconfigure_ = false;
+    AVCodecContext* ctx_ = nullptr;
+    AVFrame* frame_ = nullptr;
+    AVPacket* packet_ = nullptr;
+    int64_t pts_ = 0;
+    int64_t stat_start_us_ = 0;
+    int64_t stat_encode_us_ = 0;
+    uint64_t stat_bytes_ = 0;
+    uint32_t stat_frames_ = 0;
+    uint32_t stat_roi_frames_ = 0;
+    uint32_t stat_refresh_requests_ = 0;
+    double stat_psnr_ = 0.;
+    bool roi_applied_ = false;
+};
+
+SoftwareEncoderImpl::SoftwareEncoderImpl(uint32_t width, uint32_t height, bool report_psnr)
+    : width_{width}
+    , height_{height}
+    , report_psnr_{report_psnr} {}
+
+SoftwareEncoderImpl::~SoftwareEncoderImpl() {
+    closeCodec();
+}
+
+bool SoftwareEncoderImpl::init(const VideoEncodeParamsHelper& params) {
+    if (width_ % 2 != 0 || height_ % 2 != 0) {
+        LOGF(ERR, "SoftwareEncoder doesn't support odd resolution %ux%u", width_, height_);
+        return false;
+    }
+    codec_type_ = params.codec();
+    preset_ = params.preset();
+    bitrate_bps_ = params.bitrate();
+    fps_ = params.fps();
+    intra_refresh_period_ = params.intra_refresh_period();
+    if (codec_type_ == lt::VideoCodecType::H264) {
+        codec_ = avcodec_find_encoder_by_name("libx264");
+        if (codec_ == nullptr) {
+            codec_ = avcodec_find_encoder_by_name("libopenh264");
+        }
+    }
+    else {
+        codec_ = avcodec_find_encoder_by_name("libx265");
+    }
+    if (codec_ == nullptr) {
+        LOGF(INFO, "No software encoder for codec %d", static_cast<int>(codec_type_));
+        return false;
+    }
+    live_reconfigure_ = std::string{codec_->name} == "libx264";
+    return openCodec();
+}
+
+bool SoftwareEncoderImpl::openCodec() {
+    ctx_ = avcodec_alloc_context3(codec_);
+    if (ctx_ == nullptr) {
+        LOG(ERR) << "avcodec_alloc_context3 failed";
+        return false;
+    }
+    ctx_->width = static_cast<int>(width_);
+    ctx_->height = static_cast<int>(height_);
+    ctx_->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx_->time_base = AVRational{1, fps_};
+    ctx_->framerate = AVRational{fps_, 1};
+    ctx_->max_b_frames = 0;
+    ctx_->thread_type = FF_THREAD_SLICE;
+    ctx_->thread_count =
+        static_cast<int>(std::clamp(std::thread::hardware_concurrency(), 1u, kMaxEncodeThreads));
+    // 不设gop，只在请求时出关键帧，和硬件编码器保持一致
+    ctx_->gop_size = std::numeric_limits<int>::max();
+    if (report_psnr_) {
+        ctx_->flags |= AV_CODEC_FLAG_PSNR;
+    }
+    setRateControl();
+    if (std::string{codec_->name} == "libx264") {
+        av_opt_set(ctx_->priv_data, "preset", toX26xPreset(preset_), 0);
+        av_opt_set(ctx_->priv_data, "tune", "zerolatency", 0);
+        av_opt_set(ctx_->priv_data, "forced-idr", "1", 0);
+        if (intra_refresh_period_ != 0) {
+            // 周期性的帧内刷新波代替IDR，keyint就是刷新一遍整帧所用的帧数
+            std::string x264_params =
+                "keyint=" + std::to_string(intra_refresh_period_) + ":sliced-threads=1";
+            av_opt_set(ctx_->priv_data, "x264-params", x264_params.c_str(), 0);
+            av_opt_set(ctx_->priv_data, "intra-refresh", "1", 0);
+        }
+        else {
+            av_opt_set(ctx_->priv_data, "x264-params", "keyint=infinite:sliced-threads=1", 0);
+        }
+    }
+    else if (std::string{codec_->name} == "libx265") {
+        av_opt_set(ctx_->priv_data, "preset", toX26xPreset(preset_), 0);
+        av_opt_set(ctx_->priv_data, "tune", "zerolatency", 0);
+        av_opt_set(ctx_->priv_data, "forced-idr", "1", 0);
+        if (intra_refresh_period_ != 0) {
+            std::string x265_params = "keyint=" + std::to_string(intra_refresh_period_) +
+                                      ":intra-refresh=1:log-level=error";
+            av_opt_set(ctx_->priv_data, "x265-params", x265_params.c_str(), 0);
+        }
+        else {
+            av_opt_set(ctx_->priv_data, "x265-params", "keyint=-1:log-level=error", 0);
+        }
+    }
+    else {
+        // libopenh264
+        if (intra_refresh_period_ != 0) {
+            LOG(WARNING) << "libopenh264 doesn't support intra refresh, fallback to IDR";
+            intra_refresh_period_ = 0;
+        }
+        av_opt_set(ctx_->priv_data, "allow_skip_frames", "0", 0);
+    }
+    int ret = avcodec_open2(ctx_, codec_, nullptr);
+    if (ret < 0) {
+        LOGF(ERR, "avcodec_open2(%s) failed with %d", codec_->name, ret);
+        closeCodec();
+        return false;
+    }
+    frame_ = av_frame_alloc();
+    packet_ = av_packet_alloc();
+    if (frame_ == nullptr || packet_ == nullptr) {
+        LOG(ERR) << "Alloc AVFrame/AVPacket failed";
+        closeCodec();
+        return false;
+    }
+    frame_->format = AV_PIX_FMT_YUV420P;
+    frame_->width = ctx_->width;
+    frame_->height = ctx_->height;
+    ret = av_frame_get_buffer(frame_, 0);
+    if (ret < 0) {
+        LOGF(ERR, "av_frame_get_buffer failed with %d", ret);
+        closeCodec();
+        return false;
+    }
+    LOGF(INFO, "SoftwareEncoder(%s) opened %ux%u@%d, bitrate:%u, threads:%d, intra_refresh:%u",
+         codec_->name, width_, height_, fps_, bitrate_bps_, ctx_->thread_count,
+         intra_refresh_period_);
+    return true;
+}
+
+void SoftwareEncoderImpl::closeCodec() {
+    if (packet_ != nullptr) {
+        av_packet_free(&packet_);
+    }
+    if (frame_ != nullptr) {
+        av_frame_free(&frame_);
+    }
+    if (ctx_ != nullptr) {
+        avcodec_free_context(&ctx_);
+    }
+}
+
+void SoftwareEncoderImpl::setRateControl() {
+    // 受VBV约束的CBR，VBV大小和硬件编码器一样来自VideoEncodeParamsHelper
+    VideoEncodeParamsHelper helper{codec_type_, width_, height_, fps_, bitrate_bps_ / 1024, true};
+    ctx_->bit_rate = helper.bitrate();
+    ctx_->rc_min_rate = helper.bitrate();
+    ctx_->rc_max_rate = helper.bitrate();
+    ctx_->rc_buffer_size = helper.vbvbufsize().value_or(static_cast<int>(helper.bitrate() / fps_));
+    ctx_->rc_initial_buffer_occupancy = helper.vbvinit().value_or(ctx_->rc_buffer_size);
+}
+
+void SoftwareEncoderImpl::reconfigure(const VideoEncoder::ReconfigureParams& params) {
+    bool reopen = false;
+    if (params.bitrate_bps.has_value() && params.bitrate_bps.value() != bitrate_bps_) {
+        bitrate_bps_ = params.bitrate_bps.value();
+        reopen = !live_reconfigure_;
+    }
+    if (params.fps.has_value() && static_cast<int>(params.fps.value()) != fps_) {
+        fps_ = static_cast<int>(params.fps.value());
+        reopen = true;
+    }
+    if (ctx_ == nullptr) {
+        return;
+    }
+    if (!reopen) {
+        // libx264每帧都会比较这几个值，变了就调用x264_encoder_reconfig
+        setRateControl();
+        return;
+    }
+    closeCodec();
+    if (!openCodec()) {
+        LOG(ERR) << "Reopen SoftwareEncoder failed";
+    }
+}
+
+std::shared_ptr<ltproto::client2worker::VideoFrame>
+SoftwareEncoderImpl::encodeOneFrame(const VideoCapturer::Frame& input_frame, bool request_iframe,
+                                    bool request_refresh) {
+    if (ctx_ == nullptr) {
+        return nullptr;
+    }
+    if (input_frame.stride == 0 || input_frame.width != width_ ||
+        input_frame.height != height_) {
+        LOGF(ERR, "SoftwareEncoder needs %ux%u system memory frame, got %ux%u stride:%u", width_,
+             height_, input_frame.width, input_frame.height, input_frame.stride);
+        return nullptr;
+    }
+    const int64_t start_us = ltlib::steady_now_us();
+    int ret = av_frame_make_writable(frame_);
+    if (ret < 0) {
+        LOGF(ERR, "av_frame_make_writable failed with %d", ret);
+        return nullptr;
+    }
+    ltlib::bgraToI420(reinterpret_cast<const uint8_t*>(input_frame.data),
+                      static_cast<int>(input_frame.stride), frame_->data[0], frame_->linesize[0],
+                      frame_->data[1], frame_->linesize[1], frame_->data[2], frame_->linesize[2],
+                      static_cast<int>(width_), static_cast<int>(height_));
+    frame_->pts = pts_++;
+    // 只有必须从头解码的请求才出IDR. 丢包恢复不用做什么: x264/x265的刷新波一直首尾相接地滚动，
+    // ffmpeg又没有暴露x264_encoder_intra_refresh()，受损区域最多两个刷新周期后就被刷掉了
+    if (request_refresh && !request_iframe) {
+        stat_refresh_requests_++;
+    }
+    frame_->pict_type = request_iframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    // 关键帧要整帧清晰，不做ROI
+    setRegionsOfInterest(request_iframe ? std::vector<VideoCapturer::DirtyRect>{}
+                                        : input_frame.dirty_rects);
+    ret = avcodec_send_frame(ctx_, frame_);
+    if (ret < 0) {
+        LOGF(ERR, "avcodec_send_frame failed with %d", ret);
+        return nullptr;
+    }
+    ret = avcodec_receive_packet(ctx_, packet_);
+    if (ret == AVERROR(EAGAIN)) {
+        // zerolatency下不应该出现
+        LOG(WARNING) << "SoftwareEncoder delayed one frame";
+        return nullptr;
+    }
+    if (ret < 0) {
+        LOGF(ERR, "avcodec_receive_packet failed with %d", ret);
+        return nullptr;
+    }
+    auto out_frame = std::make_shared<ltproto::client2worker::VideoFrame>();
+    out_frame->set_frame(packet_->data, static_cast<size_t>(packet_->size));
+    out_frame->set_is_keyframe((packet_->flags & AV_PKT_FLAG_KEY) != 0);
+    updateStats(ltlib::steady_now_us() - start_us, packet_);
+    av_packet_unref(packet_);
+    return out_frame;
+}
+
+void SoftwareEncoderImpl::setRegionsOfInterest(const std::vector<VideoCapturer::DirtyRect>& rects) {
+    av_frame_remove_side_data(frame_, AV_FRAME_DATA_REGIONS_OF_INTEREST);
+    roi_applied_ = false;
+    // 空表示整帧都变了
+    if (rects.empty() || rects.size() > kMaxRegionsOfInterest) {
+        return;
+    }
+    uint64_t dirty_area = 0;
+    for (const auto& rect : rects) {
+        dirty_area += static_cast<uint64_t>(rect.width) * rect.height;
+    }
+    if (dirty_area * 100 > static_cast<uint64_t>(width_) * height_ * kMaxDirtyAreaPercent) {
+        return;
+    }
+    // 重叠时排在前面的优先，所以变化区域在前，整帧背景放最后
+    const size_t count = rects.size() + 1;
+    AVFrameSideData* side_data = av_frame_new_side_data(
+        frame_, AV_FRAME_DATA_REGIONS_OF_INTEREST, count * sizeof(AVRegionOfInterest));
+    if (side_data == nullptr) {
+        return;
+    }
+    auto rois = reinterpret_cast<AVRegionOfInterest*>(side_data->data);
+    for (size_t i = 0; i < rects.size(); i++) {
+        rois[i].self_size = sizeof(AVRegionOfInterest);
+        rois[i].left = std::clamp(rects[i].x, 0, static_cast<int>(width_));
+        rois[i].top = std::clamp(rects[i].y, 0, static_cast<int>(height_));
+        rois[i].right = std::clamp(rects[i].x + static_cast<int>(rects[i].width), 0,
+                                   static_cast<int>(width_));
+        rois[i].bottom = std::clamp(rects[i].y + static_cast<int>(rects[i].height), 0,
+                                    static_cast<int>(height_));
+        rois[i].qoffset = kDirtyQOffset;
+    }
+    AVRegionOfInterest& background = rois[rects.size()];
+    background.self_size = sizeof(AVRegionOfInterest);
+    background.left = 0;
+    background.top = 0;
+    background.right = static_cast<int>(width_);
+    background.bottom = static_cast<int>(height_);
+    background.qoffset = kStaticQOffset;
+    roi_applied_ = true;
+}
+
+void SoftwareEncoderImpl::updateStats(int64_t encode_time_us, const AVPacket* packet) {
+    const int64_t now_us = ltlib::steady_now_us();
+    if (stat_start_us_ == 0) {
+        stat_start_us_ = now_us;
+    }
+    stat_encode_us_ += encode_time_us;
+    stat_bytes_ += static_cast<uint64_t>(packet->size);
+    stat_frames_ += 1;
+    stat_roi_frames_ += roi_applied_ ? 1 : 0;
+    size_t stats_size = 0;
+    const uint8_t* stats = av_packet_get_side_data(packet, AV_PKT_DATA_QUALITY_STATS, &stats_size);
+    // 格式: quality(u32) pict_type(u8) error_count(u8) reserved(u16) error[error_count](i64)
+    if (stats != nullptr && stats_size >= 16 && stats[5] > 0) {
+        int64_t sse_y = 0;
+        memcpy(&sse_y, stats + 8, sizeof(sse_y));
+        const double pixels = static_cast<double>(width_) * height_;
+        stat_psnr_ += sse_y == 0 ? 100. : 10. * std::log10(255. * 255. * pixels / sse_y);
+    }
+    const int64_t duration_us = now_us - stat_start_us_;
+    if (duration_us < kStatIntervalUS) {
+        return;
+    }
+    // 实际码率按帧数和目标帧率折算，不受采集帧率波动影响
+    const double actual_bps = stat_bytes_ * 8.0 * fps_ / stat_frames_;
+    if (report_psnr_) {
+        LOGF(INFO,
+             "SoftwareEncoder %.2fms/frame, bitrate %.0f/%u (%.1f%%), roi %u/%u, refresh %u, "
+             "psnr_y %.2f",
+             stat_encode_us_ / 1000.0 / stat_frames_, actual_bps, bitrate_bps_,
+             actual_bps * 100.0 / bitrate_bps_, stat_roi_frames_, stat_frames_,
+             stat_refresh_requests_, stat_psnr_ / stat_frames_);
+    }
+    else {
+        LOGF(INFO, "SoftwareEncoder %.2fms/frame, bitrate %.0f/%u (%.1f%%), roi %u/%u, refresh %u",
+             stat_encode_us_ / 1000.0 / stat_frames_, actual_bps, bitrate_bps_,
+             actual_bps * 100.0 / bitrate_bps_, stat_roi_frames_, stat_frames_,
+             stat_refresh_requests_);
+    }
+    stat_start_us_ = now_us;
+    stat_encode_us_ = 0;
+    stat_bytes_ = 0;
+    stat_frames_ = 0;
+    stat_roi_frames_ = 0;
+    stat_refresh_requests_ = 0;
+    stat_psnr_ = 0.;
+}
+
+SoftwareEncoder::SoftwareEncoder(uint32_t width, uint32_t height, bool report_psnr)
+    : VideoEncoder{nullptr, nullptr, width, height}
+    , impl_{std::make_shared<SoftwareEncoderImpl>(width, height, report_psnr)} {}
+
+SoftwareEncoder::~SoftwareEncoder() {}
+
+bool SoftwareEncoder::init(const VideoEncodeParamsHelper& params) {
+    return impl_->init(params);
+}
+
+void SoftwareEncoder::reconfigure(const ReconfigureParams& params) {
+    impl_->reconfigure(params);
+}
+
+std::shared_ptr<ltproto::client2worker::VideoFrame> SoftwareEncoder::encodeFrame(void*) {
+    LOG(ERR) << "SoftwareEncoder only accepts system memory frames";
+    return nullptr;
+}
+
+std::shared_ptr<ltproto::client2worker::VideoFrame>
+SoftwareEncoder::encodeFrame(const VideoCapturer::Frame& input_frame) {
+    return impl_->encodeOneFrame(input_frame, needKeyframe(), needRefresh());
+}
+
+bool SoftwareEncoder::supportIntraRefresh() const {
+    return impl_->supportIntraRefresh();
+}
+
+} // namespace lt
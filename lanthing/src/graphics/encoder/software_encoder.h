@@ -0,0 +1,61 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <memory>
+
+#include "params_helper.h"
+#include <graphics/encoder/video_encoder.h>
+
+namespace lt {
+
+// 没有可用GPU时的兜底，基于ffmpeg的libx264/libx265/libopenh264，只接受内存里的BGRX帧.
+// ffmpeg没有暴露x264_encoder_invalidate_reference()这类接口，做不了长期参考帧恢复，
+// requestRecovery()退化为requestRefresh()
+class SoftwareEncoderImpl;
+class SoftwareEncoder : public VideoEncoder {
+public:
+    // report_psnr打开后统计编码器自己算的Y分量PSNR，做画质/码率对比时用，有额外开销
+    SoftwareEncoder(uint32_t width, uint32_t height, bool report_psnr);
+    ~SoftwareEncoder() override;
+
+    bool init(const VideoEncodeParamsHelper& params);
+    void reconfigure(const ReconfigureParams& params) override;
+    std::shared_ptr<ltproto::client2worker::VideoFrame> encodeFrame(void* input_frame) override;
+    std::shared_ptr<ltproto::client2worker::VideoFrame>
+    encodeFrame(const VideoCapturer::Frame& input_frame) override;
+    bool supportIntraRefresh() const override;
+
+private:
+    std::shared_ptr<SoftwareEncoderImpl> impl_;
+};
+
+} // namespace lt
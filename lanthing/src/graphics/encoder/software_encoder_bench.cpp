@@ -0,0 +1,242 @@
+// SoftwareEncoder编码耗时和码率基准. 不需要采集，合成一段类似桌面的画面: 静态的渐变背景，
+// 一个来回拖动的窗口，一块不停滚动的"文字"区域，带上和DXGI一样的变化区域:
+//   bench_software_encoder [width] [height] [frames] [bitrate_kbps] [h264|h265] [intra_refresh]
+//                          [loss_interval] [idr|refresh]
+// 默认1920 1080 600 8000 h264 0 0 refresh. 输出每帧编码耗时分布、实际码率、峰值/平均帧大小.
+// 编码器自己每5秒打印的统计(含PSNR)也会输出到stdout.
+// loss_interval非0时模拟每隔这么多帧丢一次包，按idr(requestKeyframe)或refresh(requestRefresh)
+// 请求恢复. 链路按目标码率匀速发送，恢复时间是从请求到最后一个恢复帧发完，IDR就是那一帧本身，
+// 刷新波是请求之后开始的那一轮(x264的刷新波从第0帧起每intra_refresh帧开始一轮)的最后一帧.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <g3log/logworker.hpp>
+
+#include <graphics/encoder/video_encoder.h>
+#include <ltlib/times.h>
+
+namespace {
+
+constexpr int64_t kFrameIntervalUS = 16'667;
+constexpr uint32_t kWindowSize = 320;
+constexpr uint32_t kTextHeight = 240;
+
+struct StdoutSink {
+    void receive(g3::LogMessageMover message) { printf("%s", message.get().toString().c_str()); }
+};
+
+class DesktopGenerator {
+public:
+    DesktopGenerator(uint32_t width, uint32_t height)
+        : width_{width}
+        , height_{height}
+        , pixels_(static_cast<size_t>(width) * height * 4) {}
+
+    lt::VideoCapturer::Frame next(uint32_t index) {
+        lt::VideoCapturer::Frame frame{};
+        frame.data = pixels_.data();
+        frame.capture_timestamp_us = index * kFrameIntervalUS;
+        frame.width = width_;
+        frame.height = height_;
+        frame.stride = width_ * 4;
+        if (index == 0) {
+            drawBackground(0, 0, width_, height_);
+            return frame;
+        }
+        // 窗口水平来回移动，旧位置露出背景，新位置画窗口，两块都算变化区域
+        const uint32_t range = width_ - kWindowSize;
+        const uint32_t old_x = position(index - 1, range);
+        const uint32_t new_x = position(index, range);
+        const uint32_t window_y = height_ / 4;
+        drawBackground(old_x, window_y, kWindowSize, kWindowSize);
+        drawWindow(new_x, window_y);
+        const uint32_t dirty_x = std::min(old_x, new_x);
+        const uint32_t dirty_w = std::max(old_x, new_x) + kWindowSize - dirty_x;
+        frame.dirty_rects.push_back({static_cast<int32_t>(dirty_x),
+                                     static_cast<int32_t>(window_y), dirty_w, kWindowSize});
+        // 底部一块像终端输出一样每帧滚一行
+        const uint32_t text_y = height_ - kTextHeight;
+        drawText(text_y, index);
+        frame.dirty_rects.push_back({0, static_cast<int32_t>(text_y), width_ / 2, kTextHeight});
+        return frame;
+    }
+
+private:
+    uint32_t position(uint32_t index, uint32_t range) const {
+        const uint32_t x = (index * 8) % (range * 2);
+        return x < range ? x : range * 2 - x;
+    }
+    uint8_t* pixel(uint32_t x, uint32_t y) { return pixels_.data() + (y * width_ + x) * 4; }
+    void drawBackground(uint32_t x0, uint32_t y0, uint32_t w, uint32_t h) {
+        for (uint32_t y = y0; y < y0 + h; y++) {
+            for (uint32_t x = x0; x < x0 + w; x++) {
+                uint8_t* p = pixel(x, y);
+                p[0] = static_cast<uint8_t>(x * 255 / width_);
+                p[1] = static_cast<uint8_t>(y * 255 / height_);
+                p[2] = 96;
+                p[3] = 255;
+            }
+        }
+    }
+    void drawWindow(uint32_t x0, uint32_t y0) {
+        for (uint32_t y = y0; y < y0 + kWindowSize; y++) {
+            for (uint32_t x = x0; x < x0 + kWindowSize; x++) {
+                uint8_t* p = pixel(x, y);
+                const bool title = y - y0 < 24;
+                const bool grid = ((x - x0) / 16 + (y - y0) / 16) % 2 == 0;
+                p[0] = title ? 200 : (grid ? 240 : 180);
+                p[1] = title ? 120 : (grid ? 240 : 180);
+                p[2] = title ? 40 : (grid ? 240 : 180);
+                p[3] = 255;
+            }
+        }
+    }
+    void drawText(uint32_t y0, uint32_t index) {
+        // 8x12的"字符"，亮暗由伪随机决定，整块每帧上移一行
+        for (uint32_t y = y0; y < y0 + kTextHeight; y++) {
+            const uint32_t line = (y - y0 + index) / 12;
+            for (uint32_t x = 0; x < width_ / 2; x++) {
+                const uint32_t glyph = (line * 131 + x / 8) * 2654435761u;
+                const bool on = ((glyph >> ((y % 12) + (x % 8))) & 1) != 0 && x % 8 != 7;
+                uint8_t* p = pixel(x, y);
+                p[0] = p[1] = p[2] = on ? 220 : 30;
+                p[3] = 255;
+            }
+        }
+    }
+
+private:
+    const uint32_t width_;
+    const uint32_t height_;
+    std::vector<uint8_t> pixels_;
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const uint32_t width = argc > 1 ? static_cast<uint32_t>(atoi(argv[1])) : 1920;
+    const uint32_t height = argc > 2 ? static_cast<uint32_t>(atoi(argv[2])) : 1080;
+    const uint32_t frames = argc > 3 ? static_cast<uint32_t>(atoi(argv[3])) : 600;
+    const uint32_t bitrate_kbps = argc > 4 ? static_cast<uint32_t>(atoi(argv[4])) : 8000;
+    const bool hevc = argc > 5 && std::string{argv[5]} == "h265";
+    const uint32_t intra_refresh = argc > 6 ? static_cast<uint32_t>(atoi(argv[6])) : 0;
+    const uint32_t loss_interval = argc > 7 ? static_cast<uint32_t>(atoi(argv[7])) : 0;
+    // 没开帧内刷新时requestRefresh()也会退化成IDR
+    const bool loss_idr = (argc > 8 && std::string{argv[8]} == "idr") || intra_refresh == 0;
+    if (width < kWindowSize * 2 || height < kWindowSize * 2 || frames == 0) {
+        printf("Invalid arguments\n");
+        return 1;
+    }
+
+    auto worker = g3::LogWorker::createLogWorker();
+    worker->addSink(std::make_unique<StdoutSink>(), &StdoutSink::receive);
+    g3::initializeLogging(worker.get());
+
+    lt::VideoEncoder::InitParams params{};
+    params.software = true;
+    params.codec_type = hevc ? lt::VideoCodecType::H265 : lt::VideoCodecType::H264;
+    params.width = width;
+    params.height = height;
+    params.bitrate_bps = bitrate_kbps * 1024;
+    params.intra_refresh_period = intra_refresh;
+    params.report_psnr = true;
+    auto encoder = lt::VideoEncoder::create(params);
+    if (encoder == nullptr) {
+        printf("Create software encoder failed\n");
+        return 1;
+    }
+
+    DesktopGenerator generator{width, height};
+    std::vector<int64_t> costs;
+    std::vector<size_t> sizes;
+    std::vector<uint32_t> loss_frames;
+    size_t keyframe_bytes = 0;
+    uint32_t keyframes = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        auto frame = generator.next(i);
+        if (loss_interval != 0 && i != 0 && i % loss_interval == 0) {
+            if (loss_idr) {
+                encoder->requestKeyframe();
+            }
+            else {
+                encoder->requestRefresh();
+            }
+            loss_frames.push_back(i);
+        }
+        const int64_t start = ltlib::steady_now_us();
+        auto encoded = encoder->encode(frame);
+        costs.push_back(ltlib::steady_now_us() - start);
+        if (encoded == nullptr) {
+            printf("Encode frame %u failed\n", i);
+            return 1;
+        }
+        sizes.push_back(encoded->frame().size());
+        if (encoded->is_keyframe()) {
+            keyframes++;
+            keyframe_bytes += encoded->frame().size();
+        }
+    }
+    encoder.reset();
+
+    int64_t total_cost = 0;
+    size_t total_bytes = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        total_cost += costs[i];
+        total_bytes += sizes[i];
+    }
+    // 第一帧一定是IDR，不算进峰值
+    const size_t max_size =
+        frames > 1 ? *std::max_element(sizes.begin() + 1, sizes.end()) : sizes.front();
+    std::sort(costs.begin(), costs.end());
+    const double avg_size = static_cast<double>(total_bytes) / frames;
+    const double seconds = frames * kFrameIntervalUS / 1'000'000.0;
+    printf("%s %ux%u frames:%u target:%ukbps actual:%.0fkbps\n", hevc ? "h265" : "h264", width,
+           height, frames, bitrate_kbps, total_bytes * 8 / 1024.0 / seconds);
+    printf("encode avg:%lldus p50:%lldus p99:%lldus max:%lldus (%.0f fps)\n",
+           static_cast<long long>(total_cost / frames),
+           static_cast<long long>(costs[costs.size() / 2]),
+           static_cast<long long>(costs[costs.size() * 99 / 100]),
+           static_cast<long long>(costs.back()), frames * 1'000'000.0 / total_cost);
+    printf("frame bytes avg:%.0f peak:%zu (%.1fx) keyframes:%u avg_keyframe:%zu\n", avg_size,
+           max_size, max_size / avg_size, keyframes, keyframes ? keyframe_bytes / keyframes : 0);
+    if (loss_frames.empty()) {
+        return 0;
+    }
+    // 按目标码率匀速发送，每一帧采集完才能开始发
+    std::vector<int64_t> sent_us(frames);
+    const double us_per_byte = 8'000'000.0 / (bitrate_kbps * 1024);
+    for (uint32_t i = 0; i < frames; i++) {
+        const int64_t start = std::max(i == 0 ? 0 : sent_us[i - 1], i * kFrameIntervalUS);
+        sent_us[i] = start + static_cast<int64_t>(sizes[i] * us_per_byte);
+    }
+    std::vector<int64_t> recovery_us;
+    for (uint32_t loss : loss_frames) {
+        uint32_t last = loss;
+        if (!loss_idr) {
+            const uint32_t wave_start = (loss + intra_refresh - 1) / intra_refresh * intra_refresh;
+            last = wave_start + intra_refresh - 1;
+        }
+        if (last < frames) {
+            recovery_us.push_back(sent_us[last] - loss * kFrameIntervalUS);
+        }
+    }
+    if (recovery_us.empty()) {
+        printf("Not enough frames to finish a recovery\n");
+        return 0;
+    }
+    int64_t total_recovery = 0;
+    for (int64_t us : recovery_us) {
+        total_recovery += us;
+    }
+    printf("%s recovery x%zu avg:%.1fms max:%.1fms\n", loss_idr ? "idr" : "refresh",
+           recovery_us.size(), total_recovery / 1000.0 / recovery_us.size(),
+           *std::max_element(recovery_us.begin(), recovery_us.end()) / 1000.0);
+    return 0;
+}
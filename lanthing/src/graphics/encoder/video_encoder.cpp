@@ -41,6 +41,7 @@
 #include "intel_encoder.h"
 #include "nvidia_encoder.h"
 #include "params_helper.h"
+#include "software_encoder.h"
 #include "video_encoder.h"
 
 // TODO: 由于之前用的是“Service和Worker之间共享Texture Shared
@@ -154,11 +155,37 @@ auto create_d3d11(std::optional<int64_t> luid)
     }
 }
 
+std::unique_ptr<lt::VideoEncoder>
+doCreateSoftwareEncoder(const lt::VideoEncoder::InitParams& params,
+                        const lt::VideoEncodeParamsHelper& helper) {
+    using namespace lt;
+    auto encoder =
+        std::make_unique<SoftwareEncoder>(params.width, params.height, params.report_psnr);
+    if (encoder->init(helper)) {
+        LOG(INFO) << "SoftwareEncoder created";
+        return encoder;
+    }
+    else {
+        LOGF(INFO, "Create SoftwareEncoder(w:%u,h:%u,c:%d) failed", params.width, params.height,
+             params.codec_type);
+        return nullptr;
+    }
+}
+
 std::unique_ptr<lt::VideoEncoder> doCreateEncoder(const lt::VideoEncoder::InitParams& params,
                                                   void* d3d11_dev, void* d3d11_ctx) {
     using namespace lt;
-    VideoEncodeParamsHelper params_helper{
-        params.codec_type, params.width, params.height, 60, params.bitrate_bps / 1024, true};
+    VideoEncodeParamsHelper params_helper{params.codec_type,
+                                          params.width,
+                                          params.height,
+                                          60,
+                                          params.bitrate_bps / 1024,
+                                          true,
+                                          params.intra_refresh_period};
+    if (params.software || d3d11_dev == nullptr || d3d11_ctx == nullptr) {
+        // 指定了软件编码，或者采集器没有D3D11设备(帧在内存里)
+        return doCreateSoftwareEncoder(params, params_helper);
+    }
     switch (params.vendor_id) {
     case kNvidiaVendorID:
     {
@@ -203,6 +230,7 @@ std::unique_ptr<lt::VideoEncoder> doCreateEncoder(const lt::VideoEncoder::InitPa
         }
     }
     default:
+        // 采集到的是显存纹理，要退回软件编码得由调用方把帧读回内存，见VCEPipeline
         LOGF(WARNING, "Unsupport gpu vendor %#x", params.vendor_id);
         return nullptr;
     }
@@ -300,7 +328,11 @@ std::unique_ptr<VideoEncoder> VideoEncoder::create(const InitParams& params) {
     // if (device == nullptr || context == nullptr) {
     //     return nullptr;
     // }
-    return doCreateEncoder(params, params.device, params.context);
+    auto encoder = doCreateEncoder(params, params.device, params.context);
+    if (encoder != nullptr) {
+        encoder->frame_id_ = params.first_frame_id;
+    }
+    return encoder;
 }
 
 VideoEncoder::VideoEncoder(void* d3d11_dev, void* d3d11_ctx, uint32_t width, uint32_t height)
@@ -308,16 +340,24 @@ VideoEncoder::VideoEncoder(void* d3d11_dev, void* d3d11_ctx, uint32_t width, uin
     , d3d11_ctx_{d3d11_ctx}
     , width_{width}
     , height_{height} {
-    auto dev = reinterpret_cast<ID3D11Device*>(d3d11_dev_);
-    dev->AddRef();
-    auto ctx = reinterpret_cast<ID3D11DeviceContext*>(d3d11_ctx_);
-    ctx->AddRef();
+    if (d3d11_dev_) {
+        auto dev = reinterpret_cast<ID3D11Device*>(d3d11_dev_);
+        dev->AddRef();
+    }
+    if (d3d11_ctx_) {
+        auto ctx = reinterpret_cast<ID3D11DeviceContext*>(d3d11_ctx_);
+        ctx->AddRef();
+    }
 }
 
 bool VideoEncoder::needKeyframe() {
     return request_keyframe_.exchange(false);
 }
 
+bool VideoEncoder::needRefresh() {
+    return request_refresh_.exchange(false);
+}
+
 VideoEncoder::~VideoEncoder() {
     if (d3d11_dev_) {
         auto dev = reinterpret_cast<ID3D11Device*>(d3d11_dev_);
@@ -333,10 +373,34 @@ void VideoEncoder::requestKeyframe() {
     request_keyframe_ = true;
 }
 
+void VideoEncoder::requestRefresh() {
+    if (!supportIntraRefresh()) {
+        requestKeyframe();
+        return;
+    }
+    request_refresh_ = true;
+}
+
+void VideoEncoder::requestRecovery(uint64_t last_decoded_frame_id) {
+    if (!supportLTR()) {
+        requestRefresh();
+        return;
+    }
+    recovery_frame_id_ = static_cast<int64_t>(last_decoded_frame_id);
+}
+
+std::optional<uint64_t> VideoEncoder::needRecovery() {
+    int64_t frame_id = recovery_frame_id_.exchange(-1);
+    if (frame_id < 0) {
+        return std::nullopt;
+    }
+    return static_cast<uint64_t>(frame_id);
+}
+
 std::shared_ptr<ltproto::client2worker::VideoFrame>
 VideoEncoder::encode(const VideoCapturer::Frame& input_frame) {
     const int64_t start_encode = ltlib::steady_now_us();
-    auto encoded_frame = this->encodeFrame(input_frame.data);
+    auto encoded_frame = this->encodeFrame(input_frame);
     const int64_t end_encode = ltlib::steady_now_us();
     if (encoded_frame == nullptr) {
         return nullptr;
@@ -357,6 +421,11 @@ VideoEncoder::encode(const VideoCapturer::Frame& input_frame) {
     return encoded_frame;
 }
 
+std::shared_ptr<ltproto::client2worker::VideoFrame>
+VideoEncoder::encodeFrame(const VideoCapturer::Frame& input_frame) {
+    return this->encodeFrame(input_frame.data);
+}
+
 /*
 std::vector<VideoEncoder::Ability> VideoEncoder::checkEncodeAbilities(uint32_t width,
                                                                       uint32_t height) {
@@ -378,8 +447,8 @@ VideoEncoder::checkEncodeAbilitiesWithLuid(int64_t luid, uint32_t width, uint32_
 */
 
 bool VideoEncoder::InitParams::validate() const {
-    if (this->width == 0 || this->height == 0 || this->bitrate_bps == 0 ||
-        this->device == nullptr || this->context == nullptr) {
+    // device和context为空时走软件编码
+    if (this->width == 0 || this->height == 0 || this->bitrate_bps == 0) {
         return false;
     }
     if (codec_type != lt::VideoCodecType::H264 && codec_type != lt::VideoCodecType::H265) {
@@ -55,6 +55,14 @@ public:
         uint32_t width = 0;
         uint32_t height = 0;
         uint32_t bitrate_bps = 0;
+        // 非0时持续做周期为这么多帧的渐进帧内刷新，丢包恢复也靠刷新波，requestKeyframe()仍然出IDR
+        uint32_t intra_refresh_period = 0;
+        // 重建编码器(比如改分辨率)时延续之前的picture_id，客户端反馈的帧ID才不会对应到新编码器的帧
+        uint64_t first_frame_id = 0;
+        // 统计并打印PSNR，目前只有软件编码器支持
+        bool report_psnr = false;
+        // 使用软件编码器，此时encode()的输入必须是内存里的帧
+        bool software = false;
 
         bool validate() const;
     };
@@ -68,7 +76,14 @@ public:
     static std::unique_ptr<VideoEncoder> create(const InitParams& params);
     virtual ~VideoEncoder();
     virtual void reconfigure(const ReconfigureParams& params) = 0;
+    // 必须从头解码的情况(新观看者、改分辨率、静止刷新)，一定出IDR
     void requestKeyframe();
+    // 丢包引起的恢复请求. 开了帧内刷新的编码器用一轮刷新波恢复，没有IDR那样的帧大小尖峰，
+    // 其它的退化为请求关键帧
+    void requestRefresh();
+    // 客户端最后正确解码的是last_decoded_frame_id，支持长期参考帧的编码器从客户端确定持有的参考帧
+    // 恢复，其它的退化为requestRefresh(). 帧ID由客户端放在RequestKeyframe里，见keyframe_request.h
+    void requestRecovery(uint64_t last_decoded_frame_id);
     std::shared_ptr<ltproto::client2worker::VideoFrame>
     encode(const VideoCapturer::Frame& input_frame);
 
@@ -79,7 +94,17 @@ public:
 protected:
     VideoEncoder(void* d3d11_dev, void* d3d11_ctx, uint32_t width, uint32_t height);
     bool needKeyframe();
+    bool needRefresh();
+    virtual bool supportLTR() const { return false; }
+    virtual bool supportIntraRefresh() const { return false; }
+    // 返回客户端最后正确解码的帧ID，没有恢复请求时返回空
+    std::optional<uint64_t> needRecovery();
+    // 正在编码的这一帧编码成功后会得到的picture_id
+    uint64_t currentFrameID() const { return frame_id_; }
     virtual std::shared_ptr<ltproto::client2worker::VideoFrame> encodeFrame(void* input_frame) = 0;
+    // 需要宽高、stride等信息的编码器(软件编码)重载这个
+    virtual std::shared_ptr<ltproto::client2worker::VideoFrame>
+    encodeFrame(const VideoCapturer::Frame& input_frame);
 
 private:
     void* d3d11_dev_ = nullptr;
@@ -88,6 +113,8 @@ private:
     const uint32_t height_;
     uint64_t frame_id_ = 0;
     std::atomic<bool> request_keyframe_{false};
+    std::atomic<bool> request_refresh_{false};
+    std::atomic<int64_t> recovery_frame_id_{-1};
     bool first_frame_ = false;
 };
 
@@ -0,0 +1,115 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include <ltproto/client2worker/request_keyframe.pb.h>
+
+namespace lt {
+
+// RequestKeyframe在ltproto里还没有字段，先用未知字段带上额外信息. 字段号要和以后加进proto的
+// 保持一致，不认识的一端会原样忽略，等于普通的关键帧请求:
+//   1: uint64 last_decoded_frame_id 客户端解码失败前最后正确解码的帧ID，用于长期参考帧恢复
+//   2: bool   full_keyframe         必须从头解码(新观看者)，否则是丢包引起的恢复请求
+struct KeyframeRequestInfo {
+    std::optional<uint64_t> last_decoded_frame_id;
+    bool full_keyframe = false;
+};
+
+namespace keyframe_request_detail {
+constexpr int kLastDecodedFrameIDField = 1;
+constexpr int kFullKeyframeField = 2;
+} // namespace keyframe_request_detail
+
+inline void writeKeyframeRequestInfo(ltproto::client2worker::RequestKeyframe& msg,
+                                     const KeyframeRequestInfo& info) {
+    using google::protobuf::internal::WireFormatLite;
+    namespace detail = keyframe_request_detail;
+    // 生成的lite代码不一定有unknown_fields()访问器，借解析把字段塞进去
+    std::string fields;
+    {
+        google::protobuf::io::StringOutputStream stream{&fields};
+        google::protobuf::io::CodedOutputStream output{&stream};
+        if (info.last_decoded_frame_id.has_value()) {
+            output.WriteTag(WireFormatLite::MakeTag(detail::kLastDecodedFrameIDField,
+                                                    WireFormatLite::WIRETYPE_VARINT));
+            output.WriteVarint64(info.last_decoded_frame_id.value());
+        }
+        if (info.full_keyframe) {
+            output.WriteTag(WireFormatLite::MakeTag(detail::kFullKeyframeField,
+                                                    WireFormatLite::WIRETYPE_VARINT));
+            output.WriteVarint32(1);
+        }
+    }
+    msg.MergeFromString(fields);
+}
+
+inline KeyframeRequestInfo
+readKeyframeRequestInfo(const ltproto::client2worker::RequestKeyframe& msg) {
+    using google::protobuf::internal::WireFormatLite;
+    namespace detail = keyframe_request_detail;
+    KeyframeRequestInfo info;
+    const std::string fields = msg.SerializeAsString();
+    google::protobuf::io::CodedInputStream input{reinterpret_cast<const uint8_t*>(fields.data()),
+                                                 static_cast<int>(fields.size())};
+    while (uint32_t tag = input.ReadTag()) {
+        const int field = WireFormatLite::GetTagFieldNumber(tag);
+        const bool varint =
+            WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_VARINT;
+        if (field == detail::kLastDecodedFrameIDField && varint) {
+            uint64_t value = 0;
+            if (!input.ReadVarint64(&value)) {
+                break;
+            }
+            info.last_decoded_frame_id = value;
+        }
+        else if (field == detail::kFullKeyframeField && varint) {
+            uint32_t value = 0;
+            if (!input.ReadVarint32(&value)) {
+                break;
+            }
+            info.full_keyframe = value != 0;
+        }
+        else if (!WireFormatLite::SkipField(&input, tag)) {
+            break;
+        }
+    }
+    return info;
+}
+
+} // namespace lt
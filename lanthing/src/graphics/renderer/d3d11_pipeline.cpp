@@ -200,6 +200,13 @@ bool D3D11Pipeline::bindTextures(const std::vector<void*>& _textures) {
     return initShaderResources(textures);
 }
 
+bool D3D11Pipeline::setVideoSize(uint32_t width, uint32_t height) {
+    video_width_ = width;
+    video_height_ = height;
+    // 纹理坐标只裁掉对齐的部分，视口不变，小分辨率的画面由采样器放大
+    return setupVideoVertexBuffer();
+}
+
 VideoRenderer::RenderResult D3D11Pipeline::render(int64_t frame) {
     // 1. 检查是否需要重置渲染目标
     // 2. 设置渲染目标
@@ -566,26 +573,7 @@ bool D3D11Pipeline::setupIAAndVSStage() {
         LOGF(WARNING, "Failed to create input layout: %#x", hr);
         return false;
     }
-    float u = (float)video_width_ / _ALIGN(video_width_, align_);
-    float v = (float)video_height_ / _ALIGN(video_height_, align_);
-    Vertex verts[] = {{-1.0f, 1.0f, 0.0f, 0.0f},
-                      {1.0f, 1.0f, u, 0.0f},
-                      {1.0f, -1.0f, u, v},
-                      {-1.0f, -1.0f, 0.0f, v}};
-    D3D11_BUFFER_DESC vb_desc = {};
-    vb_desc.ByteWidth = sizeof(verts);
-    vb_desc.Usage = D3D11_USAGE_IMMUTABLE;
-    vb_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    vb_desc.CPUAccessFlags = 0;
-    vb_desc.MiscFlags = 0;
-    vb_desc.StructureByteStride = sizeof(Vertex);
-
-    D3D11_SUBRESOURCE_DATA vb_data = {};
-    vb_data.pSysMem = verts;
-
-    hr = d3d11_dev_->CreateBuffer(&vb_desc, &vb_data, video_vertex_buffer_.GetAddressOf());
-    if (FAILED(hr)) {
-        LOGF(WARNING, "Failed to create vertext buffer, hr:0x%08x", hr);
+    if (!setupVideoVertexBuffer()) {
         return false;
     }
 
@@ -612,6 +600,33 @@ bool D3D11Pipeline::setupIAAndVSStage() {
     return true;
 }
 
+bool D3D11Pipeline::setupVideoVertexBuffer() {
+    float u = (float)video_width_ / _ALIGN(video_width_, align_);
+    float v = (float)video_height_ / _ALIGN(video_height_, align_);
+    Vertex verts[] = {{-1.0f, 1.0f, 0.0f, 0.0f},
+                      {1.0f, 1.0f, u, 0.0f},
+                      {1.0f, -1.0f, u, v},
+                      {-1.0f, -1.0f, 0.0f, v}};
+    D3D11_BUFFER_DESC vb_desc = {};
+    vb_desc.ByteWidth = sizeof(verts);
+    vb_desc.Usage = D3D11_USAGE_IMMUTABLE;
+    vb_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+    vb_desc.CPUAccessFlags = 0;
+    vb_desc.MiscFlags = 0;
+    vb_desc.StructureByteStride = sizeof(Vertex);
+
+    D3D11_SUBRESOURCE_DATA vb_data = {};
+    vb_data.pSysMem = verts;
+
+    auto hr = d3d11_dev_->CreateBuffer(&vb_desc, &vb_data,
+                                       video_vertex_buffer_.ReleaseAndGetAddressOf());
+    if (FAILED(hr)) {
+        LOGF(WARNING, "Failed to create vertext buffer, hr:0x%08x", hr);
+        return false;
+    }
+    return true;
+}
+
 bool D3D11Pipeline::setupRSStage() {
     D3D11_VIEWPORT viewport{};
     viewport.TopLeftX = 0;
@@ -704,6 +719,8 @@ bool D3D11Pipeline::setupOMStage() {
 }
 
 bool D3D11Pipeline::initShaderResources(const std::vector<ID3D11Texture2D*>& textures) {
+    // 分辨率变化后会用新解码器的纹理重新绑定，旧的view要先释放
+    video_shader_views_.clear();
     video_shader_views_.resize(textures.size());
     D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
     srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
@@ -79,6 +79,7 @@ public:
     ~D3D11Pipeline() override;
     bool init();
     bool bindTextures(const std::vector<void*>& textures) override;
+    bool setVideoSize(uint32_t width, uint32_t height) override;
     RenderResult render(int64_t frame) override;
     void updateCursor(int32_t cursor_id, float x, float y, bool visible) override;
     void switchMouseMode(bool absolute) override;
@@ -95,6 +96,7 @@ private:
     bool setupRenderPipeline();
     bool setupRenderTarget();
     bool setupIAAndVSStage();
+    bool setupVideoVertexBuffer();
     bool setupRSStage();
     bool setupPSStage();
     bool setupOMStage();
@@ -114,8 +116,8 @@ private:
 private:
     HWND hwnd_;
     const uint64_t luid_;
-    const uint32_t video_width_;
-    const uint32_t video_height_;
+    uint32_t video_width_;
+    uint32_t video_height_;
     const uint32_t align_;
     int refresh_rate_ = 60;
 
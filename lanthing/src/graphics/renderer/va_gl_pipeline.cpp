@@ -109,6 +109,13 @@ bool VaGlPipeline::bindTextures(const std::vector<void*>& textures) {
     return true;
 }
 
+bool VaGlPipeline::setVideoSize(uint32_t width, uint32_t height) {
+    video_width_ = width;
+    video_height_ = height;
+    video_size_changed_ = true;
+    return true;
+}
+
 VideoRenderer::RenderResult VaGlPipeline::render(int64_t frame) {
     EGLBoolean egl_ret = eglMakeCurrent(egl_display_, egl_surface_, egl_surface_, egl_context_);
     if (egl_ret != EGL_TRUE) {
@@ -144,6 +151,10 @@ VideoRenderer::RenderResult VaGlPipeline::render(int64_t frame) {
     }
 
     glViewport(0, 0, static_cast<GLsizei>(window_width_), static_cast<GLsizei>(window_height_));
+    if (video_size_changed_) {
+        video_size_changed_ = false;
+        updateVertices();
+    }
     EGLImage images[2] = {0};
     for (size_t i = 0; i < 2; ++i) {
         constexpr uint32_t formats[2] = {DRM_FORMAT_R8, DRM_FORMAT_GR88};
@@ -532,4 +543,19 @@ void main() {
     return true;
 }
 
+void VaGlPipeline::updateVertices() {
+    // 视口不变，小分辨率的画面由纹理采样放大
+    float u = (float)video_width_ / _ALIGN(video_width_, align_);
+    float v = (float)video_height_ / _ALIGN(video_height_, align_);
+    // clang-format off
+    float verts[] = {-1.0f, 1.0f, 0.0f, 0.0f,
+                      1.0f, 1.0f, u, 0.0f,
+                      1.0f, -1.0f, u, v,
+                      -1.0f, -1.0f, 0.0f, v};
+    // clang-format on
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(verts), verts);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 } // namespace lt
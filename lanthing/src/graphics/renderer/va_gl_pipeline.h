@@ -58,6 +58,7 @@ public:
     ~VaGlPipeline() override;
     bool init();
     bool bindTextures(const std::vector<void*>& textures) override;
+    bool setVideoSize(uint32_t width, uint32_t height) override;
     RenderResult render(int64_t frame) override;
     void updateCursor(int32_t cursor_id, float x, float y, bool visible) override;
     void switchMouseMode(bool absolute) override;
@@ -75,12 +76,15 @@ private:
     bool initEGL();
     bool initOpenGL();
     void resizeWindow(int screen_width, int screen_height);
+    void updateVertices();
 
 private:
     SDL_Window* sdl_window_ = nullptr;
     uint32_t video_width_;
     uint32_t video_height_;
     uint32_t align_;
+    // setVideoSize()不在渲染线程，顶点要等下一次render()拿到GL上下文再更新
+    bool video_size_changed_ = false;
     uint32_t card_;
     uint32_t window_width_;
     uint32_t window_height_;
@@ -50,6 +50,8 @@ public:
     static std::unique_ptr<VideoRenderer> create(const Params& params);
     virtual ~VideoRenderer() = default;
     virtual bool bindTextures(const std::vector<void*>& textures) = 0;
+    // 码流分辨率变化后，和bindTextures()一样不能与render()同时调用. 画面仍铺满窗口
+    virtual bool setVideoSize(uint32_t width, uint32_t height) = 0;
     virtual RenderResult render(int64_t frame) = 0;
     virtual void updateCursor(int32_t cursor_id, float x, float y, bool visible) = 0;
     virtual void switchMouseMode(bool absolute) = 0;
@@ -31,9 +31,15 @@
 #include <inputs/capturer/input_capturer.h>
 #include <platforms/pc_sdl.h>
 
+#include <algorithm>
 #include <array>
+#include <deque>
+#include <functional>
+#include <mutex>
 
 #include <ltlib/logging.h>
+#include <ltlib/threads.h>
+#include <ltlib/times.h>
 #include <ltproto/client2worker/controller_added_removed.pb.h>
 #include <ltproto/client2worker/controller_status.pb.h>
 #include <ltproto/client2worker/keyboard_event.pb.h>
@@ -69,6 +75,12 @@ constexpr uint32_t kControllerRightThumb = 0x0080;
 constexpr uint32_t kControllerLeftShoulder = 0x0100;
 constexpr uint32_t kControllerRightShoulder = 0x0200;
 
+// 根据RTT推算合并间隔时的上下限. 间隔远小于RTT，对操作手感的影响可以忽略
+constexpr int64_t kMinFlushIntervalUS = 1'000;
+constexpr int64_t kMaxFlushIntervalUS = 8'000;
+constexpr int64_t kDefaultFlushIntervalUS = 4'000;
+constexpr int64_t kInputStatIntervalMS = 10'000;
+
 struct Rect {
     Rect(uint32_t w, uint32_t h)
         : width{w}
@@ -99,11 +111,13 @@ class InputCapturerImpl {
 public:
     InputCapturerImpl(const InputCapturer::Params& params);
     void init();
+    void setRTT(int64_t rtt_us);
 
 private:
     void sendMessageToHost(uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg,
                            bool reliable);
     void onPlatformInputEvent(const InputEvent& ev);
+    void handlePlatformInputEvent(const InputEvent& ev);
     void handleKeyboardUpDown(const KeyboardEvent& ev);
     void handleMouseButton(const MouseButtonEvent& ev);
     void handleMouseWheel(const MouseWheelEvent& ev);
@@ -112,7 +126,16 @@ private:
     void handleControllerButton(const ControllerButtonEvent& ev);
     void handleControllerAxis(const ControllerAxisEvent& ev);
     void sendControllerState(uint32_t index);
-    void processHotKeys();
+    void processHotKeys(uint16_t scan_code, bool key_down);
+    // 下面几个函数需要持有mutex_
+    void onPendingInput();
+    void schedulePendingFlush();
+    void onFlushTimeout();
+    void flushPendingInputs();
+    int64_t flushIntervalUS() const;
+    void printStats();
+    // 不能持有mutex_
+    void drainOutbox();
 
 private:
     PcSdl* sdl_;
@@ -122,9 +145,37 @@ private:
         send_message_to_host_;
     std::function<void()> toggle_fullscreen_;
     std::function<void()> switch_mouse_mode_;
+    std::function<void()> dump_frame_trace_;
     // 0表示松开，非0表示按下。不用bool而用uint8_t是担心menset()之类函数不好处理bool数组
     std::array<uint8_t, 512> key_states_ = {0};
     std::array<std::optional<ControllerState>, 4> cstates_;
+
+    // 高频事件合并. 按键、鼠标按键、滚轮这类"边沿"事件发送前先把积攒的移动发出去，保证顺序
+    std::mutex mutex_;
+    const uint32_t flush_rate_hz_;
+    int64_t rtt_us_ = 0;
+    bool has_pending_mouse_move_ = false;
+    float pending_x_ = 0.f;
+    float pending_y_ = 0.f;
+    int32_t pending_delta_x_ = 0;
+    int32_t pending_delta_y_ = 0;
+    std::array<bool, 4> pending_controller_ = {false};
+    int64_t first_pending_time_us_ = 0;
+    int64_t last_flush_time_us_ = 0;
+    bool flush_scheduled_ = false;
+    // 发消息、热键回调都先按顺序放进outbox_，释放mutex_后再执行，回调里可以重入
+    std::deque<std::function<void()>> outbox_;
+    bool draining_ = false;
+    uint64_t received_events_ = 0;
+    uint64_t sent_messages_ = 0;
+    // 进入合并流程的移动类事件数，以及合并后实际发出的消息数.
+    // 不合并时每个移动类事件都是一条消息，其它事件两种情况下一样，据此算出合并前的消息速率
+    uint64_t coalescable_events_ = 0;
+    uint64_t coalesced_messages_ = 0;
+    int64_t max_coalesce_delay_us_ = 0;
+    int64_t last_stat_time_ms_ = 0;
+    // 放在最后，保证先于其它成员析构
+    std::unique_ptr<ltlib::TaskThread> flush_thread_;
 };
 
 std::unique_ptr<InputCapturer> InputCapturer::create(const Params& params) {
@@ -135,26 +186,76 @@ std::unique_ptr<InputCapturer> InputCapturer::create(const Params& params) {
     return input;
 }
 
+void InputCapturer::setRTT(int64_t rtt_us) {
+    impl_->setRTT(rtt_us);
+}
+
 InputCapturerImpl::InputCapturerImpl(const InputCapturer::Params& params)
     : sdl_{params.sdl}
     , host_width_{params.host_width}
     , host_height_{params.host_height}
     , send_message_to_host_{params.send_message}
     , toggle_fullscreen_{params.toggle_fullscreen}
-    , switch_mouse_mode_{params.switch_mouse_mode} {}
+    , switch_mouse_mode_{params.switch_mouse_mode}
+    , dump_frame_trace_{params.dump_frame_trace}
+    , flush_rate_hz_{params.flush_rate_hz} {}
 
 void InputCapturerImpl::init() {
+    flush_thread_ = ltlib::TaskThread::create("input_flush");
+    last_stat_time_ms_ = ltlib::steady_now_ms();
     sdl_->setInputHandler(
         std::bind(&InputCapturerImpl::onPlatformInputEvent, this, std::placeholders::_1));
 }
 
+void InputCapturerImpl::setRTT(int64_t rtt_us) {
+    std::lock_guard lock{mutex_};
+    rtt_us_ = rtt_us;
+}
+
 void InputCapturerImpl::sendMessageToHost(uint32_t type,
                                           const std::shared_ptr<google::protobuf::MessageLite>& msg,
                                           bool reliable) {
-    send_message_to_host_(type, msg, reliable);
+    sent_messages_++;
+    outbox_.push_back([this, type, msg, reliable]() { send_message_to_host_(type, msg, reliable); });
+}
+
+void InputCapturerImpl::drainOutbox() {
+    // 同一时间只有一个线程在执行outbox_，保证消息顺序. 执行期间别的线程(或者回调重入)放进来的
+    // 任务由正在执行的线程接着处理
+    std::deque<std::function<void()>> tasks;
+    while (true) {
+        {
+            std::lock_guard lock{mutex_};
+            if (draining_ || outbox_.empty()) {
+                return;
+            }
+            draining_ = true;
+            tasks.swap(outbox_);
+        }
+        for (auto& task : tasks) {
+            task();
+        }
+        tasks.clear();
+        std::lock_guard lock{mutex_};
+        draining_ = false;
+    }
 }
 
 void InputCapturerImpl::onPlatformInputEvent(const InputEvent& e) {
+    // NOTE: 运行在platform线程
+    {
+        std::lock_guard lock{mutex_};
+        handlePlatformInputEvent(e);
+    }
+    drainOutbox();
+}
+
+void InputCapturerImpl::handlePlatformInputEvent(const InputEvent& e) {
+    received_events_++;
+    if (e.type != InputEventType::MouseMove && e.type != InputEventType::ControllerAxis) {
+        // 边沿事件不能被合并，也不能跑到之前积攒的移动事件前面
+        flushPendingInputs();
+    }
     switch (e.type) {
     case InputEventType::Keyboard:
         handleKeyboardUpDown(std::get<KeyboardEvent>(e.ev));
@@ -181,12 +282,16 @@ void InputCapturerImpl::onPlatformInputEvent(const InputEvent& e) {
         LOG(FATAL) << "Unknown InputEventType:" << static_cast<int32_t>(e.type);
         break;
     }
+    // 只有边沿事件、或者移动事件都立即发出时不会走onFlushTimeout()，这里也要统计
+    printStats();
 }
 
 void InputCapturerImpl::handleKeyboardUpDown(const KeyboardEvent& ev) {
     // TODO: 增加一个reset状态的逻辑，入口在sdl还是input另说。
+    // 长按产生的重复按下不算新的按键
+    bool key_down = ev.is_pressed && key_states_[ev.scan_code] == 0;
     key_states_[ev.scan_code] = ev.is_pressed ? 1 : 0;
-    processHotKeys();
+    processHotKeys(ev.scan_code, key_down);
     auto msg = std::make_shared<ltproto::client2worker::KeyboardEvent>();
     msg->set_key(ev.scan_code);
     msg->set_down(ev.is_pressed);
@@ -235,14 +340,14 @@ void InputCapturerImpl::handleMouseWheel(const MouseWheelEvent& ev) {
 }
 
 void InputCapturerImpl::handleMouseMove(const MouseMoveEvent& ev) {
-
-    // TODO: 相对模式可能要累积一段再发出去
-    auto msg = std::make_shared<ltproto::client2worker::MouseEvent>();
-    msg->set_x(ev.x * 1.0f / ev.window_width);
-    msg->set_y(ev.y * 1.0f / ev.window_height);
-    msg->set_delta_x(ev.delta_x);
-    msg->set_delta_y(ev.delta_y);
-    sendMessageToHost(ltproto::id(msg), msg, true);
+    // 绝对坐标只保留最新的，相对位移累加
+    pending_x_ = ev.x * 1.0f / ev.window_width;
+    pending_y_ = ev.y * 1.0f / ev.window_height;
+    pending_delta_x_ += ev.delta_x;
+    pending_delta_y_ += ev.delta_y;
+    has_pending_mouse_move_ = true;
+    coalescable_events_++;
+    onPendingInput();
 }
 
 void InputCapturerImpl::handleControllerAddedRemoved(const ControllerAddedRemovedEvent& ev) {
@@ -402,7 +507,9 @@ void InputCapturerImpl::handleControllerAxis(const ControllerAxisEvent& ev) {
     default:
         return;
     }
-    sendControllerState(ev.index);
+    pending_controller_[ev.index] = true;
+    coalescable_events_++;
+    onPendingInput();
 }
 
 void InputCapturerImpl::sendControllerState(uint32_t index) {
@@ -425,15 +532,107 @@ void InputCapturerImpl::sendControllerState(uint32_t index) {
     sendMessageToHost(ltproto::id(msg), msg, true);
 }
 
-void InputCapturerImpl::processHotKeys() {
+void InputCapturerImpl::onPendingInput() {
+    if (flush_scheduled_) {
+        return;
+    }
+    // 空闲一个间隔以上之后的第一个事件立即发出，后面的再按间隔合并
+    if (ltlib::steady_now_us() - last_flush_time_us_ >= flushIntervalUS()) {
+        flushPendingInputs();
+        return;
+    }
+    schedulePendingFlush();
+}
+
+void InputCapturerImpl::schedulePendingFlush() {
+    flush_scheduled_ = true;
+    first_pending_time_us_ = ltlib::steady_now_us();
+    int64_t delay_us = flushIntervalUS() - (first_pending_time_us_ - last_flush_time_us_);
+    flush_thread_->post_delay(ltlib::TimeDelta{std::max<int64_t>(delay_us, 0)}, [this]() {
+        {
+            std::lock_guard lock{mutex_};
+            onFlushTimeout();
+        }
+        drainOutbox();
+    });
+}
+
+void InputCapturerImpl::onFlushTimeout() {
+    flushPendingInputs();
+    flush_scheduled_ = false;
+    max_coalesce_delay_us_ =
+        std::max(max_coalesce_delay_us_, ltlib::steady_now_us() - first_pending_time_us_);
+    printStats();
+}
+
+void InputCapturerImpl::flushPendingInputs() {
+    for (uint32_t index = 0; index < pending_controller_.size(); index++) {
+        if (pending_controller_[index]) {
+            pending_controller_[index] = false;
+            last_flush_time_us_ = ltlib::steady_now_us();
+            coalesced_messages_++;
+            sendControllerState(index);
+        }
+    }
+    if (!has_pending_mouse_move_) {
+        return;
+    }
+    last_flush_time_us_ = ltlib::steady_now_us();
+    auto msg = std::make_shared<ltproto::client2worker::MouseEvent>();
+    msg->set_x(pending_x_);
+    msg->set_y(pending_y_);
+    msg->set_delta_x(pending_delta_x_);
+    msg->set_delta_y(pending_delta_y_);
+    has_pending_mouse_move_ = false;
+    pending_delta_x_ = 0;
+    pending_delta_y_ = 0;
+    coalesced_messages_++;
+    sendMessageToHost(ltproto::id(msg), msg, true);
+}
+
+int64_t InputCapturerImpl::flushIntervalUS() const {
+    if (flush_rate_hz_ != 0) {
+        return 1'000'000 / flush_rate_hz_;
+    }
+    if (rtt_us_ == 0) {
+        return kDefaultFlushIntervalUS;
+    }
+    return std::clamp(rtt_us_ / 10, kMinFlushIntervalUS, kMaxFlushIntervalUS);
+}
+
+void InputCapturerImpl::printStats() {
+    int64_t now_ms = ltlib::steady_now_ms();
+    int64_t duration_ms = now_ms - last_stat_time_ms_;
+    if (duration_ms < kInputStatIntervalMS) {
+        return;
+    }
+    const uint64_t unbatched_messages = sent_messages_ - coalesced_messages_ + coalescable_events_;
+    LOG(INFO) << "Input events " << received_events_ * 1000 / duration_ms
+              << "/s, messages without coalescing " << unbatched_messages * 1000 / duration_ms
+              << "/s, messages sent " << sent_messages_ * 1000 / duration_ms
+              << "/s, max coalesce delay " << max_coalesce_delay_us_ << "us, flush interval "
+              << flushIntervalUS() << "us";
+    received_events_ = 0;
+    sent_messages_ = 0;
+    coalescable_events_ = 0;
+    coalesced_messages_ = 0;
+    max_coalesce_delay_us_ = 0;
+    last_stat_time_ms_ = now_ms;
+}
+
+void InputCapturerImpl::processHotKeys(uint16_t scan_code, bool key_down) {
     // TODO: 按键释放问题
     if (key_states_[Scancode::SCANCODE_LGUI] && key_states_[Scancode::SCANCODE_LSHIFT] &&
         key_states_[Scancode::SCANCODE_Z]) {
-        toggle_fullscreen_();
+        outbox_.push_back(toggle_fullscreen_);
     }
     if (key_states_[Scancode::SCANCODE_LGUI] && key_states_[Scancode::SCANCODE_LSHIFT] &&
         key_states_[Scancode::SCANCODE_X]) {
-        switch_mouse_mode_();
+        outbox_.push_back(switch_mouse_mode_);
+    }
+    if (key_down && scan_code == Scancode::SCANCODE_T && key_states_[Scancode::SCANCODE_LGUI] &&
+        key_states_[Scancode::SCANCODE_LSHIFT] && dump_frame_trace_) {
+        outbox_.push_back(dump_frame_trace_);
     }
 }
 
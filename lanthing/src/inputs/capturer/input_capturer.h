@@ -50,10 +50,14 @@ public:
             send_message;
         std::function<void()> toggle_fullscreen;
         std::function<void()> switch_mouse_mode;
+        std::function<void()> dump_frame_trace;
+        // 鼠标移动、摇杆这类高频事件合并发送的频率，0表示根据RTT自动调整
+        uint32_t flush_rate_hz = 0;
     };
 
 public:
     static std::unique_ptr<InputCapturer> create(const Params& params);
+    void setRTT(int64_t rtt_us);
 
 private:
     InputCapturer() = default;
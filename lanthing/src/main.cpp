@@ -28,11 +28,14 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
 #include <map>
 #include <regex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <g3log/logworker.hpp>
@@ -74,9 +77,20 @@ enum class Role {
 std::unique_ptr<g3::LogWorker> g_log_worker;
 std::unique_ptr<g3::FileSinkHandle> g_log_sink;
 std::unique_ptr<LTMinidumpGenerator> g_minidump_genertator;
+std::atomic<bool> g_sigint_received{false};
+static_assert(std::atomic<bool>::is_always_lock_free);
 
+// 信号处理函数里只能做async-signal-safe的事，加锁、join线程、写日志都交给sigintWatcher()
 void sigint_handler(int) {
+    g_sigint_received = true;
+}
+
+void sigintWatcher() {
+    while (!g_sigint_received) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    }
     LOG(INFO) << "SIGINT Received";
+    ltlib::BinaryLog::shutdown();
     g_log_worker.reset();
     g_log_sink.reset();
     g_minidump_genertator.reset();
@@ -166,6 +180,8 @@ void initLogAndMinidump(Role role) {
     // g3log必须再minidump前初始化
     g_minidump_genertator = std::make_unique<LTMinidumpGenerator>(log_dir.string());
     g_minidump_genertator->addCallback([]() { rtc::flushLogs(); });
+    std::thread sigint_watcher(sigintWatcher);
+    sigint_watcher.detach();
     signal(SIGINT, sigint_handler);
     if (LT_CRASH_ON_THREAD_HANGS) {
         ltlib::ThreadWatcher::instance()->enableCrashOnTimeout();
@@ -266,20 +282,24 @@ int main(int argc, char* argv[]) {
     ::srand(static_cast<unsigned int>(::time(nullptr)));
     auto options = parseOptions(argc, argv);
     auto iter = options.find("-type");
+    int ret = -1;
     if (iter == options.end() || iter->second == "service") {
-        return runAsService(options);
+        ret = runAsService(options);
     }
     else if (iter->second == "client") {
         // 方便调试attach
         // std::this_thread::sleep_for(std::chrono::seconds{15});
-        return runAsClient(options);
+        ret = runAsClient(options);
     }
     else if (iter->second == "worker") {
         // std::this_thread::sleep_for(std::chrono::seconds { 15 });
-        return runAsWorker(options);
+        ret = runAsWorker(options);
     }
     else {
         std::cerr << "Unknown type '" << iter->second << "'" << std::endl;
         return -1;
     }
+    // 二进制日志要赶在g_log_worker静态析构前交给g3log
+    ltlib::BinaryLog::shutdown();
+    return ret;
 }
\ No newline at end of file
@@ -30,11 +30,14 @@
 
 #include "service.h"
 #include <cassert>
+#include <filesystem>
 
+#include <ltlib/frame_trace.h>
 #include <ltlib/logging.h>
 #include <ltlib/win_service.h>
 
 #include <ltlib/strings.h>
+#include <ltlib/system.h>
 #include <ltproto/common/keep_alive.pb.h>
 #include <ltproto/ltproto.h>
 #include <ltproto/server/close_connection.pb.h>
@@ -48,6 +51,13 @@
 #include <ltproto/service2app/operate_connection.pb.h>
 #include <ltproto/service2app/service_status.pb.h>
 
+namespace {
+
+// 会话结束后worker要恢复分辨率、释放采集，等一会儿再预热下一个
+constexpr int64_t kPrewarmWorkerDelayMs = 5'000;
+
+} // namespace
+
 namespace lt {
 
 namespace svc {
@@ -58,6 +68,7 @@ Service::~Service() {
     {
         std::lock_guard lock{mutex_};
         tcp_client_.reset();
+        warm_worker_.reset();
         ioloop_.reset();
     }
 }
@@ -72,6 +83,12 @@ bool Service::init() {
         return false;
     }
     device_id_ = device_id.value();
+    // 常驻一个预热的worker会一直占着显示设置和编码器，默认关闭
+    enable_warm_worker_ = settings_->getBoolean("enable_warm_worker").value_or(false);
+    // 被控端这边记录采集、编码、发送的时间点，会话结束时导出，和控制端导出的文件拼起来看
+    ltlib::FrameTracer::instance()->setProcess(2, "host");
+    ltlib::FrameTracer::instance()->enable(
+        settings_->getBoolean("enable_frame_trace").value_or(false));
 
     ioloop_ = ltlib::IOLoop::create();
     if (ioloop_ == nullptr) {
@@ -92,6 +109,7 @@ bool Service::init() {
         });
     future.get();
     postDelayTask(1000, std::bind(&Service::checkRunAsService, this));
+    postTask(std::bind(&Service::prewarmWorker, this));
     return true;
 }
 
@@ -150,12 +168,17 @@ bool Service::initSettings() {
     return settings_ != nullptr;
 }
 
-void Service::createSession(const WorkerSession::Params& params) {
+void Service::createSession(const WorkerSession::Params& _params) {
+    WorkerSession::Params params = _params;
+    if (params.fanout_source == nullptr && warm_worker_ != nullptr && warm_worker_->isReady()) {
+        params.warm_worker = std::move(warm_worker_);
+    }
     auto session = WorkerSession::create(params);
     if (session != nullptr) {
         worker_sessions_[params.name] = session;
     }
     else {
+        postDelayTask(kPrewarmWorkerDelayMs, std::bind(&Service::prewarmWorker, this));
         auto ack = std::make_shared<ltproto::server::OpenConnectionAck>();
         ack->set_err_code(ltproto::ErrorCode::Unknown);
         tcp_client_->send(ltproto::id(ack), ack);
@@ -164,6 +187,20 @@ void Service::createSession(const WorkerSession::Params& params) {
     }
 }
 
+void Service::prewarmWorker() {
+    if (!enable_warm_worker_ || warm_worker_ != nullptr || !worker_sessions_.empty()) {
+        return;
+    }
+    WarmWorker::Params params{};
+    params.ioloop = ioloop_.get();
+    params.post_delay_task =
+        std::bind(&Service::postDelayTask, this, std::placeholders::_1, std::placeholders::_2);
+    warm_worker_ = WarmWorker::create(params);
+    if (warm_worker_ == nullptr) {
+        LOG(WARNING) << "Create warm worker failed, sessions will cold start their workers";
+    }
+}
+
 void Service::destroySession(const std::string& session_name) {
     // worker_sessions_.erase(session_name)会析构WorkerSession内部的PeerConnection
     // 而当前的destroy_session()很可能是PeerConnection信令线程回调上来的
@@ -298,14 +335,21 @@ void Service::onOpenConnection(std::shared_ptr<google::protobuf::MessageLite> _m
     }
     constexpr size_t kSessionNameLen = 8;
     const std::string session_name = ltlib::randomStr(kSessionNameLen);
+    std::shared_ptr<WorkerSession> fanout_source;
     if (!worker_sessions_.empty()) {
-        LOG(ERR) << "Only support one client";
-        return;
-    }
-    else {
-        // 用一个nullptr占位
-        worker_sessions_[session_name] = nullptr;
+        // 多人观看：后来的客户端共用已有会话的采集编码，N个观看者只编一路
+        if (!settings_->getBoolean("enable_multi_viewer").value_or(false)) {
+            LOG(ERR) << "Only support one client";
+            return;
+        }
+        fanout_source = primarySession();
+        if (fanout_source == nullptr) {
+            LOG(ERR) << "No streaming session for new viewer to join";
+            return;
+        }
     }
+    // 用一个nullptr占位
+    worker_sessions_[session_name] = nullptr;
     // 2. 准备启动worker的参数
     std::string id_str = std::to_string(msg->client_device_id());
     WorkerSession::Params worker_params{};
@@ -317,6 +361,20 @@ void Service::onOpenConnection(std::shared_ptr<google::protobuf::MessageLite> _m
     worker_params.enable_mouse =
         settings_->getBoolean("enable_mouse_for_" + id_str).value_or(false);
     worker_params.force_relay = settings_->getBoolean("force_relay").value_or(false);
+    worker_params.fanout_source = fanout_source;
+    // 观看者和主控看的是同一路流，只录主控的
+    if (fanout_source == nullptr && settings_->getBoolean("record_session").value_or(false)) {
+        std::filesystem::path default_dir = ltlib::getConfigPath(true);
+        default_dir /= "recordings";
+        worker_params.record_directory =
+            settings_->getString("record_directory").value_or(default_dir.string());
+    }
+    if (fanout_source != nullptr) {
+        // 观看者只能看
+        worker_params.enable_gamepad = false;
+        worker_params.enable_keyboard = false;
+        worker_params.enable_mouse = false;
+    }
     worker_params.ioloop = ioloop_.get();
     worker_params.post_task = std::bind(&Service::postTask, this, std::placeholders::_1);
     worker_params.post_delay_task =
@@ -411,6 +469,7 @@ void Service::onSessionClosed(int64_t device_id, WorkerSession::CloseReason clos
     reportSessionClosed(close_reason, room_id);
     destroySession(session_name);
     tellAppSessionClosed(device_id);
+    postDelayTask(kPrewarmWorkerDelayMs, std::bind(&Service::prewarmWorker, this));
 }
 
 void Service::sendMessageToServer(uint32_t type,
@@ -551,39 +610,36 @@ void Service::onConfirmConnectionAck(std::shared_ptr<google::protobuf::MessageLi
 }
 
 void Service::onOperateConnection(std::shared_ptr<google::protobuf::MessageLite> _msg) {
-    if (worker_sessions_.empty()) {
+    // 观看者没有控制权限，操作都作用在主控会话上，踢掉主控会连带关闭所有观看者
+    auto session = primarySession();
+    if (session == nullptr) {
         LOG(WARNING) << "No available connection, can't operate";
         return;
     }
-    if (worker_sessions_.size() != 1) {
-        LOG(ERR) << "We have more than one accepted connection, something must be wrong";
-        return;
-    }
-    auto session = worker_sessions_.begin();
     auto msg = std::static_pointer_cast<ltproto::service2app::OperateConnection>(_msg);
     for (auto _op : msg->operations()) {
         auto op = static_cast<ltproto::service2app::OperateConnection_Operation>(_op);
         switch (op) {
         case ltproto::service2app::OperateConnection_Operation_EnableGamepad:
-            session->second->enableGamepad();
+            session->enableGamepad();
             break;
         case ltproto::service2app::OperateConnection_Operation_DisableGamepad:
-            session->second->disableGamepad();
+            session->disableGamepad();
             break;
         case ltproto::service2app::OperateConnection_Operation_EnableKeyboard:
-            session->second->enableKeyboard();
+            session->enableKeyboard();
             break;
         case ltproto::service2app::OperateConnection_Operation_DisableKeyboard:
-            session->second->disableKeyboard();
+            session->disableKeyboard();
             break;
         case ltproto::service2app::OperateConnection_Operation_EnableMouse:
-            session->second->enableMouse();
+            session->enableMouse();
             break;
         case ltproto::service2app::OperateConnection_Operation_DisableMouse:
-            session->second->disableMouse();
+            session->disableMouse();
             break;
         case ltproto::service2app::OperateConnection_Operation_Kick:
-            session->second->close();
+            session->close();
             break;
         default:
             LOG(WARNING) << "Unknown operation " << _op;
@@ -592,6 +648,16 @@ void Service::onOperateConnection(std::shared_ptr<google::protobuf::MessageLite>
     }
 }
 
+std::shared_ptr<WorkerSession> Service::primarySession() {
+    for (auto& session : worker_sessions_) {
+        // nullptr是还在确认中的占位
+        if (session.second != nullptr && !session.second->isViewer()) {
+            return session.second;
+        }
+    }
+    return nullptr;
+}
+
 void Service::tellAppSessionClosed(int64_t device_id) {
     auto msg = std::make_shared<ltproto::service2app::DisconnectedConnection>();
     msg->set_device_id(device_id);
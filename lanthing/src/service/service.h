@@ -29,6 +29,7 @@
  */
 
 #pragma once
+#include "workers/warm_worker.h"
 #include "workers/worker_session.h"
 
 #include <ltlib/io/client.h>
@@ -54,10 +55,12 @@ private:
     bool initSettings();
     void createSession(const WorkerSession::Params& params);
     void destroySession(const std::string& session_name);
+    std::shared_ptr<WorkerSession> primarySession();
     void letUserConfirm(int64_t device_id);
     void postTask(const std::function<void()>& task);
     void postDelayTask(int64_t delay_ms, const std::function<void()>& task);
     void checkRunAsService();
+    void prewarmWorker();
 
     // 服务器
     void onServerMessage(uint32_t type, std::shared_ptr<google::protobuf::MessageLite> msg);
@@ -105,6 +108,9 @@ private:
     std::unique_ptr<ltlib::BlockingThread> thread_;
     std::mutex mutex_;
     std::map<std::string, std::shared_ptr<WorkerSession>> worker_sessions_;
+    // 没有会话的时候预先拉起的worker，下一个主控会话直接接管
+    std::shared_ptr<WarmWorker> warm_worker_;
+    bool enable_warm_worker_ = false;
     std::unique_ptr<ltlib::Settings> settings_;
     int64_t device_id_ = 0;
     bool app_connected_ = false;
@@ -0,0 +1,298 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "session_recorder.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+namespace {
+
+// 队列里加上IO线程正在写的那一批最多这么多字节，超过就丢队列里最旧的.
+// 另外muxer里还缓存着不到一个fragment(约1秒)的样本，以及打包它们时的一份拷贝
+constexpr size_t kMaxBufferedBytes = 32 * 1024 * 1024;
+constexpr int64_t kFragmentDurationUS = 1'000'000;
+// 每10分钟换一个文件，单个文件坏了也不会丢太多
+constexpr int64_t kSegmentDurationUS = 10 * 60 * 1'000'000LL;
+constexpr int64_t kReportIntervalUS = 60 * 1'000'000LL;
+// 分块写，块之间喂ThreadWatcher，慢盘上一次大写入不会被当成卡死
+constexpr size_t kWriteChunkSize = 1024 * 1024;
+
+} // namespace
+
+namespace lt {
+
+namespace svc {
+
+std::unique_ptr<SessionRecorder> SessionRecorder::create(const Params& params) {
+    if (params.video_codec != lt::VideoCodecType::H264 &&
+        params.video_codec != lt::VideoCodecType::H265) {
+        LOG(ERR) << "Can't record video codec " << static_cast<int>(params.video_codec);
+        return nullptr;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(params.directory, ec);
+    if (ec) {
+        LOG(ERR) << "Create recording directory " << params.directory
+                 << " failed: " << ec.message();
+        return nullptr;
+    }
+    std::unique_ptr<SessionRecorder> recorder{new SessionRecorder(params)};
+    auto that = recorder.get();
+    recorder->thread_ = ltlib::BlockingThread::create(
+        "recorder", [that](const std::function<void()>& i_am_alive) { that->ioLoop(i_am_alive); });
+    if (recorder->thread_ == nullptr) {
+        LOG(ERR) << "Create recorder thread failed";
+        return nullptr;
+    }
+    LOG(INFO) << "Recording session " << params.name << " to " << params.directory;
+    return recorder;
+}
+
+SessionRecorder::SessionRecorder(const Params& params)
+    : params_(params) {}
+
+SessionRecorder::~SessionRecorder() {
+    {
+        std::lock_guard lock{mutex_};
+        stoped_ = true;
+    }
+    cv_.notify_one();
+    // 等IO线程把队列里剩下的写完
+    thread_.reset();
+}
+
+void SessionRecorder::onVideo(const lt::VideoFrame& frame) {
+    const int64_t start_us = ltlib::steady_now_us();
+    Packet packet{};
+    packet.is_video = true;
+    packet.keyframe = frame.is_keyframe;
+    packet.width = frame.width;
+    packet.height = frame.height;
+    // worker采集时打的steady clock，和下面音频用的是同一个时钟
+    packet.timestamp_us = frame.capture_timestamp_us;
+    packet.data.assign(frame.data, frame.data + frame.size);
+    push(std::move(packet), start_us);
+}
+
+void SessionRecorder::onAudio(const lt::AudioData& audio) {
+    if (params_.audio_channels == 0) {
+        return;
+    }
+    const int64_t start_us = ltlib::steady_now_us();
+    Packet packet{};
+    packet.is_video = false;
+    auto data = reinterpret_cast<const uint8_t*>(audio.data);
+    packet.data.assign(data, data + audio.size);
+    // AudioData没有带采集时间，包里第一个样本是在大约一个包时长之前采到的.
+    // 减掉这段打包延迟，和视频一样按采集时间对齐，剩下的只有管道传输的延迟
+    packet.timestamp_us = start_us - ltlib::Fmp4Muxer::opusPacketDurationUs(packet.data);
+    push(std::move(packet), start_us);
+}
+
+void SessionRecorder::push(Packet&& packet, int64_t start_us) {
+    {
+        std::lock_guard lock{mutex_};
+        buffered_bytes_ += packet.data.size();
+        packets_.push_back(std::move(packet));
+        while (buffered_bytes_ > kMaxBufferedBytes && packets_.size() > 1) {
+            const size_t size = packets_.front().data.size();
+            buffered_bytes_ -= size;
+            dropped_bytes_.fetch_add(size, std::memory_order_relaxed);
+            packets_.pop_front();
+            dropped_ = true;
+        }
+    }
+    cv_.notify_one();
+    // 拷贝加入队就是录制给发送线程增加的全部延迟
+    const int64_t cost_us = ltlib::steady_now_us() - start_us;
+    enqueue_count_.fetch_add(1, std::memory_order_relaxed);
+    enqueue_total_us_.fetch_add(static_cast<uint64_t>(cost_us), std::memory_order_relaxed);
+    int64_t max_us = enqueue_max_us_.load(std::memory_order_relaxed);
+    while (cost_us > max_us && !enqueue_max_us_.compare_exchange_weak(max_us, cost_us)) {
+    }
+}
+
+void SessionRecorder::ioLoop(const std::function<void()>& i_am_alive) {
+    last_report_us_ = ltlib::steady_now_us();
+    bool stoped = false;
+    while (!stoped) {
+        i_am_alive();
+        std::deque<Packet> packets;
+        bool dropped = false;
+        {
+            std::unique_lock lock{mutex_};
+            cv_.wait_for(lock, std::chrono::milliseconds{100},
+                         [this]() { return stoped_ || !packets_.empty(); });
+            // 这一批写完之前仍然算在buffered_bytes_里，否则发送线程可以再攒满一个kMaxBufferedBytes
+            packets.swap(packets_);
+            dropped = dropped_;
+            dropped_ = false;
+            stoped = stoped_;
+        }
+        if (dropped) {
+            // 丢掉的都比这一批早，当前文件到此为止，从下一个关键帧开始新文件
+            LOG(WARNING) << "Recorder can't keep up with the stream, data dropped";
+            closeSegment(i_am_alive);
+        }
+        size_t written_bytes = 0;
+        for (auto& packet : packets) {
+            writePacket(packet, i_am_alive);
+            written_bytes += packet.data.size();
+        }
+        packets.clear();
+        {
+            std::lock_guard lock{mutex_};
+            buffered_bytes_ -= written_bytes;
+        }
+        reportOverhead(false);
+    }
+    closeSegment(i_am_alive);
+    reportOverhead(true);
+}
+
+void SessionRecorder::writePacket(const Packet& packet, const std::function<void()>& i_am_alive) {
+    if (packet.is_video && packet.keyframe) {
+        if (muxer_ != nullptr &&
+            (packet.width != segment_width_ || packet.height != segment_height_ ||
+             packet.timestamp_us - segment_start_us_ >= kSegmentDurationUS)) {
+            closeSegment(i_am_alive);
+        }
+        if (muxer_ == nullptr) {
+            openSegment(packet, i_am_alive);
+            return;
+        }
+    }
+    if (muxer_ == nullptr) {
+        // 等关键帧
+        return;
+    }
+    if (packet.is_video) {
+        muxer_->addVideo(packet.data, packet.keyframe, packet.timestamp_us);
+        if (muxer_->bufferedDurationUs() >= kFragmentDurationUS) {
+            flushFragment(false, i_am_alive);
+        }
+    }
+    else {
+        muxer_->addAudio(packet.data, packet.timestamp_us);
+    }
+}
+
+bool SessionRecorder::openSegment(const Packet& keyframe,
+                                  const std::function<void()>& i_am_alive) {
+    ltlib::Fmp4Muxer::Params params{};
+    params.video_codec = params_.video_codec == lt::VideoCodecType::H264
+                             ? ltlib::Fmp4Muxer::VideoCodec::H264
+                             : ltlib::Fmp4Muxer::VideoCodec::H265;
+    params.width = keyframe.width;
+    params.height = keyframe.height;
+    params.audio_channels = params_.audio_channels;
+    params.audio_sample_rate = params_.audio_sample_rate;
+    auto muxer = std::make_unique<ltlib::Fmp4Muxer>(params);
+    if (!muxer->addVideo(keyframe.data, true, keyframe.timestamp_us)) {
+        LOG(WARNING) << "Keyframe without parameter sets, can't start recording";
+        return false;
+    }
+    std::filesystem::path path{params_.directory};
+    path /= params_.name + "_" + std::to_string(ltlib::utc_now_ms()) + ".mp4";
+    filename_ = path.string();
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open()) {
+        LOG(ERR) << "Open " << filename_ << " failed";
+        return false;
+    }
+    muxer_ = std::move(muxer);
+    segment_start_us_ = keyframe.timestamp_us;
+    segment_width_ = keyframe.width;
+    segment_height_ = keyframe.height;
+    LOG(INFO) << "Start recording " << filename_;
+    fragment_ = muxer_->initSegment();
+    writeFragment(i_am_alive);
+    return muxer_ != nullptr;
+}
+
+void SessionRecorder::closeSegment(const std::function<void()>& i_am_alive) {
+    if (muxer_ == nullptr) {
+        return;
+    }
+    flushFragment(true, i_am_alive);
+    if (muxer_ != nullptr) {
+        file_.close();
+        muxer_.reset();
+        LOG(INFO) << "Recorded " << filename_;
+    }
+}
+
+void SessionRecorder::flushFragment(bool final, const std::function<void()>& i_am_alive) {
+    fragment_.clear();
+    muxer_->flushFragment(fragment_, final);
+    writeFragment(i_am_alive);
+}
+
+void SessionRecorder::writeFragment(const std::function<void()>& i_am_alive) {
+    for (size_t offset = 0; offset < fragment_.size() && file_.good(); offset += kWriteChunkSize) {
+        i_am_alive();
+        const size_t size = std::min(kWriteChunkSize, fragment_.size() - offset);
+        file_.write(reinterpret_cast<const char*>(fragment_.data() + offset),
+                    static_cast<std::streamsize>(size));
+    }
+    if (!file_.good()) {
+        LOG(ERR) << "Write " << filename_ << " failed, stop recording this file";
+        file_.close();
+        muxer_.reset();
+    }
+}
+
+void SessionRecorder::reportOverhead(bool force) {
+    const int64_t now_us = ltlib::steady_now_us();
+    if (!force && now_us - last_report_us_ < kReportIntervalUS) {
+        return;
+    }
+    last_report_us_ = now_us;
+    const uint64_t count = enqueue_count_.exchange(0);
+    const uint64_t total_us = enqueue_total_us_.exchange(0);
+    const int64_t max_us = enqueue_max_us_.exchange(0);
+    const uint64_t dropped_bytes = dropped_bytes_.exchange(0);
+    if (count == 0) {
+        return;
+    }
+    LOGF(INFO,
+         "Recorder added %.1fus on average and %lldus at most to the sending thread over %llu "
+         "packets, dropped %llu bytes",
+         static_cast<double>(total_us) / count, static_cast<long long>(max_us),
+         static_cast<unsigned long long>(count), static_cast<unsigned long long>(dropped_bytes));
+}
+
+} // namespace svc
+
+} // namespace lt
@@ -0,0 +1,123 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ltlib/fmp4_muxer.h>
+#include <ltlib/threads.h>
+#include <transport/transport.h>
+
+namespace lt {
+
+namespace svc {
+
+// 把发给客户端的已编码音视频原样另存一份fragmented MP4，不需要第二个编码器.
+// 发送线程只拷贝入队，封装和写盘都在后台IO线程. 队列有上限，磁盘跟不上时丢最旧的数据，
+// 丢过数据之后从下一个关键帧开始新的文件.
+class SessionRecorder {
+public:
+    struct Params {
+        std::string directory;
+        // 文件名前缀
+        std::string name;
+        lt::VideoCodecType video_codec;
+        // 0表示不录音频，音频必须是Opus
+        uint32_t audio_channels;
+        uint32_t audio_sample_rate;
+    };
+
+public:
+    static std::unique_ptr<SessionRecorder> create(const Params& params);
+    ~SessionRecorder();
+
+    // 可以在任意线程调用，不会阻塞在磁盘IO上
+    void onVideo(const lt::VideoFrame& frame);
+    void onAudio(const lt::AudioData& audio);
+
+private:
+    struct Packet {
+        bool is_video;
+        bool keyframe;
+        uint32_t width;
+        uint32_t height;
+        int64_t timestamp_us;
+        std::vector<uint8_t> data;
+    };
+    SessionRecorder(const Params& params);
+    void push(Packet&& packet, int64_t start_us);
+    void ioLoop(const std::function<void()>& i_am_alive);
+    void writePacket(const Packet& packet, const std::function<void()>& i_am_alive);
+    bool openSegment(const Packet& keyframe, const std::function<void()>& i_am_alive);
+    void closeSegment(const std::function<void()>& i_am_alive);
+    void flushFragment(bool final, const std::function<void()>& i_am_alive);
+    void writeFragment(const std::function<void()>& i_am_alive);
+    void reportOverhead(bool force);
+
+private:
+    const Params params_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Packet> packets_;
+    size_t buffered_bytes_ = 0;
+    bool dropped_ = false;
+    bool stoped_ = false;
+
+    // 发送线程上的开销统计
+    std::atomic<uint64_t> enqueue_count_{0};
+    std::atomic<uint64_t> enqueue_total_us_{0};
+    std::atomic<int64_t> enqueue_max_us_{0};
+    std::atomic<uint64_t> dropped_bytes_{0};
+
+    // 以下只在IO线程访问
+    std::unique_ptr<ltlib::Fmp4Muxer> muxer_;
+    std::ofstream file_;
+    std::string filename_;
+    int64_t segment_start_us_ = 0;
+    uint32_t segment_width_ = 0;
+    uint32_t segment_height_ = 0;
+    std::vector<uint8_t> fragment_;
+    int64_t last_report_us_ = 0;
+
+    std::unique_ptr<ltlib::BlockingThread> thread_;
+};
+
+} // namespace svc
+
+} // namespace lt
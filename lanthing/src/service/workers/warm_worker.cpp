@@ -0,0 +1,214 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "warm_worker.h"
+
+#include <ltlib/logging.h>
+
+#include <ltproto/common/keep_alive.pb.h>
+#include <ltproto/ltproto.h>
+
+#include <ltlib/strings.h>
+#include <ltlib/system.h>
+#include <ltlib/times.h>
+
+#include "worker_process.h"
+#include <worker/video_frame_ring.h>
+
+namespace {
+
+// 比worker的超时(5秒)短得多
+constexpr int64_t kKeepAliveIntervalMs = 1000;
+
+} // namespace
+
+namespace lt {
+
+namespace svc {
+
+std::shared_ptr<WarmWorker> WarmWorker::create(const Params& params) {
+    std::shared_ptr<WarmWorker> worker{new WarmWorker(params)};
+    if (!worker->init(params.ioloop)) {
+        return nullptr;
+    }
+    return worker;
+}
+
+WarmWorker::WarmWorker(const Params& params)
+    : post_delay_task_{params.post_delay_task} {
+    constexpr size_t kRandLength = 4;
+    pipe_name_ = "Lanthing_worker_" + ltlib::randomStr(kRandLength);
+}
+
+WarmWorker::~WarmWorker() {
+    if (process_ != nullptr) {
+        // 没被接管，worker收不到心跳会自己退出
+        process_->stop();
+    }
+}
+
+bool WarmWorker::init(ltlib::IOLoop* ioloop) {
+    ltlib::Server::Params params{};
+    params.stype = ltlib::StreamType::Pipe;
+    params.ioloop = ioloop;
+    params.pipe_name = "\\\\?\\pipe\\" + pipe_name_;
+    params.on_accepted = std::bind(&WarmWorker::onPipeAccepted, this, std::placeholders::_1);
+    params.on_closed = std::bind(&WarmWorker::onPipeDisconnected, this, std::placeholders::_1);
+    params.on_message = std::bind(&WarmWorker::onPipeMessage, this, std::placeholders::_1,
+                                  std::placeholders::_2, std::placeholders::_3);
+    pipe_server_ = ltlib::Server::create(params);
+    if (pipe_server_ == nullptr) {
+        LOG(ERR) << "Init warm worker pipe server failed";
+        return false;
+    }
+    // worker初始化的时候就会打开共享内存，所以要赶在拉起进程之前创建
+    video_ring_ =
+        ltlib::SharedMemoryRing::create(videoFrameRingName(pipe_name_), kVideoFrameRingCapacity);
+    if (video_ring_ == nullptr) {
+        LOG(WARNING) << "Init warm worker video frame ring failed";
+    }
+    WorkerProcess::Params process_params{};
+    process_params.pipe_name = pipe_name_;
+    process_params.path = ltlib::getProgramFullpath();
+    process_params.warm = true;
+    launch_time_us_ = ltlib::steady_now_us();
+    process_ = WorkerProcess::create(process_params);
+    std::weak_ptr<WarmWorker> weak_this = weak_from_this();
+    post_delay_task_(kKeepAliveIntervalMs, [weak_this]() {
+        if (auto that = weak_this.lock()) {
+            that->sendKeepAlive();
+        }
+    });
+    LOG(INFO) << "Launching warm worker " << pipe_name_;
+    return true;
+}
+
+bool WarmWorker::isReady() const {
+    return ready_ && !adopted_;
+}
+
+const std::string& WarmWorker::pipeName() const {
+    return pipe_name_;
+}
+
+int64_t WarmWorker::warmUpMs() const {
+    return warm_up_ms_;
+}
+
+uint32_t WarmWorker::adopt(const Handlers& handlers) {
+    adopted_ = true;
+    handlers_ = handlers;
+    return pipe_client_fd_;
+}
+
+ltlib::Server* WarmWorker::pipeServer() {
+    return pipe_server_.get();
+}
+
+std::shared_ptr<WorkerProcess> WarmWorker::takeProcess() {
+    return std::move(process_);
+}
+
+std::unique_ptr<ltlib::SharedMemoryRing> WarmWorker::takeVideoRing() {
+    return std::move(video_ring_);
+}
+
+void WarmWorker::onPipeAccepted(uint32_t fd) {
+    if (adopted_) {
+        handlers_.on_accepted(fd);
+        return;
+    }
+    if (pipe_client_fd_ != std::numeric_limits<uint32_t>::max()) {
+        LOG(WARNING) << "New warm worker(" << fd << ") connected, but another warm worker("
+                     << pipe_client_fd_ << ") already being serve";
+        pipe_server_->close(fd);
+        return;
+    }
+    pipe_client_fd_ = fd;
+}
+
+void WarmWorker::onPipeDisconnected(uint32_t fd) {
+    if (adopted_) {
+        handlers_.on_closed(fd);
+        return;
+    }
+    if (pipe_client_fd_ != fd) {
+        return;
+    }
+    // WorkerProcess会重新拉起，等新的worker再次就绪
+    pipe_client_fd_ = std::numeric_limits<uint32_t>::max();
+    ready_ = false;
+    LOGF(INFO, "Warm worker(%u) disconnected", fd);
+}
+
+void WarmWorker::onPipeMessage(uint32_t fd, uint32_t type,
+                               std::shared_ptr<google::protobuf::MessageLite> msg) {
+    if (type == ltproto::type::kKeepAliveAck && drop_keepalive_ack_) {
+        return;
+    }
+    if (adopted_) {
+        if (type == ltproto::type::kStreamingParams) {
+            // 这之后的KeepAliveAck都是会话发的KeepAlive的回复
+            drop_keepalive_ack_ = false;
+        }
+        handlers_.on_message(fd, type, msg);
+        return;
+    }
+    if (type != ltproto::type::kStreamingParams) {
+        LOG(WARNING) << "Warm worker sent unexpected message type:" << type;
+        return;
+    }
+    ready_ = true;
+    if (warm_up_ms_ < 0) {
+        warm_up_ms_ = (ltlib::steady_now_us() - launch_time_us_) / 1000;
+    }
+    LOGF(INFO, "Warm worker %s ready, warm up took %lldms", pipe_name_.c_str(), warm_up_ms_);
+}
+
+void WarmWorker::sendKeepAlive() {
+    if (adopted_) {
+        // 接管之后由会话转发客户端的心跳
+        return;
+    }
+    if (pipe_client_fd_ != std::numeric_limits<uint32_t>::max()) {
+        auto msg = std::make_shared<ltproto::common::KeepAlive>();
+        pipe_server_->send(pipe_client_fd_, ltproto::id(msg), msg);
+    }
+    std::weak_ptr<WarmWorker> weak_this = weak_from_this();
+    post_delay_task_(kKeepAliveIntervalMs, [weak_this]() {
+        if (auto that = weak_this.lock()) {
+            that->sendKeepAlive();
+        }
+    });
+}
+
+} // namespace svc
+
+} // namespace lt
@@ -0,0 +1,111 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+
+#include <google/protobuf/message_lite.h>
+
+#include <ltlib/io/ioloop.h>
+#include <ltlib/io/server.h>
+#include <ltlib/shared_memory_ring.h>
+
+namespace lt {
+
+namespace svc {
+
+class WorkerProcess;
+
+// 提前拉起一个worker进程，让它在没有会话的时候就做完探测编码器、打开采集这些耗时的初始化.
+// 会话来了直接接管这个worker，把客户端的串流参数通过管道发过去，分辨率或编码格式不一致时由
+// worker自己重建视频流水线. 没有就绪的预热worker时，WorkerSession照旧冷启动.
+class WarmWorker : public std::enable_shared_from_this<WarmWorker> {
+public:
+    struct Params {
+        ltlib::IOLoop* ioloop;
+        std::function<void(int64_t, const std::function<void()>&)> post_delay_task;
+    };
+
+    // 接管之后管道上的事件都转给会话
+    struct Handlers {
+        std::function<void(uint32_t)> on_accepted;
+        std::function<void(uint32_t)> on_closed;
+        std::function<void(uint32_t, uint32_t, std::shared_ptr<google::protobuf::MessageLite>)>
+            on_message;
+    };
+
+public:
+    static std::shared_ptr<WarmWorker> create(const Params& params);
+    ~WarmWorker();
+
+    // worker已经连上管道并报告了初始化完成
+    bool isReady() const;
+    const std::string& pipeName() const;
+    // 从拉起进程到worker就绪的耗时，也就是冷启动一个worker要花的时间
+    int64_t warmUpMs() const;
+    // 返回当前连着的worker的fd
+    uint32_t adopt(const Handlers& handlers);
+    ltlib::Server* pipeServer();
+    std::shared_ptr<WorkerProcess> takeProcess();
+    std::unique_ptr<ltlib::SharedMemoryRing> takeVideoRing();
+
+private:
+    WarmWorker(const Params& params);
+    bool init(ltlib::IOLoop* ioloop);
+    void onPipeAccepted(uint32_t fd);
+    void onPipeDisconnected(uint32_t fd);
+    void onPipeMessage(uint32_t fd, uint32_t type,
+                       std::shared_ptr<google::protobuf::MessageLite> msg);
+    void sendKeepAlive();
+
+private:
+    std::function<void(int64_t, const std::function<void()>&)> post_delay_task_;
+    std::string pipe_name_;
+    std::unique_ptr<ltlib::Server> pipe_server_;
+    uint32_t pipe_client_fd_ = std::numeric_limits<uint32_t>::max();
+    std::unique_ptr<ltlib::SharedMemoryRing> video_ring_;
+    std::shared_ptr<WorkerProcess> process_;
+    bool ready_ = false;
+    int64_t launch_time_us_ = 0;
+    int64_t warm_up_ms_ = -1;
+    bool adopted_ = false;
+    // 接管之前发出去的KeepAlive，它的Ack不能转给会话
+    bool drop_keepalive_ack_ = true;
+    Handlers handlers_;
+};
+
+} // namespace svc
+
+} // namespace lt
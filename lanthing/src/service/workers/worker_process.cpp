@@ -81,6 +81,7 @@ WorkerProcess::WorkerProcess(const Params& params)
     , client_height_{params.client_height}
     , client_refresh_rate_{params.client_refresh_rate}
     , client_codecs_{params.client_codecs}
+    , warm_{params.warm}
     , run_as_win_service_{ltlib::isRunAsService()} {}
 
 WorkerProcess::~WorkerProcess() {
@@ -99,6 +100,19 @@ void WorkerProcess::stop() {
     stoped_ = true;
 }
 
+void WorkerProcess::setClientParams(uint32_t client_width, uint32_t client_height,
+                                    uint32_t client_refresh_rate,
+                                    const std::vector<lt::VideoCodecType>& client_codecs) {
+    std::lock_guard lk{mutex_};
+    client_width_ = client_width;
+    client_height_ = client_height;
+    client_refresh_rate_ = client_refresh_rate;
+    client_codecs_ = client_codecs;
+    warm_ = false;
+    // 预热的worker已经按客户端参数协商过一次
+    first_launch_ = false;
+}
+
 void WorkerProcess::start() {
     std::lock_guard lk{mutex_};
     if (thread_ != nullptr) {
@@ -125,16 +139,24 @@ void WorkerProcess::mainLoop(const std::function<void()>& i_am_alive) {
 
 bool WorkerProcess::launchWorkerProcess() {
     std::stringstream ss;
-    ss << path_ << " -type worker "
-       << " -name " << pipe_name_ << " -width " << client_width_ << " -height " << client_height_
-       << " -freq " << client_refresh_rate_ << " -codecs " << ::to_string(client_codecs_)
-       << " -action streaming";
-    if (first_launch_) {
-        first_launch_ = false;
-        ss << " -negotiate 1";
-    }
-    else {
-        ss << " -negotiate 0";
+    {
+        std::lock_guard lk{mutex_};
+        ss << path_ << " -type worker "
+           << " -name " << pipe_name_ << " -action streaming";
+        if (warm_) {
+            ss << " -warm 1";
+        }
+        else {
+            ss << " -width " << client_width_ << " -height " << client_height_ << " -freq "
+               << client_refresh_rate_ << " -codecs " << ::to_string(client_codecs_);
+            if (first_launch_) {
+                first_launch_ = false;
+                ss << " -negotiate 1";
+            }
+            else {
+                ss << " -negotiate 0";
+            }
+        }
     }
     std::wstring cmd = ltlib::utf8To16(ss.str());
     if (process_handle_) {
@@ -58,12 +58,18 @@ public:
         uint32_t client_height;
         uint32_t client_refresh_rate;
         std::vector<lt::VideoCodecType> client_codecs;
+        // 预热的worker还不知道客户端参数，启动后等service通过管道发来
+        bool warm = false;
     };
 
 public:
     static std::unique_ptr<WorkerProcess> create(const Params& params);
     ~WorkerProcess();
     void stop();
+    // 预热的worker被会话接管后调用，之后worker退出重启就按客户端参数启动
+    void setClientParams(uint32_t client_width, uint32_t client_height,
+                         uint32_t client_refresh_rate,
+                         const std::vector<lt::VideoCodecType>& client_codecs);
 
 private:
     WorkerProcess(const Params& params);
@@ -80,6 +86,7 @@ private:
     uint32_t client_height_;
     uint32_t client_refresh_rate_;
     std::vector<lt::VideoCodecType> client_codecs_;
+    bool warm_;
     bool run_as_win_service_;
     std::mutex mutex_;
     std::unique_ptr<ltlib::BlockingThread> thread_;
@@ -30,8 +30,13 @@
 
 #include "worker_session.h"
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <vector>
 
+#include <ltlib/frame_trace.h>
 #include <ltlib/logging.h>
 
 #include <ltproto/client2service/time_sync.pb.h>
@@ -44,6 +49,7 @@
 #include <ltproto/client2worker/video_frame.pb.h>
 #include <ltproto/common/keep_alive.pb.h>
 #include <ltproto/common/keep_alive_ack.pb.h>
+#include <ltproto/common/streaming_params.pb.h>
 #include <ltproto/server/open_connection.pb.h>
 #include <ltproto/service2app/accepted_connection.pb.h>
 #include <ltproto/service2app/connection_status.pb.h>
@@ -64,7 +70,12 @@
 #include <transport/transport_rtc2.h>
 #include <transport/transport_tcp.h>
 
+#include <graphics/keyframe_request.h>
+
+#include "session_recorder.h"
+#include "warm_worker.h"
 #include "worker_process.h"
+#include <worker/video_frame_ring.h>
 #include <string_keys.h>
 
 namespace {
@@ -109,12 +120,15 @@ WorkerSession::WorkerSession(const Params& params)
     , on_accepted_connection_(params.on_accepted_connection)
     , on_connection_status_(params.on_connection_status)
     , user_defined_relay_server_(params.user_defined_relay_server)
+    , warm_worker_(params.warm_worker)
     , on_create_session_completed_(params.on_create_completed)
     , on_closed_(params.on_closed)
     , enable_gamepad_(params.enable_gamepad)
     , enable_keyboard_(params.enable_keyboard)
     , enable_mouse_(params.enable_mouse)
-    , force_relay_(params.force_relay) {
+    , force_relay_(params.force_relay)
+    , record_directory_(params.record_directory)
+    , fanout_source_(params.fanout_source) {
     constexpr int kRandLength = 4;
     pipe_name_ = "Lanthing_worker_";
     for (int i = 0; i < kRandLength; ++i) {
@@ -123,6 +137,11 @@ WorkerSession::WorkerSession(const Params& params)
 }
 
 WorkerSession::~WorkerSession() {
+    if (video_ring_thread_ != nullptr) {
+        video_ring_stoped_ = true;
+        video_ring_->wakeup();
+        video_ring_thread_.reset();
+    }
     if (tp_server_ != nullptr) {
         switch (LT_TRANSPORT_TYPE) {
         case LT_TRANSPORT_TCP:
@@ -176,6 +195,10 @@ void WorkerSession::close() {
     postTask(std::bind(&WorkerSession::onClosed, this, CloseReason::UserKick));
 }
 
+bool WorkerSession::isViewer() const {
+    return fanout_source_ != nullptr;
+}
+
 bool WorkerSession::init(std::shared_ptr<google::protobuf::MessageLite> _msg,
                          ltlib::IOLoop* ioloop) {
     auto msg = std::static_pointer_cast<ltproto::server::OpenConnection>(_msg);
@@ -231,15 +254,28 @@ bool WorkerSession::init(std::shared_ptr<google::protobuf::MessageLite> _msg,
         LOG(WARNING) << "Client doesn't supports any valid video codec";
         return false;
     }
+    if (isViewer()) {
+        return initViewer(client_codecs, ioloop);
+    }
 
+    worker_start_time_us_ = ltlib::steady_now_us();
     if (!initSignlingClient(ioloop)) {
         LOG(WARNING) << "Init signaling client failed";
         return false;
     }
+    if (warm_worker_ != nullptr) {
+        adoptWarmWorker((uint32_t)client_width, (uint32_t)client_height,
+                        (uint32_t)client_refresh_rate, client_codecs);
+        return true;
+    }
     if (!initPipeServer(ioloop)) {
         LOG(WARNING) << "Init worker pipe server failed";
         return false;
     }
+    if (!initVideoFrameRing()) {
+        // 不影响串流，worker打不开共享内存会退回到用pipe传视频帧
+        LOG(WARNING) << "Init video frame ring failed, worker will send video frames through pipe";
+    }
     createWorkerProcess((uint32_t)client_width, (uint32_t)client_height,
                         (uint32_t)client_refresh_rate, client_codecs);
     return true;
@@ -368,6 +404,45 @@ void WorkerSession::createWorkerProcess(uint32_t client_width, uint32_t client_h
     worker_process_ = WorkerProcess::create(params);
 }
 
+void WorkerSession::adoptWarmWorker(uint32_t client_width, uint32_t client_height,
+                                    uint32_t client_refresh_rate,
+                                    std::vector<lt::VideoCodecType> client_codecs) {
+    LOG(INFO) << "Adopt warm worker " << warm_worker_->pipeName();
+    pipe_name_ = warm_worker_->pipeName();
+    WarmWorker::Handlers handlers{};
+    handlers.on_accepted = std::bind(&WorkerSession::onPipeAccepted, this, std::placeholders::_1);
+    handlers.on_closed = std::bind(&WorkerSession::onPipeDisconnected, this, std::placeholders::_1);
+    handlers.on_message = std::bind(&WorkerSession::onPipeMessage, this, std::placeholders::_1,
+                                    std::placeholders::_2, std::placeholders::_3);
+    pipe_client_fd_ = warm_worker_->adopt(handlers);
+    worker_process_ = warm_worker_->takeProcess();
+    worker_process_->setClientParams(client_width, client_height, client_refresh_rate,
+                                     client_codecs);
+    video_ring_ = warm_worker_->takeVideoRing();
+    if (video_ring_ == nullptr || !startVideoFrameRing()) {
+        LOG(WARNING) << "Warm worker has no video frame ring, it will send video frames through "
+                        "pipe";
+    }
+    // worker按客户端参数重新协商，回一个StreamingParams，之后和冷启动的worker走一样的流程
+    auto params = std::make_shared<ltproto::common::StreamingParams>();
+    params->set_video_width(static_cast<int32_t>(client_width));
+    params->set_video_height(static_cast<int32_t>(client_height));
+    params->set_screen_refresh_rate(static_cast<int32_t>(client_refresh_rate));
+    for (auto codec : client_codecs) {
+        switch (codec) {
+        case lt::VideoCodecType::H264:
+            params->add_video_codecs(ltproto::common::VideoCodecType::AVC);
+            break;
+        case lt::VideoCodecType::H265:
+            params->add_video_codecs(ltproto::common::VideoCodecType::HEVC);
+            break;
+        default:
+            break;
+        }
+    }
+    sendToWorker(ltproto::id(params), params);
+}
+
 void WorkerSession::onClosed(CloseReason reason) {
     // NOTE: 运行在ioloop
     bool rtc_closed = false;
@@ -390,14 +465,25 @@ void WorkerSession::onClosed(CloseReason reason) {
     default:
         break;
     }
+    closed_ = true;
+    if (isViewer()) {
+        // 观看者退出不影响worker，只是少了一路转发
+        // 先从转发列表里移除，fanoutVideo()/fanoutAudio()就不会再用到下面关闭的tp_server_
+        fanout_source_->removeViewer(this);
+        fanout_source_->updateEncoderBitrate();
+    }
     if (!rtc_closed) {
         tp_server_->close();
     }
-    if (reason != CloseReason::WorkerFailed) {
-        auto msg = std::make_shared<ltproto::worker2service::StopWorking>();
-        sendToWorker(ltproto::id(msg), msg);
-        if (worker_process_ != nullptr) {
-            worker_process_->stop();
+    if (!isViewer()) {
+        closeViewers();
+        dumpFrameTrace();
+        if (reason != CloseReason::WorkerFailed) {
+            auto msg = std::make_shared<ltproto::worker2service::StopWorking>();
+            sendToWorker(ltproto::id(msg), msg);
+            if (worker_process_ != nullptr) {
+                worker_process_->stop();
+            }
         }
     }
     postDelayTask(
@@ -610,11 +696,16 @@ bool WorkerSession::initPipeServer(ltlib::IOLoop* ioloop) {
     return true;
 }
 
+ltlib::Server* WorkerSession::pipeServer() {
+    // 接管的预热worker连的是WarmWorker的管道
+    return warm_worker_ != nullptr ? warm_worker_->pipeServer() : pipe_server_.get();
+}
+
 void WorkerSession::onPipeAccepted(uint32_t fd) {
     if (pipe_client_fd_ != std::numeric_limits<uint32_t>::max()) {
         LOG(WARNING) << "New worker(" << fd << ") connected to service, but another worker(" << fd
                      << ") already being serve";
-        pipe_server_->close(fd);
+        pipeServer()->close(fd);
         return;
     }
     pipe_client_fd_ = fd;
@@ -702,7 +793,15 @@ void WorkerSession::onStartWorkingAck(std::shared_ptr<google::protobuf::MessageL
 
 void WorkerSession::sendToWorker(uint32_t type,
                                  std::shared_ptr<google::protobuf::MessageLite> msg) {
-    pipe_server_->send(pipe_client_fd_, type, msg);
+    if (isViewer()) {
+        if (fanout_source_->closed_) {
+            // 主会话已经关闭，worker也跟着退出了
+            return;
+        }
+        fanout_source_->sendToWorker(type, msg);
+        return;
+    }
+    pipeServer()->send(pipe_client_fd_, type, msg);
 }
 
 void WorkerSession::sendToWorkerFromOtherThread(
@@ -710,6 +809,83 @@ void WorkerSession::sendToWorkerFromOtherThread(
     postTask([this, type, msg]() { sendToWorker(type, msg); });
 }
 
+bool WorkerSession::initVideoFrameRing() {
+    video_ring_ =
+        ltlib::SharedMemoryRing::create(videoFrameRingName(pipe_name_), kVideoFrameRingCapacity);
+    if (video_ring_ == nullptr) {
+        return false;
+    }
+    return startVideoFrameRing();
+}
+
+bool WorkerSession::startVideoFrameRing() {
+    video_ring_thread_ = ltlib::BlockingThread::create(
+        "video_ring", [this](const std::function<void()>& i_am_alive) {
+            videoFrameRingLoop(i_am_alive);
+        });
+    return video_ring_thread_ != nullptr;
+}
+
+void WorkerSession::videoFrameRingLoop(const std::function<void()>& i_am_alive) {
+    // 这个线程只负责等worker的通知，读共享内存在ioloop上做，保证只有一个消费者
+    while (!video_ring_stoped_) {
+        i_am_alive();
+        if (video_ring_->waitForData(100) != ltlib::Event::WaitResult::Success ||
+            video_ring_stoped_) {
+            continue;
+        }
+        if (!video_ring_draining_.exchange(true)) {
+            postTask(std::bind(&WorkerSession::drainVideoFrameRing, this));
+        }
+    }
+}
+
+void WorkerSession::drainVideoFrameRing() {
+    // NOTE: 运行在ioloop
+    auto on_record = std::bind(&WorkerSession::onVideoFrameFromRing, this, std::placeholders::_1);
+    while (true) {
+        while (video_ring_->read(on_record)) {
+        }
+        video_ring_draining_ = false;
+        // 清标志前worker写入的通知可能被video_ring线程忽略了，这里再检查一次
+        if (!video_ring_->hasData() || video_ring_draining_.exchange(true)) {
+            return;
+        }
+    }
+}
+
+void WorkerSession::onVideoFrameFromRing(std::span<const uint8_t> record) {
+    // NOTE: 运行在ioloop，record指向共享内存，只在这个函数内有效.
+    // 读指针要等这个函数返回才前移，worker不会覆盖这段数据，发送、转发、录制都会在这里同步拷走，
+    // 所以不用再拷一份. 头部先拷出来再检查，帧数据即使被worker改了也只影响它自己的画面
+    VideoFrameRingHeader header;
+    if (record.size() < sizeof(header)) {
+        LOG(ERR) << "Invalid video frame record size " << record.size();
+        return;
+    }
+    memcpy(&header, record.data(), sizeof(header));
+    if (tp_server_ == nullptr) {
+        return;
+    }
+    lt::VideoFrame video_frame{};
+    video_frame.capture_timestamp_us = header.capture_timestamp_us;
+    video_frame.start_encode_timestamp_us = header.start_encode_timestamp_us;
+    video_frame.end_encode_timestamp_us = header.end_encode_timestamp_us;
+    video_frame.width = header.width;
+    video_frame.height = header.height;
+    video_frame.is_keyframe = header.is_keyframe != 0;
+    video_frame.data = record.data() + sizeof(header);
+    video_frame.size = static_cast<uint32_t>(record.size() - sizeof(header));
+    video_frame.ltframe_id = header.ltframe_id;
+    traceVideoFrame(video_frame);
+    tp_server_->sendVideo(video_frame);
+    fanoutVideo(video_frame);
+    if (recorder_ != nullptr) {
+        recorder_->onVideo(video_frame);
+    }
+    calcVideoSpeed(video_frame.size);
+}
+
 void WorkerSession::onKeepAliveAck() {
     auto ack = std::make_shared<ltproto::common::KeepAliveAck>();
     sendMessageToRemoteClient(ltproto::id(ack), ack, true);
@@ -718,7 +894,16 @@ void WorkerSession::onKeepAliveAck() {
 void WorkerSession::onWorkerStreamingParams(std::shared_ptr<google::protobuf::MessageLite> msg) {
     if (negotiated_streaming_params_ == nullptr) {
         // 第一次收到Worker进程的onWorkerStreamingParams
+        int64_t elapsed_ms = (ltlib::steady_now_us() - worker_start_time_us_) / 1000;
+        if (warm_worker_ != nullptr) {
+            LOGF(INFO, "Worker ready after %lldms, warm worker (cold start took %lldms)",
+                 elapsed_ms, warm_worker_->warmUpMs());
+        }
+        else {
+            LOGF(INFO, "Worker ready after %lldms, cold start", elapsed_ms);
+        }
         negotiated_streaming_params_ = msg;
+        createRecorder();
         maybeOnCreateSessionCompleted();
     }
     else {
@@ -800,9 +985,15 @@ void WorkerSession::onTpLossRateUpdate(void* user_data, float rate) {
 
 void WorkerSession::onTpEesimatedVideoBitreateUpdate(void* user_data, uint32_t bps) {
     auto that = reinterpret_cast<WorkerSession*>(user_data);
-    auto msg = std::make_shared<ltproto::worker2service::ReconfigureVideoEncoder>();
-    msg->set_bitrate_bps(bps);
-    that->sendToWorkerFromOtherThread(ltproto::id(msg), msg);
+    that->video_bitrate_bps_ = bps;
+    that->postTask([that]() {
+        if (that->isViewer()) {
+            that->fanout_source_->updateEncoderBitrate();
+        }
+        else {
+            that->updateEncoderBitrate();
+        }
+    });
 }
 
 void WorkerSession::onTpStat(void* user_data, uint32_t bwe_bps, uint32_t nack) {
@@ -813,6 +1004,10 @@ void WorkerSession::onTpStat(void* user_data, uint32_t bwe_bps, uint32_t nack) {
     msg->set_nack(nack);
     msg->set_loss_rate(that->loss_rate_);
     LOG(DEBUG) << "BWE " << bwe_bps << " NACK " << nack;
+    // worker根据带宽和丢包调整音频码率，观看者的链路不参与
+    if (!that->isViewer()) {
+        that->sendToWorkerFromOtherThread(ltproto::id(msg), msg);
+    }
     that->postTask([that, msg]() { that->sendMessageToRemoteClient(ltproto::id(msg), msg, true); });
 }
 
@@ -831,7 +1026,12 @@ void WorkerSession::onCapturedVideo(std::shared_ptr<google::protobuf::MessageLit
     video_frame.data = reinterpret_cast<const uint8_t*>(encoded_frame->frame().data());
     video_frame.size = static_cast<uint32_t>(encoded_frame->frame().size());
     video_frame.ltframe_id = encoded_frame->picture_id();
+    traceVideoFrame(video_frame);
     tp_server_->sendVideo(video_frame);
+    fanoutVideo(video_frame);
+    if (recorder_ != nullptr) {
+        recorder_->onVideo(video_frame);
+    }
 
     calcVideoSpeed(video_frame.size);
     // static std::ofstream out{"./service_stream", std::ios::binary};
@@ -839,12 +1039,45 @@ void WorkerSession::onCapturedVideo(std::shared_ptr<google::protobuf::MessageLit
     // out.flush();
 }
 
+void WorkerSession::traceVideoFrame(const lt::VideoFrame& frame) {
+    // worker和service在同一台机器，时间戳都是steady clock，就是参考时钟
+    // Send由传输层发出首包时打点(目前只有rtc2)
+    auto tracer = ltlib::FrameTracer::instance();
+    if (!tracer->enabled()) {
+        return;
+    }
+    tracer->stamp(frame.ltframe_id, ltlib::FrameTracer::Stage::Capture,
+                  frame.capture_timestamp_us);
+    tracer->stamp(frame.ltframe_id, ltlib::FrameTracer::Stage::StartEncode,
+                  frame.start_encode_timestamp_us);
+    tracer->stamp(frame.ltframe_id, ltlib::FrameTracer::Stage::EndEncode,
+                  frame.end_encode_timestamp_us);
+}
+
+void WorkerSession::dumpFrameTrace() {
+    if (!ltlib::FrameTracer::instance()->enabled()) {
+        return;
+    }
+    std::filesystem::path path = ltlib::getConfigPath(true);
+    path /= "trace";
+    if (!std::filesystem::exists(path) && !std::filesystem::create_directories(path)) {
+        LOG(ERR) << "Create frame trace directory '" << path.string() << "' failed";
+        return;
+    }
+    path /= "host_frame_trace_" + std::to_string(ltlib::utc_now_ms()) + ".json";
+    ltlib::FrameTracer::instance()->dumpChromeTrace(path.string());
+}
+
 void WorkerSession::onCapturedAudio(std::shared_ptr<google::protobuf::MessageLite> _msg) {
     auto captured_audio = std::static_pointer_cast<ltproto::client2worker::AudioData>(_msg);
     lt::AudioData audio_data{};
     audio_data.data = reinterpret_cast<const uint8_t*>(captured_audio->data().c_str());
     audio_data.size = static_cast<uint32_t>(captured_audio->data().size());
     tp_server_->sendAudio(audio_data);
+    fanoutAudio(audio_data);
+    if (recorder_ != nullptr) {
+        recorder_->onAudio(audio_data);
+    }
 }
 
 void WorkerSession::onTimeSync(std::shared_ptr<google::protobuf::MessageLite> _msg) {
@@ -898,6 +1131,13 @@ void WorkerSession::dispatchDcMessage(uint32_t type,
     default:
         break;
     }
+    if (isViewer()) {
+        // 观看者不能操作被控端，只允许请求关键帧
+        if (type == ltype::kRequestKeyframe) {
+            sendToWorkerFromOtherThread(type, msg);
+        }
+        return;
+    }
     if (worker_registered_msg_.find(type) != worker_registered_msg_.cend()) {
         sendToWorkerFromOtherThread(type, msg);
     }
@@ -918,16 +1158,48 @@ void WorkerSession::onStartTransmission(std::shared_ptr<google::protobuf::Messag
         sendMessageToRemoteClient(ltproto::id(ack), ack, true);
         return;
     }
+    if (isViewer()) {
+        postTask(std::bind(&WorkerSession::startViewing, this));
+        return;
+    }
     startWorking();
     // 暂时不回Ack，等到worker process回了StartWorkingAck再回.
 }
 
 void WorkerSession::onKeepAlive(std::shared_ptr<google::protobuf::MessageLite> msg) {
     // 是否需给client要回ack
+    if (isViewer()) {
+        // worker的心跳由fanout_source负责，这里直接回
+        auto ack = std::make_shared<ltproto::common::KeepAliveAck>();
+        sendMessageToRemoteClient(ltproto::id(ack), ack, true);
+        return;
+    }
     // 转发给worker
     postTask([this, msg]() { sendToWorker(ltproto::type::kKeepAlive, msg); });
 }
 
+void WorkerSession::createRecorder() {
+    // 这时还没有StartWorking，worker不会发视频帧，之后recorder_不再改变，不需要加锁
+    if (record_directory_.empty()) {
+        return;
+    }
+    auto negotiated_params =
+        std::static_pointer_cast<ltproto::common::StreamingParams>(negotiated_streaming_params_);
+    SessionRecorder::Params params{};
+    params.directory = record_directory_;
+    params.name = std::to_string(client_device_id_) + "_" + session_name_;
+    params.video_codec = ::to_ltrtc(
+        static_cast<ltproto::common::VideoCodecType>(negotiated_params->video_codecs().Get(0)));
+    // LT_TRANSPORT_RTC传的是PCM，只录视频
+    params.audio_channels =
+        LT_TRANSPORT_TYPE == LT_TRANSPORT_RTC ? 0 : negotiated_params->audio_channels();
+    params.audio_sample_rate = negotiated_params->audio_sample_rate();
+    recorder_ = SessionRecorder::create(params);
+    if (recorder_ == nullptr) {
+        LOG(WARNING) << "Create session recorder failed, streaming without recording";
+    }
+}
+
 void WorkerSession::updateLastRecvTime() {
     last_recv_time_us_ = ltlib::steady_now_us();
 }
@@ -1028,6 +1300,121 @@ bool WorkerSession::sendMessageToRemoteClient(
 void WorkerSession::bypassToClient(uint32_t type,
                                    std::shared_ptr<google::protobuf::MessageLite> msg) {
     sendMessageToRemoteClient(type, msg, true);
+    fanoutMessage(type, msg);
+}
+
+bool WorkerSession::initViewer(const std::vector<lt::VideoCodecType>& client_codecs,
+                               ltlib::IOLoop* ioloop) {
+    // 直接沿用fanout_source协商好的参数，分辨率不同由客户端渲染时缩放
+    auto negotiated_params = std::static_pointer_cast<ltproto::common::StreamingParams>(
+        fanout_source_->negotiated_streaming_params_);
+    if (negotiated_params == nullptr) {
+        LOG(WARNING) << "Fan-out source hasn't negotiated streaming params";
+        return false;
+    }
+    auto codec = ::to_ltrtc(
+        static_cast<ltproto::common::VideoCodecType>(negotiated_params->video_codecs().Get(0)));
+    if (std::find(client_codecs.begin(), client_codecs.end(), codec) == client_codecs.end()) {
+        LOG(WARNING) << "Viewer doesn't support codec " << static_cast<int>(codec);
+        return false;
+    }
+    negotiated_streaming_params_ = negotiated_params;
+    if (!initSignlingClient(ioloop)) {
+        LOG(WARNING) << "Init signaling client failed";
+        return false;
+    }
+    return true;
+}
+
+void WorkerSession::startViewing() {
+    // NOTE: 运行在ioloop
+    fanout_source_->addViewer(shared_from_this());
+    // 新观看者要从关键帧开始解码
+    auto req = std::make_shared<ltproto::client2worker::RequestKeyframe>();
+    KeyframeRequestInfo info;
+    info.full_keyframe = true;
+    writeKeyframeRequestInfo(*req, info);
+    sendToWorker(ltproto::id(req), req);
+    auto ack = std::make_shared<ltproto::client2worker::StartTransmissionAck>();
+    ack->set_err_code(ltproto::ErrorCode::Success);
+    sendMessageToRemoteClient(ltproto::id(ack), ack, true);
+    tellAppAccpetedConnection();
+    postDelayTask(
+        1000, std::bind(&WorkerSession::sendConnectionStatus, this, true, false, false, false));
+}
+
+void WorkerSession::addViewer(const std::shared_ptr<WorkerSession>& viewer) {
+    std::lock_guard lock{viewers_mtx_};
+    viewers_.push_back(viewer);
+    LOG(INFO) << "Viewer " << viewer->session_name_ << " joined, " << viewers_.size()
+              << " viewer(s) sharing session " << session_name_;
+}
+
+void WorkerSession::removeViewer(const WorkerSession* viewer) {
+    // 这里持有的不是最后一个引用，WorkerSession不会在锁内析构
+    std::lock_guard lock{viewers_mtx_};
+    std::erase_if(viewers_, [viewer](const std::shared_ptr<WorkerSession>& v) {
+        return v.get() == viewer;
+    });
+}
+
+void WorkerSession::closeViewers() {
+    std::vector<std::shared_ptr<WorkerSession>> viewers;
+    {
+        std::lock_guard lock{viewers_mtx_};
+        viewers.swap(viewers_);
+    }
+    for (auto& viewer : viewers) {
+        viewer->close();
+    }
+}
+
+void WorkerSession::fanoutVideo(const lt::VideoFrame& frame) {
+    // NOTE: 运行在ioloop
+    std::lock_guard lock{viewers_mtx_};
+    for (auto& viewer : viewers_) {
+        viewer->tp_server_->sendVideo(frame);
+    }
+}
+
+void WorkerSession::fanoutAudio(const lt::AudioData& audio) {
+    std::lock_guard lock{viewers_mtx_};
+    for (auto& viewer : viewers_) {
+        viewer->tp_server_->sendAudio(audio);
+    }
+}
+
+void WorkerSession::fanoutMessage(uint32_t type,
+                                  std::shared_ptr<google::protobuf::MessageLite> msg) {
+    std::lock_guard lock{viewers_mtx_};
+    for (auto& viewer : viewers_) {
+        viewer->sendMessageToRemoteClient(type, msg, true);
+    }
+}
+
+void WorkerSession::updateEncoderBitrate() {
+    // NOTE: 运行在ioloop
+    if (closed_) {
+        // 主会话关闭时closeViewers()会让每个观看者回调到这里，此时worker管道已经不可用
+        return;
+    }
+    // 只有一路编码，码率取所有链路带宽估计的最小值，保证每个观看者都不拥塞
+    uint32_t bps = video_bitrate_bps_;
+    {
+        std::lock_guard lock{viewers_mtx_};
+        for (auto& viewer : viewers_) {
+            uint32_t viewer_bps = viewer->video_bitrate_bps_;
+            if (viewer_bps != 0 && (bps == 0 || viewer_bps < bps)) {
+                bps = viewer_bps;
+            }
+        }
+    }
+    if (bps == 0) {
+        return;
+    }
+    auto msg = std::make_shared<ltproto::worker2service::ReconfigureVideoEncoder>();
+    msg->set_bitrate_bps(bps);
+    sendToWorker(ltproto::id(msg), msg);
 }
 
 } // namespace svc
@@ -39,6 +39,7 @@
 #include <ltlib/io/client.h>
 #include <ltlib/io/ioloop.h>
 #include <ltlib/io/server.h>
+#include <ltlib/shared_memory_ring.h>
 #include <ltlib/threads.h>
 #include <ltlib/time_sync.h>
 #include <transport/transport.h>
@@ -48,6 +49,8 @@ namespace lt {
 namespace svc {
 
 class WorkerProcess;
+class SessionRecorder;
+class WarmWorker;
 
 class WorkerSession : public std::enable_shared_from_this<WorkerSession> {
     struct SpeedEntry {
@@ -80,6 +83,12 @@ public:
         bool enable_keyboard;
         bool enable_mouse;
         bool force_relay;
+        // 非空时本会话只观看，共用fanout_source的worker进程，不再另起一路采集编码
+        std::shared_ptr<WorkerSession> fanout_source;
+        // 非空时把发出去的音视频另存到这个目录
+        std::string record_directory;
+        // 非空时接管这个已经初始化好的worker，不再冷启动worker进程
+        std::shared_ptr<WarmWorker> warm_worker;
     };
 
 public:
@@ -93,6 +102,7 @@ public:
     void enableKeyboard();
     void disableKeyboard();
     void close();
+    bool isViewer() const;
 
 private:
     WorkerSession(const Params& params);
@@ -104,6 +114,9 @@ private:
     void createWorkerProcess(uint32_t client_width, uint32_t client_height,
                              uint32_t client_refresh_rate,
                              std::vector<lt::VideoCodecType> client_codecs);
+    void adoptWarmWorker(uint32_t client_width, uint32_t client_height,
+                         uint32_t client_refresh_rate,
+                         std::vector<lt::VideoCodecType> client_codecs);
     void onClosed(CloseReason reason);
     void maybeOnCreateSessionCompleted();
     void postTask(const std::function<void()>& task);
@@ -127,6 +140,7 @@ private:
 
     // worker process
     bool initPipeServer(ltlib::IOLoop* ioloop);
+    ltlib::Server* pipeServer();
     void onPipeAccepted(uint32_t fd);
     void onPipeDisconnected(uint32_t fd);
     void onPipeMessage(uint32_t fd, uint32_t type,
@@ -137,6 +151,11 @@ private:
     void sendToWorkerFromOtherThread(uint32_t type,
                                      std::shared_ptr<google::protobuf::MessageLite> msg);
     void onKeepAliveAck();
+    bool initVideoFrameRing();
+    bool startVideoFrameRing();
+    void videoFrameRingLoop(const std::function<void()>& i_am_alive);
+    void drainVideoFrameRing();
+    void onVideoFrameFromRing(std::span<const uint8_t> record);
     void onWorkerStreamingParams(std::shared_ptr<google::protobuf::MessageLite> msg);
 
     // rtc server
@@ -170,6 +189,22 @@ private:
     void tellAppAccpetedConnection();
     void sendConnectionStatus(bool repeat, bool gp_hit, bool kb_hit, bool mouse_hit);
     void calcVideoSpeed(int64_t new_frame_bytes);
+    void traceVideoFrame(const lt::VideoFrame& frame);
+    void dumpFrameTrace();
+    void createRecorder();
+
+    // 多人观看
+    bool initViewer(const std::vector<lt::VideoCodecType>& client_codecs,
+                    ltlib::IOLoop* ioloop);
+    void startViewing();
+    // 以下只在fanout_source上调用
+    void addViewer(const std::shared_ptr<WorkerSession>& viewer);
+    void removeViewer(const WorkerSession* viewer);
+    void closeViewers();
+    void fanoutVideo(const lt::VideoFrame& frame);
+    void fanoutAudio(const lt::AudioData& audio);
+    void fanoutMessage(uint32_t type, std::shared_ptr<google::protobuf::MessageLite> msg);
+    void updateEncoderBitrate();
 
 private:
     std::string session_name_;
@@ -184,8 +219,15 @@ private:
     std::unique_ptr<ltlib::Server> pipe_server_;
     uint32_t pipe_client_fd_ = std::numeric_limits<uint32_t>::max();
     std::string pipe_name_;
+    std::unique_ptr<ltlib::SharedMemoryRing> video_ring_;
+    std::unique_ptr<ltlib::BlockingThread> video_ring_thread_;
+    std::atomic<bool> video_ring_stoped_{false};
+    // ioloop上已经有一个待执行或正在执行的drainVideoFrameRing()
+    std::atomic<bool> video_ring_draining_{false};
     std::set<uint32_t> worker_registered_msg_;
     std::shared_ptr<WorkerProcess> worker_process_;
+    std::shared_ptr<WarmWorker> warm_worker_;
+    int64_t worker_start_time_us_ = 0;
     int64_t client_device_id_ = 0;
     std::string service_id_;
     std::string room_id_;
@@ -214,10 +256,21 @@ private:
     int64_t video_send_bps_ = 0;
     bool force_relay_ = false;
     bool first_start_working_ack_received_ = false;
+    std::string record_directory_;
+    // 在第一个视频帧之前创建，之后只读
+    std::unique_ptr<SessionRecorder> recorder_;
 
     std::atomic<bool> enable_gamepad_;
     std::atomic<bool> enable_keyboard_;
     std::atomic<bool> enable_mouse_;
+
+    std::shared_ptr<WorkerSession> fanout_source_;
+    std::mutex viewers_mtx_;
+    // 观看者和fanout_source互相持有，观看者关闭时从这里移除以解开循环引用
+    std::vector<std::shared_ptr<WorkerSession>> viewers_;
+    std::atomic<uint32_t> video_bitrate_bps_{0};
+    // 作为fanout_source关闭后，观看者不能再通过它往worker发消息
+    std::atomic<bool> closed_{false};
 };
 
 } // namespace svc
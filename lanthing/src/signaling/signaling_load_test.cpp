@@ -0,0 +1,241 @@
+// 信令服务器压测客户端.
+// 每个房间两个连接: 第一个加入成功后第二个再加入，然后两边互相发SignalingMessage直到达到指定条数.
+// 所有房间同时在线，输出加房间速度、转发消息吞吐和失败数，有失败或超时时返回非0，可以直接放进CI.
+// 不指定-port时在进程内启动一个SignalingServer，不需要网络:
+//   signaling_load_test -rooms 1000 -messages 50 -threads 4
+//   signaling_load_test -host 10.0.0.2 -port 44899 -rooms 5000
+
+#if defined(LT_LINUX)
+#include <sys/resource.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <g3log/logworker.hpp>
+
+#include <ltlib/io/client.h>
+#include <ltlib/io/ioloop.h>
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+#include <ltproto/ltproto.h>
+#include <ltproto/signaling/join_room.pb.h>
+#include <ltproto/signaling/join_room_ack.pb.h>
+#include <ltproto/signaling/signaling_message.pb.h>
+#include <ltproto/signaling/signaling_message_ack.pb.h>
+
+#include "signaling_server.h"
+
+namespace {
+
+struct NullSink {
+    void receive(g3::LogMessageMover message) { (void)message; }
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t port = 0;
+    uint32_t rooms = 1000;
+    uint32_t messages = 50;
+    uint32_t threads = 4;
+};
+
+// 一个房间的两个连接都在同一个ioloop上，不需要加锁
+struct Room {
+    std::string room_id;
+    std::unique_ptr<ltlib::Client> peers[2];
+    uint32_t received = 0;
+};
+
+struct Stats {
+    std::atomic<uint32_t> joined{0};
+    std::atomic<uint32_t> finished{0};
+    std::atomic<uint32_t> failures{0};
+    std::atomic<int64_t> all_joined_us{0};
+    std::promise<void> done;
+};
+
+Options parseOptions(int argc, char* argv[]) {
+    std::map<std::string, std::string> kv;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        kv[argv[i]] = argv[i + 1];
+    }
+    Options options;
+    if (kv.count("-host")) {
+        options.host = kv["-host"];
+    }
+    if (kv.count("-port")) {
+        options.port = static_cast<uint16_t>(std::atoi(kv["-port"].c_str()));
+    }
+    if (kv.count("-rooms")) {
+        options.rooms = static_cast<uint32_t>(std::atoi(kv["-rooms"].c_str()));
+    }
+    if (kv.count("-messages")) {
+        options.messages = static_cast<uint32_t>(std::atoi(kv["-messages"].c_str()));
+    }
+    if (kv.count("-threads")) {
+        options.threads = std::max(1u, static_cast<uint32_t>(std::atoi(kv["-threads"].c_str())));
+    }
+    return options;
+}
+
+void raiseFdLimit() {
+#if defined(LT_LINUX)
+    // 每个房间两个连接，内嵌服务器时两端共4个fd，默认的1024不够用
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+void sendSignaling(ltlib::Client* client, uint32_t seq) {
+    auto msg = std::make_shared<ltproto::signaling::SignalingMessage>();
+    msg->set_level(ltproto::signaling::SignalingMessage::Core);
+    auto coremsg = msg->mutable_core_message();
+    coremsg->set_key("load_test");
+    coremsg->set_value(std::to_string(seq));
+    client->send(ltproto::id(msg), msg);
+}
+
+void connectPeer(const Options& options, ltlib::IOLoop* ioloop, Room* room, int index,
+                 Stats* stats) {
+    ltlib::Client::Params params{};
+    params.stype = ltlib::StreamType::TCP;
+    params.ioloop = ioloop;
+    params.host = options.host;
+    params.port = options.port;
+    params.is_tls = false;
+    params.on_connected = [room, index]() {
+        auto msg = std::make_shared<ltproto::signaling::JoinRoom>();
+        msg->set_room_id(room->room_id);
+        msg->set_session_id(room->room_id + "_" + std::to_string(index));
+        room->peers[index]->send(ltproto::id(msg), msg);
+    };
+    params.on_closed = [stats]() { stats->failures++; };
+    params.on_reconnecting = []() {};
+    params.on_message = [&options, ioloop, room, index,
+                         stats](uint32_t type,
+                                const std::shared_ptr<google::protobuf::MessageLite>& _msg) {
+        namespace ltype = ltproto::type;
+        switch (type) {
+        case ltype::kJoinRoomAck:
+        {
+            auto msg = std::static_pointer_cast<ltproto::signaling::JoinRoomAck>(_msg);
+            if (msg->err_code() != ltproto::ErrorCode::Success) {
+                stats->failures++;
+                break;
+            }
+            if (index == 0) {
+                connectPeer(options, ioloop, room, 1, stats);
+                break;
+            }
+            if (++stats->joined == options.rooms) {
+                stats->all_joined_us = ltlib::steady_now_us();
+            }
+            sendSignaling(room->peers[1].get(), 0);
+            break;
+        }
+        case ltype::kSignalingMessage:
+            if (++room->received < options.messages) {
+                sendSignaling(room->peers[index].get(), room->received);
+            }
+            else if (++stats->finished == options.rooms) {
+                stats->done.set_value();
+            }
+            break;
+        case ltype::kSignalingMessageAck:
+        {
+            auto msg = std::static_pointer_cast<ltproto::signaling::SignalingMessageAck>(_msg);
+            if (msg->err_code() != ltproto::ErrorCode::Success) {
+                stats->failures++;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    };
+    room->peers[index] = ltlib::Client::create(params);
+    if (room->peers[index] == nullptr) {
+        stats->failures++;
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto worker = g3::LogWorker::createLogWorker();
+    worker->addSink(std::make_unique<NullSink>(), &NullSink::receive);
+    g3::initializeLogging(worker.get());
+    raiseFdLimit();
+
+    Options options = parseOptions(argc, argv);
+    std::unique_ptr<lt::sig::SignalingServer> server;
+    if (options.port == 0) {
+        lt::sig::SignalingServer::Params params{};
+        params.bind_ip = "127.0.0.1";
+        params.threads = options.threads;
+        server = lt::sig::SignalingServer::create(params);
+        if (server == nullptr) {
+            printf("Start embedded signaling server failed\n");
+            return -1;
+        }
+        options.port = server->port();
+    }
+    printf("target:%s:%u rooms:%u messages/room:%u client threads:%u\n", options.host.c_str(),
+           options.port, options.rooms, options.messages, options.threads);
+
+    Stats stats;
+    std::vector<std::unique_ptr<ltlib::IOLoop>> ioloops;
+    for (uint32_t i = 0; i < options.threads; i++) {
+        ioloops.push_back(ltlib::IOLoop::create());
+    }
+    std::vector<Room> rooms(options.rooms);
+    int64_t start = ltlib::steady_now_us();
+    for (uint32_t i = 0; i < options.rooms; i++) {
+        ltlib::IOLoop* ioloop = ioloops[i % ioloops.size()].get();
+        Room* room = &rooms[i];
+        room->room_id = "load_test_room_" + std::to_string(i);
+        // Client要在自己的ioloop线程创建
+        ioloop->post([&options, ioloop, room, &stats]() {
+            connectPeer(options, ioloop, room, 0, &stats);
+        });
+    }
+    std::vector<std::thread> threads;
+    for (auto& ioloop : ioloops) {
+        threads.emplace_back([ioloop = ioloop.get()]() { ioloop->run([]() {}); });
+    }
+    constexpr auto kTimeout = std::chrono::seconds{120};
+    bool timeout = stats.done.get_future().wait_for(kTimeout) != std::future_status::ready;
+    int64_t end = ltlib::steady_now_us();
+
+    uint32_t joined = stats.joined;
+    int64_t joined_us = stats.all_joined_us != 0 ? stats.all_joined_us - start : end - start;
+    uint64_t relayed = 0;
+    for (const auto& room : rooms) {
+        relayed += room.received;
+    }
+    printf("joined:%u/%u in %.2fs (%.0f rooms/s)\n", joined, options.rooms, joined_us / 1e6,
+           joined * 1e6 / std::max<int64_t>(joined_us, 1));
+    printf("relayed:%llu in %.2fs (%.0f msgs/s)\n", static_cast<unsigned long long>(relayed),
+           (end - start) / 1e6, relayed * 1e6 / std::max<int64_t>(end - start, 1));
+    printf("failures:%u%s\n", stats.failures.load(), timeout ? " (timeout)" : "");
+    fflush(stdout);
+    // 所有连接和ioloop直接跟着进程退出
+    for (auto& thread : threads) {
+        thread.detach();
+    }
+    std::quick_exit(timeout || stats.failures != 0 ? 1 : 0);
+}
@@ -0,0 +1,112 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// 独立的信令服务器进程: lanthing-sig -ip 0.0.0.0 -port 44899 -threads 4
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <g3log/logworker.hpp>
+
+#include <ltlib/logging.h>
+#include <ltlib/system.h>
+
+#include "signaling_server.h"
+
+namespace {
+
+std::map<std::string, std::string> parseOptions(int argc, char* argv[]) {
+    std::vector<std::string> args;
+    std::map<std::string, std::string> options;
+    for (int i = 0; i < argc; i++) {
+        args.push_back(argv[i]);
+    }
+    for (size_t i = 0; i < args.size(); ++i) {
+        if ('-' != args[i][0]) {
+            continue;
+        }
+        if (i >= args.size() - 1) {
+            break;
+        }
+        if ('-' != args[i + 1][0]) {
+            options.insert({args[i], args[i + 1]});
+            ++i;
+        }
+    }
+    return options;
+}
+
+std::string getOption(const std::map<std::string, std::string>& options, const std::string& key,
+                      const std::string& default_value) {
+    auto iter = options.find(key);
+    return iter == options.end() ? default_value : iter->second;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto options = parseOptions(argc, argv);
+    std::filesystem::path log_dir = ltlib::getProgramPath();
+    log_dir = log_dir / "log" / "signaling";
+    std::error_code ec;
+    std::filesystem::create_directories(log_dir, ec);
+    auto log_worker = g3::LogWorker::createLogWorker();
+    log_worker->addSink(std::make_unique<ltlib::LogSink>("signaling", log_dir.string()),
+                        &ltlib::LogSink::fileWrite);
+    g3::log_levels::disable(DEBUG);
+    g3::only_change_at_initialization::addLogLevel(ERR);
+    g3::initializeLogging(log_worker.get());
+
+    lt::sig::SignalingServer::Params params{};
+    params.bind_ip = getOption(options, "-ip", "0.0.0.0");
+    params.bind_port = static_cast<uint16_t>(std::atoi(getOption(options, "-port", "0").c_str()));
+    std::string threads = getOption(options, "-threads",
+                                    std::to_string(std::thread::hardware_concurrency()));
+    params.threads = static_cast<uint32_t>(std::atoi(threads.c_str()));
+    auto server = lt::sig::SignalingServer::create(params);
+    if (server == nullptr) {
+        printf("Start signaling server failed, see logs in %s\n", log_dir.string().c_str());
+        return -1;
+    }
+    printf("Signaling server listening on %s:%u\n", params.bind_ip.c_str(), server->port());
+    fflush(stdout);
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::minutes{1});
+        LOG(INFO) << "Active rooms: " << server->roomCount();
+    }
+    return 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "signaling_server.h"
+
+#include <algorithm>
+
+#include <ltlib/logging.h>
+#include <ltproto/common/keep_alive.pb.h>
+#include <ltproto/common/keep_alive_ack.pb.h>
+#include <ltproto/ltproto.h>
+#include <ltproto/signaling/join_room.pb.h>
+#include <ltproto/signaling/join_room_ack.pb.h>
+#include <ltproto/signaling/signaling_message.pb.h>
+#include <ltproto/signaling/signaling_message_ack.pb.h>
+
+namespace {
+
+constexpr uint32_t kInvalidFd = std::numeric_limits<uint32_t>::max();
+
+} // namespace
+
+namespace lt {
+
+namespace sig {
+
+std::unique_ptr<SignalingServer> SignalingServer::create(const Params& params) {
+    std::unique_ptr<SignalingServer> server{new SignalingServer};
+    if (!server->init(params)) {
+        return nullptr;
+    }
+    return server;
+}
+
+bool SignalingServer::init(const Params& params) {
+    uint32_t threads = std::max(params.threads, 1u);
+    for (uint32_t i = 0; i < threads; i++) {
+        auto ioloop = ltlib::IOLoop::create();
+        if (ioloop == nullptr) {
+            LOG(ERR) << "Create IOLoop failed";
+            return false;
+        }
+        ioloops_.push_back(std::move(ioloop));
+    }
+    // ltlib::Server要求在ioloop跑起来之前创建
+    ltlib::Server::Params server_params{};
+    server_params.stype = ltlib::StreamType::TCP;
+    server_params.ioloop = ioloops_[0].get();
+    for (size_t i = 1; i < ioloops_.size(); i++) {
+        server_params.shard_ioloops.push_back(ioloops_[i].get());
+    }
+    server_params.bind_ip = params.bind_ip;
+    server_params.bind_port = params.bind_port;
+    server_params.on_accepted =
+        std::bind(&SignalingServer::onAccepted, this, std::placeholders::_1);
+    server_params.on_closed = std::bind(&SignalingServer::onClosed, this, std::placeholders::_1);
+    server_params.on_message = std::bind(&SignalingServer::onMessage, this, std::placeholders::_1,
+                                         std::placeholders::_2, std::placeholders::_3);
+    server_ = ltlib::Server::create(server_params);
+    if (server_ == nullptr) {
+        LOG(ERR) << "Create signaling server on " << params.bind_ip << ":" << params.bind_port
+                 << " failed";
+        return false;
+    }
+    for (size_t i = 0; i < ioloops_.size(); i++) {
+        ltlib::IOLoop* ioloop = ioloops_[i].get();
+        threads_.push_back(ltlib::BlockingThread::create(
+            "sig_loop_" + std::to_string(i),
+            [ioloop](const std::function<void()>& i_am_alive) { ioloop->run(i_am_alive); }));
+    }
+    LOG(INFO) << "Signaling server listening on " << params.bind_ip << ":" << server_->port()
+              << " with " << ioloops_.size() << " ioloops";
+    return true;
+}
+
+uint16_t SignalingServer::port() const {
+    return server_->port();
+}
+
+size_t SignalingServer::roomCount() {
+    std::lock_guard lock{mutex_};
+    return rooms_.size();
+}
+
+ltlib::IOLoop* SignalingServer::currentLoop() {
+    for (auto& ioloop : ioloops_) {
+        if (ioloop->isCurrentThread()) {
+            return ioloop.get();
+        }
+    }
+    return nullptr;
+}
+
+void SignalingServer::onAccepted(uint32_t fd) {
+    // 回调发生在接受这个连接的ioloop上，之后这个连接的收发都在这个ioloop
+    ltlib::IOLoop* ioloop = currentLoop();
+    std::lock_guard lock{mutex_};
+    conns_[fd] = Conn{ioloop, ""};
+}
+
+void SignalingServer::onClosed(uint32_t fd) {
+    std::lock_guard lock{mutex_};
+    auto conn = conns_.find(fd);
+    if (conn == conns_.end()) {
+        return;
+    }
+    auto room = rooms_.find(conn->second.room_id);
+    if (room != rooms_.end()) {
+        bool empty = true;
+        for (auto& member : room->second.members) {
+            if (member.fd == fd) {
+                member = Member{};
+            }
+            empty = empty && member.fd == kInvalidFd;
+        }
+        if (empty) {
+            LOG(INFO) << "Room " << room->first << " closed";
+            rooms_.erase(room);
+        }
+    }
+    conns_.erase(conn);
+}
+
+void SignalingServer::onMessage(uint32_t fd, uint32_t type,
+                                const std::shared_ptr<google::protobuf::MessageLite>& msg) {
+    namespace ltype = ltproto::type;
+    switch (type) {
+    case ltype::kKeepAlive:
+        onKeepAlive(fd);
+        break;
+    case ltype::kJoinRoom:
+        onJoinRoom(fd, msg);
+        break;
+    case ltype::kSignalingMessage:
+        onSignalingMessage(fd, msg);
+        break;
+    default:
+        LOG(WARNING) << "Unknown signaling message type " << type << " from " << fd;
+        break;
+    }
+}
+
+void SignalingServer::onJoinRoom(uint32_t fd,
+                                 const std::shared_ptr<google::protobuf::MessageLite>& _msg) {
+    auto msg = std::static_pointer_cast<ltproto::signaling::JoinRoom>(_msg);
+    auto ack = std::make_shared<ltproto::signaling::JoinRoomAck>();
+    ack->set_err_code(ltproto::ErrorCode::InvalidParameter);
+    if (msg->room_id().empty() || msg->session_id().empty()) {
+        LOG(WARNING) << "Invalid JoinRoom from " << fd;
+        server_->send(fd, ltproto::id(ack), ack);
+        return;
+    }
+    {
+        std::lock_guard lock{mutex_};
+        auto conn = conns_.find(fd);
+        if (conn == conns_.end() || !conn->second.room_id.empty()) {
+            LOG(WARNING) << "Connection " << fd << " can't join room " << msg->room_id();
+            server_->send(fd, ltproto::id(ack), ack);
+            return;
+        }
+        Room& room = rooms_[msg->room_id()];
+        Member* slot = nullptr;
+        for (auto& member : room.members) {
+            // 同一个session重连，新连接顶替旧连接
+            if (member.session_id == msg->session_id()) {
+                slot = &member;
+                break;
+            }
+            if (slot == nullptr && member.fd == kInvalidFd) {
+                slot = &member;
+            }
+        }
+        if (slot == nullptr) {
+            // ltproto里没有"房间已满"的错误码
+            LOG(WARNING) << "Room " << msg->room_id() << " is full, reject " << msg->session_id();
+            server_->send(fd, ltproto::id(ack), ack);
+            return;
+        }
+        if (slot->fd != kInvalidFd) {
+            auto old_conn = conns_.find(slot->fd);
+            if (old_conn != conns_.end()) {
+                old_conn->second.room_id.clear();
+            }
+        }
+        slot->fd = fd;
+        slot->session_id = msg->session_id();
+        conn->second.room_id = msg->room_id();
+    }
+    LOG(INFO) << "Session " << msg->session_id() << " joined room " << msg->room_id();
+    ack->set_err_code(ltproto::ErrorCode::Success);
+    server_->send(fd, ltproto::id(ack), ack);
+}
+
+void SignalingServer::onSignalingMessage(
+    uint32_t fd, const std::shared_ptr<google::protobuf::MessageLite>& msg) {
+    uint32_t peer_fd = kInvalidFd;
+    ltlib::IOLoop* peer_loop = nullptr;
+    {
+        std::lock_guard lock{mutex_};
+        auto conn = conns_.find(fd);
+        auto room = conn == conns_.end() ? rooms_.end() : rooms_.find(conn->second.room_id);
+        if (room != rooms_.end()) {
+            for (const auto& member : room->second.members) {
+                if (member.fd != fd && member.fd != kInvalidFd) {
+                    peer_fd = member.fd;
+                    break;
+                }
+            }
+        }
+        auto peer = conns_.find(peer_fd);
+        if (peer != conns_.end()) {
+            peer_loop = peer->second.ioloop;
+        }
+    }
+    auto ack = std::make_shared<ltproto::signaling::SignalingMessageAck>();
+    if (peer_loop == nullptr) {
+        ack->set_err_code(ltproto::ErrorCode::SignalingPeerNotOnline);
+    }
+    else {
+        ack->set_err_code(ltproto::ErrorCode::Success);
+        sendTo(peer_loop, peer_fd, ltproto::type::kSignalingMessage, msg);
+    }
+    server_->send(fd, ltproto::id(ack), ack);
+}
+
+void SignalingServer::onKeepAlive(uint32_t fd) {
+    auto ack = std::make_shared<ltproto::common::KeepAliveAck>();
+    server_->send(fd, ltproto::id(ack), ack);
+}
+
+void SignalingServer::sendTo(ltlib::IOLoop* ioloop, uint32_t fd, uint32_t type,
+                             const std::shared_ptr<google::protobuf::MessageLite>& msg) {
+    // 房间的两个成员可能落在不同的ioloop上，连接只能在自己的ioloop上发送
+    if (ioloop->isCurrentThread()) {
+        server_->send(fd, type, msg);
+    }
+    else {
+        ioloop->post([this, fd, type, msg]() { server_->send(fd, type, msg); });
+    }
+}
+
+} // namespace sig
+
+} // namespace lt
@@ -0,0 +1,111 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <array>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <google/protobuf/message_lite.h>
+
+#include <ltlib/io/ioloop.h>
+#include <ltlib/io/server.h>
+#include <ltlib/threads.h>
+
+namespace lt {
+
+namespace sig {
+
+// 可自建的信令服务器，协议与lanthing.net的信令服务一致(JoinRoom/SignalingMessage/KeepAlive).
+// 一个房间最多两个成员，SignalingMessage原样转发给房间里的另一个成员.
+// ltlib::Server不支持TLS，客户端要用LT_SERVER_USE_SSL=false编译，或者在前面放一个做TLS的反向代理.
+// 设计上和进程同生命周期，不支持运行中途销毁.
+class SignalingServer {
+public:
+    struct Params {
+        std::string bind_ip = "0.0.0.0";
+        uint16_t bind_port = 0;
+        // 处理连接的ioloop数量，>1时用SO_REUSEPORT分片(仅Linux)
+        uint32_t threads = 1;
+    };
+
+public:
+    static std::unique_ptr<SignalingServer> create(const Params& params);
+    uint16_t port() const;
+    size_t roomCount();
+
+private:
+    struct Member {
+        uint32_t fd = std::numeric_limits<uint32_t>::max();
+        std::string session_id;
+    };
+    struct Room {
+        std::array<Member, 2> members;
+    };
+    struct Conn {
+        ltlib::IOLoop* ioloop = nullptr;
+        std::string room_id;
+    };
+
+private:
+    SignalingServer() = default;
+    bool init(const Params& params);
+    ltlib::IOLoop* currentLoop();
+    void onAccepted(uint32_t fd);
+    void onClosed(uint32_t fd);
+    void onMessage(uint32_t fd, uint32_t type,
+                   const std::shared_ptr<google::protobuf::MessageLite>& msg);
+    void onJoinRoom(uint32_t fd, const std::shared_ptr<google::protobuf::MessageLite>& msg);
+    void onSignalingMessage(uint32_t fd, const std::shared_ptr<google::protobuf::MessageLite>& msg);
+    void onKeepAlive(uint32_t fd);
+    void sendTo(ltlib::IOLoop* ioloop, uint32_t fd, uint32_t type,
+                const std::shared_ptr<google::protobuf::MessageLite>& msg);
+
+private:
+    // 成员的声明顺序决定了析构顺序: server_ -> ioloops_(停止循环) -> threads_(join)
+    std::vector<std::unique_ptr<ltlib::BlockingThread>> threads_;
+    std::vector<std::unique_ptr<ltlib::IOLoop>> ioloops_;
+    std::unique_ptr<ltlib::Server> server_;
+    // 房间表和连接表被所有ioloop共享，临界区只做哈希表查找
+    std::mutex mutex_;
+    std::unordered_map<std::string /*room_id*/, Room> rooms_;
+    std::unordered_map<uint32_t /*fd*/, Conn> conns_;
+};
+
+} // namespace sig
+
+} // namespace lt
@@ -30,7 +30,12 @@
 
 #include "worker_streaming.h"
 
+#include <algorithm>
+
 #include <ltproto/client2worker/audio_data.pb.h>
+#include <ltproto/client2worker/request_keyframe.pb.h>
+#include <ltproto/client2worker/send_side_stat.pb.h>
+#include <ltproto/client2worker/video_frame.pb.h>
 #include <ltproto/common/keep_alive_ack.pb.h>
 #include <ltproto/common/streaming_params.pb.h>
 #include <ltproto/ltproto.h>
@@ -38,9 +43,12 @@
 #include <ltproto/worker2service/start_working_ack.pb.h>
 
 #include <ltlib/logging.h>
+#include <ltlib/startup_tasks.h>
 #include <ltlib/system.h>
 #include <ltlib/times.h>
 
+#include <worker/video_frame_ring.h>
+
 namespace {
 
 lt::VideoCodecType to_ltrtc(ltproto::common::VideoCodecType codec_type) {
@@ -84,6 +92,32 @@ namespace worker {
 
 std::unique_ptr<WorkerStreaming>
 WorkerStreaming::create(std::map<std::string, std::string> options) {
+    auto warm = options.find("-warm");
+    if (warm != options.end() && std::atoi(warm->second.c_str()) != 0) {
+        // 还不知道客户端参数，先按当前显示器和所有编码格式初始化
+        Params params{};
+        params.warm = true;
+        params.need_negotiate = false;
+        params.name = options["-name"];
+        if (params.name.empty()) {
+            LOG(ERR) << "Parameter invalid: name";
+            return nullptr;
+        }
+        auto display = ltlib::getDisplayOutputDesc();
+        if (display.width <= 0 || display.height <= 0) {
+            LOG(ERR) << "Get display output desc failed";
+            return nullptr;
+        }
+        params.width = static_cast<uint32_t>(display.width);
+        params.height = static_cast<uint32_t>(display.height);
+        params.refresh_rate = display.frequency > 0 ? static_cast<uint32_t>(display.frequency) : 60;
+        params.codecs = {lt::VideoCodecType::H265, lt::VideoCodecType::H264};
+        std::unique_ptr<WorkerStreaming> worker{new WorkerStreaming{params}};
+        if (!worker->init()) {
+            return nullptr;
+        }
+        return worker;
+    }
     if (options.find("-width") == options.end() || options.find("-height") == options.end() ||
         options.find("-freq") == options.end() || options.find("-codecs") == options.end() ||
         options.find("-name") == options.end() || options.find("-negotiate") == options.end()) {
@@ -139,7 +173,8 @@ WorkerStreaming::create(std::map<std::string, std::string> options) {
 }
 
 WorkerStreaming::WorkerStreaming(const Params& params)
-    : need_negotiate_{params.need_negotiate}
+    : warm_{params.warm}
+    , need_negotiate_{params.need_negotiate}
     , client_width_{params.width}
     , client_height_{params.height}
     , client_refresh_rate_{params.refresh_rate}
@@ -161,45 +196,86 @@ void WorkerStreaming::wait() {
 }
 
 bool WorkerStreaming::init() {
-    session_observer_ = SessionChangeObserver::create();
-    if (session_observer_ == nullptr) {
-        LOG(ERR) << "Create session observer failed";
-        return false;
-    }
-    ioloop_ = ltlib::IOLoop::create();
-    if (ioloop_ == nullptr) {
-        LOG(ERR) << "Create IOLoop failed";
-        return false;
-    }
-    if (!initPipeClient()) {
-        LOG(ERR) << "Init pipe client failed";
-        return false;
-    }
-    if (need_negotiate_) {
-        if (!negotiateAllParameters()) {
-            return false;
-        }
-    }
-    else {
-        negotiated_display_setting_.width = client_width_;
-        negotiated_display_setting_.height = client_height_;
-        negotiated_display_setting_.refrash_rate = client_refresh_rate_;
-        if (!negotiateStreamParameters()) {
-            return false;
-        }
-    }
-
+    ltlib::StartupTasks startup{"worker"};
+    std::unique_ptr<ltlib::Settings> settings;
+    startup.measure("settings", [&settings]() {
+        // 打不开就用默认参数
+        settings = ltlib::Settings::create(ltlib::Settings::Storage::Sqlite);
+        return true;
+    });
+    auto video_params = videoParams(settings.get());
+    auto audio_params = audioParams(settings.get());
+    // 先在当前线程注册好自己的消息处理函数，再起视频线程，视频线程里的编码管线也会往
+    // msg_handlers_里注册，两边不能同时写
     namespace ltype = ltproto::type;
     namespace ph = std::placeholders;
     const std::pair<uint32_t, MessageHandler> handlers[] = {
         {ltype::kStartWorking, std::bind(&WorkerStreaming::onStartWorking, this, ph::_1)},
         {ltype::kStopWorking, std::bind(&WorkerStreaming::onStopWorking, this, ph::_1)},
-        {ltype::kKeepAlive, std::bind(&WorkerStreaming::onKeepAlive, this, ph::_1)}};
+        {ltype::kKeepAlive, std::bind(&WorkerStreaming::onKeepAlive, this, ph::_1)},
+        {ltype::kSendSideStat, std::bind(&WorkerStreaming::onSendSideStat, this, ph::_1)}};
     for (auto& handler : handlers) {
         if (!registerMessageHandler(handler.first, handler.second)) {
             LOG(FATAL) << "Register message handler(" << handler.first << ") failed";
         }
     }
+    if (warm_) {
+        // 被会话接管时service会发来客户端的串流参数
+        registerMessageHandler(ltype::kStreamingParams,
+                               std::bind(&WorkerStreaming::onServiceStreamingParams, this, ph::_1));
+    }
+
+    // 改分辨率和探测编码器最慢，放到单独线程，和音频、管道等初始化并发.
+    // 音频采集要在当前线程创建，它初始化的COM跟着线程走
+    startup.run("video", [this, &startup, &video_params]() {
+        auto negotiate = std::bind(&WorkerStreaming::negotiateDisplaySetting, this);
+        if (!startup.measure("display", negotiate)) {
+            return false;
+        }
+        video_params.width = negotiated_display_setting_.width;
+        video_params.height = negotiated_display_setting_.height;
+        return startup.measure("encoder", [this, &video_params]() {
+            video_ = lt::VideoCaptureEncodePipeline::create(video_params);
+            if (video_ == nullptr) {
+                LOGF(ERR, "Create VideoCaptureEncodePipeline failed");
+                return false;
+            }
+            return true;
+        });
+    });
+    bool success = startup.measure("session_observer", [this]() {
+        session_observer_ = SessionChangeObserver::create();
+        if (session_observer_ == nullptr) {
+            LOG(ERR) << "Create session observer failed";
+            return false;
+        }
+        return true;
+    });
+    success = success && startup.measure("pipe", [this]() {
+        ioloop_ = ltlib::IOLoop::create();
+        if (ioloop_ == nullptr) {
+            LOG(ERR) << "Create IOLoop failed";
+            return false;
+        }
+        if (!initPipeClient()) {
+            LOG(ERR) << "Init pipe client failed";
+            return false;
+        }
+        video_ring_ = ltlib::SharedMemoryRing::open(videoFrameRingName(pipe_name_));
+        if (video_ring_ == nullptr) {
+            LOG(WARNING) << "Open video frame ring failed, send video frames through pipe";
+        }
+        return true;
+    });
+    success = success && startup.measure("audio", [this, &audio_params]() {
+        audio_ = AudioCapturer::create(audio_params);
+        return audio_ != nullptr;
+    });
+    if (!success) {
+        startup.wait();
+        LOG(INFO) << startup.report();
+        return false;
+    }
 
     std::promise<void> promise;
     auto future = promise.get_future();
@@ -209,6 +285,19 @@ bool WorkerStreaming::init() {
             mainLoop(i_am_alive);
         });
     future.get();
+    // ioloop不等视频初始化，管道先连上service. 视频线程结束后才把协商好的参数交给ioloop，
+    // 在这之前ioloop不处理service发来的消息，视频线程注册消息处理函数也就不会和它冲突
+    success = startup.wait();
+    LOG(INFO) << startup.report();
+    if (!success) {
+        return false;
+    }
+    ioloop_->post([this]() {
+        setNegotiatedParams();
+        if (connected_to_service_) {
+            sendPipeMessage(ltproto::id(negotiated_params_), negotiated_params_);
+        }
+    });
     ioloop_->postDelay(500 /*ms*/, std::bind(&WorkerStreaming::checkCimeout, this));
     return true;
 } // namespace lt
@@ -277,7 +366,13 @@ void WorkerStreaming::recoverDisplaySettings() {
     }
 }
 
-bool WorkerStreaming::negotiateAllParameters() {
+bool WorkerStreaming::negotiateDisplaySetting() {
+    if (!need_negotiate_) {
+        negotiated_display_setting_.width = client_width_;
+        negotiated_display_setting_.height = client_height_;
+        negotiated_display_setting_.refrash_rate = client_refresh_rate_;
+        return true;
+    }
     DisplaySetting client_display_setting{client_width_, client_height_, client_refresh_rate_};
     auto result = DisplaySettingNegotiator::negotiate(client_display_setting);
     if (result.negotiated.width == 0 || result.negotiated.height == 0) {
@@ -299,15 +394,10 @@ bool WorkerStreaming::negotiateAllParameters() {
         }
     }
     negotiated_display_setting_ = result.negotiated;
-    if (!negotiateStreamParameters()) {
-        return false;
-    }
     return true;
 }
 
-bool WorkerStreaming::negotiateStreamParameters() {
-    auto negotiated_params = std::make_shared<ltproto::common::StreamingParams>();
-
+lt::AudioCapturer::Params WorkerStreaming::audioParams(ltlib::Settings* settings) {
     lt::AudioCapturer::Params audio_params{};
 #if LT_TRANSPORT_TYPE == LT_TRANSPORT_RTC
     audio_params.type = AudioCodecType::PCM;
@@ -316,39 +406,57 @@ bool WorkerStreaming::negotiateStreamParameters() {
 #endif
     audio_params.on_audio_data =
         std::bind(&WorkerStreaming::onCapturedAudioData, this, std::placeholders::_1);
-    auto audio = AudioCapturer::create(audio_params);
-    if (audio == nullptr) {
-        return false;
+    if (settings != nullptr) {
+        // 2500/5000/10000/20000，越短延迟越低，但码率开销越大
+        auto frame_duration = settings->getInteger("audio_frame_duration_us");
+        if (frame_duration.has_value()) {
+            audio_params.frame_duration_us = static_cast<uint32_t>(frame_duration.value());
+        }
+        auto low_delay = settings->getBoolean("audio_low_delay");
+        audio_params.low_delay = low_delay.has_value() && low_delay.value();
     }
-    negotiated_params->set_audio_channels(audio->channels());
-    negotiated_params->set_audio_sample_rate(audio->framesPerSec());
+    return audio_params;
+}
 
+lt::VideoCaptureEncodePipeline::Params WorkerStreaming::videoParams(ltlib::Settings* settings) {
     lt::VideoCaptureEncodePipeline::Params video_params{};
     video_params.codecs = client_codec_types_;
-    video_params.width = negotiated_display_setting_.width;
-    video_params.height = negotiated_display_setting_.height;
+    if (settings != nullptr) {
+        // 0或者不设置表示丢包后用IDR恢复
+        auto intra_refresh = settings->getInteger("video_intra_refresh_period");
+        if (intra_refresh.has_value() && intra_refresh.value() > 0) {
+            video_params.intra_refresh_period = static_cast<uint32_t>(intra_refresh.value());
+        }
+        // 旧客户端认不出码流里的分辨率变化，默认关闭
+        auto adaptive_resolution = settings->getBoolean("video_adaptive_resolution");
+        if (adaptive_resolution.has_value()) {
+            video_params.adaptive_resolution = adaptive_resolution.value();
+        }
+        auto report_psnr = settings->getBoolean("video_report_psnr");
+        video_params.report_psnr = report_psnr.has_value() && report_psnr.value();
+        video_params.software_encoder =
+            settings->getBoolean("video_software_encoder").value_or(false);
+    }
     video_params.send_message = std::bind(&WorkerStreaming::sendPipeMessageFromOtherThread, this,
                                           std::placeholders::_1, std::placeholders::_2);
     video_params.register_message_handler =
-        std::bind(&WorkerStreaming::registerMessageHandler, this, std::placeholders::_1,
+        std::bind(&WorkerStreaming::registerVideoMessageHandler, this, std::placeholders::_1,
                   std::placeholders::_2);
-    auto video = lt::VideoCaptureEncodePipeline::create(video_params);
-    if (video == nullptr) {
-        LOGF(ERR, "Create VideoCaptureEncodePipeline failed");
-        return false;
-    }
+    return video_params;
+}
+
+void WorkerStreaming::setNegotiatedParams() {
+    auto negotiated_params = std::make_shared<ltproto::common::StreamingParams>();
+    negotiated_params->set_audio_channels(audio_->channels());
+    negotiated_params->set_audio_sample_rate(audio_->framesPerSec());
     negotiated_params->set_enable_driver_input(false);
     negotiated_params->set_enable_gamepad(false);
     negotiated_params->set_screen_refresh_rate(negotiated_display_setting_.refrash_rate);
     negotiated_params->set_video_width(negotiated_display_setting_.width);
     negotiated_params->set_video_height(negotiated_display_setting_.height);
-    negotiated_params->add_video_codecs(to_protobuf(video->codec()));
-    LOG(INFO) << "Negotiated video codec:" << to_string(video->codec());
-
+    negotiated_params->add_video_codecs(to_protobuf(video_->codec()));
+    LOG(INFO) << "Negotiated video codec:" << to_string(video_->codec());
     negotiated_params_ = negotiated_params;
-    video_ = std::move(video);
-    audio_ = std::move(audio);
-    return true;
 }
 
 void WorkerStreaming::mainLoop(const std::function<void()>& i_am_alive) {
@@ -386,6 +494,14 @@ bool WorkerStreaming::registerMessageHandler(uint32_t type, const MessageHandler
     }
 }
 
+bool WorkerStreaming::registerVideoMessageHandler(uint32_t type, const MessageHandler& handler) {
+    if (!registerMessageHandler(type, handler)) {
+        return false;
+    }
+    video_msg_types_.push_back(type);
+    return true;
+}
+
 void WorkerStreaming::dispatchServiceMessage(
     uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg) {
     auto iter = msg_handlers_.find(type);
@@ -407,10 +523,41 @@ bool WorkerStreaming::sendPipeMessage(uint32_t type,
 // FIXME: 返回值
 bool WorkerStreaming::sendPipeMessageFromOtherThread(
     uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg) {
+    if (type == ltproto::type::kVideoFrame && video_ring_ != nullptr) {
+        // 只有编码线程会走到这里，满足单生产者
+        return writeVideoFrameToRing(msg);
+    }
     postTask([type, msg, this]() { sendPipeMessage(type, msg); });
     return true;
 }
 
+bool WorkerStreaming::writeVideoFrameToRing(
+    const std::shared_ptr<google::protobuf::MessageLite>& _msg) {
+    auto msg = std::static_pointer_cast<ltproto::client2worker::VideoFrame>(_msg);
+    VideoFrameRingHeader header{};
+    header.ltframe_id = msg->picture_id();
+    header.capture_timestamp_us = msg->capture_timestamp_us();
+    header.start_encode_timestamp_us = msg->start_encode_timestamp_us();
+    header.end_encode_timestamp_us = msg->end_encode_timestamp_us();
+    header.width = msg->width();
+    header.height = msg->height();
+    header.is_keyframe = msg->is_keyframe() ? 1 : 0;
+    std::span<const uint8_t> header_span{reinterpret_cast<const uint8_t*>(&header),
+                                         sizeof(header)};
+    std::span<const uint8_t> frame_span{reinterpret_cast<const uint8_t*>(msg->frame().data()),
+                                        msg->frame().size()};
+    if (video_ring_->write({header_span, frame_span})) {
+        return true;
+    }
+    // service读得太慢，这一帧丢掉了，和网络丢包一样请求恢复
+    LOG(WARNING) << "Video frame ring full, drop frame " << header.ltframe_id;
+    postTask([this]() {
+        auto request = std::make_shared<ltproto::client2worker::RequestKeyframe>();
+        dispatchServiceMessage(ltproto::type::kRequestKeyframe, request);
+    });
+    return false;
+}
+
 void WorkerStreaming::printStats() {}
 
 void WorkerStreaming::checkCimeout() {
@@ -433,6 +580,10 @@ void WorkerStreaming::onCapturedAudioData(
 
 void WorkerStreaming::onPipeMessage(uint32_t type,
                                     std::shared_ptr<google::protobuf::MessageLite> msg) {
+    if (negotiated_params_ == nullptr) {
+        LOG(WARNING) << "Received message(" << type << ") before init finished, drop it";
+        return;
+    }
     dispatchServiceMessage(type, msg);
 }
 
@@ -454,6 +605,10 @@ void WorkerStreaming::onPipeConnected() {
         LOG(INFO) << "Connected to service";
     }
     connected_to_service_ = true;
+    if (negotiated_params_ == nullptr) {
+        // 视频还在初始化，协商好以后再发
+        return;
+    }
     // 连上第一时间，向service发送协商好的串流参数
     auto params = std::static_pointer_cast<ltproto::common::StreamingParams>(negotiated_params_);
     sendPipeMessage(ltproto::id(params), params);
@@ -511,6 +666,70 @@ void WorkerStreaming::onKeepAlive(const std::shared_ptr<google::protobuf::Messag
     sendPipeMessage(ltproto::id(ack), ack);
 }
 
+void WorkerStreaming::onSendSideStat(const std::shared_ptr<google::protobuf::MessageLite>& _msg) {
+    auto msg = std::static_pointer_cast<ltproto::client2worker::SendSideStat>(_msg);
+    if (audio_) {
+        audio_->updateNetworkStat(msg->loss_rate(), static_cast<uint32_t>(msg->bwe()));
+    }
+}
+
+void WorkerStreaming::onServiceStreamingParams(
+    const std::shared_ptr<google::protobuf::MessageLite>& _msg) {
+    if (!warm_) {
+        LOG(WARNING) << "Received StreamingParams from service, but we are not a warm worker";
+        return;
+    }
+    warm_ = false;
+    // 被接管相当于重新启动，超时从现在开始算
+    last_time_received_from_service_ = ltlib::steady_now_ms();
+    auto msg = std::static_pointer_cast<ltproto::common::StreamingParams>(_msg);
+    client_width_ = static_cast<uint32_t>(msg->video_width());
+    client_height_ = static_cast<uint32_t>(msg->video_height());
+    client_refresh_rate_ = static_cast<uint32_t>(msg->screen_refresh_rate());
+    client_codec_types_.clear();
+    for (auto codec : msg->video_codecs()) {
+        auto codec_type = to_ltrtc(static_cast<ltproto::common::VideoCodecType>(codec));
+        if (codec_type != lt::VideoCodecType::Unknown) {
+            client_codec_types_.push_back(codec_type);
+        }
+    }
+    need_negotiate_ = true;
+    const DisplaySetting warm_display = negotiated_display_setting_;
+    if (!negotiateDisplaySetting()) {
+        LOG(ERR) << "Negotiate display setting for adopted warm worker failed, exit worker";
+        stop();
+        return;
+    }
+    bool same_size = warm_display.width == negotiated_display_setting_.width &&
+                     warm_display.height == negotiated_display_setting_.height;
+    bool codec_supported = std::find(client_codec_types_.cbegin(), client_codec_types_.cend(),
+                                     video_->codec()) != client_codec_types_.cend();
+    if (same_size && codec_supported) {
+        LOG(INFO) << "Warm video pipeline matches client, reuse it";
+    }
+    else {
+        LOGF(INFO, "Warm video pipeline(%ux%u %s) doesn't match client, recreate it",
+             warm_display.width, warm_display.height, to_string(video_->codec()).c_str());
+        video_.reset();
+        for (uint32_t type : video_msg_types_) {
+            msg_handlers_.erase(type);
+        }
+        video_msg_types_.clear();
+        auto settings = ltlib::Settings::create(ltlib::Settings::Storage::Sqlite);
+        auto video_params = videoParams(settings.get());
+        video_params.width = negotiated_display_setting_.width;
+        video_params.height = negotiated_display_setting_.height;
+        video_ = lt::VideoCaptureEncodePipeline::create(video_params);
+        if (video_ == nullptr) {
+            LOG(ERR) << "Recreate VideoCaptureEncodePipeline failed, exit worker";
+            stop();
+            return;
+        }
+    }
+    setNegotiatedParams();
+    sendPipeMessage(ltproto::id(negotiated_params_), negotiated_params_);
+}
+
 } // namespace worker
 
 } // namespace lt
\ No newline at end of file
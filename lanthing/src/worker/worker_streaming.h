@@ -38,6 +38,7 @@
 #include <ltlib/io/client.h>
 #include <ltlib/io/ioloop.h>
 #include <ltlib/settings.h>
+#include <ltlib/shared_memory_ring.h>
 #include <ltlib/threads.h>
 #include <transport/transport.h>
 
@@ -62,6 +63,8 @@ public:
         uint32_t refresh_rate;
         bool need_negotiate;
         std::vector<lt::VideoCodecType> codecs;
+        // 预热的worker按当前显示器初始化，等service发来客户端参数再重新协商
+        bool warm;
     };
 
 public:
@@ -75,13 +78,16 @@ private:
     bool initPipeClient();
     bool saveAndChangeCurrentDisplaySettings(DisplaySettingNegotiator::Result result);
     void recoverDisplaySettings();
-    bool negotiateAllParameters();
-    bool negotiateStreamParameters();
+    bool negotiateDisplaySetting();
+    lt::AudioCapturer::Params audioParams(ltlib::Settings* settings);
+    lt::VideoCaptureEncodePipeline::Params videoParams(ltlib::Settings* settings);
+    void setNegotiatedParams();
     void mainLoop(const std::function<void()>& i_am_alive);
     void stop();
     void postTask(const std::function<void()>& task);
     void postDelayTask(int64_t delay_ms, const std::function<void()>& task);
     bool registerMessageHandler(uint32_t type, const MessageHandler& msg);
+    bool registerVideoMessageHandler(uint32_t type, const MessageHandler& msg);
     void dispatchServiceMessage(uint32_t type,
                                 const std::shared_ptr<google::protobuf::MessageLite>& msg);
     bool sendPipeMessage(uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg);
@@ -89,6 +95,7 @@ private:
                                         const std::shared_ptr<google::protobuf::MessageLite>& msg);
     void printStats();
     void checkCimeout();
+    bool writeVideoFrameToRing(const std::shared_ptr<google::protobuf::MessageLite>& msg);
     // TODO: AUDIO和VIDEO INPUT一样改成通用的接口
     void onCapturedAudioData(std::shared_ptr<google::protobuf::MessageLite> audio_data);
 
@@ -100,23 +107,30 @@ private:
     void onStartWorking(const std::shared_ptr<google::protobuf::MessageLite>& msg);
     void onStopWorking(const std::shared_ptr<google::protobuf::MessageLite>& msg);
     void onKeepAlive(const std::shared_ptr<google::protobuf::MessageLite>& msg);
+    void onSendSideStat(const std::shared_ptr<google::protobuf::MessageLite>& msg);
+    void onServiceStreamingParams(const std::shared_ptr<google::protobuf::MessageLite>& msg);
 
 private:
-    const bool need_negotiate_;
-    const uint32_t client_width_;
-    const uint32_t client_height_;
-    const uint32_t client_refresh_rate_;
-    const std::vector<lt::VideoCodecType> client_codec_types_;
+    // 预热的worker被接管时会改写下面几个客户端参数
+    bool warm_;
+    bool need_negotiate_;
+    uint32_t client_width_;
+    uint32_t client_height_;
+    uint32_t client_refresh_rate_;
+    std::vector<lt::VideoCodecType> client_codec_types_;
     const std::string pipe_name_;
     bool connected_to_service_ = false;
     std::mutex mutex_;
     std::unique_ptr<SessionChangeObserver> session_observer_;
     std::map<uint32_t, MessageHandler> msg_handlers_;
+    // 视频流水线注册的消息，重建流水线时要先删掉
+    std::vector<uint32_t> video_msg_types_;
     DisplaySetting negotiated_display_setting_;
     lt::VideoCodecType negotiated_video_codec_type_ = lt::VideoCodecType::Unknown;
     std::shared_ptr<google::protobuf::MessageLite> negotiated_params_;
     std::unique_ptr<ltlib::IOLoop> ioloop_;
     std::unique_ptr<ltlib::Client> pipe_client_;
+    std::unique_ptr<ltlib::SharedMemoryRing> video_ring_;
     std::unique_ptr<ltlib::BlockingThread> thread_;
     int64_t last_time_received_from_service_;
     std::unique_ptr<lt::VideoCaptureEncodePipeline> video_;
@@ -0,0 +1,71 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <ltlib/ltlib.h>
+
+namespace ltlib {
+
+// CPU上的颜色空间转换和缩放，给没有GPU可用的采集、编码、解码、渲染路径使用.
+// YUV统一是BT.601 limited range，每2x2个像素共用一组UV. 各级SIMD实现和标量实现逐字节一致.
+// 宽高必须是偶数，stride单位是字节. 不做参数检查.
+
+enum class SimdLevel {
+    Scalar,
+    SSSE3,
+    AVX2,
+    NEON,
+};
+
+// 当前CPU支持的最高级别
+LT_API SimdLevel detectSimdLevel();
+// 当前使用的级别，默认是detectSimdLevel()
+LT_API SimdLevel simdLevel();
+// 测试和基准用，强制使用某一级实现. CPU不支持时返回false，保持原来的级别
+LT_API bool setSimdLevel(SimdLevel level);
+LT_API const char* toString(SimdLevel level);
+
+LT_API void bgraToNV12(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride, uint8_t* uv,
+                       int uv_stride, int width, int height);
+
+LT_API void bgraToI420(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride, uint8_t* u,
+                       int u_stride, uint8_t* v, int v_stride, int width, int height);
+
+// 输出的alpha固定为255
+LT_API void nv12ToBGRA(const uint8_t* y, int y_stride, const uint8_t* uv, int uv_stride,
+                       uint8_t* bgra, int bgra_stride, int width, int height);
+
+// 2x2盒式滤波缩小一半，width/height是源图像的宽高
+LT_API void downscaleBGRAHalf(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride,
+                              int width, int height);
+
+} // namespace ltlib
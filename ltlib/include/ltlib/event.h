@@ -50,6 +50,8 @@ public:
     Event() noexcept;
     // create named event
     explicit Event(const std::string& name) noexcept;
+    // security_attributes在Windows上是SECURITY_ATTRIBUTES*，POSIX上忽略(固定0600)
+    Event(const std::string& name, void* security_attributes) noexcept;
     Event(Event&& other) noexcept;
     Event& operator=(Event&& other) noexcept;
     Event(Event&) = delete;
@@ -0,0 +1,103 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <span>
+#include <vector>
+
+#include <ltlib/ltlib.h>
+
+namespace ltlib {
+
+// 把已编码的H.264/H.265(Annex-B)和Opus包封装成fragmented MP4，不重新编码.
+// 只负责生成字节，写文件和线程由调用者负责. 每个实例对应一个独立可播放的文件.
+// 视频从第一个带参数集的关键帧开始，之前收到的视频和音频都会被丢弃.
+class LT_API Fmp4Muxer {
+public:
+    enum class VideoCodec {
+        H264,
+        H265,
+    };
+    struct Params {
+        VideoCodec video_codec = VideoCodec::H264;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // 0表示没有音轨
+        uint32_t audio_channels = 0;
+        uint32_t audio_sample_rate = 48000;
+    };
+
+public:
+    explicit Fmp4Muxer(const Params& params);
+
+    // 时间戳单位us. 返回false表示这一帧被丢弃
+    bool addVideo(std::span<const uint8_t> annexb, bool keyframe, int64_t timestamp_us);
+    bool addAudio(std::span<const uint8_t> opus_packet, int64_t timestamp_us);
+
+    // ftyp+moov，收到第一个关键帧之前是空的
+    const std::vector<uint8_t>& initSegment() const;
+    // 缓存中还没flush的视频时长
+    int64_t bufferedDurationUs() const;
+    // 把缓存的样本打包成moof+mdat追加到out，没有样本时什么都不做.
+    // 最后一个视频帧要等下一帧到来才知道时长，会留到下一次；final为true时按前一帧的时长补上
+    void flushFragment(std::vector<uint8_t>& out, bool final = false);
+
+    // 按TOC算出的Opus包时长，解析失败返回0
+    static int64_t opusPacketDurationUs(std::span<const uint8_t> opus_packet);
+
+private:
+    struct Sample {
+        std::vector<uint8_t> data;
+        uint32_t duration;
+        bool keyframe;
+    };
+    bool makeInitSegment(std::span<const uint8_t> annexb);
+    void writeTrackFragment(std::vector<uint8_t>& out, uint32_t track_id, uint64_t decode_time,
+                            const std::vector<Sample>& samples, bool video,
+                            size_t& data_offset_pos);
+
+private:
+    const Params params_;
+    std::vector<uint8_t> init_segment_;
+    int64_t first_timestamp_us_ = -1;
+    uint32_t sequence_number_ = 0;
+    // 视频时间基90kHz，音频按Opus的规定固定48kHz
+    std::vector<Sample> video_samples_;
+    int64_t last_video_timestamp_us_ = 0;
+    uint64_t video_decode_time_ = 0;
+    uint32_t last_video_duration_ = 0;
+    std::vector<Sample> audio_samples_;
+    uint64_t audio_decode_time_ = 0;
+    uint64_t audio_next_time_ = 0;
+};
+
+} // namespace ltlib
@@ -0,0 +1,117 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ltlib/ltlib.h>
+
+namespace ltlib {
+
+// 按ltframe_id记录一帧从采集到上屏的各个阶段，导出为Chrome/Perfetto可以打开的json.
+// 每个线程写自己的环形缓冲区，stamp()不加锁. 导出时每个槽位用seqlock校验，正在被覆盖的事件直接丢弃.
+class LT_API FrameTracer {
+public:
+    enum class Stage : uint8_t {
+        Capture,
+        StartEncode,
+        EndEncode,
+        // 被控端传输层把这一帧的第一个包发出去
+        Send,
+        // 控制端收到这一帧的第一个包
+        FirstPacket,
+        // 控制端组帧完成，交给解码
+        Arrival,
+        StartDecode,
+        EndDecode,
+        Render,
+        Present,
+    };
+    static constexpr size_t kEventsPerThread = 8192;
+
+public:
+    static FrameTracer* instance();
+    void enable(bool on);
+    bool enabled() const;
+    // 控制端和被控端各导出一个文件，时间戳都是被控端时钟，ltframe_id也一样，
+    // 用不同的pid区分后把traceEvents拼起来就能看到完整的链路
+    void setProcess(uint32_t pid, const std::string& name);
+    // offset = 本地时钟 - 参考时钟，即TimeSync算出来的time_diff
+    void setClockOffset(int64_t offset_us);
+    // 使用本地时钟打点
+    void stamp(uint64_t ltframe_id, Stage stage);
+    void stamp(uint64_t ltframe_id, Stage stage, int64_t local_timestamp_us);
+    // 时间戳本身已经是参考时钟(比如随帧带过来的采集、编码时间)
+    void stampRemote(uint64_t ltframe_id, Stage stage, int64_t remote_timestamp_us);
+    bool dumpChromeTrace(const std::string& path);
+
+private:
+    struct Event {
+        uint64_t ltframe_id;
+        int64_t timestamp_us;
+        Stage stage;
+    };
+    // 第index个事件写入过程中seq为2*index+1，写完为2*index+2
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<uint64_t> ltframe_id{0};
+        std::atomic<int64_t> timestamp_us{0};
+        std::atomic<uint8_t> stage{0};
+    };
+    struct Ring {
+        uint32_t tid;
+        std::atomic<uint64_t> write_index{0};
+        std::unique_ptr<Slot[]> slots;
+    };
+
+private:
+    FrameTracer() = default;
+    FrameTracer(const FrameTracer&) = delete;
+    FrameTracer& operator=(const FrameTracer&) = delete;
+    Ring* threadRing();
+    void push(uint64_t ltframe_id, Stage stage, int64_t timestamp_us);
+    static bool readSlot(const Slot& slot, uint64_t index, Event& event);
+
+private:
+    std::atomic<bool> enabled_{false};
+    std::atomic<int64_t> clock_offset_us_{0};
+    std::mutex mutex_;
+    uint32_t pid_ = 1;
+    std::string process_name_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+};
+
+} // namespace ltlib
@@ -33,7 +33,10 @@
 #include <ltlib/io/types.h>
 #include <ltlib/io/ioloop.h>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 #include <google/protobuf/message_lite.h>
 
 namespace ltlib
@@ -52,6 +55,10 @@ public:
         std::string pipe_name;
         std::string bind_ip;
         uint16_t bind_port;
+        // 非空时，TCP连接会被分散到ioloop和shard_ioloops上(Linux SO_REUSEPORT)
+        // 每个连接固定在一个ioloop上，它的回调在那个ioloop的线程里执行，send()/close()也必须在那个线程调用
+        // 所有ioloop都要在run()之前创建Server. 其它平台或者Pipe会忽略shard_ioloops，只用ioloop
+        std::vector<IOLoop*> shard_ioloops;
         std::function<void(uint32_t)> on_accepted;
         std::function<void(uint32_t)> on_closed;
         std::function<void(uint32_t /*fd*/, uint32_t /*type*/, const std::shared_ptr<google::protobuf::MessageLite>&)> on_message;
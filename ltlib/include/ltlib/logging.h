@@ -11,8 +11,10 @@
 
 #include <inttypes.h>
 
+#include <atomic>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include <g3log/g3log.hpp>
@@ -26,6 +28,39 @@ const LEVELS ERR{WARNING.value + 100, "ERROR"};
     else                                                                                           \
         LogCapture(file, line, func, level).stream()
 
+// 编译期日志级别过滤. 低于LT_LOG_MIN_LEVEL的LOG_FAST/LOGB整条语句会被编译器删掉，参数不会被求值.
+// 热路径(收发包之类)用这两个宏，其它地方继续用LOG/LOGF.
+// 单个目标可以定义LT_LOG_TARGET_MIN_LEVEL覆盖全局的LT_LOG_MIN_LEVEL.
+#ifndef LT_LOG_MIN_LEVEL
+#define LT_LOG_MIN_LEVEL 0
+#endif
+#define LT_LOG_LEVEL_DEBUG 0
+#define LT_LOG_LEVEL_INFO 1
+#define LT_LOG_LEVEL_WARNING 2
+#define LT_LOG_LEVEL_ERR 3
+#if defined(LT_LOG_TARGET_MIN_LEVEL)
+#define LT_LOG_ENABLED(level) (LT_LOG_LEVEL_##level >= LT_LOG_TARGET_MIN_LEVEL)
+#else
+#define LT_LOG_ENABLED(level) (LT_LOG_LEVEL_##level >= LT_LOG_MIN_LEVEL)
+#endif
+
+#define LOG_FAST(level)                                                                            \
+    if (!LT_LOG_ENABLED(level) || !g3::logLevel(level)) {                                          \
+    }                                                                                              \
+    else                                                                                           \
+        LogCapture(__FILE__, __LINE__, static_cast<const char*>(G3LOG_PRETTY_FUNCTION), level)     \
+            .stream()
+
+// 二进制日志: 只把格式串指针和整数参数写进当前线程的环形缓冲区，由后台线程格式化后交给g3log.
+// 格式串必须是字面量，用"{}"做占位符，参数只支持整数/枚举/bool，最多4个.
+// 例: LOGB(DEBUG, "kcp output {}", len);
+#define LOGB(level, fmt, ...)                                                                      \
+    do {                                                                                           \
+        if (LT_LOG_ENABLED(level) && g3::logLevel(level)) {                                        \
+            ::ltlib::BinaryLog::write(&level, __FILE__, __LINE__, fmt, ##__VA_ARGS__);             \
+        }                                                                                          \
+    } while (false)
+
 namespace ltlib {
 class LT_API LogSink {
 public:
@@ -60,4 +95,64 @@ private:
     LogSink(const LogSink& other) = delete;
 };
 
+class LT_API BinaryLog {
+public:
+    static constexpr size_t kMaxArgs = 4;
+    static constexpr size_t kRecordsPerThread = 4096;
+
+    struct Record {
+        int64_t timestamp_us;
+        const LEVELS* level;
+        const char* file;
+        int line;
+        const char* fmt;
+        uint32_t argc;
+        // 第i位为1表示args[i]原本是无符号数，格式化时按uint64输出
+        uint32_t unsigned_mask;
+        int64_t args[kMaxArgs];
+    };
+
+public:
+    template <typename... Args>
+    static void write(const LEVELS* level, const char* file, int line, const char* fmt,
+                      Args... args) {
+        static_assert(sizeof...(Args) <= kMaxArgs, "LOGB supports at most 4 arguments");
+        static_assert(((std::is_integral_v<Args> || std::is_enum_v<Args>) && ...),
+                      "LOGB only supports integral arguments");
+        Record* record = beginWrite();
+        if (record == nullptr) {
+            return;
+        }
+        record->level = level;
+        record->file = file;
+        record->line = line;
+        record->fmt = fmt;
+        record->argc = static_cast<uint32_t>(sizeof...(Args));
+        record->unsigned_mask = 0;
+        [[maybe_unused]] uint32_t index = 0;
+        ((record->unsigned_mask |= (isUnsigned<Args>() ? 1u : 0u) << index,
+          record->args[index++] = static_cast<int64_t>(args)),
+         ...);
+        commitWrite();
+    }
+    // 立即把所有线程缓冲区里的日志交给g3log，一般不需要手动调用
+    static void flush();
+    // 停掉后台线程并把剩下的日志交给g3log. 必须在g3log的LogWorker析构前调用，之后的LOGB不再输出
+    static void shutdown();
+    // 因缓冲区满而丢弃的条数
+    static uint64_t dropped();
+
+private:
+    template <typename T> static constexpr bool isUnsigned() {
+        if constexpr (std::is_enum_v<T>) {
+            return std::is_unsigned_v<std::underlying_type_t<T>>;
+        }
+        else {
+            return std::is_unsigned_v<T>;
+        }
+    }
+    static Record* beginWrite();
+    static void commitWrite();
+};
+
 } // namespace ltlib
\ No newline at end of file
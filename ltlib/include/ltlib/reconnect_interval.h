@@ -31,11 +31,11 @@
 #pragma once
 #include <ltlib/ltlib.h>
 #include <cstdint>
-#include <array>
 
 namespace ltlib
 {
 
+// 断线后第一次立即重试，之后从100ms开始指数退避，最长60秒
 class LT_API ReconnectInterval
 {
 public:
@@ -44,8 +44,9 @@ public:
     int64_t next();
 
 private:
-    static constexpr std::array<int64_t, 8>kIntervalsMS { 100, 500, 1'000, 2'000, 5'000, 10'000, 30'000, 60'000 };
-    size_t index_ = 0;
+    static constexpr int64_t kBaseIntervalMS = 100;
+    static constexpr int64_t kMaxIntervalMS = 60'000;
+    uint32_t attempts_ = 0;
 };
 
 } // namespace ltlib
\ No newline at end of file
@@ -31,6 +31,7 @@
 #pragma once
 #include <cstdint>
 
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
@@ -61,6 +62,8 @@ public:
     virtual auto getUpdateTime(const std::string& key) -> std::optional<int64_t> = 0;
     virtual auto getKeysStartWith(const std::string& prefix) -> std::vector<std::string> = 0;
     virtual void deleteKey(const std::string& key) = 0;
+    // 在同一个事务里执行writes中的所有set/delete，多次写入只落一次盘
+    virtual void batch(const std::function<void()>& writes) = 0;
 
 protected:
     virtual bool init() = 0;
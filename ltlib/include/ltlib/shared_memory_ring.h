@@ -0,0 +1,91 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <string>
+
+#include <ltlib/event.h>
+#include <ltlib/ltlib.h>
+
+namespace ltlib {
+
+// 跨进程的单生产者单消费者环形缓冲区，记录是变长的，每条记录在共享内存里是连续的.
+// 生产者write()之后通过命名Event通知消费者，消费者在回调里直接读共享内存，不需要额外拷贝.
+class LT_API SharedMemoryRing {
+public:
+    // 由消费者一方创建，生产者open()
+    static std::unique_ptr<SharedMemoryRing> create(const std::string& name, uint32_t capacity);
+    static std::unique_ptr<SharedMemoryRing> open(const std::string& name);
+    ~SharedMemoryRing();
+
+    // 生产者调用. 空间不够时返回false，不会覆盖未读的数据
+    bool write(std::initializer_list<std::span<const uint8_t>> parts);
+
+    // 消费者调用. 读出一条记录，没有数据返回false.
+    // 记录长度、写位置不合法时丢弃所有未读数据并返回false，不会越界读
+    bool read(const std::function<void(std::span<const uint8_t>)>& consumer);
+    // 消费者调用. 是否还有没读的数据，和read()在同一个线程调用
+    bool hasData();
+    // 等待生产者的通知，可能会有虚假唤醒
+    Event::WaitResult waitForData(uint32_t ms);
+    // 让阻塞在waitForData()的线程返回
+    void wakeup();
+    uint32_t capacity() const;
+
+private:
+    struct Header;
+    SharedMemoryRing() = default;
+    SharedMemoryRing(const SharedMemoryRing&) = delete;
+    SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+    bool map(const std::string& name, uint32_t capacity, bool is_creator);
+    void unmap();
+    Header* header();
+    uint8_t* data();
+    bool reset(uint64_t write_pos, const char* reason);
+
+private:
+    std::string name_;
+    bool is_creator_ = false;
+    void* mapping_ = nullptr;
+    void* address_ = nullptr;
+    size_t mapped_size_ = 0;
+    uint32_t capacity_ = 0;
+    // 只有消费者使用
+    uint64_t read_pos_ = 0;
+    Event doorbell_;
+};
+
+} // namespace ltlib
@@ -0,0 +1,84 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ltlib/ltlib.h>
+
+namespace ltlib {
+
+// 启动阶段的任务组: 互不依赖的初始化步骤放到单独线程并发执行，每个阶段都计时，
+// 最后生成一行启动报告. 有依赖或者必须在当前线程做的步骤用measure()串行执行.
+class LT_API StartupTasks {
+public:
+    explicit StartupTasks(const std::string& name);
+    ~StartupTasks();
+
+    // 在新线程执行，和其它run()的任务并发
+    void run(const std::string& phase, const std::function<bool()>& task);
+
+    // 在调用线程执行并计时，可以在run()的任务里调用，用来细分阶段
+    bool measure(const std::string& phase, const std::function<bool()>& task);
+
+    // 等所有run()的任务结束，任一阶段失败返回false. 可以多次调用
+    bool wait();
+
+    // 形如"startup(client) 48ms ok | settings +0ms 3ms ok | sdl +3ms 45ms ok"，
+    // 阶段按开始时间排序，+号后面是相对任务组创建的偏移
+    std::string report() const;
+
+private:
+    struct Phase {
+        std::string name;
+        int64_t start_us;
+        int64_t end_us;
+        bool success;
+    };
+
+private:
+    StartupTasks(const StartupTasks&) = delete;
+    StartupTasks& operator=(const StartupTasks&) = delete;
+
+private:
+    const std::string name_;
+    const int64_t begin_us_;
+    mutable std::mutex mutex_;
+    std::vector<Phase> phases_;
+    std::vector<std::thread> threads_;
+};
+
+} // namespace ltlib
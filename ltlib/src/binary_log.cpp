@@ -0,0 +1,192 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ltlib/logging.h>
+
+#include <cinttypes>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <ltlib/times.h>
+
+namespace {
+
+// 单生产者(写日志的线程)单消费者(flush线程)
+struct Ring {
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::vector<ltlib::BinaryLog::Record> records;
+};
+
+std::string format(const ltlib::BinaryLog::Record& record) {
+    std::string out;
+    uint32_t arg_index = 0;
+    for (const char* p = record.fmt; *p != '\0'; p++) {
+        if (p[0] == '{' && p[1] == '}' && arg_index < record.argc) {
+            char buff[32];
+            if (record.unsigned_mask & (1u << arg_index)) {
+                snprintf(buff, sizeof(buff), "%" PRIu64,
+                         static_cast<uint64_t>(record.args[arg_index]));
+            }
+            else {
+                snprintf(buff, sizeof(buff), "%" PRId64, record.args[arg_index]);
+            }
+            out += buff;
+            arg_index++;
+            p++;
+        }
+        else {
+            out.push_back(*p);
+        }
+    }
+    return out;
+}
+
+class BinaryLogFlusher {
+public:
+    static BinaryLogFlusher* instance() {
+        static BinaryLogFlusher flusher;
+        return &flusher;
+    }
+
+    // 静态析构时g3log可能已经没了，这里只停线程不再输出，剩下的日志由shutdown()负责
+    ~BinaryLogFlusher() { stop(); }
+
+    void shutdown() {
+        stop();
+        flush();
+    }
+
+    Ring* createRing() {
+        auto new_ring = std::make_shared<Ring>();
+        new_ring->records.resize(ltlib::BinaryLog::kRecordsPerThread);
+        std::lock_guard lock{mutex_};
+        rings_.push_back(new_ring);
+        if (!thread_.joinable() && !stopped_) {
+            thread_ = std::thread{[this]() { loop(); }};
+        }
+        return new_ring.get();
+    }
+
+    void flush() {
+        std::lock_guard flush_lock{flush_mutex_};
+        std::vector<std::shared_ptr<Ring>> rings;
+        {
+            std::lock_guard lock{mutex_};
+            rings = rings_;
+        }
+        for (auto& ring : rings) {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            for (; tail < head; tail++) {
+                const auto& record = ring->records[tail % ltlib::BinaryLog::kRecordsPerThread];
+                LogCapture(record.file, record.line, "", *record.level).stream()
+                    << '[' << record.timestamp_us << "] " << format(record);
+            }
+            ring->tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    std::atomic<uint64_t> dropped{0};
+
+private:
+    void stop() {
+        {
+            std::lock_guard lock{mutex_};
+            stopped_ = true;
+        }
+        cv_.notify_one();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    void loop() {
+        constexpr auto kFlushInterval = std::chrono::milliseconds{200};
+        while (true) {
+            {
+                std::unique_lock lock{mutex_};
+                cv_.wait_for(lock, kFlushInterval, [this]() { return stopped_; });
+                if (stopped_) {
+                    return;
+                }
+            }
+            flush();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::mutex flush_mutex_;
+    std::condition_variable cv_;
+    bool stopped_ = false;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    std::thread thread_;
+};
+
+thread_local Ring* t_ring = nullptr;
+
+} // namespace
+
+namespace ltlib {
+
+BinaryLog::Record* BinaryLog::beginWrite() {
+    if (t_ring == nullptr) {
+        t_ring = BinaryLogFlusher::instance()->createRing();
+    }
+    uint64_t head = t_ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = t_ring->tail.load(std::memory_order_acquire);
+    if (head - tail >= kRecordsPerThread) {
+        BinaryLogFlusher::instance()->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Record* record = &t_ring->records[head % kRecordsPerThread];
+    record->timestamp_us = steady_now_us();
+    return record;
+}
+
+void BinaryLog::commitWrite() {
+    t_ring->head.fetch_add(1, std::memory_order_release);
+}
+
+void BinaryLog::flush() {
+    BinaryLogFlusher::instance()->flush();
+}
+
+void BinaryLog::shutdown() {
+    BinaryLogFlusher::instance()->shutdown();
+}
+
+uint64_t BinaryLog::dropped() {
+    return BinaryLogFlusher::instance()->dropped.load(std::memory_order_relaxed);
+}
+
+} // namespace ltlib
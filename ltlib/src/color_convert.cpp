@@ -0,0 +1,729 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ltlib/color_convert.h>
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LT_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define LT_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// MSVC不需要为每个函数指定指令集，GCC/Clang用target属性，不需要给整个文件加-mavx2
+#if defined(LT_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define LT_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define LT_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define LT_TARGET_SSSE3
+#define LT_TARGET_AVX2
+#endif
+
+namespace {
+
+// 以下标量实现是所有SIMD实现的参考，系数都选成SIMD里16位整数不会溢出的值:
+// Y = ((33R + 64G + 13B + 64) >> 7) + 16
+// U = ((-38R - 74G + 112B + 128) >> 8) + 128
+// V = ((112R - 94G - 18B + 128) >> 8) + 128
+// R = (298C + 409E + 128) >> 8, G = (298C - 100D - 208E + 128) >> 8, B = (298C + 516D + 128) >> 8
+// 其中C = Y - 16, D = U - 128, E = V - 128
+
+struct Kernels {
+    void (*y_row)(const uint8_t* bgra, uint8_t* y, int width);
+    void (*uv_row)(const uint8_t* row0, const uint8_t* row1, uint8_t* uv, int width);
+    void (*u_v_row)(const uint8_t* row0, const uint8_t* row1, uint8_t* u, uint8_t* v, int width);
+    void (*nv12_row)(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width);
+    void (*half_row)(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width);
+};
+
+inline uint8_t clampU8(int32_t value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+inline uint8_t toY(int32_t b, int32_t g, int32_t r) {
+    return static_cast<uint8_t>(((13 * b + 64 * g + 33 * r + 64) >> 7) + 16);
+}
+
+inline uint8_t toU(int32_t b, int32_t g, int32_t r) {
+    return static_cast<uint8_t>(((112 * b - 74 * g - 38 * r + 128) >> 8) + 128);
+}
+
+inline uint8_t toV(int32_t b, int32_t g, int32_t r) {
+    return static_cast<uint8_t>(((-18 * b - 94 * g + 112 * r + 128) >> 8) + 128);
+}
+
+// 2x2个像素某个通道的四舍五入平均
+inline int32_t avg2x2(const uint8_t* row0, const uint8_t* row1, int channel) {
+    return (row0[channel] + row0[channel + 4] + row1[channel] + row1[channel + 4] + 2) >> 2;
+}
+
+void yRowScalar(const uint8_t* bgra, uint8_t* y, int width) {
+    for (int x = 0; x < width; x++) {
+        y[x] = toY(bgra[x * 4], bgra[x * 4 + 1], bgra[x * 4 + 2]);
+    }
+}
+
+// step为2时u/v交错写(NV12)，为1时分别写(I420)
+void uvRowScalar(const uint8_t* row0, const uint8_t* row1, uint8_t* u, uint8_t* v, int step,
+                 int width) {
+    for (int x = 0; x < width; x += 2) {
+        const int32_t b = avg2x2(row0 + x * 4, row1 + x * 4, 0);
+        const int32_t g = avg2x2(row0 + x * 4, row1 + x * 4, 1);
+        const int32_t r = avg2x2(row0 + x * 4, row1 + x * 4, 2);
+        u[x / 2 * step] = toU(b, g, r);
+        v[x / 2 * step] = toV(b, g, r);
+    }
+}
+
+void nv12RowScalar(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width) {
+    for (int x = 0; x < width; x++) {
+        const int32_t c = y[x] - 16;
+        const int32_t d = uv[x / 2 * 2] - 128;
+        const int32_t e = uv[x / 2 * 2 + 1] - 128;
+        bgra[x * 4] = clampU8((298 * c + 516 * d + 128) >> 8);
+        bgra[x * 4 + 1] = clampU8((298 * c - 100 * d - 208 * e + 128) >> 8);
+        bgra[x * 4 + 2] = clampU8((298 * c + 409 * e + 128) >> 8);
+        bgra[x * 4 + 3] = 255;
+    }
+}
+
+void halfRowScalar(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width) {
+    for (int x = 0; x < dst_width; x++) {
+        for (int c = 0; c < 4; c++) {
+            dst[x * 4 + c] = static_cast<uint8_t>(avg2x2(row0 + x * 8, row1 + x * 8, c));
+        }
+    }
+}
+
+void uvRowNV12Scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* uv, int width) {
+    uvRowScalar(row0, row1, uv, uv + 1, 2, width);
+}
+
+void uvRowI420Scalar(const uint8_t* row0, const uint8_t* row1, uint8_t* u, uint8_t* v,
+                     int width) {
+    uvRowScalar(row0, row1, u, v, 1, width);
+}
+
+const Kernels kScalarKernels = {yRowScalar, uvRowNV12Scalar, uvRowI420Scalar, nv12RowScalar,
+                                halfRowScalar};
+
+#if defined(LT_SIMD_X86)
+
+// ---------------------------------- SSSE3: 一次16个Y、8个像素的UV ----------------------------------
+
+// 4个BGRA像素 -> 每对相邻像素每个通道的和(16位): [B01 G01 R01 A01 B23 G23 R23 A23]
+LT_TARGET_SSSE3 inline __m128i pairSumSSSE3(__m128i pixels) {
+    const __m128i shuffle = _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+    return _mm_maddubs_epi16(_mm_shuffle_epi8(pixels, shuffle), _mm_set1_epi8(1));
+}
+
+// 两行各4个像素 -> 两个2x2块每个通道的平均值(16位)
+LT_TARGET_SSSE3 inline __m128i avg2x2SSSE3(const uint8_t* row0, const uint8_t* row1) {
+    __m128i sum = _mm_add_epi16(
+        pairSumSSSE3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0))),
+        pairSumSSSE3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1))));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+// 两行各8个像素 -> 低8字节是交错的4组UV
+LT_TARGET_SSSE3 inline __m128i uv8SSSE3(const uint8_t* row0, const uint8_t* row1) {
+    const __m128i coef_u = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+    const __m128i coef_v = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+    const __m128i c128 = _mm_set1_epi32(128);
+    __m128i a = avg2x2SSSE3(row0, row1);
+    __m128i b = avg2x2SSSE3(row0 + 16, row1 + 16);
+    __m128i u = _mm_hadd_epi32(_mm_madd_epi16(a, coef_u), _mm_madd_epi16(b, coef_u));
+    __m128i v = _mm_hadd_epi32(_mm_madd_epi16(a, coef_v), _mm_madd_epi16(b, coef_v));
+    u = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(u, c128), 8), c128);
+    v = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(v, c128), 8), c128);
+    __m128i uv = _mm_unpacklo_epi16(_mm_packs_epi32(u, u), _mm_packs_epi32(v, v));
+    return _mm_packus_epi16(uv, uv);
+}
+
+LT_TARGET_SSSE3 void yRowSSSE3(const uint8_t* bgra, uint8_t* y, int width) {
+    const __m128i coef = _mm_setr_epi8(13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0);
+    const __m128i c64 = _mm_set1_epi16(64);
+    const __m128i c16 = _mm_set1_epi16(16);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m128i* src = reinterpret_cast<const __m128i*>(bgra + x * 4);
+        __m128i m0 = _mm_maddubs_epi16(_mm_loadu_si128(src), coef);
+        __m128i m1 = _mm_maddubs_epi16(_mm_loadu_si128(src + 1), coef);
+        __m128i m2 = _mm_maddubs_epi16(_mm_loadu_si128(src + 2), coef);
+        __m128i m3 = _mm_maddubs_epi16(_mm_loadu_si128(src + 3), coef);
+        __m128i y0 = _mm_hadd_epi16(m0, m1);
+        __m128i y1 = _mm_hadd_epi16(m2, m3);
+        y0 = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(y0, c64), 7), c16);
+        y1 = _mm_add_epi16(_mm_srli_epi16(_mm_add_epi16(y1, c64), 7), c16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y + x), _mm_packus_epi16(y0, y1));
+    }
+    yRowScalar(bgra + x * 4, y + x, width - x);
+}
+
+LT_TARGET_SSSE3 void uvRowNV12SSSE3(const uint8_t* row0, const uint8_t* row1, uint8_t* uv,
+                                    int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(uv + x), uv8SSSE3(row0 + x * 4, row1 + x * 4));
+    }
+    uvRowNV12Scalar(row0 + x * 4, row1 + x * 4, uv + x, width - x);
+}
+
+LT_TARGET_SSSE3 void uvRowI420SSSE3(const uint8_t* row0, const uint8_t* row1, uint8_t* u,
+                                    uint8_t* v, int width) {
+    const __m128i deinterleave =
+        _mm_setr_epi8(0, 2, 4, 6, 1, 3, 5, 7, 8, 10, 12, 14, 9, 11, 13, 15);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i uv = _mm_shuffle_epi8(uv8SSSE3(row0 + x * 4, row1 + x * 4), deinterleave);
+        const int32_t u4 = _mm_cvtsi128_si32(uv);
+        const int32_t v4 = _mm_cvtsi128_si32(_mm_srli_si128(uv, 4));
+        std::memcpy(u + x / 2, &u4, 4);
+        std::memcpy(v + x / 2, &v4, 4);
+    }
+    uvRowI420Scalar(row0 + x * 4, row1 + x * 4, u + x / 2, v + x / 2, width - x);
+}
+
+LT_TARGET_SSSE3 void nv12RowSSSE3(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c16 = _mm_set1_epi16(16);
+    const __m128i c128 = _mm_set1_epi16(128);
+    const __m128i c128_32 = _mm_set1_epi32(128);
+    const __m128i alpha = _mm_set1_epi8(-1);
+    const __m128i dup_d = _mm_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+    const __m128i dup_e = _mm_setr_epi8(2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+    const __m128i coef_r = _mm_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409);
+    const __m128i coef_gd = _mm_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100);
+    // 和常量128配对，顺便把四舍五入加上
+    const __m128i coef_ge = _mm_setr_epi16(-208, 1, -208, 1, -208, 1, -208, 1);
+    const __m128i coef_b = _mm_setr_epi16(298, 516, 298, 516, 298, 516, 298, 516);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i c = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x));
+        c = _mm_sub_epi16(_mm_unpacklo_epi8(c, zero), c16);
+        __m128i de = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(uv + x));
+        de = _mm_sub_epi16(_mm_unpacklo_epi8(de, zero), c128);
+        __m128i d = _mm_shuffle_epi8(de, dup_d);
+        __m128i e = _mm_shuffle_epi8(de, dup_e);
+        __m128i ce_lo = _mm_unpacklo_epi16(c, e);
+        __m128i ce_hi = _mm_unpackhi_epi16(c, e);
+        __m128i cd_lo = _mm_unpacklo_epi16(c, d);
+        __m128i cd_hi = _mm_unpackhi_epi16(c, d);
+        __m128i ek_lo = _mm_unpacklo_epi16(e, c128);
+        __m128i ek_hi = _mm_unpackhi_epi16(e, c128);
+        __m128i r_lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_lo, coef_r), c128_32), 8);
+        __m128i r_hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(ce_hi, coef_r), c128_32), 8);
+        __m128i g_lo = _mm_srai_epi32(
+            _mm_add_epi32(_mm_madd_epi16(cd_lo, coef_gd), _mm_madd_epi16(ek_lo, coef_ge)), 8);
+        __m128i g_hi = _mm_srai_epi32(
+            _mm_add_epi32(_mm_madd_epi16(cd_hi, coef_gd), _mm_madd_epi16(ek_hi, coef_ge)), 8);
+        __m128i b_lo = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_lo, coef_b), c128_32), 8);
+        __m128i b_hi = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(cd_hi, coef_b), c128_32), 8);
+        __m128i r = _mm_packs_epi32(r_lo, r_hi);
+        __m128i g = _mm_packs_epi32(g_lo, g_hi);
+        __m128i b = _mm_packs_epi32(b_lo, b_hi);
+        __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+        __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), alpha);
+        __m128i* dst = reinterpret_cast<__m128i*>(bgra + x * 4);
+        _mm_storeu_si128(dst, _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(bg, ra));
+    }
+    nv12RowScalar(y + x, uv + x, bgra + x * 4, width - x);
+}
+
+LT_TARGET_SSSE3 void halfRowSSSE3(const uint8_t* row0, const uint8_t* row1, uint8_t* dst,
+                                  int dst_width) {
+    int x = 0;
+    for (; x + 4 <= dst_width; x += 4) {
+        __m128i a = avg2x2SSSE3(row0 + x * 8, row1 + x * 8);
+        __m128i b = avg2x2SSSE3(row0 + x * 8 + 16, row1 + x * 8 + 16);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(a, b));
+    }
+    halfRowScalar(row0 + x * 8, row1 + x * 8, dst + x * 4, dst_width - x);
+}
+
+const Kernels kSSSE3Kernels = {yRowSSSE3, uvRowNV12SSSE3, uvRowI420SSSE3, nv12RowSSSE3,
+                               halfRowSSSE3};
+
+// ---------------------------------- AVX2: 一次32个Y、16个像素的UV ----------------------------------
+// AVX2的unpack/pack/hadd都是在两个128位lane内分别进行的，每个kernel最后要把lane的顺序调整回来
+
+LT_TARGET_AVX2 inline __m256i pairSumAVX2(__m256i pixels) {
+    const __m256i shuffle =
+        _mm256_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15, 0, 4, 1, 5, 2, 6, 3,
+                         7, 8, 12, 9, 13, 10, 14, 11, 15);
+    return _mm256_maddubs_epi16(_mm256_shuffle_epi8(pixels, shuffle), _mm256_set1_epi8(1));
+}
+
+// 两行各8个像素 -> 低lane是第0、1块，高lane是第2、3块
+LT_TARGET_AVX2 inline __m256i avg2x2AVX2(const uint8_t* row0, const uint8_t* row1) {
+    __m256i sum = _mm256_add_epi16(
+        pairSumAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0))),
+        pairSumAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1))));
+    return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+// 两行各16个像素 -> 按顺序交错的8组UV
+LT_TARGET_AVX2 inline __m128i uv16AVX2(const uint8_t* row0, const uint8_t* row1) {
+    const __m256i coef_u = _mm256_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0, 112, -74, -38, 0,
+                                             112, -74, -38, 0);
+    const __m256i coef_v = _mm256_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0, -18, -94, 112, 0,
+                                             -18, -94, 112, 0);
+    const __m256i c128 = _mm256_set1_epi32(128);
+    __m256i a = avg2x2AVX2(row0, row1);
+    __m256i b = avg2x2AVX2(row0 + 32, row1 + 32);
+    // u: [U0 U1 U4 U5 | U2 U3 U6 U7]
+    __m256i u = _mm256_hadd_epi32(_mm256_madd_epi16(a, coef_u), _mm256_madd_epi16(b, coef_u));
+    __m256i v = _mm256_hadd_epi32(_mm256_madd_epi16(a, coef_v), _mm256_madd_epi16(b, coef_v));
+    u = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(u, c128), 8), c128);
+    v = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(v, c128), 8), c128);
+    __m256i uv = _mm256_unpacklo_epi16(_mm256_packs_epi32(u, u), _mm256_packs_epi32(v, v));
+    uv = _mm256_packus_epi16(uv, uv);
+    uv = _mm256_permutevar8x32_epi32(uv, _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5));
+    return _mm256_castsi256_si128(uv);
+}
+
+LT_TARGET_AVX2 void yRowAVX2(const uint8_t* bgra, uint8_t* y, int width) {
+    const __m256i coef = _mm256_setr_epi8(13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33,
+                                          0, 13, 64, 33, 0, 13, 64, 33, 0, 13, 64, 33, 0, 13, 64,
+                                          33, 0);
+    const __m256i c64 = _mm256_set1_epi16(64);
+    const __m256i c16 = _mm256_set1_epi16(16);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        const __m256i* src = reinterpret_cast<const __m256i*>(bgra + x * 4);
+        __m256i m0 = _mm256_maddubs_epi16(_mm256_loadu_si256(src), coef);
+        __m256i m1 = _mm256_maddubs_epi16(_mm256_loadu_si256(src + 1), coef);
+        __m256i m2 = _mm256_maddubs_epi16(_mm256_loadu_si256(src + 2), coef);
+        __m256i m3 = _mm256_maddubs_epi16(_mm256_loadu_si256(src + 3), coef);
+        __m256i y0 = _mm256_hadd_epi16(m0, m1);
+        __m256i y1 = _mm256_hadd_epi16(m2, m3);
+        y0 = _mm256_add_epi16(_mm256_srli_epi16(_mm256_add_epi16(y0, c64), 7), c16);
+        y1 = _mm256_add_epi16(_mm256_srli_epi16(_mm256_add_epi16(y1, c64), 7), c16);
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(y0, y1), order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + x), packed);
+    }
+    yRowSSSE3(bgra + x * 4, y + x, width - x);
+}
+
+LT_TARGET_AVX2 void uvRowNV12AVX2(const uint8_t* row0, const uint8_t* row1, uint8_t* uv,
+                                  int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x), uv16AVX2(row0 + x * 4, row1 + x * 4));
+    }
+    uvRowNV12SSSE3(row0 + x * 4, row1 + x * 4, uv + x, width - x);
+}
+
+LT_TARGET_AVX2 void uvRowI420AVX2(const uint8_t* row0, const uint8_t* row1, uint8_t* u,
+                                  uint8_t* v, int width) {
+    const __m128i deinterleave =
+        _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i uv = _mm_shuffle_epi8(uv16AVX2(row0 + x * 4, row1 + x * 4), deinterleave);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), uv);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_srli_si128(uv, 8));
+    }
+    uvRowI420SSSE3(row0 + x * 4, row1 + x * 4, u + x / 2, v + x / 2, width - x);
+}
+
+LT_TARGET_AVX2 void nv12RowAVX2(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width) {
+    const __m256i c16 = _mm256_set1_epi16(16);
+    const __m256i c128 = _mm256_set1_epi16(128);
+    const __m256i c128_32 = _mm256_set1_epi32(128);
+    const __m256i alpha = _mm256_set1_epi8(-1);
+    const __m256i dup_d = _mm256_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13, 0,
+                                           1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+    const __m256i dup_e = _mm256_setr_epi8(2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15,
+                                           2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+    const __m256i coef_r = _mm256_setr_epi16(298, 409, 298, 409, 298, 409, 298, 409, 298, 409, 298,
+                                             409, 298, 409, 298, 409);
+    const __m256i coef_gd = _mm256_setr_epi16(298, -100, 298, -100, 298, -100, 298, -100, 298,
+                                              -100, 298, -100, 298, -100, 298, -100);
+    const __m256i coef_ge =
+        _mm256_setr_epi16(-208, 1, -208, 1, -208, 1, -208, 1, -208, 1, -208, 1, -208, 1, -208, 1);
+    const __m256i coef_b = _mm256_setr_epi16(298, 516, 298, 516, 298, 516, 298, 516, 298, 516, 298,
+                                             516, 298, 516, 298, 516);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        // 低lane是第0~7个像素，高lane是第8~15个像素
+        __m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x)));
+        c = _mm256_sub_epi16(c, c16);
+        __m256i de =
+            _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x)));
+        de = _mm256_sub_epi16(de, c128);
+        __m256i d = _mm256_shuffle_epi8(de, dup_d);
+        __m256i e = _mm256_shuffle_epi8(de, dup_e);
+        __m256i ce_lo = _mm256_unpacklo_epi16(c, e);
+        __m256i ce_hi = _mm256_unpackhi_epi16(c, e);
+        __m256i cd_lo = _mm256_unpacklo_epi16(c, d);
+        __m256i cd_hi = _mm256_unpackhi_epi16(c, d);
+        __m256i ek_lo = _mm256_unpacklo_epi16(e, c128);
+        __m256i ek_hi = _mm256_unpackhi_epi16(e, c128);
+        __m256i r_lo =
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ce_lo, coef_r), c128_32), 8);
+        __m256i r_hi =
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(ce_hi, coef_r), c128_32), 8);
+        __m256i g_lo = _mm256_srai_epi32(
+            _mm256_add_epi32(_mm256_madd_epi16(cd_lo, coef_gd), _mm256_madd_epi16(ek_lo, coef_ge)),
+            8);
+        __m256i g_hi = _mm256_srai_epi32(
+            _mm256_add_epi32(_mm256_madd_epi16(cd_hi, coef_gd), _mm256_madd_epi16(ek_hi, coef_ge)),
+            8);
+        __m256i b_lo =
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_lo, coef_b), c128_32), 8);
+        __m256i b_hi =
+            _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(cd_hi, coef_b), c128_32), 8);
+        __m256i r = _mm256_packs_epi32(r_lo, r_hi);
+        __m256i g = _mm256_packs_epi32(g_lo, g_hi);
+        __m256i b = _mm256_packs_epi32(b_lo, b_hi);
+        __m256i bg = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), _mm256_packus_epi16(g, g));
+        __m256i ra = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), alpha);
+        __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+        __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+        __m256i* dst = reinterpret_cast<__m256i*>(bgra + x * 4);
+        _mm256_storeu_si256(dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(dst + 1, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    nv12RowSSSE3(y + x, uv + x, bgra + x * 4, width - x);
+}
+
+LT_TARGET_AVX2 void halfRowAVX2(const uint8_t* row0, const uint8_t* row1, uint8_t* dst,
+                                int dst_width) {
+    int x = 0;
+    for (; x + 8 <= dst_width; x += 8) {
+        __m256i a = avg2x2AVX2(row0 + x * 8, row1 + x * 8);
+        __m256i b = avg2x2AVX2(row0 + x * 8 + 32, row1 + x * 8 + 32);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), packed);
+    }
+    halfRowSSSE3(row0 + x * 8, row1 + x * 8, dst + x * 4, dst_width - x);
+}
+
+const Kernels kAVX2Kernels = {yRowAVX2, uvRowNV12AVX2, uvRowI420AVX2, nv12RowAVX2, halfRowAVX2};
+
+#endif // LT_SIMD_X86
+
+#if defined(LT_SIMD_NEON)
+
+// ---------------------------------- NEON: 一次16个像素 ----------------------------------
+
+void yRowNEON(const uint8_t* bgra, uint8_t* y, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t p = vld4q_u8(bgra + x * 4);
+        uint16x8_t lo = vmull_u8(vget_low_u8(p.val[0]), vdup_n_u8(13));
+        lo = vmlal_u8(lo, vget_low_u8(p.val[1]), vdup_n_u8(64));
+        lo = vmlal_u8(lo, vget_low_u8(p.val[2]), vdup_n_u8(33));
+        uint16x8_t hi = vmull_u8(vget_high_u8(p.val[0]), vdup_n_u8(13));
+        hi = vmlal_u8(hi, vget_high_u8(p.val[1]), vdup_n_u8(64));
+        hi = vmlal_u8(hi, vget_high_u8(p.val[2]), vdup_n_u8(33));
+        uint8x8_t y_lo = vshrn_n_u16(vaddq_u16(lo, vdupq_n_u16(64)), 7);
+        uint8x8_t y_hi = vshrn_n_u16(vaddq_u16(hi, vdupq_n_u16(64)), 7);
+        vst1q_u8(y + x, vaddq_u8(vcombine_u8(y_lo, y_hi), vdupq_n_u8(16)));
+    }
+    yRowScalar(bgra + x * 4, y + x, width - x);
+}
+
+// 两行各16个像素 -> 8组U、8组V
+inline void uv16NEON(const uint8_t* row0, const uint8_t* row1, uint8x8_t& u8, uint8x8_t& v8) {
+    uint8x16x4_t p0 = vld4q_u8(row0);
+    uint8x16x4_t p1 = vld4q_u8(row1);
+    uint16x8_t sum_b = vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]);
+    uint16x8_t sum_g = vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]);
+    uint16x8_t sum_r = vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]);
+    int16x8_t b = vreinterpretq_s16_u16(vrshrq_n_u16(sum_b, 2));
+    int16x8_t g = vreinterpretq_s16_u16(vrshrq_n_u16(sum_g, 2));
+    int16x8_t r = vreinterpretq_s16_u16(vrshrq_n_u16(sum_r, 2));
+    const int16x8_t c128 = vdupq_n_s16(128);
+    int16x8_t u = vmulq_n_s16(b, 112);
+    u = vmlaq_n_s16(u, g, -74);
+    u = vmlaq_n_s16(u, r, -38);
+    u = vaddq_s16(vshrq_n_s16(vaddq_s16(u, c128), 8), c128);
+    int16x8_t v = vmulq_n_s16(b, -18);
+    v = vmlaq_n_s16(v, g, -94);
+    v = vmlaq_n_s16(v, r, 112);
+    v = vaddq_s16(vshrq_n_s16(vaddq_s16(v, c128), 8), c128);
+    u8 = vmovn_u16(vreinterpretq_u16_s16(u));
+    v8 = vmovn_u16(vreinterpretq_u16_s16(v));
+}
+
+void uvRowNV12NEON(const uint8_t* row0, const uint8_t* row1, uint8_t* uv, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8x2_t out;
+        uv16NEON(row0 + x * 4, row1 + x * 4, out.val[0], out.val[1]);
+        vst2_u8(uv + x, out);
+    }
+    uvRowNV12Scalar(row0 + x * 4, row1 + x * 4, uv + x, width - x);
+}
+
+void uvRowI420NEON(const uint8_t* row0, const uint8_t* row1, uint8_t* u, uint8_t* v, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x8_t u8;
+        uint8x8_t v8;
+        uv16NEON(row0 + x * 4, row1 + x * 4, u8, v8);
+        vst1_u8(u + x / 2, u8);
+        vst1_u8(v + x / 2, v8);
+    }
+    uvRowI420Scalar(row0 + x * 4, row1 + x * 4, u + x / 2, v + x / 2, width - x);
+}
+
+// (c0 * coef0 + c1 * coef1 + c2 * coef2 + 128) >> 8，再饱和到[0, 255]
+inline uint8x8_t yuvChannelNEON(int16x8_t c0, int16_t coef0, int16x8_t c1, int16_t coef1,
+                                int16x8_t c2, int16_t coef2) {
+    int32x4_t lo = vmull_n_s16(vget_low_s16(c0), coef0);
+    lo = vmlal_n_s16(lo, vget_low_s16(c1), coef1);
+    lo = vmlal_n_s16(lo, vget_low_s16(c2), coef2);
+    int32x4_t hi = vmull_n_s16(vget_high_s16(c0), coef0);
+    hi = vmlal_n_s16(hi, vget_high_s16(c1), coef1);
+    hi = vmlal_n_s16(hi, vget_high_s16(c2), coef2);
+    lo = vshrq_n_s32(vaddq_s32(lo, vdupq_n_s32(128)), 8);
+    hi = vshrq_n_s32(vaddq_s32(hi, vdupq_n_s32(128)), 8);
+    return vqmovun_s16(vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+}
+
+void nv12RowNEON(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, int width) {
+    const int16x8_t c16 = vdupq_n_s16(16);
+    const int16x8_t c128 = vdupq_n_s16(128);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t yv = vld1q_u8(y + x);
+        uint8x8x2_t uvp = vld2_u8(uv + x);
+        int16x8_t d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uvp.val[0])), c128);
+        int16x8_t e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(uvp.val[1])), c128);
+        int16x8x2_t dd = vzipq_s16(d, d);
+        int16x8x2_t ee = vzipq_s16(e, e);
+        int16x8_t c_lo = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(yv))), c16);
+        int16x8_t c_hi = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(yv))), c16);
+        uint8x16x4_t out;
+        out.val[0] = vcombine_u8(yuvChannelNEON(c_lo, 298, dd.val[0], 516, ee.val[0], 0),
+                                 yuvChannelNEON(c_hi, 298, dd.val[1], 516, ee.val[1], 0));
+        out.val[1] = vcombine_u8(yuvChannelNEON(c_lo, 298, dd.val[0], -100, ee.val[0], -208),
+                                 yuvChannelNEON(c_hi, 298, dd.val[1], -100, ee.val[1], -208));
+        out.val[2] = vcombine_u8(yuvChannelNEON(c_lo, 298, dd.val[0], 0, ee.val[0], 409),
+                                 yuvChannelNEON(c_hi, 298, dd.val[1], 0, ee.val[1], 409));
+        out.val[3] = vdupq_n_u8(255);
+        vst4q_u8(bgra + x * 4, out);
+    }
+    nv12RowScalar(y + x, uv + x, bgra + x * 4, width - x);
+}
+
+void halfRowNEON(const uint8_t* row0, const uint8_t* row1, uint8_t* dst, int dst_width) {
+    int x = 0;
+    for (; x + 8 <= dst_width; x += 8) {
+        uint8x16x4_t p0 = vld4q_u8(row0 + x * 8);
+        uint8x16x4_t p1 = vld4q_u8(row1 + x * 8);
+        uint8x8x4_t out;
+        for (int c = 0; c < 4; c++) {
+            out.val[c] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(p0.val[c]), p1.val[c]), 2);
+        }
+        vst4_u8(dst + x * 4, out);
+    }
+    halfRowScalar(row0 + x * 8, row1 + x * 8, dst + x * 4, dst_width - x);
+}
+
+const Kernels kNEONKernels = {yRowNEON, uvRowNV12NEON, uvRowI420NEON, nv12RowNEON, halfRowNEON};
+
+#endif // LT_SIMD_NEON
+
+const Kernels* kernelsFor(ltlib::SimdLevel level) {
+    switch (level) {
+#if defined(LT_SIMD_X86)
+    case ltlib::SimdLevel::SSSE3:
+        return &kSSSE3Kernels;
+    case ltlib::SimdLevel::AVX2:
+        return &kAVX2Kernels;
+#endif
+#if defined(LT_SIMD_NEON)
+    case ltlib::SimdLevel::NEON:
+        return &kNEONKernels;
+#endif
+    default:
+        return &kScalarKernels;
+    }
+}
+
+struct Dispatch {
+    std::atomic<ltlib::SimdLevel> level;
+    std::atomic<const Kernels*> kernels;
+};
+
+Dispatch& dispatch() {
+    static Dispatch instance{ltlib::detectSimdLevel(), kernelsFor(ltlib::detectSimdLevel())};
+    return instance;
+}
+
+const Kernels& kernels() {
+    return *dispatch().kernels.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+namespace ltlib {
+
+SimdLevel detectSimdLevel() {
+#if defined(LT_SIMD_NEON)
+    // AArch64一定有NEON
+    return SimdLevel::NEON;
+#elif defined(LT_SIMD_X86)
+#if defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuid(info, 1);
+    const bool ssse3 = (info[2] & (1 << 9)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    bool avx2 = false;
+    // 还要确认操作系统会保存YMM寄存器
+    if (max_leaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    const bool ssse3 = __builtin_cpu_supports("ssse3");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+    if (avx2) {
+        return SimdLevel::AVX2;
+    }
+    if (ssse3) {
+        return SimdLevel::SSSE3;
+    }
+    return SimdLevel::Scalar;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel simdLevel() {
+    return dispatch().level.load(std::memory_order_relaxed);
+}
+
+bool setSimdLevel(SimdLevel level) {
+    const SimdLevel max_level = detectSimdLevel();
+    bool supported = false;
+    switch (level) {
+    case SimdLevel::Scalar:
+        supported = true;
+        break;
+    case SimdLevel::SSSE3:
+        supported = max_level == SimdLevel::SSSE3 || max_level == SimdLevel::AVX2;
+        break;
+    case SimdLevel::AVX2:
+    case SimdLevel::NEON:
+        supported = max_level == level;
+        break;
+    default:
+        break;
+    }
+    if (!supported) {
+        return false;
+    }
+    dispatch().level = level;
+    dispatch().kernels = kernelsFor(level);
+    return true;
+}
+
+const char* toString(SimdLevel level) {
+    switch (level) {
+    case SimdLevel::Scalar:
+        return "Scalar";
+    case SimdLevel::SSSE3:
+        return "SSSE3";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::NEON:
+        return "NEON";
+    default:
+        return "Unknown";
+    }
+}
+
+void bgraToNV12(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride, uint8_t* uv,
+                int uv_stride, int width, int height) {
+    const Kernels& k = kernels();
+    for (int row = 0; row < height; row += 2) {
+        const uint8_t* row0 = bgra + static_cast<ptrdiff_t>(row) * bgra_stride;
+        const uint8_t* row1 = row0 + bgra_stride;
+        uint8_t* y0 = y + static_cast<ptrdiff_t>(row) * y_stride;
+        k.y_row(row0, y0, width);
+        k.y_row(row1, y0 + y_stride, width);
+        k.uv_row(row0, row1, uv + static_cast<ptrdiff_t>(row / 2) * uv_stride, width);
+    }
+}
+
+void bgraToI420(const uint8_t* bgra, int bgra_stride, uint8_t* y, int y_stride, uint8_t* u,
+                int u_stride, uint8_t* v, int v_stride, int width, int height) {
+    const Kernels& k = kernels();
+    for (int row = 0; row < height; row += 2) {
+        const uint8_t* row0 = bgra + static_cast<ptrdiff_t>(row) * bgra_stride;
+        const uint8_t* row1 = row0 + bgra_stride;
+        uint8_t* y0 = y + static_cast<ptrdiff_t>(row) * y_stride;
+        k.y_row(row0, y0, width);
+        k.y_row(row1, y0 + y_stride, width);
+        k.u_v_row(row0, row1, u + static_cast<ptrdiff_t>(row / 2) * u_stride,
+                  v + static_cast<ptrdiff_t>(row / 2) * v_stride, width);
+    }
+}
+
+void nv12ToBGRA(const uint8_t* y, int y_stride, const uint8_t* uv, int uv_stride, uint8_t* bgra,
+                int bgra_stride, int width, int height) {
+    const Kernels& k = kernels();
+    for (int row = 0; row < height; row++) {
+        k.nv12_row(y + static_cast<ptrdiff_t>(row) * y_stride,
+                   uv + static_cast<ptrdiff_t>(row / 2) * uv_stride,
+                   bgra + static_cast<ptrdiff_t>(row) * bgra_stride, width);
+    }
+}
+
+void downscaleBGRAHalf(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride, int width,
+                       int height) {
+    const Kernels& k = kernels();
+    for (int row = 0; row < height / 2; row++) {
+        const uint8_t* row0 = src + static_cast<ptrdiff_t>(row) * 2 * src_stride;
+        k.half_row(row0, row0 + src_stride, dst + static_cast<ptrdiff_t>(row) * dst_stride,
+                   width / 2);
+    }
+}
+
+} // namespace ltlib
@@ -0,0 +1,70 @@
+// 颜色转换和缩放基准: 1080p下每个kernel在各级SIMD实现上的吞吐，单位Mpixel/s.
+
+#include <cstdio>
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <ltlib/color_convert.h>
+
+namespace {
+
+constexpr int kWidth = 1920;
+constexpr int kHeight = 1080;
+constexpr int kIterations = 200;
+
+double measureMpps(const std::function<void()>& func) {
+    func(); // 预热
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; i++) {
+        func();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return static_cast<double>(kWidth) * kHeight * kIterations / seconds / 1e6;
+}
+
+} // namespace
+
+int main() {
+    std::vector<uint8_t> bgra(kWidth * kHeight * 4);
+    std::vector<uint8_t> y(kWidth * kHeight);
+    std::vector<uint8_t> uv(kWidth * kHeight / 2);
+    std::vector<uint8_t> half(kWidth * kHeight);
+    for (size_t i = 0; i < bgra.size(); i++) {
+        bgra[i] = static_cast<uint8_t>(i * 7 + i / 4099);
+    }
+    uint8_t* u = uv.data();
+    uint8_t* v = uv.data() + kWidth * kHeight / 4;
+
+    printf("detected: %s\n", ltlib::toString(ltlib::detectSimdLevel()));
+    printf("%-8s %14s %14s %14s %14s\n", "level", "BGRA->NV12", "BGRA->I420", "NV12->BGRA",
+           "BGRA half");
+    for (auto level : {ltlib::SimdLevel::Scalar, ltlib::SimdLevel::SSSE3, ltlib::SimdLevel::AVX2,
+                       ltlib::SimdLevel::NEON}) {
+        if (!ltlib::setSimdLevel(level)) {
+            continue;
+        }
+        double to_nv12 = measureMpps([&]() {
+            ltlib::bgraToNV12(bgra.data(), kWidth * 4, y.data(), kWidth, uv.data(), kWidth, kWidth,
+                              kHeight);
+        });
+        double to_i420 = measureMpps([&]() {
+            ltlib::bgraToI420(bgra.data(), kWidth * 4, y.data(), kWidth, u, kWidth / 2, v,
+                              kWidth / 2, kWidth, kHeight);
+        });
+        double from_nv12 = measureMpps([&]() {
+            ltlib::nv12ToBGRA(y.data(), kWidth, uv.data(), kWidth, bgra.data(), kWidth * 4, kWidth,
+                              kHeight);
+        });
+        // 按源图像的像素数计
+        double downscale = measureMpps([&]() {
+            ltlib::downscaleBGRAHalf(bgra.data(), kWidth * 4, half.data(), kWidth * 2, kWidth,
+                                     kHeight);
+        });
+        printf("%-8s %14.1f %14.1f %14.1f %14.1f\n", ltlib::toString(level), to_nv12, to_i420,
+               from_nv12, downscale);
+    }
+    return 0;
+}
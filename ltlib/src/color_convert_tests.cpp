@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+#include <ltlib/color_convert.h>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+// 宽度覆盖各级SIMD的整块和所有可能的尾巴长度
+constexpr int kMaxWidth = 134;
+constexpr int kHeights[] = {2, 4, 6, 18};
+constexpr int kStridePadding = 12;
+
+std::vector<uint8_t> randomBytes(size_t size, uint32_t seed) {
+    std::mt19937 rng{seed};
+    std::uniform_int_distribution<int> dist{0, 255};
+    std::vector<uint8_t> bytes(size);
+    for (auto& byte : bytes) {
+        byte = static_cast<uint8_t>(dist(rng));
+    }
+    return bytes;
+}
+
+std::vector<ltlib::SimdLevel> simdLevels() {
+    std::vector<ltlib::SimdLevel> levels;
+    for (auto level : {ltlib::SimdLevel::SSSE3, ltlib::SimdLevel::AVX2, ltlib::SimdLevel::NEON}) {
+        if (ltlib::setSimdLevel(level)) {
+            levels.push_back(level);
+        }
+    }
+    ltlib::setSimdLevel(ltlib::detectSimdLevel());
+    return levels;
+}
+
+} // namespace
+
+class ColorConvertTest : public testing::Test {
+protected:
+    void TearDown() override { ltlib::setSimdLevel(ltlib::detectSimdLevel()); }
+};
+
+TEST_F(ColorConvertTest, ScalarAlwaysAvailable) {
+    EXPECT_TRUE(ltlib::setSimdLevel(ltlib::SimdLevel::Scalar));
+    EXPECT_EQ(ltlib::simdLevel(), ltlib::SimdLevel::Scalar);
+    EXPECT_TRUE(ltlib::setSimdLevel(ltlib::detectSimdLevel()));
+    EXPECT_EQ(ltlib::simdLevel(), ltlib::detectSimdLevel());
+}
+
+TEST_F(ColorConvertTest, KnownColors) {
+    ltlib::setSimdLevel(ltlib::SimdLevel::Scalar);
+    std::vector<uint8_t> white(4 * 4, 255);
+    std::vector<uint8_t> y(4);
+    std::vector<uint8_t> uv(2);
+    ltlib::bgraToNV12(white.data(), 8, y.data(), 2, uv.data(), 2, 2, 2);
+    EXPECT_EQ(y, std::vector<uint8_t>(4, 235));
+    EXPECT_EQ(uv, std::vector<uint8_t>(2, 128));
+
+    std::vector<uint8_t> black = {0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255};
+    ltlib::bgraToNV12(black.data(), 8, y.data(), 2, uv.data(), 2, 2, 2);
+    EXPECT_EQ(y, std::vector<uint8_t>(4, 16));
+    EXPECT_EQ(uv, std::vector<uint8_t>(2, 128));
+
+    std::vector<uint8_t> bgra(4 * 4);
+    y.assign(4, 235);
+    ltlib::nv12ToBGRA(y.data(), 2, uv.data(), 2, bgra.data(), 8, 2, 2);
+    EXPECT_EQ(bgra, white);
+}
+
+TEST_F(ColorConvertTest, BGRAToNV12MatchesScalar) {
+    for (auto level : simdLevels()) {
+        for (int height : kHeights) {
+            for (int width = 2; width <= kMaxWidth; width += 2) {
+                const int stride = width * 4 + kStridePadding;
+                auto bgra = randomBytes(static_cast<size_t>(stride) * height, width * height);
+                std::vector<uint8_t> y_ref(width * height), uv_ref(width * height / 2);
+                std::vector<uint8_t> y(width * height), uv(width * height / 2);
+                ltlib::setSimdLevel(ltlib::SimdLevel::Scalar);
+                ltlib::bgraToNV12(bgra.data(), stride, y_ref.data(), width, uv_ref.data(), width,
+                                  width, height);
+                ltlib::setSimdLevel(level);
+                ltlib::bgraToNV12(bgra.data(), stride, y.data(), width, uv.data(), width, width,
+                                  height);
+                ASSERT_EQ(y, y_ref) << ltlib::toString(level) << " " << width << "x" << height;
+                ASSERT_EQ(uv, uv_ref) << ltlib::toString(level) << " " << width << "x" << height;
+            }
+        }
+    }
+}
+
+TEST_F(ColorConvertTest, BGRAToI420MatchesScalar) {
+    for (auto level : simdLevels()) {
+        for (int height : kHeights) {
+            for (int width = 2; width <= kMaxWidth; width += 2) {
+                const int stride = width * 4 + kStridePadding;
+                const size_t chroma_size = static_cast<size_t>(width / 2) * (height / 2);
+                auto bgra = randomBytes(static_cast<size_t>(stride) * height, width + height);
+                std::vector<uint8_t> y_ref(width * height), u_ref(chroma_size), v_ref(chroma_size);
+                std::vector<uint8_t> y(width * height), u(chroma_size), v(chroma_size);
+                ltlib::setSimdLevel(ltlib::SimdLevel::Scalar);
+                ltlib::bgraToI420(bgra.data(), stride, y_ref.data(), width, u_ref.data(),
+                                  width / 2, v_ref.data(), width / 2, width, height);
+                ltlib::setSimdLevel(level);
+                ltlib::bgraToI420(bgra.data(), stride, y.data(), width, u.data(), width / 2,
+                                  v.data(), width / 2, width, height);
+                ASSERT_EQ(y, y_ref) << ltlib::toString(level) << " " << width << "x" << height;
+                ASSERT_EQ(u, u_ref) << ltlib::toString(level) << " " << width << "x" << height;
+                ASSERT_EQ(v, v_ref) << ltlib::toString(level) << " " << width << "x" << height;
+            }
+        }
+    }
+}
+
+TEST_F(ColorConvertTest, NV12ToBGRAMatchesScalar) {
+    for (auto level : simdLevels()) {
+        for (int height : kHeights) {
+            for (int width = 2; width <= kMaxWidth; width += 2) {
+                const int stride = width * 4 + kStridePadding;
+                // 随机的Y/UV会覆盖到需要饱和的取值
+                auto y = randomBytes(static_cast<size_t>(width) * height, width * 3 + height);
+                auto uv = randomBytes(static_cast<size_t>(width) * height / 2, width + height * 5);
+                std::vector<uint8_t> bgra_ref(static_cast<size_t>(stride) * height);
+                std::vector<uint8_t> bgra(static_cast<size_t>(stride) * height);
+                ltlib::setSimdLevel(ltlib::SimdLevel::Scalar);
+                ltlib::nv12ToBGRA(y.data(), width, uv.data(), width, bgra_ref.data(), stride,
+                                  width, height);
+                ltlib::setSimdLevel(level);
+                ltlib::nv12ToBGRA(y.data(), width, uv.data(), width, bgra.data(), stride, width,
+                                  height);
+                ASSERT_EQ(bgra, bgra_ref)
+                    << ltlib::toString(level) << " " << width << "x" << height;
+            }
+        }
+    }
+}
+
+TEST_F(ColorConvertTest, DownscaleHalfMatchesScalar) {
+    for (auto level : simdLevels()) {
+        for (int height : kHeights) {
+            for (int width = 2; width <= kMaxWidth; width += 2) {
+                const int src_stride = width * 4 + kStridePadding;
+                const int dst_stride = width * 2;
+                auto src = randomBytes(static_cast<size_t>(src_stride) * height, width * height);
+                std::vector<uint8_t> dst_ref(static_cast<size_t>(dst_stride) * height / 2);
+                std::vector<uint8_t> dst(static_cast<size_t>(dst_stride) * height / 2);
+                ltlib::setSimdLevel(ltlib::SimdLevel::Scalar);
+                ltlib::downscaleBGRAHalf(src.data(), src_stride, dst_ref.data(), dst_stride, width,
+                                         height);
+                ltlib::setSimdLevel(level);
+                ltlib::downscaleBGRAHalf(src.data(), src_stride, dst.data(), dst_stride, width,
+                                         height);
+                ASSERT_EQ(dst, dst_ref) << ltlib::toString(level) << " " << width << "x" << height;
+            }
+        }
+    }
+}
@@ -31,6 +31,10 @@
 #if defined(LT_WINDOWS)
 #include <Windows.h>
 #else
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <time.h>
 #endif // LT_WINDOWS
 #include <ltlib/event.h>
 #include <ltlib/strings.h>
@@ -49,11 +53,17 @@ Event::Event() noexcept
 }
 
 Event::Event(const std::string& name) noexcept
+    : Event { name, nullptr }
+{
+}
+
+Event::Event(const std::string& name, void* security_attributes) noexcept
     : name_ { name }
 {
     assert(!name_.empty());
     std::wstring wname = utf8To16(name_);
-    handle_ = ::CreateEventW(NULL, FALSE, FALSE, wname.c_str());
+    handle_ = ::CreateEventW(reinterpret_cast<SECURITY_ATTRIBUTES*>(security_attributes), FALSE,
+                             FALSE, wname.c_str());
     if (::GetLastError() == 0) {
         is_owner_ = true;
     }
@@ -125,49 +135,133 @@ void Event::close()
 #else // LT_WINDOWS
 
 // 在跨进程使用pthread的mutex和condition variable，需要使用共享内存，有点麻烦
+// 所以这里用POSIX信号量，notify()多次会让wait()多返回几次，使用者需要自己检查条件
 
 Event::Event() noexcept
+{
+    auto sem = new sem_t;
+    if (sem_init(sem, 0, 0) != 0) {
+        delete sem;
+        handle_ = nullptr;
+        return;
+    }
+    handle_ = sem;
+    is_owner_ = true;
+}
+
+Event::Event(const std::string& name, void*) noexcept
+    : Event { name }
 {
 }
 
 Event::Event(const std::string& name) noexcept
+    : name_ { name[0] == '/' ? name : "/" + name }
 {
-    (void)name;
+    assert(!name.empty());
+    sem_t* sem = sem_open(name_.c_str(), O_CREAT | O_EXCL, 0600, 0);
+    if (sem != SEM_FAILED) {
+        is_owner_ = true;
+    } else if (errno == EEXIST) {
+        sem = sem_open(name_.c_str(), 0);
+    }
+    handle_ = sem == SEM_FAILED ? nullptr : sem;
+    assert(handle_ != nullptr);
 }
+
 Event::Event(Event&& other) noexcept
+    : name_(other.name_)
+    , handle_(other.handle_)
+    , is_owner_(other.is_owner_)
 {
-    (void)other;
+    other.name_.clear();
+    other.handle_ = nullptr;
+    other.is_owner_ = false;
 }
 
 Event& Event::operator=(Event&& other) noexcept
 {
-    (void)other;
+    close();
+    name_ = other.name_;
+    handle_ = other.handle_;
+    is_owner_ = other.is_owner_;
+    other.name_.clear();
+    other.handle_ = nullptr;
+    other.is_owner_ = false;
     return *this;
 }
 
 Event::~Event()
 {
+    close();
 }
 
 bool Event::notify()
 {
-    return false;
+    if (handle_ == nullptr) {
+        return false;
+    }
+    return sem_post(reinterpret_cast<sem_t*>(handle_)) == 0;
 }
 
 Event::WaitResult Event::wait()
 {
-    return WaitResult::Failed;
+    if (handle_ == nullptr) {
+        return WaitResult::Failed;
+    }
+    int ret;
+    do {
+        ret = sem_wait(reinterpret_cast<sem_t*>(handle_));
+    } while (ret != 0 && errno == EINTR);
+    return ret == 0 ? WaitResult::Success : WaitResult::Failed;
 }
 
 Event::WaitResult Event::waitFor(uint32_t ms)
 {
-    (void)ms;
-    return WaitResult::Failed;
+    if (handle_ == nullptr) {
+        return WaitResult::Failed;
+    }
+    timespec ts {};
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += static_cast<long>(ms % 1000) * 1'000'000;
+    if (ts.tv_nsec >= 1'000'000'000) {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1'000'000'000;
+    }
+    int ret;
+    do {
+        ret = sem_timedwait(reinterpret_cast<sem_t*>(handle_), &ts);
+    } while (ret != 0 && errno == EINTR);
+    if (ret == 0) {
+        return WaitResult::Success;
+    } else if (errno == ETIMEDOUT) {
+        return WaitResult::Timeout;
+    } else {
+        return WaitResult::Failed;
+    }
 }
 
 void* Event::getHandle() const
 {
-    return nullptr;
+    return handle_;
+}
+
+void Event::close()
+{
+    if (handle_ == nullptr) {
+        return;
+    }
+    auto sem = reinterpret_cast<sem_t*>(handle_);
+    if (name_.empty()) {
+        sem_destroy(sem);
+        delete sem;
+    } else {
+        sem_close(sem);
+        if (is_owner_) {
+            sem_unlink(name_.c_str());
+        }
+    }
+    handle_ = nullptr;
 }
 
 #endif
@@ -0,0 +1,643 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ltlib/fmp4_muxer.h>
+
+#include <cstring>
+
+// 参考ISO/IEC 14496-12(fragmented MP4)、14496-15(avcC/hvcC)和Opus in ISOBMFF(dOps)
+
+namespace {
+
+constexpr uint32_t kVideoTimescale = 90'000;
+constexpr uint32_t kAudioTimescale = 48'000;
+constexpr uint32_t kVideoTrackID = 1;
+constexpr uint32_t kAudioTrackID = 2;
+constexpr uint32_t kDefaultVideoDuration = kVideoTimescale / 60;
+// 音频包间隔超过这么多，认为中间是没有包的静音
+constexpr uint64_t kMaxAudioGap = kAudioTimescale / 10;
+// trun里的sample_flags: 关键帧sample_depends_on=2，其它帧depends_on=1且is_non_sync
+constexpr uint32_t kSyncSampleFlags = 0x02000000;
+constexpr uint32_t kNonSyncSampleFlags = 0x01010000;
+constexpr uint32_t kMatrix[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+
+class BoxWriter {
+public:
+    explicit BoxWriter(std::vector<uint8_t>& out)
+        : out_(out) {}
+    void u8(uint8_t v) { out_.push_back(v); }
+    void u16(uint16_t v) {
+        u8(static_cast<uint8_t>(v >> 8));
+        u8(static_cast<uint8_t>(v));
+    }
+    void u32(uint32_t v) {
+        u16(static_cast<uint16_t>(v >> 16));
+        u16(static_cast<uint16_t>(v));
+    }
+    void u64(uint64_t v) {
+        u32(static_cast<uint32_t>(v >> 32));
+        u32(static_cast<uint32_t>(v));
+    }
+    void zeros(size_t count) { out_.insert(out_.end(), count, 0); }
+    void bytes(std::span<const uint8_t> data) { out_.insert(out_.end(), data.begin(), data.end()); }
+    void fourcc(const char* type) { bytes({reinterpret_cast<const uint8_t*>(type), 4}); }
+    void matrix() {
+        for (uint32_t v : kMatrix) {
+            u32(v);
+        }
+    }
+    size_t begin(const char* type) {
+        size_t pos = out_.size();
+        u32(0);
+        fourcc(type);
+        return pos;
+    }
+    size_t beginFull(const char* type, uint8_t version, uint32_t flags) {
+        size_t pos = begin(type);
+        u32((static_cast<uint32_t>(version) << 24) | flags);
+        return pos;
+    }
+    void end(size_t pos) { patch32(pos, static_cast<uint32_t>(out_.size() - pos)); }
+    void patch32(size_t pos, uint32_t v) {
+        out_[pos + 0] = static_cast<uint8_t>(v >> 24);
+        out_[pos + 1] = static_cast<uint8_t>(v >> 16);
+        out_[pos + 2] = static_cast<uint8_t>(v >> 8);
+        out_[pos + 3] = static_cast<uint8_t>(v);
+    }
+    size_t size() const { return out_.size(); }
+
+private:
+    std::vector<uint8_t>& out_;
+};
+
+std::vector<std::span<const uint8_t>> splitAnnexB(std::span<const uint8_t> data) {
+    std::vector<std::span<const uint8_t>> nals;
+    const size_t size = data.size();
+    size_t start = size;
+    size_t i = 0;
+    auto push = [&](size_t end) {
+        // 4字节起始码多出来的0算在前一个NAL的尾巴上，去掉
+        while (end > start && data[end - 1] == 0) {
+            end--;
+        }
+        if (end > start) {
+            nals.push_back(data.subspan(start, end - start));
+        }
+    };
+    while (i + 2 < size) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (start != size) {
+                push(i);
+            }
+            i += 3;
+            start = i;
+        }
+        else {
+            i++;
+        }
+    }
+    if (start < size) {
+        push(size);
+    }
+    return nals;
+}
+
+uint8_t nalType(ltlib::Fmp4Muxer::VideoCodec codec, std::span<const uint8_t> nal) {
+    return codec == ltlib::Fmp4Muxer::VideoCodec::H264 ? (nal[0] & 0x1F) : ((nal[0] >> 1) & 0x3F);
+}
+
+// 去掉防竞争字节00 00 03里的03
+std::vector<uint8_t> toRbsp(std::span<const uint8_t> nal) {
+    std::vector<uint8_t> rbsp;
+    rbsp.reserve(nal.size());
+    int zeros = 0;
+    for (uint8_t byte : nal) {
+        if (zeros >= 2 && byte == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = byte == 0 ? zeros + 1 : 0;
+        rbsp.push_back(byte);
+    }
+    return rbsp;
+}
+
+// 一个Opus包在48kHz下的样本数，见RFC 6716 3.1
+uint32_t opusPacketSamples(std::span<const uint8_t> packet) {
+    constexpr uint32_t kSilkFrames[4] = {480, 960, 1920, 2880};
+    constexpr uint32_t kCeltFrames[4] = {120, 240, 480, 960};
+    if (packet.empty()) {
+        return 0;
+    }
+    const uint32_t config = packet[0] >> 3;
+    uint32_t frame_samples = 0;
+    if (config < 12) {
+        frame_samples = kSilkFrames[config & 3];
+    }
+    else if (config < 16) {
+        frame_samples = (config & 1) ? 960 : 480;
+    }
+    else {
+        frame_samples = kCeltFrames[config & 3];
+    }
+    uint32_t frames = 0;
+    switch (packet[0] & 3) {
+    case 0:
+        frames = 1;
+        break;
+    case 1:
+    case 2:
+        frames = 2;
+        break;
+    default:
+        if (packet.size() < 2) {
+            return 0;
+        }
+        frames = packet[1] & 0x3F;
+        break;
+    }
+    return frame_samples * frames;
+}
+
+void writeAvcC(BoxWriter& w, std::span<const uint8_t> sps, std::span<const uint8_t> pps) {
+    size_t avcc = w.begin("avcC");
+    w.u8(1);
+    w.u8(sps[1]); // profile_idc
+    w.u8(sps[2]); // constraint flags
+    w.u8(sps[3]); // level_idc
+    w.u8(0xFF);   // lengthSizeMinusOne = 3
+    w.u8(0xE1);   // 1个SPS
+    w.u16(static_cast<uint16_t>(sps.size()));
+    w.bytes(sps);
+    w.u8(1);
+    w.u16(static_cast<uint16_t>(pps.size()));
+    w.bytes(pps);
+    const uint8_t profile = sps[1];
+    if (profile == 100 || profile == 110 || profile == 122 || profile == 144) {
+        // 编码器只出4:2:0 8bit
+        w.u8(0xFC | 1);
+        w.u8(0xF8);
+        w.u8(0xF8);
+        w.u8(0);
+    }
+    w.end(avcc);
+}
+
+void writeHvcC(BoxWriter& w, std::span<const uint8_t> vps, std::span<const uint8_t> sps,
+               std::span<const uint8_t> pps, std::span<const uint8_t> ptl) {
+    size_t hvcc = w.begin("hvcC");
+    w.u8(1);
+    // general_profile_space/tier/profile_idc, 32bit兼容标记, 48bit约束标记, level_idc
+    w.bytes(ptl);
+    w.u16(0xF000); // min_spatial_segmentation_idc
+    w.u8(0xFC);    // parallelismType
+    w.u8(0xFD);    // chroma_format_idc = 1
+    w.u8(0xF8);    // bit_depth_luma_minus8
+    w.u8(0xF8);    // bit_depth_chroma_minus8
+    w.u16(0);      // avgFrameRate
+    // constantFrameRate=0, numTemporalLayers=1, temporalIdNested=1, lengthSizeMinusOne=3
+    w.u8(0x0F);
+    w.u8(3);
+    const std::pair<uint8_t, std::span<const uint8_t>> arrays[] = {
+        {32, vps}, {33, sps}, {34, pps}};
+    for (auto& [type, nal] : arrays) {
+        w.u8(0x80 | type); // array_completeness = 1
+        w.u16(1);
+        w.u16(static_cast<uint16_t>(nal.size()));
+        w.bytes(nal);
+    }
+    w.end(hvcc);
+}
+
+void writeTrackHeader(BoxWriter& w, uint32_t track_id, uint16_t volume, uint32_t width,
+                      uint32_t height) {
+    size_t tkhd = w.beginFull("tkhd", 0, 0x000003); // enabled | in_movie
+    w.u32(0);
+    w.u32(0);
+    w.u32(track_id);
+    w.u32(0);
+    w.u32(0); // duration由各个fragment决定
+    w.zeros(8);
+    w.u16(0);
+    w.u16(0);
+    w.u16(volume);
+    w.u16(0);
+    w.matrix();
+    w.u32(width << 16);
+    w.u32(height << 16);
+    w.end(tkhd);
+}
+
+void writeMediaHeader(BoxWriter& w, uint32_t timescale, const char* handler, const char* name) {
+    size_t mdhd = w.beginFull("mdhd", 0, 0);
+    w.u32(0);
+    w.u32(0);
+    w.u32(timescale);
+    w.u32(0);
+    w.u16(0x55C4); // "und"
+    w.u16(0);
+    w.end(mdhd);
+    size_t hdlr = w.beginFull("hdlr", 0, 0);
+    w.u32(0);
+    w.fourcc(handler);
+    w.zeros(12);
+    w.bytes({reinterpret_cast<const uint8_t*>(name), strlen(name) + 1});
+    w.end(hdlr);
+}
+
+void writeDataInfo(BoxWriter& w) {
+    size_t dinf = w.begin("dinf");
+    size_t dref = w.beginFull("dref", 0, 0);
+    w.u32(1);
+    size_t url = w.beginFull("url ", 0, 0x000001); // 数据在同一个文件里
+    w.end(url);
+    w.end(dref);
+    w.end(dinf);
+}
+
+// 样本表都是空的，样本信息全在moof里
+void writeEmptySampleTables(BoxWriter& w) {
+    size_t stts = w.beginFull("stts", 0, 0);
+    w.u32(0);
+    w.end(stts);
+    size_t stsc = w.beginFull("stsc", 0, 0);
+    w.u32(0);
+    w.end(stsc);
+    size_t stsz = w.beginFull("stsz", 0, 0);
+    w.u32(0);
+    w.u32(0);
+    w.end(stsz);
+    size_t stco = w.beginFull("stco", 0, 0);
+    w.u32(0);
+    w.end(stco);
+}
+
+} // namespace
+
+namespace ltlib {
+
+Fmp4Muxer::Fmp4Muxer(const Params& params)
+    : params_(params) {}
+
+bool Fmp4Muxer::addVideo(std::span<const uint8_t> annexb, bool keyframe, int64_t timestamp_us) {
+    if (first_timestamp_us_ < 0) {
+        if (!keyframe || !makeInitSegment(annexb)) {
+            return false;
+        }
+        first_timestamp_us_ = timestamp_us;
+        last_video_timestamp_us_ = timestamp_us;
+    }
+    else if (!video_samples_.empty()) {
+        // 上一帧的时长到现在才知道. 用取整后的绝对时间相减，不会累积误差
+        auto to_video_time = [this](int64_t us) {
+            return (us - first_timestamp_us_) * kVideoTimescale / 1'000'000;
+        };
+        int64_t duration =
+            to_video_time(timestamp_us) - to_video_time(last_video_timestamp_us_);
+        if (duration <= 0) {
+            duration = 1;
+        }
+        video_samples_.back().duration = static_cast<uint32_t>(duration);
+        last_video_duration_ = static_cast<uint32_t>(duration);
+    }
+    Sample sample{};
+    sample.keyframe = keyframe;
+    sample.data.reserve(annexb.size() + 16);
+    for (auto nal : splitAnnexB(annexb)) {
+        // 改成4字节长度前缀
+        const auto size = static_cast<uint32_t>(nal.size());
+        const uint8_t length[4] = {static_cast<uint8_t>(size >> 24),
+                                   static_cast<uint8_t>(size >> 16),
+                                   static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size)};
+        sample.data.insert(sample.data.end(), length, length + 4);
+        sample.data.insert(sample.data.end(), nal.begin(), nal.end());
+    }
+    if (sample.data.empty()) {
+        return false;
+    }
+    video_samples_.push_back(std::move(sample));
+    last_video_timestamp_us_ = timestamp_us;
+    return true;
+}
+
+bool Fmp4Muxer::addAudio(std::span<const uint8_t> opus_packet, int64_t timestamp_us) {
+    if (first_timestamp_us_ < 0 || params_.audio_channels == 0 ||
+        timestamp_us < first_timestamp_us_) {
+        return false;
+    }
+    const uint32_t duration = opusPacketSamples(opus_packet);
+    if (duration == 0) {
+        return false;
+    }
+    const auto arrival =
+        static_cast<uint64_t>((timestamp_us - first_timestamp_us_) * kAudioTimescale / 1'000'000);
+    if (audio_samples_.empty()) {
+        if (arrival > audio_next_time_ + kMaxAudioGap) {
+            audio_next_time_ = arrival;
+        }
+        audio_decode_time_ = audio_next_time_;
+    }
+    else if (arrival > audio_next_time_ + kMaxAudioGap) {
+        // 静音期间采集端不出包，拉长上一个包，保持音画同步
+        audio_samples_.back().duration += static_cast<uint32_t>(arrival - audio_next_time_);
+        audio_next_time_ = arrival;
+    }
+    Sample sample{};
+    sample.data.assign(opus_packet.begin(), opus_packet.end());
+    sample.duration = duration;
+    sample.keyframe = true;
+    audio_samples_.push_back(std::move(sample));
+    audio_next_time_ += duration;
+    return true;
+}
+
+int64_t Fmp4Muxer::opusPacketDurationUs(std::span<const uint8_t> opus_packet) {
+    return static_cast<int64_t>(opusPacketSamples(opus_packet)) * 1'000'000 / kAudioTimescale;
+}
+
+const std::vector<uint8_t>& Fmp4Muxer::initSegment() const {
+    return init_segment_;
+}
+
+int64_t Fmp4Muxer::bufferedDurationUs() const {
+    uint64_t duration = 0;
+    for (auto& sample : video_samples_) {
+        duration += sample.duration;
+    }
+    return static_cast<int64_t>(duration * 1'000'000 / kVideoTimescale);
+}
+
+void Fmp4Muxer::flushFragment(std::vector<uint8_t>& out, bool final) {
+    if (first_timestamp_us_ < 0) {
+        return;
+    }
+    std::vector<Sample> video;
+    if (final) {
+        if (!video_samples_.empty() && video_samples_.back().duration == 0) {
+            video_samples_.back().duration =
+                last_video_duration_ != 0 ? last_video_duration_ : kDefaultVideoDuration;
+        }
+        video.swap(video_samples_);
+    }
+    else if (video_samples_.size() > 1) {
+        video.assign(std::make_move_iterator(video_samples_.begin()),
+                     std::make_move_iterator(video_samples_.end() - 1));
+        video_samples_.erase(video_samples_.begin(), video_samples_.end() - 1);
+    }
+    std::vector<Sample> audio;
+    audio.swap(audio_samples_);
+    if (video.empty() && audio.empty()) {
+        return;
+    }
+
+    const size_t moof_start = out.size();
+    BoxWriter w{out};
+    size_t video_offset_pos = 0;
+    size_t audio_offset_pos = 0;
+    size_t moof = w.begin("moof");
+    size_t mfhd = w.beginFull("mfhd", 0, 0);
+    w.u32(++sequence_number_);
+    w.end(mfhd);
+    if (!video.empty()) {
+        writeTrackFragment(out, kVideoTrackID, video_decode_time_, video, true, video_offset_pos);
+    }
+    if (!audio.empty()) {
+        writeTrackFragment(out, kAudioTrackID, audio_decode_time_, audio, false,
+                           audio_offset_pos);
+    }
+    w.end(moof);
+
+    // data_offset相对moof的起始位置(default-base-is-moof)
+    const size_t moof_size = out.size() - moof_start;
+    size_t mdat_size = 8;
+    for (auto& sample : video) {
+        mdat_size += sample.data.size();
+    }
+    const size_t video_bytes = mdat_size - 8;
+    for (auto& sample : audio) {
+        mdat_size += sample.data.size();
+    }
+    if (!video.empty()) {
+        w.patch32(video_offset_pos, static_cast<uint32_t>(moof_size + 8));
+    }
+    if (!audio.empty()) {
+        w.patch32(audio_offset_pos, static_cast<uint32_t>(moof_size + 8 + video_bytes));
+    }
+    w.u32(static_cast<uint32_t>(mdat_size));
+    w.fourcc("mdat");
+    for (auto& sample : video) {
+        w.bytes(sample.data);
+        video_decode_time_ += sample.duration;
+    }
+    for (auto& sample : audio) {
+        w.bytes(sample.data);
+        audio_decode_time_ += sample.duration;
+    }
+}
+
+bool Fmp4Muxer::makeInitSegment(std::span<const uint8_t> annexb) {
+    std::span<const uint8_t> vps;
+    std::span<const uint8_t> sps;
+    std::span<const uint8_t> pps;
+    const bool h264 = params_.video_codec == VideoCodec::H264;
+    for (auto nal : splitAnnexB(annexb)) {
+        uint8_t type = nalType(params_.video_codec, nal);
+        if (h264 ? type == 7 : type == 33) {
+            sps = sps.empty() ? nal : sps;
+        }
+        else if (h264 ? type == 8 : type == 34) {
+            pps = pps.empty() ? nal : pps;
+        }
+        else if (!h264 && type == 32) {
+            vps = vps.empty() ? nal : vps;
+        }
+    }
+    if (sps.size() < 4 || pps.empty() || (!h264 && vps.empty())) {
+        return false;
+    }
+    std::vector<uint8_t> sps_rbsp;
+    if (!h264) {
+        // profile_tier_level紧跟在2字节NAL头和1字节vps_id/max_sub_layers后面，共12字节
+        sps_rbsp = toRbsp(sps);
+        if (sps_rbsp.size() < 15) {
+            return false;
+        }
+    }
+    const bool has_audio = params_.audio_channels != 0;
+
+    std::vector<uint8_t>& out = init_segment_;
+    out.clear();
+    BoxWriter w{out};
+    size_t ftyp = w.begin("ftyp");
+    w.fourcc("iso6");
+    w.u32(0);
+    w.fourcc("iso6");
+    w.fourcc("isom");
+    w.fourcc("mp41");
+    w.end(ftyp);
+
+    size_t moov = w.begin("moov");
+    size_t mvhd = w.beginFull("mvhd", 0, 0);
+    w.u32(0);
+    w.u32(0);
+    w.u32(1000);
+    w.u32(0);
+    w.u32(0x00010000); // rate 1.0
+    w.u16(0x0100);     // volume 1.0
+    w.zeros(10);
+    w.matrix();
+    w.zeros(24);
+    w.u32(has_audio ? kAudioTrackID + 1 : kVideoTrackID + 1);
+    w.end(mvhd);
+
+    // 视频轨. 用avc3/hev1，关键帧里的参数集原样保留，分辨率变化时播放器也能跟上
+    size_t trak = w.begin("trak");
+    writeTrackHeader(w, kVideoTrackID, 0, params_.width, params_.height);
+    size_t mdia = w.begin("mdia");
+    writeMediaHeader(w, kVideoTimescale, "vide", "VideoHandler");
+    size_t minf = w.begin("minf");
+    size_t vmhd = w.beginFull("vmhd", 0, 0x000001);
+    w.zeros(8);
+    w.end(vmhd);
+    writeDataInfo(w);
+    size_t stbl = w.begin("stbl");
+    size_t stsd = w.beginFull("stsd", 0, 0);
+    w.u32(1);
+    size_t entry = w.begin(h264 ? "avc3" : "hev1");
+    w.zeros(6);
+    w.u16(1); // data_reference_index
+    w.zeros(16);
+    w.u16(static_cast<uint16_t>(params_.width));
+    w.u16(static_cast<uint16_t>(params_.height));
+    w.u32(0x00480000); // 72dpi
+    w.u32(0x00480000);
+    w.u32(0);
+    w.u16(1); // frame_count
+    w.zeros(32);
+    w.u16(0x0018);
+    w.u16(0xFFFF);
+    if (h264) {
+        writeAvcC(w, sps, pps);
+    }
+    else {
+        writeHvcC(w, vps, sps, pps, std::span<const uint8_t>{sps_rbsp}.subspan(3, 12));
+    }
+    w.end(entry);
+    w.end(stsd);
+    writeEmptySampleTables(w);
+    w.end(stbl);
+    w.end(minf);
+    w.end(mdia);
+    w.end(trak);
+
+    if (has_audio) {
+        trak = w.begin("trak");
+        writeTrackHeader(w, kAudioTrackID, 0x0100, 0, 0);
+        mdia = w.begin("mdia");
+        writeMediaHeader(w, kAudioTimescale, "soun", "SoundHandler");
+        minf = w.begin("minf");
+        size_t smhd = w.beginFull("smhd", 0, 0);
+        w.u32(0);
+        w.end(smhd);
+        writeDataInfo(w);
+        stbl = w.begin("stbl");
+        stsd = w.beginFull("stsd", 0, 0);
+        w.u32(1);
+        entry = w.begin("Opus");
+        w.zeros(6);
+        w.u16(1);
+        w.zeros(8);
+        w.u16(static_cast<uint16_t>(params_.audio_channels));
+        w.u16(16);
+        w.u32(0);
+        w.u32(kAudioTimescale << 16);
+        size_t dops = w.begin("dOps");
+        w.u8(0);
+        w.u8(static_cast<uint8_t>(params_.audio_channels));
+        w.u16(0); // 拿不到编码器的lookahead，不裁剪
+        w.u32(params_.audio_sample_rate);
+        w.u16(0);
+        w.u8(0); // 单声道或立体声
+        w.end(dops);
+        w.end(entry);
+        w.end(stsd);
+        writeEmptySampleTables(w);
+        w.end(stbl);
+        w.end(minf);
+        w.end(mdia);
+        w.end(trak);
+    }
+
+    size_t mvex = w.begin("mvex");
+    for (uint32_t track_id : {kVideoTrackID, kAudioTrackID}) {
+        if (track_id == kAudioTrackID && !has_audio) {
+            break;
+        }
+        size_t trex = w.beginFull("trex", 0, 0);
+        w.u32(track_id);
+        w.u32(1);
+        w.u32(0);
+        w.u32(0);
+        w.u32(0);
+        w.end(trex);
+    }
+    w.end(mvex);
+    w.end(moov);
+    return true;
+}
+
+void Fmp4Muxer::writeTrackFragment(std::vector<uint8_t>& out, uint32_t track_id,
+                                   uint64_t decode_time, const std::vector<Sample>& samples,
+                                   bool video, size_t& data_offset_pos) {
+    BoxWriter w{out};
+    size_t traf = w.begin("traf");
+    size_t tfhd = w.beginFull("tfhd", 0, 0x020000); // default-base-is-moof
+    w.u32(track_id);
+    w.end(tfhd);
+    size_t tfdt = w.beginFull("tfdt", 1, 0);
+    w.u64(decode_time);
+    w.end(tfdt);
+    // data-offset | sample-duration | sample-size [| sample-flags]
+    size_t trun = w.beginFull("trun", 0, video ? 0x000701 : 0x000301);
+    w.u32(static_cast<uint32_t>(samples.size()));
+    data_offset_pos = w.size();
+    w.u32(0);
+    for (auto& sample : samples) {
+        w.u32(sample.duration);
+        w.u32(static_cast<uint32_t>(sample.data.size()));
+        if (video) {
+            w.u32(sample.keyframe ? kSyncSampleFlags : kNonSyncSampleFlags);
+        }
+    }
+    w.end(trun);
+    w.end(traf);
+}
+
+} // namespace ltlib
@@ -0,0 +1,342 @@
+#include <gtest/gtest.h>
+#include <ltlib/fmp4_muxer.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Box {
+    std::string type;
+    size_t offset; // box起始位置
+    size_t size;
+};
+
+uint32_t readU32(const std::vector<uint8_t>& data, size_t pos) {
+    return (uint32_t(data[pos]) << 24) | (uint32_t(data[pos + 1]) << 16) |
+           (uint32_t(data[pos + 2]) << 8) | uint32_t(data[pos + 3]);
+}
+
+uint64_t readU64(const std::vector<uint8_t>& data, size_t pos) {
+    return (uint64_t(readU32(data, pos)) << 32) | readU32(data, pos + 4);
+}
+
+// [begin, end)之间的直接子box
+std::vector<Box> children(const std::vector<uint8_t>& data, size_t begin, size_t end) {
+    std::vector<Box> boxes;
+    while (begin + 8 <= end) {
+        Box box{std::string(reinterpret_cast<const char*>(data.data() + begin + 4), 4), begin,
+                readU32(data, begin)};
+        EXPECT_GE(box.size, 8u);
+        EXPECT_LE(begin + box.size, end);
+        if (box.size < 8 || begin + box.size > end) {
+            break;
+        }
+        boxes.push_back(box);
+        begin += box.size;
+    }
+    EXPECT_EQ(begin, end);
+    return boxes;
+}
+
+std::vector<std::string> types(const std::vector<Box>& boxes) {
+    std::vector<std::string> result;
+    for (auto& box : boxes) {
+        result.push_back(box.type);
+    }
+    return result;
+}
+
+// 按路径找box，header_skip是中间每层box头之后要跳过的字节(stsd这种有额外字段的)
+const Box* find(const std::vector<uint8_t>& data, std::vector<Box>& storage, size_t begin,
+                size_t end, const std::vector<std::pair<std::string, size_t>>& path) {
+    const Box* found = nullptr;
+    for (auto& [type, skip] : path) {
+        auto boxes = children(data, begin, end);
+        found = nullptr;
+        for (auto& box : boxes) {
+            if (box.type == type) {
+                storage.push_back(box);
+                found = &storage.back();
+                break;
+            }
+        }
+        if (found == nullptr) {
+            return nullptr;
+        }
+        begin = found->offset + 8 + skip;
+        end = found->offset + found->size;
+    }
+    return found;
+}
+
+std::vector<uint8_t> concat(std::initializer_list<std::vector<uint8_t>> parts) {
+    std::vector<uint8_t> out;
+    for (auto& part : parts) {
+        out.insert(out.end(), part.begin(), part.end());
+    }
+    return out;
+}
+
+const std::vector<uint8_t> kStartCode4 = {0, 0, 0, 1};
+const std::vector<uint8_t> kStartCode3 = {0, 0, 1};
+// High profile, level 4.0
+const std::vector<uint8_t> kH264Sps = {0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40, 0x78};
+const std::vector<uint8_t> kH264Pps = {0x68, 0xEB, 0xE3, 0xCB};
+const std::vector<uint8_t> kH264Idr = {0x65, 0x88, 0x84, 0x00, 0x33, 0xFF};
+const std::vector<uint8_t> kH264P = {0x41, 0x9A, 0x02, 0x04};
+
+std::vector<uint8_t> h264Keyframe() {
+    return concat({kStartCode4, kH264Sps, kStartCode4, kH264Pps, kStartCode3, kH264Idr});
+}
+
+std::vector<uint8_t> h264PFrame() {
+    return concat({kStartCode4, kH264P});
+}
+
+// CELT 20ms单帧
+const std::vector<uint8_t> kOpus20ms = {0xF8, 0x01, 0x02, 0x03};
+
+ltlib::Fmp4Muxer::Params h264Params(uint32_t audio_channels) {
+    ltlib::Fmp4Muxer::Params params{};
+    params.video_codec = ltlib::Fmp4Muxer::VideoCodec::H264;
+    params.width = 1920;
+    params.height = 1080;
+    params.audio_channels = audio_channels;
+    params.audio_sample_rate = 48000;
+    return params;
+}
+
+struct TrackRun {
+    uint32_t track_id;
+    uint64_t decode_time;
+    std::vector<uint32_t> durations;
+    std::vector<uint32_t> sizes;
+    std::vector<uint32_t> flags;
+    std::vector<std::vector<uint8_t>> payloads;
+};
+
+std::vector<TrackRun> parseFragment(const std::vector<uint8_t>& data) {
+    std::vector<TrackRun> runs;
+    auto top = children(data, 0, data.size());
+    EXPECT_EQ(types(top), (std::vector<std::string>{"moof", "mdat"}));
+    if (top.size() != 2) {
+        return runs;
+    }
+    const size_t moof_start = top[0].offset;
+    for (auto& traf : children(data, moof_start + 8, moof_start + top[0].size)) {
+        if (traf.type != "traf") {
+            EXPECT_EQ(traf.type, "mfhd");
+            continue;
+        }
+        TrackRun run{};
+        for (auto& box : children(data, traf.offset + 8, traf.offset + traf.size)) {
+            size_t pos = box.offset + 8;
+            const uint32_t version_flags = readU32(data, pos);
+            pos += 4;
+            if (box.type == "tfhd") {
+                EXPECT_EQ(version_flags & 0xFFFFFF, 0x020000u);
+                run.track_id = readU32(data, pos);
+            }
+            else if (box.type == "tfdt") {
+                EXPECT_EQ(version_flags >> 24, 1u);
+                run.decode_time = readU64(data, pos);
+            }
+            else if (box.type == "trun") {
+                const uint32_t count = readU32(data, pos);
+                size_t data_pos = moof_start + readU32(data, pos + 4);
+                pos += 8;
+                const bool has_flags = (version_flags & 0x400) != 0;
+                for (uint32_t i = 0; i < count; i++) {
+                    run.durations.push_back(readU32(data, pos));
+                    run.sizes.push_back(readU32(data, pos + 4));
+                    pos += 8;
+                    if (has_flags) {
+                        run.flags.push_back(readU32(data, pos));
+                        pos += 4;
+                    }
+                    EXPECT_LE(data_pos + run.sizes.back(), data.size());
+                    run.payloads.emplace_back(data.begin() + data_pos,
+                                              data.begin() + data_pos + run.sizes.back());
+                    data_pos += run.sizes.back();
+                }
+                EXPECT_EQ(pos, box.offset + box.size);
+            }
+        }
+        runs.push_back(run);
+    }
+    return runs;
+}
+
+} // namespace
+
+TEST(Fmp4Muxer, DropUntilKeyframeWithParameterSets) {
+    ltlib::Fmp4Muxer muxer{h264Params(2)};
+    EXPECT_FALSE(muxer.addVideo(h264PFrame(), false, 0));
+    EXPECT_FALSE(muxer.addAudio(kOpus20ms, 0));
+    // 没有参数集的关键帧也不能开始
+    EXPECT_FALSE(muxer.addVideo(concat({kStartCode4, kH264Idr}), true, 10'000));
+    EXPECT_TRUE(muxer.initSegment().empty());
+    EXPECT_TRUE(muxer.addVideo(h264Keyframe(), true, 20'000));
+    EXPECT_FALSE(muxer.initSegment().empty());
+    // 早于第一个关键帧的音频也不要
+    EXPECT_FALSE(muxer.addAudio(kOpus20ms, 19'000));
+    EXPECT_TRUE(muxer.addAudio(kOpus20ms, 20'000));
+}
+
+TEST(Fmp4Muxer, H264InitSegment) {
+    ltlib::Fmp4Muxer muxer{h264Params(2)};
+    ASSERT_TRUE(muxer.addVideo(h264Keyframe(), true, 0));
+    const auto& init = muxer.initSegment();
+    auto top = children(init, 0, init.size());
+    ASSERT_EQ(types(top), (std::vector<std::string>{"ftyp", "moov"}));
+    auto moov = children(init, top[1].offset + 8, top[1].offset + top[1].size);
+    EXPECT_EQ(types(moov), (std::vector<std::string>{"mvhd", "trak", "trak", "mvex"}));
+    auto mvex = children(init, moov[3].offset + 8, moov[3].offset + moov[3].size);
+    EXPECT_EQ(types(mvex), (std::vector<std::string>{"trex", "trex"}));
+
+    std::vector<Box> storage;
+    storage.reserve(16);
+    // stsd: full box头4字节 + entry_count 4字节
+    const Box* avc3 = find(init, storage, top[1].offset + 8, top[1].offset + top[1].size,
+                           {{"trak", 0},
+                            {"mdia", 0},
+                            {"minf", 0},
+                            {"stbl", 0},
+                            {"stsd", 8},
+                            {"avc3", 78}});
+    ASSERT_NE(avc3, nullptr);
+    EXPECT_EQ(readU32(init, avc3->offset + 8 + 24) >> 16, 1920u);
+    EXPECT_EQ(readU32(init, avc3->offset + 8 + 24) & 0xFFFF, 1080u);
+    auto config = children(init, avc3->offset + 8 + 78, avc3->offset + avc3->size);
+    ASSERT_EQ(types(config), (std::vector<std::string>{"avcC"}));
+    std::vector<uint8_t> avcc(init.begin() + config[0].offset + 8,
+                              init.begin() + config[0].offset + config[0].size);
+    std::vector<uint8_t> expected = {1, 0x64, 0x00, 0x28, 0xFF, 0xE1, 0, 8};
+    expected.insert(expected.end(), kH264Sps.begin(), kH264Sps.end());
+    expected.insert(expected.end(), {1, 0, 4});
+    expected.insert(expected.end(), kH264Pps.begin(), kH264Pps.end());
+    // High profile带chroma/bitdepth扩展
+    expected.insert(expected.end(), {0xFD, 0xF8, 0xF8, 0});
+    EXPECT_EQ(avcc, expected);
+}
+
+TEST(Fmp4Muxer, VideoFragmentsHoldLastFrame) {
+    ltlib::Fmp4Muxer muxer{h264Params(0)};
+    ASSERT_TRUE(muxer.addVideo(h264Keyframe(), true, 1'000'000));
+    ASSERT_TRUE(muxer.addVideo(h264PFrame(), false, 1'033'333));
+    ASSERT_TRUE(muxer.addVideo(h264PFrame(), false, 1'066'666));
+    EXPECT_NEAR(muxer.bufferedDurationUs(), 66'666, 20);
+
+    std::vector<uint8_t> fragment;
+    muxer.flushFragment(fragment);
+    auto runs = parseFragment(fragment);
+    ASSERT_EQ(runs.size(), 1u);
+    EXPECT_EQ(runs[0].track_id, 1u);
+    EXPECT_EQ(runs[0].decode_time, 0u);
+    EXPECT_EQ(runs[0].durations, (std::vector<uint32_t>{2999, 3000}));
+    EXPECT_EQ(runs[0].flags, (std::vector<uint32_t>{0x02000000, 0x01010000}));
+    // Annex-B起始码换成4字节长度
+    std::vector<uint8_t> keyframe =
+        concat({{0, 0, 0, 8}, kH264Sps, {0, 0, 0, 4}, kH264Pps, {0, 0, 0, 6}, kH264Idr});
+    EXPECT_EQ(runs[0].payloads[0], keyframe);
+    EXPECT_EQ(runs[0].payloads[1], concat({{0, 0, 0, 4}, kH264P}));
+
+    ASSERT_TRUE(muxer.addVideo(h264PFrame(), false, 1'100'000));
+    fragment.clear();
+    muxer.flushFragment(fragment, true);
+    runs = parseFragment(fragment);
+    ASSERT_EQ(runs.size(), 1u);
+    EXPECT_EQ(runs[0].decode_time, 5999u);
+    // 最后一帧用前一帧的时长补
+    EXPECT_EQ(runs[0].durations, (std::vector<uint32_t>{3001, 3001}));
+
+    fragment.clear();
+    muxer.flushFragment(fragment, true);
+    EXPECT_TRUE(fragment.empty());
+}
+
+TEST(Fmp4Muxer, AudioTimingAndGaps) {
+    ltlib::Fmp4Muxer muxer{h264Params(2)};
+    ASSERT_TRUE(muxer.addVideo(h264Keyframe(), true, 0));
+    ASSERT_TRUE(muxer.addAudio(kOpus20ms, 0));
+    ASSERT_TRUE(muxer.addAudio(kOpus20ms, 21'000)); // 抖动不影响连续性
+    // 500ms没有包，拉长上一个包
+    ASSERT_TRUE(muxer.addAudio(kOpus20ms, 540'000));
+    // code 3，2个2.5ms的帧
+    const std::vector<uint8_t> two_frames = {0x83, 0x02, 0x00};
+    ASSERT_TRUE(muxer.addAudio(two_frames, 560'000));
+    EXPECT_FALSE(muxer.addAudio({}, 570'000));
+
+    std::vector<uint8_t> fragment;
+    muxer.flushFragment(fragment);
+    auto runs = parseFragment(fragment);
+    // 只有一帧视频，时长未知，留到下次
+    ASSERT_EQ(runs.size(), 1u);
+    EXPECT_EQ(runs[0].track_id, 2u);
+    EXPECT_EQ(runs[0].decode_time, 0u);
+    EXPECT_EQ(runs[0].durations, (std::vector<uint32_t>{960, 960 + 25920 - 1920, 960, 240}));
+    EXPECT_EQ(runs[0].payloads[0], kOpus20ms);
+    EXPECT_EQ(runs[0].payloads[3], two_frames);
+
+    // 新fragment开头有间隔，直接移动起点
+    ASSERT_TRUE(muxer.addVideo(h264PFrame(), false, 1'000'000));
+    ASSERT_TRUE(muxer.addAudio(kOpus20ms, 1'000'000));
+    fragment.clear();
+    muxer.flushFragment(fragment);
+    runs = parseFragment(fragment);
+    ASSERT_EQ(runs.size(), 2u);
+    EXPECT_EQ(runs[0].track_id, 1u);
+    EXPECT_EQ(runs[0].durations, (std::vector<uint32_t>{90000}));
+    EXPECT_EQ(runs[1].track_id, 2u);
+    EXPECT_EQ(runs[1].decode_time, 48000u);
+}
+
+TEST(Fmp4Muxer, H265ConfigFromEscapedSps) {
+    ltlib::Fmp4Muxer::Params params{};
+    params.video_codec = ltlib::Fmp4Muxer::VideoCodec::H265;
+    params.width = 1280;
+    params.height = 720;
+    ltlib::Fmp4Muxer muxer{params};
+    const std::vector<uint8_t> vps = {0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF};
+    // PTL: profile 1，兼容标记0x60000000，约束标记0x90 00 00 00 00 00，level 93.
+    // 约束标记里的连续0被插入了防竞争字节
+    const std::vector<uint8_t> sps = {0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x00, 0x90,
+                                      0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x5D, 0xA0};
+    const std::vector<uint8_t> pps = {0x44, 0x01, 0xC1, 0x72};
+    const std::vector<uint8_t> idr = {0x26, 0x01, 0xAF, 0x06};
+    ASSERT_TRUE(muxer.addVideo(
+        concat({kStartCode4, vps, kStartCode4, sps, kStartCode4, pps, kStartCode4, idr}), true,
+        0));
+    const auto& init = muxer.initSegment();
+    std::vector<Box> storage;
+    storage.reserve(16);
+    const Box* hev1 = find(init, storage, 0, init.size(),
+                           {{"moov", 0},
+                            {"trak", 0},
+                            {"mdia", 0},
+                            {"minf", 0},
+                            {"stbl", 0},
+                            {"stsd", 8},
+                            {"hev1", 78}});
+    ASSERT_NE(hev1, nullptr);
+    auto config = children(init, hev1->offset + 8 + 78, hev1->offset + hev1->size);
+    ASSERT_EQ(types(config), (std::vector<std::string>{"hvcC"}));
+    const size_t pos = config[0].offset + 8;
+    std::vector<uint8_t> ptl(init.begin() + pos + 1, init.begin() + pos + 13);
+    EXPECT_EQ(ptl, (std::vector<uint8_t>{0x01, 0x60, 0x00, 0x00, 0x00, 0x90, 0x00, 0x00, 0x00,
+                                         0x00, 0x00, 0x5D}));
+    // 3个数组: VPS/SPS/PPS，参数集本身保持原样
+    EXPECT_EQ(init[pos + 22], 3);
+    EXPECT_EQ(init[pos + 23], 0x80 | 32);
+    EXPECT_EQ(init[pos + 23 + 5 + vps.size()], 0x80 | 33);
+    std::vector<uint8_t> stored_sps(init.begin() + pos + 23 + 5 + vps.size() + 5,
+                                    init.begin() + pos + 23 + 5 + vps.size() + 5 + sps.size());
+    EXPECT_EQ(stored_sps, sps);
+    // 只有视频轨
+    auto moov = find(init, storage, 0, init.size(), {{"moov", 0}});
+    ASSERT_NE(moov, nullptr);
+    EXPECT_EQ(types(children(init, moov->offset + 8, moov->offset + moov->size)),
+              (std::vector<std::string>{"mvhd", "trak", "mvex"}));
+}
@@ -0,0 +1,245 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ltlib/frame_trace.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+namespace {
+
+const char* stageName(ltlib::FrameTracer::Stage stage) {
+    using Stage = ltlib::FrameTracer::Stage;
+    switch (stage) {
+    case Stage::Capture:
+        return "Capture";
+    case Stage::StartEncode:
+        return "StartEncode";
+    case Stage::EndEncode:
+        return "EndEncode";
+    case Stage::Send:
+        return "Send";
+    case Stage::FirstPacket:
+        return "FirstPacket";
+    case Stage::Arrival:
+        return "Arrival";
+    case Stage::StartDecode:
+        return "StartDecode";
+    case Stage::EndDecode:
+        return "EndDecode";
+    case Stage::Render:
+        return "Render";
+    case Stage::Present:
+        return "Present";
+    default:
+        return "Unknown";
+    }
+}
+
+} // namespace
+
+namespace ltlib {
+
+FrameTracer* FrameTracer::instance() {
+    static FrameTracer tracer;
+    return &tracer;
+}
+
+void FrameTracer::enable(bool on) {
+    enabled_ = on;
+}
+
+bool FrameTracer::enabled() const {
+    return enabled_;
+}
+
+void FrameTracer::setProcess(uint32_t pid, const std::string& name) {
+    std::lock_guard lock{mutex_};
+    pid_ = pid;
+    process_name_ = name;
+}
+
+void FrameTracer::setClockOffset(int64_t offset_us) {
+    clock_offset_us_ = offset_us;
+}
+
+void FrameTracer::stamp(uint64_t ltframe_id, Stage stage) {
+    if (!enabled_) {
+        return;
+    }
+    push(ltframe_id, stage, steady_now_us() - clock_offset_us_);
+}
+
+void FrameTracer::stamp(uint64_t ltframe_id, Stage stage, int64_t local_timestamp_us) {
+    if (!enabled_) {
+        return;
+    }
+    push(ltframe_id, stage, local_timestamp_us - clock_offset_us_);
+}
+
+void FrameTracer::stampRemote(uint64_t ltframe_id, Stage stage, int64_t remote_timestamp_us) {
+    if (!enabled_) {
+        return;
+    }
+    push(ltframe_id, stage, remote_timestamp_us);
+}
+
+FrameTracer::Ring* FrameTracer::threadRing() {
+    thread_local Ring* ring = nullptr;
+    if (ring != nullptr) {
+        return ring;
+    }
+    auto new_ring = std::make_shared<Ring>();
+    new_ring->slots = std::make_unique<Slot[]>(kEventsPerThread);
+    {
+        std::lock_guard lock{mutex_};
+        new_ring->tid = static_cast<uint32_t>(rings_.size() + 1);
+        rings_.push_back(new_ring);
+    }
+    // rings_持有所有权，线程退出后数据依然可以导出
+    ring = new_ring.get();
+    return ring;
+}
+
+void FrameTracer::push(uint64_t ltframe_id, Stage stage, int64_t timestamp_us) {
+    Ring* ring = threadRing();
+    uint64_t index = ring->write_index.load(std::memory_order_relaxed);
+    Slot& slot = ring->slots[index % kEventsPerThread];
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.ltframe_id.store(ltframe_id, std::memory_order_relaxed);
+    slot.timestamp_us.store(timestamp_us, std::memory_order_relaxed);
+    slot.stage.store(static_cast<uint8_t>(stage), std::memory_order_relaxed);
+    slot.seq.store(2 * index + 2, std::memory_order_release);
+    ring->write_index.store(index + 1, std::memory_order_release);
+}
+
+bool FrameTracer::readSlot(const Slot& slot, uint64_t index, Event& event) {
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != 2 * index + 2) {
+        return false;
+    }
+    event.ltframe_id = slot.ltframe_id.load(std::memory_order_relaxed);
+    event.timestamp_us = slot.timestamp_us.load(std::memory_order_relaxed);
+    event.stage = static_cast<Stage>(slot.stage.load(std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == seq;
+}
+
+bool FrameTracer::dumpChromeTrace(const std::string& path) {
+    std::vector<std::shared_ptr<Ring>> rings;
+    uint32_t pid = 1;
+    std::string process_name;
+    {
+        std::lock_guard lock{mutex_};
+        rings = rings_;
+        pid = pid_;
+        process_name = process_name_;
+    }
+    struct TidEvent {
+        uint32_t tid;
+        Event event;
+    };
+    std::vector<TidEvent> all_events;
+    for (auto& ring : rings) {
+        // 读的同时写线程可能在覆盖最老的事件，seq对不上的槽位丢弃
+        uint64_t end = ring->write_index.load(std::memory_order_acquire);
+        uint64_t begin = end > kEventsPerThread ? end - kEventsPerThread : 0;
+        for (uint64_t i = begin; i < end; i++) {
+            Event event{};
+            if (readSlot(ring->slots[i % kEventsPerThread], i, event)) {
+                all_events.push_back(TidEvent{ring->tid, event});
+            }
+        }
+    }
+    std::sort(all_events.begin(), all_events.end(), [](const TidEvent& a, const TidEvent& b) {
+        return a.event.timestamp_us < b.event.timestamp_us;
+    });
+
+    std::ofstream out{path, std::ios::out | std::ios::trunc};
+    if (!out.good()) {
+        LOG(ERR) << "Open frame trace file '" << path << "' failed";
+        return false;
+    }
+    char line[256];
+    bool first = true;
+    auto write_event = [&out, &first](const char* event) {
+        out << (first ? "\n" : ",\n") << event;
+        first = false;
+    };
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    if (!process_name.empty()) {
+        snprintf(line, sizeof(line),
+                 "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"%s\"}}",
+                 pid, process_name.c_str());
+        write_event(line);
+    }
+    std::map<uint64_t, std::vector<Event>> frames;
+    for (const auto& e : all_events) {
+        snprintf(line, sizeof(line),
+                 "{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%" PRId64
+                 ",\"pid\":%u,\"tid\":%u,\"args\":{\"ltframe_id\":%" PRIu64 "}}",
+                 stageName(e.event.stage), e.event.timestamp_us, pid, e.tid, e.event.ltframe_id);
+        write_event(line);
+        frames[e.event.ltframe_id].push_back(e.event);
+    }
+    // 每一帧画成一条异步轨道，相邻两个阶段之间一个区间
+    for (auto& [ltframe_id, events] : frames) {
+        std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+            return a.stage < b.stage;
+        });
+        for (size_t i = 1; i < events.size(); i++) {
+            const char* name = stageName(events[i - 1].stage);
+            snprintf(line, sizeof(line),
+                     "{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"b\",\"id\":%" PRIu64
+                     ",\"ts\":%" PRId64 ",\"pid\":%u,\"tid\":0}",
+                     name, ltframe_id, events[i - 1].timestamp_us, pid);
+            write_event(line);
+            snprintf(line, sizeof(line),
+                     "{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"e\",\"id\":%" PRIu64
+                     ",\"ts\":%" PRId64 ",\"pid\":%u,\"tid\":0}",
+                     name, ltframe_id, events[i].timestamp_us, pid);
+            write_event(line);
+        }
+    }
+    out << "\n]}\n";
+    out.flush();
+    LOG(INFO) << "Dumped " << all_events.size() << " frame trace events of " << frames.size()
+              << " frames to " << path;
+    return out.good();
+}
+
+} // namespace ltlib
@@ -33,60 +33,152 @@
 
 #include <cstring>
 
+#include <algorithm>
+#include <map>
+#include <mutex>
+
 #include <mbedtls/debug.h>
 #include <mbedtls/error.h>
 
 #include <ltlib/logging.h>
-#include <ltlib/pragma_warning.h>
+#include <ltlib/times.h>
 
-// 忘了在哪个开源项目抄了一部分，sorry。这种写法不是很好理解，有bug也不好修（刚修了一个，在tls_read之后没有重置input
-// buffer，在遇到大消息bug就表现出来了） 一直想重写，但是能run，就没动手??
+// 收: uv读到的密文直接交给mbedtls(mbed_ssl_recv从in_data_取)，解密到复用的plain_里交给上层.
+// 发: 同一轮ioloop里的send先攒成明文，下一轮合成尽量少的TLS record，密文攒到out_里一次uv_write.
 
 namespace {
 
+// 明文攒到这么多就立刻加密发送，不再等下一轮ioloop
+constexpr size_t kMaxPendingBytes = 64 * 1024;
+// 一个TLS record最大16KB明文
+constexpr size_t kPlainBufferSize = 16 * 1024;
+
+void run_callbacks(const std::vector<std::function<void()>>& callbacks) {
+    for (auto& callback : callbacks) {
+        callback();
+    }
+}
+
 void tls_debug_log(void* ctx, int level, const char* file, int line, const char* str) {
     (void)ctx;
     LOGF(DEBUG, "tlslog: [%d] [%s:%d] %s", level, file, line, str);
 }
 
+std::string tls_error_str(int error) {
+    char err[256] = {0};
+    mbedtls_strerror(error, err, sizeof(err));
+    return err;
+}
+
 } // namespace
 
 namespace ltlib {
 
-constexpr uint32_t TLS_BUF_SZ = 32 * 1024;
+bool is_handshake_continue(int state) {
+    return state != MBEDTLS_SSL_HANDSHAKE_OVER && state != MBEDTLS_SSL_HELLO_REQUEST;
+}
 
-enum TLS_RESULT {
-    TLS_OK = 0,
-    TLS_ERR = -1,
-    TLS_EOF = -2,
-    TLS_READ_AGAIN = -3,
-    TLS_MORE_AVAILABLE = -4,
-    TLS_HAS_WRITE = -5,
-};
+// 按证书内容缓存的客户端配置，重连和新建的连接都不用再解析证书、初始化熵源.
+// mbedtls_ssl_config在mbedtls_ssl_setup之后只读，可以被多个ssl_context共用;
+// ctr_drbg不是线程安全的，不同ioloop上的连接会同时用到，所以要加锁.
+struct TlsClientConfig {
+    mbedtls_ssl_config cfg;
+    mbedtls_x509_crt ca;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    std::mutex drbg_mutex;
+
+    TlsClientConfig() {
+        mbedtls_ssl_config_init(&cfg);
+        mbedtls_x509_crt_init(&ca);
+        mbedtls_entropy_init(&entropy);
+        mbedtls_ctr_drbg_init(&drbg);
+    }
+    ~TlsClientConfig() {
+        mbedtls_ssl_config_free(&cfg);
+        mbedtls_x509_crt_free(&ca);
+        mbedtls_ctr_drbg_free(&drbg);
+        mbedtls_entropy_free(&entropy);
+    }
+    TlsClientConfig(const TlsClientConfig&) = delete;
+    TlsClientConfig& operator=(const TlsClientConfig&) = delete;
 
-struct msg {
-    size_t len;
-    uint8_t* buf;
+    static int random(void* ctx, unsigned char* output, size_t len) {
+        auto that = reinterpret_cast<TlsClientConfig*>(ctx);
+        std::lock_guard lock{that->drbg_mutex};
+        return mbedtls_ctr_drbg_random(&that->drbg, output, len);
+    }
 
-    STAILQ_ENTRY(msg)
-    next;
-};
+    // configs故意不释放，活到进程结束: 一个进程只会用到一两张证书，
+    // 断线后重连时也不用再解析证书、初始化熵源
+    static std::shared_ptr<TlsClientConfig> get(const std::string& cert) {
+        static std::mutex mutex;
+        static std::map<std::string, std::shared_ptr<TlsClientConfig>> configs;
+        std::lock_guard lock{mutex};
+        auto iter = configs.find(cert);
+        if (iter != configs.end()) {
+            return iter->second;
+        }
+        auto config = create(cert);
+        if (config != nullptr) {
+            configs[cert] = config;
+        }
+        return config;
+    }
 
-bool is_handshake_continue(int state) {
-    return state != MBEDTLS_SSL_HANDSHAKE_OVER && state != MBEDTLS_SSL_HELLO_REQUEST;
-}
+private:
+    static std::shared_ptr<TlsClientConfig> create(const std::string& cert) {
+        auto config = std::make_shared<TlsClientConfig>();
+        mbedtls_ssl_conf_dbg(&config->cfg, tls_debug_log, nullptr);
+        mbedtls_debug_set_threshold(0);
+        mbedtls_ssl_config_defaults(&config->cfg, MBEDTLS_SSL_IS_CLIENT,
+                                    MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+        mbedtls_ssl_conf_renegotiation(&config->cfg, MBEDTLS_SSL_RENEGOTIATION_ENABLED);
+        mbedtls_ssl_conf_authmode(&config->cfg, MBEDTLS_SSL_VERIFY_REQUIRED);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        mbedtls_ssl_conf_session_tickets(&config->cfg, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+        const char* pers = "ltlib_tls_client";
+        int ret = mbedtls_ctr_drbg_seed(&config->drbg, mbedtls_entropy_func, &config->entropy,
+                                        reinterpret_cast<const unsigned char*>(pers),
+                                        strlen(pers));
+        if (ret != 0) {
+            LOG(ERR) << "Seed ctr_drbg failed: " << ret;
+            return nullptr;
+        }
+        mbedtls_ssl_conf_rng(&config->cfg, &TlsClientConfig::random, config.get());
+        ret = mbedtls_x509_crt_parse(
+            &config->ca, reinterpret_cast<const unsigned char*>(cert.c_str()), cert.size() + 1);
+        if (ret != 0) {
+            LOG(ERR) << "Parse cert file failed: " << ret;
+            return nullptr;
+        }
+        mbedtls_ssl_conf_ca_chain(&config->cfg, &config->ca, nullptr);
+        return config;
+    }
+};
 
 MbedtlsCTransport::MbedtlsCTransport(const Params& params)
     : uvtransport_{make_uv_params(params)}
+    , ioloop_{params.ioloop}
+    , plain_(kPlainBufferSize)
     , on_connected_{params.on_connected}
     , on_closed_{params.on_closed}
     , on_reconnecting_{params.on_reconnecting}
     , on_read_{params.on_read}
-    , more_buffer_(TLS_BUF_SZ)
-    , cert_content_{params.cert} {}
+    , cert_content_{params.cert} {
+    mbedtls_ssl_init(&ssl_);
+    mbedtls_ssl_session_init(&session_);
+}
 
 MbedtlsCTransport::~MbedtlsCTransport() {
-    mbedtls_ctr_drbg_free(&drbg_);
+    // 不在ioloop线程上时不能碰uv，攒着的数据只能丢掉.
+    // 上层正在析构，不再回调它的callback
+    if (!ioloop_->isNotCurrentThread()) {
+        flush_before_close(false);
+    }
+    mbedtls_ssl_free(&ssl_);
+    mbedtls_ssl_session_free(&session_);
 }
 
 bool MbedtlsCTransport::init() {
@@ -103,120 +195,138 @@ bool MbedtlsCTransport::init() {
 }
 
 bool MbedtlsCTransport::tls_init_context() {
-    mbedtls_ssl_config_init(&ssl_cfg_);
-    mbedtls_ssl_conf_dbg(&ssl_cfg_, tls_debug_log, nullptr);
-    mbedtls_debug_set_threshold(0);
-    mbedtls_ssl_config_defaults(&ssl_cfg_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
-                                MBEDTLS_SSL_PRESET_DEFAULT);
-    mbedtls_ssl_conf_renegotiation(&ssl_cfg_, MBEDTLS_SSL_RENEGOTIATION_ENABLED);
-    mbedtls_ssl_conf_authmode(&ssl_cfg_, MBEDTLS_SSL_VERIFY_REQUIRED);
-    ::memset(&entropy_, 0, sizeof(entropy_));
-    mbedtls_entropy_init(&entropy_);
-    mbedtls_ctr_drbg_init(&drbg_);
-    std::unique_ptr<uint8_t[]> seed{new uint8_t[MBEDTLS_ENTROPY_MAX_SEED_SIZE]};
-    mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_, seed.get(),
-                          MBEDTLS_ENTROPY_MAX_SEED_SIZE);
-    mbedtls_ssl_conf_rng(&ssl_cfg_, mbedtls_ctr_drbg_random, &drbg_);
-    mbedtls_x509_crt_init(&own_cert_);
-    int ret = mbedtls_x509_crt_parse(&own_cert_,
-                                     reinterpret_cast<const unsigned char*>(cert_content_.c_str()),
-                                     cert_content_.size() + 1);
-    if (ret != 0) {
-        LOG(ERR) << "Parse cert file failed: " << ret;
-        return false;
-    }
-    mbedtls_ssl_conf_ca_chain(&ssl_cfg_, &own_cert_, nullptr);
-    return true;
+    tls_cfg_ = TlsClientConfig::get(cert_content_);
+    return tls_cfg_ != nullptr;
 }
 
 bool MbedtlsCTransport::tls_init_engine() {
-    mbedtls_ssl_init(&ssl_);
-    mbedtls_ssl_setup(&ssl_, &ssl_cfg_);
+    mbedtls_ssl_setup(&ssl_, &tls_cfg_->cfg);
     const std::string& hostname =
         uvtransport_.is_tcp() ? uvtransport_.host() : uvtransport_.pipe_name();
-    // std::string hostname = "lanthing.net";
     mbedtls_ssl_set_hostname(&ssl_, hostname.c_str());
-    // session_ = std::make_unique<mbedtls_ssl_session>();
-    // memset(session_.get(), 0, sizeof(mbedtls_ssl_session));
-    bio_in_ = BIO::create();
-    bio_out_ = BIO::create();
     mbedtls_ssl_set_bio(&ssl_, this, mbed_ssl_send, mbed_ssl_recv, nullptr);
     return true;
 }
 
 int MbedtlsCTransport::tls_reset_engine() {
-    // if (mbedtls_ssl_get_session(&ssl_, session_.get()) != 0) {
-    //     mbedtls_ssl_session_free(session_.get());
-    // }
-    if (bio_in_) {
-        BIO::destroy(bio_in_);
-        bio_in_ = BIO::create();
-    }
-    if (bio_out_) {
-        BIO::destroy(bio_out_);
-        bio_out_ = BIO::create();
-    }
-    return mbedtls_ssl_session_reset(&ssl_);
+    // 旧连接上没发出去的数据直接丢掉，和断线时uv里没写完的数据一样.
+    // 这些数据的send()已经返回过true，callback照样调用，和LibuvCTransport写失败时一样
+    in_data_ = nullptr;
+    in_len_ = 0;
+    out_.clear();
+    pending_.clear();
+    std::vector<std::function<void()>> callbacks;
+    callbacks.swap(pending_callbacks_);
+    int ret = mbedtls_ssl_session_reset(&ssl_);
+    run_callbacks(callbacks);
+    return ret;
 }
 
-int MbedtlsCTransport::tls_write(const char* data, uint32_t data_len, char* out,
-                                 decltype(Buffer::len)* out_bytes, uint32_t maxout) {
-    size_t wrote = 0;
-    while (data_len > wrote) {
-        int rc = mbedtls_ssl_write(&ssl_, (const unsigned char*)(data + wrote), data_len - wrote);
+bool MbedtlsCTransport::read_records() {
+    while (true) {
+        int rc = mbedtls_ssl_read(&ssl_, reinterpret_cast<unsigned char*>(plain_.data()),
+                                  plain_.size());
+        if (rc > 0) {
+            if (!on_read_(Buffer{plain_.data(), static_cast<uint32_t>(rc)})) {
+                return false;
+            }
+            continue;
+        }
+        if (rc == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            break;
+        }
+        if (rc == 0 || rc == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+            LOG(INFO) << "TLS connection closed by peer";
+            return false;
+        }
+        error_ = rc;
+        LOGF(ERR, "TLS read error: -0x%04x(%s)", -rc, tls_error_str(rc).c_str());
+        return false;
+    }
+    // 重协商、alert之类的会在读的过程中产生要发出去的数据
+    return flush_output();
+}
+
+bool MbedtlsCTransport::encrypt(const char* data, size_t len) {
+    size_t written = 0;
+    while (written < len) {
+        // 超过16KB的明文mbedtls会拆成多个record，每次返回实际写入的长度
+        int rc = mbedtls_ssl_write(&ssl_, reinterpret_cast<const unsigned char*>(data + written),
+                                   len - written);
         if (rc < 0) {
             error_ = rc;
-            return rc;
+            LOGF(ERR, "TLS write error: -0x%04x(%s)", -rc, tls_error_str(rc).c_str());
+            return false;
         }
-        wrote += rc;
+        written += rc;
     }
-    *out_bytes = bio_out_->read(reinterpret_cast<uint8_t*>(out), maxout);
-    return static_cast<int>(bio_out_->available);
+    return true;
 }
 
-int MbedtlsCTransport::tls_read(const char* ssl_in, uint32_t ssl_in_len, char* out,
-                                decltype(Buffer::len)* out_bytes, uint32_t maxout) {
-    if (ssl_in_len > 0 && ssl_in != NULL) {
-        bio_in_->put(reinterpret_cast<const uint8_t*>(ssl_in), ssl_in_len);
+bool MbedtlsCTransport::flush_pending(const std::function<void()>& callback) {
+    if (pending_.empty()) {
+        return true;
     }
+    std::vector<std::function<void()>> callbacks;
+    callbacks.swap(pending_callbacks_);
+    // 前accepted个callback对应的send()已经返回过true，失败了也要调用;
+    // 最后一个是这次send()自己的，失败时由返回值告诉调用者
+    const size_t accepted = callbacks.size();
+    if (callback) {
+        callbacks.push_back(callback);
+    }
+    bool success = encrypt(pending_.data(), pending_.size()) && flush_output(callbacks);
+    pending_.clear();
+    if (!success) {
+        out_.clear();
+        callbacks.resize(accepted);
+        run_callbacks(callbacks);
+    }
+    return success;
+}
 
-    int rc;
-    uint8_t* writep = (uint8_t*)out;
-    size_t total_out = 0;
-
-    do {
-        rc = mbedtls_ssl_read(&ssl_, writep, maxout - total_out);
-
-        if (rc > 0) {
-            total_out += rc;
-            writep += rc;
+void MbedtlsCTransport::flush_before_close(bool callbacks_needed) {
+    if (pending_.empty()) {
+        return;
+    }
+    std::vector<std::function<void()>> callbacks;
+    callbacks.swap(pending_callbacks_);
+    bool success = encrypt(pending_.data(), pending_.size());
+    pending_.clear();
+    if (success) {
+        const auto size = static_cast<int32_t>(out_.size());
+        int32_t written = uvtransport_.try_send(out_.data(), static_cast<uint32_t>(out_.size()));
+        if (written != size) {
+            LOGF(WARNING, "Drop %d bytes of TLS data before close", size - std::max(written, 0));
         }
-    } while (rc > 0 && (maxout - total_out) > 0);
-
-    *out_bytes = static_cast<uint32_t>(total_out);
-
-    // this indicates that more bytes are needed to complete SSL frame
-    if (rc == MBEDTLS_ERR_SSL_WANT_READ) {
-        return bio_out_->available > 0 ? TLS_HAS_WRITE : TLS_OK;
     }
-
-    if (rc == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
-        return TLS_EOF;
+    out_.clear();
+    // 写没写出去都要调用，之后上层会收到on_reconnecting
+    if (callbacks_needed) {
+        run_callbacks(callbacks);
     }
+}
 
-    if (rc < 0) {
-        error_ = rc;
-        char err[1024];
-        mbedtls_strerror(rc, err, 1024);
-        LOGF(ERR, "TLS error: %0x(%s)", rc, err);
-        return TLS_ERR;
-    }
+bool MbedtlsCTransport::flush_output() {
+    std::vector<std::function<void()>> callbacks;
+    return flush_output(callbacks);
+}
 
-    if (bio_in_->available > 0 || mbedtls_ssl_check_pending(&ssl_)) {
-        return TLS_MORE_AVAILABLE;
+bool MbedtlsCTransport::flush_output(std::vector<std::function<void()>>& callbacks) {
+    if (out_.empty()) {
+        run_callbacks(callbacks);
+        callbacks.clear();
+        return true;
     }
-
-    return TLS_OK;
+    auto data = std::make_shared<std::vector<char>>();
+    data->swap(out_);
+    out_.reserve(data->capacity());
+    Buffer buff{data->data(), static_cast<uint32_t>(data->size())};
+    if (!uvtransport_.send(&buff, 1, [data, callbacks]() { run_callbacks(callbacks); })) {
+        return false;
+    }
+    callbacks.clear();
+    return true;
 }
 
 CTransport::Params MbedtlsCTransport::make_uv_params(const Params& params) {
@@ -229,85 +339,35 @@ CTransport::Params MbedtlsCTransport::make_uv_params(const Params& params) {
 }
 
 bool MbedtlsCTransport::on_uv_read(const Buffer& uvbuf) {
-    int state = ssl_.MBEDTLS_PRIVATE(state);
-    if (is_handshake_continue(state)) {
-        Buffer buff{TLS_BUF_SZ};
-        auto hs_state = continue_handshake(uvbuf.base, uvbuf.len, buff.base, &buff.len, TLS_BUF_SZ);
-        if (buff.len > 0) {
-            int success = uvtransport_.send(&buff, 1, [buff]() { delete buff.base; });
-            if (!success) {
-                delete buff.base;
-                return false;
-            }
+    in_data_ = uvbuf.base;
+    in_len_ = uvbuf.len;
+    if (is_handshake_continue(ssl_.MBEDTLS_PRIVATE(state))) {
+        auto hs_state = continue_handshake();
+        if (!flush_output()) {
+            return false;
         }
-        else {
-            delete buff.base;
+        if (hs_state == HandshakeState::ERROR_) {
+            LOG(ERR) << "TLS handshake error:" << tls_error_str(error_);
+            return false;
         }
-        if (hs_state == HandshakeState::COMPLETE) {
-            return on_connected_();
+        if (hs_state != HandshakeState::COMPLETE) {
+            in_data_ = nullptr;
+            in_len_ = 0;
+            return true;
         }
-        else if (hs_state == HandshakeState::ERROR_) {
-            char errbuf[1024];
-            mbedtls_strerror(error_, errbuf, sizeof(errbuf));
-            LOG(ERR) << "TLS handshake error:" << errbuf;
+        LOGF(INFO, "TLS handshake completed in %lldus (%s)",
+             static_cast<long long>(ltlib::steady_now_us() - handshake_start_us_),
+             has_session_ ? "resumption offered" : "full");
+        save_session();
+        if (!on_connected_()) {
             return false;
         }
+        // 服务器可能紧跟着Finished发了应用数据，继续往下读
     }
-    else if (state == MBEDTLS_SSL_HANDSHAKE_OVER) {
-        Buffer outbuff = uvbuf;
-        Buffer inbuff = uvbuf;
-        enum TLS_RESULT rc = TLS_MORE_AVAILABLE;
-        while (rc == TLS_MORE_AVAILABLE || rc == TLS_READ_AGAIN) {
-            // uint32_t out_bytes = 0;
-            rc = (TLS_RESULT)tls_read(inbuff.base, inbuff.len, outbuff.base, &outbuff.len,
-                                      outbuff.len);
-            inbuff.base = nullptr;
-            inbuff.len = 0;
-            switch (rc) {
-            case ltlib::TLS_OK:
-                on_read_(outbuff);
-                break;
-            case ltlib::TLS_EOF:
-                if (outbuff.len > 0) {
-                    on_read_(outbuff);
-                }
-                return false;
-            case ltlib::TLS_READ_AGAIN:
-            case ltlib::TLS_MORE_AVAILABLE:
-                on_read_(outbuff);
-                outbuff.base = more_buffer_.data();
-                outbuff.len = static_cast<uint32_t>(more_buffer_.size());
-                break;
-            case ltlib::TLS_HAS_WRITE:
-            {
-                Buffer writebuf{TLS_BUF_SZ};
-                int tls_rc = tls_write(nullptr, 0, writebuf.base, &writebuf.len, TLS_BUF_SZ);
-                (void)tls_rc; // FIXME: tls_rc
-                bool success =
-                    uvtransport_.send(&writebuf, 1, [writebuf]() { delete writebuf.base; });
-                if (!success) {
-                    return false;
-                }
-                break;
-            }
-            case ltlib::TLS_ERR:
-            default:
-                if (outbuff.len > 0) {
-                    on_read_(outbuff);
-                }
-                if (rc == ltlib::TLS_ERR) {
-                    LOG(ERR) << "Unexpected TLS result:" << rc;
-                }
-                else {
-                    char errbuf[1024];
-                    mbedtls_strerror(error_, errbuf, 1024);
-                    LOG(ERR) << "TLS error:" << errbuf;
-                }
-                return false;
-            }
-        }
-    }
-    return true;
+    bool success = read_records();
+    in_data_ = nullptr;
+    in_len_ = 0;
+    return success;
 }
 
 void MbedtlsCTransport::on_uv_closed() {
@@ -327,180 +387,126 @@ void MbedtlsCTransport::on_uv_reconnecting() {
 }
 
 bool MbedtlsCTransport::on_uv_connected() {
-    // tls_reset_engine();
     int state = ssl_.MBEDTLS_PRIVATE(state);
     LOG(DEBUG) << "Start tls handshake " << state;
     if (is_handshake_continue(state)) {
         LOGF(ERR, "Start hanshake in the middle of another handshak(%d)", state);
         return false;
     }
-    Buffer buff{TLS_BUF_SZ};
-    continue_handshake(nullptr, 0, buff.base, &buff.len, TLS_BUF_SZ);
-    int success = uvtransport_.send(&buff, 1, [buff]() { delete buff.base; });
-    if (!success) {
-        delete buff.base;
+    handshake_start_us_ = ltlib::steady_now_us();
+    if (has_session_) {
+        // 服务器不认这个session时会自动退回完整握手
+        int ret = mbedtls_ssl_set_session(&ssl_, &session_);
+        if (ret != 0) {
+            LOGF(WARNING, "mbedtls_ssl_set_session failed: %0x", ret);
+        }
+    }
+    if (continue_handshake() == HandshakeState::ERROR_) {
+        LOG(ERR) << "TLS handshake error:" << tls_error_str(error_);
         return false;
     }
-    return true;
+    return flush_output();
 }
 
-MbedtlsCTransport::HandshakeState
-MbedtlsCTransport::continue_handshake(char* in, uint32_t in_bytes, char* out,
-                                      decltype(Buffer::len)* out_bytes, uint32_t maxout) {
-    if (in_bytes > 0) {
-        bio_in_->put(reinterpret_cast<const uint8_t*>(in), in_bytes);
-    }
-    // if (ssl_.MBEDTLS_PRIVATE(state) == MBEDTLS_SSL_HELLO_REQUEST && session_ != nullptr) {
-    //     mbedtls_ssl_set_session(&ssl_, session_.get());
-    //     mbedtls_ssl_session_free(session_.get());
-    // }
-    int state = mbedtls_ssl_handshake(&ssl_);
-    char err[1024];
-    mbedtls_strerror(state, err, 1024);
-    *out_bytes = bio_out_->read(reinterpret_cast<uint8_t*>(out), maxout);
+void MbedtlsCTransport::save_session() {
+    mbedtls_ssl_session_free(&session_);
+    mbedtls_ssl_session_init(&session_);
+    int ret = mbedtls_ssl_get_session(&ssl_, &session_);
+    has_session_ = ret == 0;
+    if (ret != 0) {
+        LOGF(WARNING, "mbedtls_ssl_get_session failed: %0x", ret);
+    }
+}
 
+MbedtlsCTransport::HandshakeState MbedtlsCTransport::continue_handshake() {
+    int ret = mbedtls_ssl_handshake(&ssl_);
     if (ssl_.MBEDTLS_PRIVATE(state) == MBEDTLS_SSL_HANDSHAKE_OVER) {
         return HandshakeState::COMPLETE;
     }
-    else if (state == MBEDTLS_ERR_SSL_WANT_READ || state == MBEDTLS_ERR_SSL_WANT_WRITE) {
+    else if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
         return HandshakeState::CONTINUE;
     }
     else {
-        error_ = state;
+        error_ = ret;
         return HandshakeState::ERROR_;
     }
 }
 
 int MbedtlsCTransport::mbed_ssl_send(void* ctx, const uint8_t* buf, size_t len) {
     auto that = reinterpret_cast<MbedtlsCTransport*>(ctx);
-    that->bio_out_->put(buf, len);
+    that->out_.insert(that->out_.end(), buf, buf + len);
     return static_cast<int>(len);
 }
 
 int MbedtlsCTransport::mbed_ssl_recv(void* ctx, uint8_t* buf, size_t len) {
     auto that = reinterpret_cast<MbedtlsCTransport*>(ctx);
-    if (that->bio_in_->available == 0) {
+    if (that->in_len_ == 0) {
         return MBEDTLS_ERR_SSL_WANT_READ;
     }
-    return that->bio_in_->read(buf, len);
+    size_t size = std::min(len, that->in_len_);
+    memcpy(buf, that->in_data_, size);
+    that->in_data_ += size;
+    that->in_len_ -= size;
+    return static_cast<int>(size);
 }
 
 bool MbedtlsCTransport::send(Buffer buff[], uint32_t buff_count,
                              const std::function<void()>& callback) {
-    int tls_rc = 0;
-    decltype(Buffer::len) out_size;
+    if (is_handshake_continue(ssl_.MBEDTLS_PRIVATE(state))) {
+        LOG(ERR) << "Send data before TLS handshake completed";
+        return false;
+    }
+    size_t total = 0;
     for (uint32_t i = 0; i < buff_count; i++) {
-        tls_rc = tls_write(buff[i].base, buff[i].len, nullptr, &out_size, 0);
-        if (tls_rc < 0) {
-            char errbuf[1024] = {0};
-            mbedtls_strerror(error_, errbuf, 1024);
-            LOG(ERR) << "tls_write failed:" << errbuf;
-            return false;
-        }
+        total += buff[i].len;
     }
-    if (tls_rc > 0) {
-        Buffer outbuf{uint32_t(tls_rc)};
-        tls_rc = tls_write(nullptr, 0, outbuf.base, &outbuf.len, tls_rc);
-        if (tls_rc < 0) {
-            char errbuf[1024] = {0};
-            mbedtls_strerror(error_, errbuf, 1024);
-            LOG(ERR) << "tls_write failed:" << errbuf;
+    if (total >= kMaxPendingBytes) {
+        // 大包不再拷贝到pending_，先把前面攒的发掉保证顺序，再直接加密
+        if (!flush_pending()) {
             return false;
         }
-        else {
-            bool success = uvtransport_.send(&outbuf, 1, [outbuf, callback]() {
-                delete outbuf.base;
-                if (callback) {
-                    callback();
-                }
-            });
-            return success;
+        for (uint32_t i = 0; i < buff_count; i++) {
+            if (!encrypt(buff[i].base, buff[i].len)) {
+                out_.clear();
+                return false;
+            }
         }
+        std::vector<std::function<void()>> callbacks;
+        if (callback) {
+            callbacks.push_back(callback);
+        }
+        return flush_output(callbacks);
     }
-    else if (tls_rc == 0) {
-        return true;
+    for (uint32_t i = 0; i < buff_count; i++) {
+        pending_.insert(pending_.end(), buff[i].base, buff[i].base + buff[i].len);
     }
-
-    return true;
-}
-
-void MbedtlsCTransport::reconnect() {
-    uvtransport_.reconnect();
-}
-
-WARNING_DISABLE(6011)
-WARNING_DISABLE(6001)
-BIO* BIO::create() {
-
-    BIO* bio = (BIO*)calloc(1, sizeof(BIO));
-
-    bio->headoffset = 0;
-    bio->qlen = 0;
-
-    STAILQ_INIT(&bio->message_q);
-    return bio;
-}
-
-void BIO::destroy(BIO* b) {
-
-    while (!STAILQ_EMPTY(&b->message_q)) {
-        struct msg* m = STAILQ_FIRST(&b->message_q);
-        STAILQ_REMOVE_HEAD(&b->message_q, next);
-        free(m->buf);
-        free(m);
+    if (pending_.size() >= kMaxPendingBytes) {
+        return flush_pending(callback);
     }
-
-    free(b);
-}
-
-int BIO::put(const uint8_t* buf, size_t len) {
-    struct msg* m = (struct msg*)malloc(sizeof(struct msg));
-    if (m == NULL) {
-        return -1;
+    if (callback) {
+        pending_callbacks_.push_back(callback);
     }
-
-    m->buf = (uint8_t*)malloc(len);
-    if (m->buf == NULL) {
-        free(m);
-        return -1;
+    if (!flush_scheduled_) {
+        flush_scheduled_ = true;
+        std::weak_ptr<int> weak_alive = alive_;
+        ioloop_->post([this, weak_alive]() {
+            if (weak_alive.lock() == nullptr) {
+                return;
+            }
+            flush_scheduled_ = false;
+            // 失败时callback已经在flush_pending()里调用过，重连通过on_reconnecting告诉上层
+            if (!flush_pending()) {
+                uvtransport_.reconnect();
+            }
+        });
     }
-    memcpy(m->buf, buf, len);
-
-    m->len = len;
-
-    STAILQ_INSERT_TAIL(&message_q, m, next);
-    available += len;
-    qlen += 1;
-
-    return static_cast<int>(len);
+    return true;
 }
 
-int BIO::read(uint8_t* buf, size_t len) {
-    size_t total = 0;
-
-    while (!STAILQ_EMPTY(&message_q) && total < len) {
-        struct msg* m = STAILQ_FIRST(&message_q);
-
-        size_t recv_size = std::min(len - total, m->len - headoffset);
-        memcpy(buf + total, m->buf + headoffset, recv_size);
-        headoffset += recv_size;
-        available -= recv_size;
-        total += recv_size;
-
-        if (headoffset == m->len) {
-            STAILQ_REMOVE_HEAD(&message_q, next);
-            headoffset = 0;
-            qlen -= 1;
-
-            free(m->buf);
-            free(m);
-        }
-    }
-
-    return (int)total;
+void MbedtlsCTransport::reconnect() {
+    // send()已经对这些数据返回过true，不能在这里悄悄丢掉
+    flush_before_close(true);
+    uvtransport_.reconnect();
 }
 
-WARNING_ENABLE(6011)
-WARNING_ENABLE(6001)
-
-} // namespace ltlib
\ No newline at end of file
+} // namespace ltlib
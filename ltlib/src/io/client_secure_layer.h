@@ -30,8 +30,8 @@
 
 #pragma once
 #include "client_transport_layer.h"
-#include "queue.h"
 #include <cstdint>
+#include <memory>
 #include <mbedtls/ctr_drbg.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/ssl.h>
@@ -39,19 +39,7 @@
 
 namespace ltlib {
 
-// TODO: REPLACE BIO
-struct BIO {
-    static BIO* create();
-    static void destroy(BIO* b);
-    int put(const uint8_t* buf, size_t len);
-    int read(uint8_t* buf, size_t len);
-
-    size_t available;
-    size_t headoffset;
-    unsigned int qlen;
-    STAILQ_HEAD(msgq, msg)
-    message_q;
-};
+struct TlsClientConfig;
 
 class MbedtlsCTransport : public CTransport {
 private:
@@ -61,48 +49,67 @@ public:
     MbedtlsCTransport(const Params& params);
     ~MbedtlsCTransport() override;
     bool init() override;
+    // 小于kMaxPendingBytes的数据只是拷进pending_，在ioloop的下一轮和同一轮的其它send一起加密发送，
+    // 所以返回true只表示数据被接受了. 和LibuvCTransport一样:
+    // 返回false时callback不会被调用; 返回true后callback一定会被调用一次，正常情况是密文交给uv写完后，
+    // 之后加密、写入失败或者断线时也会调用，随后上层会收到on_reconnecting(或on_closed).
+    // 只有MbedtlsCTransport析构时还没发出去的数据不调用
     bool send(Buffer buff[], uint32_t buff_count, const std::function<void()>& callback) override;
+    // 断开前先把pending_里攒着的数据写出去
     void reconnect() override;
 
 private:
     bool tls_init_context();
     bool tls_init_engine();
     int tls_reset_engine();
-    int tls_write(const char* data, uint32_t data_len, char* out, decltype(Buffer::len)* out_bytes,
-                  uint32_t maxout);
-    int tls_read(const char* ssl_in, uint32_t ssl_in_len, char* out,
-                 decltype(Buffer::len)* out_bytes, uint32_t maxout);
+    bool read_records();
+    bool encrypt(const char* data, size_t len);
+    bool flush_pending(const std::function<void()>& callback = nullptr);
+    void flush_before_close(bool callbacks_needed);
+    bool flush_output();
+    // 成功时callbacks交给uv的写回调并被清空，失败时原样留给调用者处理
+    bool flush_output(std::vector<std::function<void()>>& callbacks);
     Params make_uv_params(const Params& params);
     bool on_uv_read(const Buffer&);
     void on_uv_closed();
     void on_uv_reconnecting();
     bool on_uv_connected();
+    void save_session();
 
-    HandshakeState continue_handshake(char* in, uint32_t in_bytes, char* out,
-                                      decltype(Buffer::len)* out_bytes, uint32_t maxout);
+    HandshakeState continue_handshake();
     static int mbed_ssl_send(void* ctx, const uint8_t* buf, size_t len);
     static int mbed_ssl_recv(void* ctx, uint8_t* buf, size_t len);
 
 private:
     LibuvCTransport uvtransport_;
-    // 下面几个是所有connections共有的，但我们这里只有1个connection
-    mbedtls_ssl_config ssl_cfg_;
-    mbedtls_pk_context own_key_;
-    mbedtls_x509_crt own_cert_;
+    IOLoop* ioloop_;
+    // 同一份证书的所有连接共用，证书只解析一次
+    std::shared_ptr<TlsClientConfig> tls_cfg_;
     // 下面几个是属于某一个connection
     mbedtls_ssl_context ssl_;
-    // std::unique_ptr<mbedtls_ssl_session> session_;
-    mbedtls_ctr_drbg_context drbg_;
-    mbedtls_entropy_context entropy_;
-    BIO* bio_in_;
-    BIO* bio_out_;
-    int error_;
+    // 上一次握手成功的session，重连时用来恢复会话(session ticket或session id)，省掉证书校验
+    mbedtls_ssl_session session_;
+    bool has_session_ = false;
+    int64_t handshake_start_us_ = 0;
+    int error_ = 0;
+    // 正在处理的这次uv读到的密文，mbedtls通过mbed_ssl_recv直接从这里取
+    const char* in_data_ = nullptr;
+    size_t in_len_ = 0;
+    // 解密后的明文，每次读都复用
+    std::vector<char> plain_;
+    // mbedtls产生的密文，攒到一起交给一次uv_write
+    std::vector<char> out_;
+    // 同一轮ioloop里send的小包先攒起来，合成一个TLS record
+    std::vector<char> pending_;
+    std::vector<std::function<void()>> pending_callbacks_;
+    bool flush_scheduled_ = false;
+    // 投递到ioloop的flush任务用它判断this是否还活着
+    std::shared_ptr<int> alive_ = std::make_shared<int>(0);
 
     std::function<bool()> on_connected_;
     std::function<void()> on_closed_;
     std::function<void()> on_reconnecting_;
     std::function<bool(const Buffer&)> on_read_;
-    std::vector<char> more_buffer_;
     const std::string cert_content_;
 };
 
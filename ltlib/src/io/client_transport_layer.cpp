@@ -34,6 +34,7 @@
 #include <errno.h>
 
 #include <ltlib/logging.h>
+#include <ltlib/times.h>
 
 #if defined(LT_WINDOWS)
 #define LAST_ERROR_NO WSAGetLastError()
@@ -43,6 +44,9 @@
 
 namespace {
 
+// 连接稳定了这么久才算一次成功的连接，下次断线立即重连；否则继续退避，避免连上就断的服务器被刷爆
+constexpr int64_t kStableConnectionMS = 5'000;
+
 struct UvWrittenInfo {
     UvWrittenInfo(ltlib::LibuvCTransport* _that, const std::function<void()>& cb)
         : that(_that)
@@ -175,6 +179,16 @@ bool LibuvCTransport::send(Buffer buff[], uint32_t buff_count,
     return true;
 }
 
+int32_t LibuvCTransport::try_send(const char* data, uint32_t len) {
+    uv_stream_t* stream_handle = uvstream();
+    if (stream_handle == nullptr) {
+        return -1;
+    }
+    // 前面还有没写完的uv_write时返回UV_EAGAIN，不会打乱顺序
+    uv_buf_t uvbuf = uv_buf_init(const_cast<char*>(data), len);
+    return uv_try_write(stream_handle, &uvbuf, 1);
+}
+
 bool LibuvCTransport::is_tcp() const {
     return stype_ == StreamType::TCP;
 }
@@ -214,6 +228,10 @@ uv_handle_t* LibuvCTransport::uvhandle_release() {
 }
 
 void LibuvCTransport::reconnect() {
+    if (connected_at_ms_ != 0 && ltlib::steady_now_ms() - connected_at_ms_ >= kStableConnectionMS) {
+        intervals_.reset();
+    }
+    connected_at_ms_ = 0;
     uv_handle_t* conn = uvhandle_release();
     if (conn != nullptr) {
         uv_close(conn, &LibuvCTransport::delay_reconnect);
@@ -252,7 +270,7 @@ void LibuvCTransport::do_reconnect(uv_timer_t* handle) {
 void LibuvCTransport::on_connected(uv_connect_t* req, int status) {
     auto that = reinterpret_cast<LibuvCTransport*>(req->data);
     if (status == 0) {
-        that->intervals_.reset();
+        that->connected_at_ms_ = ltlib::steady_now_ms();
         if (that->stype_ == StreamType::TCP) {
             sockaddr_in addr{};
             int name_len = sizeof(addr);
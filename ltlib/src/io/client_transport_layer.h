@@ -73,6 +73,9 @@ public:
     bool init() override;
     bool send(Buffer buff[], uint32_t buff_count, const std::function<void()>& callback) override;
     void reconnect() override;
+    // 不排队也不回调，返回立即写进socket的字节数，出错返回负数. 给关闭连接前的最后一次发送用，
+    // 这时候再uv_write，请求会在关闭时被取消
+    int32_t try_send(const char* data, uint32_t len);
     bool is_tcp() const;
     const std::string& pipe_name();
     const std::string& host();
@@ -110,6 +113,7 @@ private:
     std::function<void()> on_reconnecting_;
     std::function<bool(const Buffer&)> on_read_;
     ltlib::ReconnectInterval intervals_;
+    int64_t connected_at_ms_ = 0;
 };
 
 } // namespace ltlib
\ No newline at end of file
@@ -51,6 +51,10 @@ struct Conn
     std::shared_ptr<ltproto::Parser> parser;
 };
 
+// 分片时fd的高8位是分片序号，每个分片的LibuvSTransport从(shard << kShardShift)开始分配fd
+constexpr uint32_t kShardShift = 24;
+constexpr size_t kMaxShards = 256;
+
 } // namespace
 
 namespace ltlib
@@ -68,35 +72,58 @@ public:
     uint16_t port();
 
 private:
-    LibuvSTransport::Params make_uv_params(const Server::Params& params);
+    LibuvSTransport::Params make_uv_params(const Server::Params& params, IOLoop* ioloop, size_t shard);
+    size_t shard_of(uint32_t fd) const;
     void on_transport_accepted(uint32_t fd);
     void on_transport_closed(uint32_t fd);
     bool on_transport_read(uint32_t fd, const Buffer& buff);
 
 private:
-    std::unique_ptr<LibuvSTransport> transport_;
+    Server::Params params_;
+    std::vector<IOLoop*> ioloops_;
+    std::vector<std::unique_ptr<LibuvSTransport>> transports_;
     std::function<void(uint32_t)> on_accepted_;
     std::function<void(uint32_t)> on_closed_;
     std::function<void(uint32_t /*fd*/, uint32_t /*type*/, const std::shared_ptr<google::protobuf::MessageLite>&)> on_message_;
-    std::map<uint32_t /*fd*/, Conn> conns_;
+    // 每个分片一个，只在该分片的ioloop线程访问
+    std::vector<std::map<uint32_t /*fd*/, Conn>> conns_;
 };
 
 ServerImpl::ServerImpl(const Server::Params& params)
-    : transport_ { std::make_unique<LibuvSTransport>(make_uv_params(params)) }
+    : params_ { params }
     , on_accepted_ { params.on_accepted }
     , on_closed_ { params.on_closed }
     , on_message_ { params.on_message }
 {
+    ioloops_.push_back(params.ioloop);
+    if (params.shard_ioloops.empty()) {
+        return;
+    }
+#if defined(LT_LINUX)
+    if (params.stype == StreamType::TCP) {
+        ioloops_.insert(ioloops_.end(), params.shard_ioloops.begin(), params.shard_ioloops.end());
+    }
+    else {
+        LOG(WARNING) << "Pipe server doesn't support shard_ioloops, ignored";
+    }
+#else
+    LOG(WARNING) << "shard_ioloops is only supported on Linux, ignored";
+#endif
 }
 
-LibuvSTransport::Params ServerImpl::make_uv_params(const Server::Params& params)
+LibuvSTransport::Params ServerImpl::make_uv_params(const Server::Params& params, IOLoop* ioloop, size_t shard)
 {
     LibuvSTransport::Params uvparams {};
     uvparams.stype = params.stype;
-    uvparams.ioloop = params.ioloop;
+    uvparams.ioloop = ioloop;
     uvparams.pipe_name = params.pipe_name;
     uvparams.bind_ip = params.bind_ip;
     uvparams.bind_port = params.bind_port;
+    uvparams.reuse_port = ioloops_.size() > 1;
+    if (ioloops_.size() > 1) {
+        uvparams.fd_base = static_cast<uint32_t>(shard) << kShardShift;
+        uvparams.fd_mask = (1u << kShardShift) - 1;
+    }
     uvparams.on_accepted = std::bind(&ServerImpl::on_transport_accepted, this, std::placeholders::_1);
     uvparams.on_closed = std::bind(&ServerImpl::on_transport_closed, this, std::placeholders::_1);
     uvparams.on_read = std::bind(&ServerImpl::on_transport_read, this, std::placeholders::_1, std::placeholders::_2);
@@ -105,13 +132,44 @@ LibuvSTransport::Params ServerImpl::make_uv_params(const Server::Params& params)
 
 bool ServerImpl::init()
 {
-    return transport_->init();
+    if (ioloops_.size() > kMaxShards) {
+        LOG(ERR) << "Too many shard ioloops: " << ioloops_.size();
+        return false;
+    }
+    conns_.resize(ioloops_.size());
+    for (size_t shard = 0; shard < ioloops_.size(); shard++) {
+        auto uvparams = make_uv_params(params_, ioloops_[shard], shard);
+        if (shard != 0) {
+            // bind_port可能是0，后面的分片要监听第一个分片实际拿到的端口
+            uvparams.bind_port = transports_[0]->port();
+        }
+        auto transport = std::make_unique<LibuvSTransport>(uvparams);
+        if (!transport->init()) {
+            return false;
+        }
+        transports_.push_back(std::move(transport));
+    }
+    if (transports_.size() > 1) {
+        LOGF(INFO, "TCP server %s:%u sharded across %zu ioloops", params_.bind_ip.c_str(), port(), transports_.size());
+    }
+    return true;
+}
+
+size_t ServerImpl::shard_of(uint32_t fd) const
+{
+    // 不分片时fd用满32位
+    return ioloops_.size() == 1 ? 0 : fd >> kShardShift;
 }
 
 bool ServerImpl::send(uint32_t fd, uint32_t type, const std::shared_ptr<google::protobuf::MessageLite>& msg, const std::function<void()>& callback)
 {
-    auto iter = conns_.find(fd);
-    if (iter == conns_.cend()) {
+    if (shard_of(fd) >= conns_.size()) {
+        LOG(WARNING) << "Send data to invalid fd:" << fd;
+        return false;
+    }
+    auto& conns = conns_[shard_of(fd)];
+    auto iter = conns.find(fd);
+    if (iter == conns.cend()) {
         LOG(WARNING) << "Send data to invalid fd:" << fd;
         return false;
     }
@@ -125,7 +183,7 @@ bool ServerImpl::send(uint32_t fd, uint32_t type, const std::shared_ptr<google::
         { (char*)&pkt.header, sizeof(pkt.header) },
         { (char*)pkt.payload.get(), pkt.header.payload_size }
     };
-    return transport_->send(fd, buffs, 2, [packet, callback]() {
+    return transports_[shard_of(fd)]->send(fd, buffs, 2, [packet, callback]() {
         // 把packet capture进来，是为了延续内部shared_ptr的生命周期
         if (callback != nullptr) {
             callback();
@@ -135,8 +193,13 @@ bool ServerImpl::send(uint32_t fd, uint32_t type, const std::shared_ptr<google::
 
 bool ServerImpl::send(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_t len, const std::function<void()>& callback)
 {
-    auto iter = conns_.find(fd);
-    if (iter == conns_.cend()) {
+    if (shard_of(fd) >= conns_.size()) {
+        LOG(WARNING) << "Send data to invalid fd:" << fd;
+        return false;
+    }
+    auto& conns = conns_[shard_of(fd)];
+    auto iter = conns.find(fd);
+    if (iter == conns.cend()) {
         LOG(WARNING) << "Send data to invalid fd:" << fd;
         return false;
     }
@@ -150,7 +213,7 @@ bool ServerImpl::send(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_
         { (char*)&pkt.header, sizeof(pkt.header) },
         { (char*)pkt.payload.get(), pkt.header.payload_size }
     };
-    return transport_->send(fd, buffs, 2, [packet, callback]() {
+    return transports_[shard_of(fd)]->send(fd, buffs, 2, [packet, callback]() {
         // 把packet capture进来，是为了延续内部shared_ptr的生命周期
         if (callback != nullptr) {
             callback();
@@ -160,36 +223,41 @@ bool ServerImpl::send(uint32_t fd, const std::shared_ptr<uint8_t>& data, uint32_
 
 void ServerImpl::close(uint32_t fd)
 {
-    transport_->close(fd);
+    if (shard_of(fd) >= transports_.size()) {
+        LOG(WARNING) << "Close invalid fd:" << fd;
+        return;
+    }
+    transports_[shard_of(fd)]->close(fd);
 }
 
 std::string ServerImpl::ip()
 {
-    return transport_->ip();
+    return transports_[0]->ip();
 }
 
 uint16_t ServerImpl::port()
 {
-    return transport_->port();
+    return transports_[0]->port();
 }
 
 void ServerImpl::on_transport_accepted(uint32_t fd)
 {
     Conn conn { fd };
-    conns_[fd] = conn;
+    conns_[shard_of(fd)][fd] = conn;
     on_accepted_(fd);
 }
 
 void ServerImpl::on_transport_closed(uint32_t fd)
 {
     on_closed_(fd);
-    conns_.erase(fd);
+    conns_[shard_of(fd)].erase(fd);
 }
 
 bool ServerImpl::on_transport_read(uint32_t fd, const Buffer& buff)
 {
-    auto iter = conns_.find(fd);
-    if (iter == conns_.cend()) {
+    auto& conns = conns_[shard_of(fd)];
+    auto iter = conns.find(fd);
+    if (iter == conns.cend()) {
         LOG(WARNING) << "Read data on invalid fd:" << fd;
         return false;
     }
@@ -29,6 +29,10 @@
  */
 
 #include "server_transport_layer.h"
+#if defined(LT_LINUX)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 #include <ltlib/logging.h>
 
 namespace {
@@ -46,11 +50,14 @@ struct UvWrittenInfo {
 namespace ltlib {
 
 LibuvSTransport::LibuvSTransport(const Params& params)
-    : stype_{params.stype}
+    : fd_base_{params.fd_base}
+    , fd_mask_{params.fd_mask}
+    , stype_{params.stype}
     , ioloop_{params.ioloop}
     , pipe_name_{params.pipe_name}
     , bind_ip_{params.bind_ip}
     , bind_port_{params.bind_port}
+    , reuse_port_{params.reuse_port}
     , on_accepted_{params.on_accepted}
     , on_closed_{params.on_closed}
     , on_read_{params.on_read} {}
@@ -141,6 +148,10 @@ bool LibuvSTransport::init_tcp() {
         LOG(ERR) << "Init tcp socket failed: " << ret;
         server_tcp_.reset(); // reset是为了告诉析构函数，不要close这个socket
     }
+    if (reuse_port_ && !open_reuse_port_socket()) {
+        server_tcp_.reset();
+        return false;
+    }
     struct sockaddr_in addr;
     ret = uv_ip4_addr(bind_ip_.c_str(), bind_port_, &addr);
     if (ret != 0) {
@@ -163,7 +174,8 @@ bool LibuvSTransport::init_tcp() {
     listen_port_ = ntohs(addr.sin_port);
     LOGF(DEBUG, "Listening on %s:%u", bind_ip_.c_str(), listen_port_);
     server_tcp_->data = this;
-    constexpr int kBacklog = 4;
+    // 4对本机的几个连接够用，但分片模式是给大量TCP连接准备的
+    constexpr int kBacklog = 128;
     ret = uv_listen(reinterpret_cast<uv_stream_t*>(server_tcp_.get()), kBacklog,
                     &LibuvSTransport::on_new_client);
     if (ret != 0) {
@@ -174,6 +186,33 @@ bool LibuvSTransport::init_tcp() {
     return true;
 }
 
+bool LibuvSTransport::open_reuse_port_socket() {
+#if defined(LT_LINUX)
+    // libuv的uv_tcp_bind()只会设置SO_REUSEADDR，SO_REUSEPORT要在bind之前自己设
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        LOG(ERR) << "Create socket failed: " << errno;
+        return false;
+    }
+    int on = 1;
+    if (::setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+        LOG(ERR) << "setsockopt(SO_REUSEPORT) failed: " << errno;
+        ::close(sock);
+        return false;
+    }
+    int ret = uv_tcp_open(server_tcp_.get(), sock);
+    if (ret != 0) {
+        LOG(ERR) << "uv_tcp_open failed: " << ret;
+        ::close(sock);
+        return false;
+    }
+    return true;
+#else
+    LOG(ERR) << "SO_REUSEPORT is only supported on Linux";
+    return false;
+#endif
+}
+
 bool LibuvSTransport::init_pipe() {
     server_pipe_ = std::make_unique<uv_pipe_t>();
     uv_pipe_init(uvloop(), server_pipe_.get(), 0); /*返回值永远是0*/
@@ -258,7 +297,7 @@ void LibuvSTransport::on_new_client(uv_stream_t* server, int status) {
         LOG(ERR) << "Accept pipe client failed: " << ret;
         return;
     }
-    conn->fd = that->latest_fd_++;
+    conn->fd = that->fd_base_ | (that->latest_fd_++ & that->fd_mask_);
     that->conns_[conn->fd] = conn;
     ret = uv_read_start(conn->handle, &LibuvSTransport::on_alloc_memory, &LibuvSTransport::on_read);
     if (ret != 0) {
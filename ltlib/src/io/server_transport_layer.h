@@ -52,6 +52,11 @@ public:
         std::string pipe_name;
         std::string bind_ip;
         uint16_t bind_port;
+        // 多个LibuvSTransport监听同一个端口，由内核分配连接，仅Linux TCP有效
+        bool reuse_port = false;
+        // 分配给连接的fd是fd_base | (递增序号 & fd_mask)，用来区分不同的LibuvSTransport
+        uint32_t fd_base = 0;
+        uint32_t fd_mask = 0xFFFFFFFF;
         std::function<void(uint32_t)> on_accepted;
         std::function<void(uint32_t)> on_closed;
         std::function<bool(uint32_t, const Buffer&)> on_read;
@@ -79,6 +84,7 @@ public:
 
 private:
     bool init_tcp();
+    bool open_reuse_port_socket();
     bool init_pipe();
     uv_loop_t* uvloop();
     uv_stream_t* server_handle();
@@ -90,11 +96,14 @@ private:
 
 private:
     uint32_t latest_fd_ = 0;
+    uint32_t fd_base_;
+    uint32_t fd_mask_;
     StreamType stype_;
     IOLoop* ioloop_;
     std::string pipe_name_;
     std::string bind_ip_;
     uint16_t bind_port_;
+    bool reuse_port_;
     uint16_t listen_port_;
     std::unique_ptr<uv_tcp_t> server_tcp_;
     std::unique_ptr<uv_pipe_t> server_pipe_;
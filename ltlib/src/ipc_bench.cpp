@@ -0,0 +1,180 @@
+// 视频帧跨进程传输基准: 共享内存环形缓冲区 vs pipe+protobuf.
+// 两条路径都在同一个进程的两个线程之间跑，数据路径和worker->service一致.
+// 生产者尽快地写，所以延迟里包含了排队时间.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <g3log/logworker.hpp>
+
+#include <ltlib/io/client.h>
+#include <ltlib/io/ioloop.h>
+#include <ltlib/io/server.h>
+#include <ltlib/logging.h>
+#include <ltlib/shared_memory_ring.h>
+#include <ltlib/system.h>
+#include <ltlib/times.h>
+#include <ltproto/client2worker/video_frame.pb.h>
+#include <ltproto/ltproto.h>
+
+namespace {
+
+constexpr uint32_t kFrameSize = 200 * 1024; // 100Mbps@60fps大概一帧200KB
+constexpr uint32_t kFrameCount = 5000;
+constexpr uint32_t kRingCapacity = 32 * 1024 * 1024;
+
+struct NullSink {
+    void receive(g3::LogMessageMover message) { (void)message; }
+};
+
+struct Result {
+    double seconds;
+    std::vector<int64_t> latencies_us;
+};
+
+void printResult(const char* name, Result& result) {
+    std::sort(result.latencies_us.begin(), result.latencies_us.end());
+    int64_t sum = 0;
+    for (auto latency : result.latencies_us) {
+        sum += latency;
+    }
+    size_t count = result.latencies_us.size();
+    double mbps = count * double(kFrameSize) * 8 / result.seconds / 1'000'000;
+    printf("%-6s frames:%zu throughput:%.0fMbps %.0ffps latency(us) avg:%lld p50:%lld p99:%lld\n",
+           name, count, mbps, count / result.seconds, static_cast<long long>(sum / count),
+           static_cast<long long>(result.latencies_us[count / 2]),
+           static_cast<long long>(result.latencies_us[count * 99 / 100]));
+}
+
+Result benchRing() {
+    auto consumer_ring = ltlib::SharedMemoryRing::create("lt_ipc_bench", kRingCapacity);
+    auto producer_ring = ltlib::SharedMemoryRing::open("lt_ipc_bench");
+    if (consumer_ring == nullptr || producer_ring == nullptr) {
+        printf("Create SharedMemoryRing failed\n");
+        exit(-1);
+    }
+    Result result;
+    result.latencies_us.reserve(kFrameCount);
+    auto start = ltlib::steady_now_us();
+    std::thread producer{[&producer_ring]() {
+        std::vector<uint8_t> frame(kFrameSize, 0x5A);
+        for (uint32_t i = 0; i < kFrameCount; i++) {
+            int64_t now = ltlib::steady_now_us();
+            std::span<const uint8_t> ts{reinterpret_cast<const uint8_t*>(&now), sizeof(now)};
+            while (!producer_ring->write({ts, {frame.data(), frame.size()}})) {
+                std::this_thread::yield();
+            }
+        }
+    }};
+    while (result.latencies_us.size() < kFrameCount) {
+        bool got = consumer_ring->read([&result](std::span<const uint8_t> record) {
+            int64_t sent;
+            memcpy(&sent, record.data(), sizeof(sent));
+            result.latencies_us.push_back(ltlib::steady_now_us() - sent);
+        });
+        if (!got) {
+            consumer_ring->waitForData(100);
+        }
+    }
+    result.seconds = (ltlib::steady_now_us() - start) / 1'000'000.0;
+    producer.join();
+    return result;
+}
+
+Result benchPipe() {
+    Result result;
+    result.latencies_us.reserve(kFrameCount);
+    std::promise<void> done;
+    int64_t start = 0;
+    std::string pipe_name = ltlib::getConfigPath(false) + "/lt_ipc_bench_pipe";
+
+    auto server_loop = ltlib::IOLoop::create();
+    auto client_loop = ltlib::IOLoop::create();
+    ltlib::Server::Params server_params{};
+    server_params.stype = ltlib::StreamType::Pipe;
+    server_params.ioloop = server_loop.get();
+    server_params.pipe_name = pipe_name;
+    server_params.on_accepted = [](uint32_t) {};
+    server_params.on_closed = [](uint32_t) {};
+    server_params.on_message = [&result, &done](uint32_t, uint32_t type,
+                                                const std::shared_ptr<google::protobuf::MessageLite>&
+                                                    _msg) {
+        if (type != ltproto::type::kVideoFrame) {
+            return;
+        }
+        auto msg = std::static_pointer_cast<ltproto::client2worker::VideoFrame>(_msg);
+        result.latencies_us.push_back(ltlib::steady_now_us() - msg->capture_timestamp_us());
+        if (result.latencies_us.size() == kFrameCount) {
+            done.set_value();
+        }
+    };
+    auto server = ltlib::Server::create(server_params);
+    if (server == nullptr) {
+        printf("Create pipe server failed\n");
+        exit(-1);
+    }
+
+    std::unique_ptr<ltlib::Client> client;
+    std::string frame(kFrameSize, 0x5A);
+    uint32_t sent = 0;
+    // 上一帧写完再写下一帧，和worker一样由编码线程投递到ioloop
+    std::function<void()> send_next = [&]() {
+        if (sent++ == kFrameCount) {
+            return;
+        }
+        auto msg = std::make_shared<ltproto::client2worker::VideoFrame>();
+        msg->set_frame(frame);
+        msg->set_capture_timestamp_us(ltlib::steady_now_us());
+        client->send(ltproto::id(msg), msg, [&]() { client_loop->post(send_next); });
+    };
+    ltlib::Client::Params client_params{};
+    client_params.stype = ltlib::StreamType::Pipe;
+    client_params.ioloop = client_loop.get();
+    client_params.pipe_name = pipe_name;
+    client_params.on_connected = [&]() {
+        start = ltlib::steady_now_us();
+        send_next();
+    };
+    client_params.on_closed = []() {};
+    client_params.on_reconnecting = []() {};
+    client_params.on_message = [](uint32_t, const std::shared_ptr<google::protobuf::MessageLite>&) {
+    };
+
+    std::thread server_thread{[&]() { server_loop->run([]() {}); }};
+    client_loop->post([&]() { client = ltlib::Client::create(client_params); });
+    std::thread client_thread{[&]() { client_loop->run([]() {}); }};
+    done.get_future().get();
+    result.seconds = (ltlib::steady_now_us() - start) / 1'000'000.0;
+    // IOLoop没有stop接口，直接让线程跟着进程退出
+    server_thread.detach();
+    client_thread.detach();
+    server.release();
+    client.release();
+    server_loop.release();
+    client_loop.release();
+    return result;
+}
+
+} // namespace
+
+int main() {
+    auto worker = g3::LogWorker::createLogWorker();
+    worker->addSink(std::make_unique<NullSink>(), &NullSink::receive);
+    g3::initializeLogging(worker.get());
+
+    auto ring = benchRing();
+    printResult("shm", ring);
+    auto pipe = benchPipe();
+    printResult("pipe", pipe);
+    fflush(stdout);
+    std::quick_exit(0);
+}
@@ -0,0 +1,70 @@
+// 日志开销基准: 被编译期过滤掉的日志、经g3log输出的日志、经二进制环形缓冲区输出的日志，每次调用多少ns.
+
+#include <cstdio>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <g3log/logworker.hpp>
+
+#include <ltlib/logging.h>
+
+namespace {
+
+constexpr int kIterations = 1'000'000;
+
+struct NullSink {
+    void receive(g3::LogMessageMover message) { (void)message; }
+};
+
+template <typename Func>
+double measureNs(Func&& func) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; i++) {
+        func(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / kIterations;
+}
+
+// bench_logging用LT_LOG_TARGET_MIN_LEVEL=1编译，DEBUG在编译期就被关掉了
+static_assert(!LT_LOG_ENABLED(DEBUG) && LT_LOG_ENABLED(INFO));
+
+double suppressedFast() {
+    return measureNs([](int i) { LOG_FAST(DEBUG) << "suppressed " << i; });
+}
+double suppressedBinary() {
+    return measureNs([](int i) { LOGB(DEBUG, "suppressed {}", i); });
+}
+
+double emittedG3log() {
+    return measureNs([](int i) { LOG(INFO) << "emitted " << i; });
+}
+
+double emittedBinary() {
+    // 环形缓冲区满了会丢日志，这里按批次写，给flush线程留时间
+    return measureNs([](int i) {
+        LOGB(INFO, "emitted {}", i);
+        if (i % 1024 == 1023) {
+            ltlib::BinaryLog::flush();
+        }
+    });
+}
+
+} // namespace
+
+int main() {
+    auto worker = g3::LogWorker::createLogWorker();
+    worker->addSink(std::make_unique<NullSink>(), &NullSink::receive);
+    g3::initializeLogging(worker.get());
+
+    printf("LOG_FAST suppressed at compile time: %.2f ns/call\n", suppressedFast());
+    printf("LOGB suppressed at compile time:     %.2f ns/call\n", suppressedBinary());
+    printf("LOG emitted through g3log:           %.2f ns/call\n", emittedG3log());
+    // flush()的耗时也算在里面，真实场景下格式化在后台线程
+    printf("LOGB emitted to binary ring:         %.2f ns/call (dropped %llu)\n", emittedBinary(),
+           static_cast<unsigned long long>(ltlib::BinaryLog::dropped()));
+    ltlib::BinaryLog::shutdown();
+    return 0;
+}
@@ -30,19 +30,27 @@
 
 #include <ltlib/reconnect_interval.h>
 
+#include <algorithm>
+
 namespace ltlib
 {
 
 void ReconnectInterval::reset()
 {
-    index_ = 0;
+    attempts_ = 0;
 }
 
 int64_t ReconnectInterval::next()
 {
-    auto interval = kIntervalsMS[index_];
-    index_ = std::min(index_ + 1, kIntervalsMS.size() - 1);
-    return interval;
+    // 0, 100, 200, 400 ... 60000
+    if (attempts_ == 0)
+    {
+        attempts_++;
+        return 0;
+    }
+    int64_t interval = kBaseIntervalMS << std::min<uint32_t>(attempts_ - 1, 20);
+    attempts_ = std::min<uint32_t>(attempts_ + 1, 32);
+    return std::min(interval, kMaxIntervalMS);
 }
 
 } // namespace ltlib
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include <gtest/gtest.h>
+#include <ltlib/reconnect_interval.h>
+
+TEST(ReconnectInterval, ImmediateThenExponentialBackoff) {
+    ltlib::ReconnectInterval intervals;
+    const int64_t expected[] = {0,    100,  200,   400,   800,   1600,  3200,
+                                6400, 12800, 25600, 51200, 60000, 60000};
+    for (int64_t ms : expected) {
+        EXPECT_EQ(intervals.next(), ms);
+    }
+}
+
+TEST(ReconnectInterval, StaysAtMaxInterval) {
+    ltlib::ReconnectInterval intervals;
+    // 次数计数有上限，不会溢出或者移位移出范围
+    for (int i = 0; i < 1000; i++) {
+        intervals.next();
+    }
+    EXPECT_EQ(intervals.next(), 60000);
+}
+
+TEST(ReconnectInterval, ResetStartsOver) {
+    ltlib::ReconnectInterval intervals;
+    for (int i = 0; i < 5; i++) {
+        intervals.next();
+    }
+    intervals.reset();
+    EXPECT_EQ(intervals.next(), 0);
+    EXPECT_EQ(intervals.next(), 100);
+}
@@ -0,0 +1,166 @@
+// ltlib::Server压测: 单ioloop vs 多ioloop分片(SO_REUSEPORT).
+// 多个客户端ioloop各自建立一批TCP连接，每个连接做固定轮数的ping-pong，服务端原样回复.
+// 输出建连速度(conns/s)和双向消息吞吐(msgs/s).
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <g3log/logworker.hpp>
+
+#include <ltlib/io/client.h>
+#include <ltlib/io/ioloop.h>
+#include <ltlib/io/server.h>
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+#include <ltproto/common/keep_alive.pb.h>
+#include <ltproto/ltproto.h>
+
+namespace {
+
+constexpr uint32_t kClientLoops = 4;
+constexpr uint32_t kConnectionsPerLoop = 32;
+constexpr uint32_t kRoundsPerConnection = 2000;
+
+struct NullSink {
+    void receive(g3::LogMessageMover message) { (void)message; }
+};
+
+struct Result {
+    double conns_per_sec;
+    double msgs_per_sec;
+};
+
+std::unique_ptr<ltlib::IOLoop> createLoop() {
+    auto loop = ltlib::IOLoop::create();
+    if (loop == nullptr) {
+        printf("Create IOLoop failed\n");
+        exit(-1);
+    }
+    return loop;
+}
+
+Result bench(uint32_t server_loops) {
+    constexpr uint32_t kConnections = kClientLoops * kConnectionsPerLoop;
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<ltlib::IOLoop>> loops;
+    for (uint32_t i = 0; i < server_loops + kClientLoops; i++) {
+        loops.push_back(createLoop());
+    }
+
+    ltlib::Server* server_ptr = nullptr;
+    ltlib::Server::Params server_params{};
+    server_params.stype = ltlib::StreamType::TCP;
+    server_params.ioloop = loops[0].get();
+    for (uint32_t i = 1; i < server_loops; i++) {
+        server_params.shard_ioloops.push_back(loops[i].get());
+    }
+    server_params.bind_ip = "127.0.0.1";
+    server_params.bind_port = 0;
+    server_params.on_accepted = [](uint32_t) {};
+    server_params.on_closed = [](uint32_t) {};
+    // 回调在连接所在的ioloop线程，直接在这里回复
+    server_params.on_message = [&server_ptr](uint32_t fd, uint32_t type,
+                                             const std::shared_ptr<google::protobuf::MessageLite>&
+                                                 msg) { server_ptr->send(fd, type, msg); };
+    auto server = ltlib::Server::create(server_params);
+    if (server == nullptr) {
+        printf("Create TCP server failed\n");
+        exit(-1);
+    }
+    server_ptr = server.get();
+
+    std::atomic<uint32_t> connected{0};
+    std::atomic<uint32_t> finished{0};
+    std::promise<void> all_connected;
+    std::promise<void> all_finished;
+    std::vector<std::unique_ptr<ltlib::Client>> clients(kConnections);
+    std::vector<uint32_t> rounds(kConnections, 0);
+    int64_t start = ltlib::steady_now_us();
+    int64_t connected_at = 0;
+    auto ping = [&clients](uint32_t index) {
+        auto msg = std::make_shared<ltproto::common::KeepAlive>();
+        clients[index]->send(ltproto::id(msg), msg);
+    };
+    for (uint32_t i = 0; i < kConnections; i++) {
+        ltlib::IOLoop* client_loop = loops[server_loops + i / kConnectionsPerLoop].get();
+        ltlib::Client::Params params{};
+        params.stype = ltlib::StreamType::TCP;
+        params.ioloop = client_loop;
+        params.host = "127.0.0.1";
+        params.port = server->port();
+        params.on_connected = [&, i]() {
+            if (++connected == kConnections) {
+                connected_at = ltlib::steady_now_us();
+                all_connected.set_value();
+            }
+            ping(i);
+        };
+        params.on_closed = []() {};
+        params.on_reconnecting = []() {};
+        params.on_message = [&, i](uint32_t,
+                                   const std::shared_ptr<google::protobuf::MessageLite>&) {
+            if (++rounds[i] < kRoundsPerConnection) {
+                ping(i);
+            }
+            else if (++finished == kConnections) {
+                all_finished.set_value();
+            }
+        };
+        // Client要在自己的ioloop线程创建
+        client_loop->post([&clients, i, params]() { clients[i] = ltlib::Client::create(params); });
+    }
+    for (auto& loop : loops) {
+        threads.emplace_back([loop = loop.get()]() { loop->run([]() {}); });
+    }
+    all_connected.get_future().get();
+    all_finished.get_future().get();
+    int64_t end = ltlib::steady_now_us();
+
+    Result result{};
+    result.conns_per_sec = kConnections * 1'000'000.0 / std::max<int64_t>(connected_at - start, 1);
+    // 一轮是一条请求加一条回复
+    result.msgs_per_sec = kConnections * kRoundsPerConnection * 2 * 1'000'000.0 /
+                          std::max<int64_t>(end - connected_at, 1);
+    // IOLoop没有stop接口，直接让线程跟着进程退出
+    for (auto& thread : threads) {
+        thread.detach();
+    }
+    for (auto& client : clients) {
+        client.release();
+    }
+    server.release();
+    for (auto& loop : loops) {
+        loop.release();
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto worker = g3::LogWorker::createLogWorker();
+    worker->addSink(std::make_unique<NullSink>(), &NullSink::receive);
+    g3::initializeLogging(worker.get());
+
+    uint32_t max_loops = std::max(2u, std::thread::hardware_concurrency() / 2);
+    if (argc > 1) {
+        max_loops = static_cast<uint32_t>(std::max(1, atoi(argv[1])));
+    }
+    printf("clients:%u rounds/conn:%u\n", kClientLoops * kConnectionsPerLoop,
+           kRoundsPerConnection);
+    for (uint32_t loops = 1; loops <= max_loops; loops *= 2) {
+        Result result = bench(loops);
+        printf("server ioloops:%-3u %10.0f conns/s %12.0f msgs/s\n", loops, result.conns_per_sec,
+               result.msgs_per_sec);
+    }
+    fflush(stdout);
+    std::quick_exit(0);
+}
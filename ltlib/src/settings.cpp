@@ -39,11 +39,11 @@
 #endif
 #include <ltlib/settings.h>
 
-#include <inttypes.h>
-
 #include <array>
 #include <filesystem>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 
 #include <sqlite3.h>
 #include <toml++/toml.h>
@@ -62,7 +62,6 @@ namespace ltlib {
 // 2. 将跨进程锁的实现交给9千万行测试代码的sqlite，而不是手搓玩具
 //*********************↓↓↓↓↓SettingsSqlite↓↓↓↓↓*******************************
 
-// TODO:
 static bool validateStr(const std::string& str) {
     if (str.empty()) {
         return false;
@@ -70,8 +69,8 @@ static bool validateStr(const std::string& str) {
     return true;
 }
 
-// 只是存储本地，手拼SQL不会爆炸吧？
-// 算了， TODO: 校验key和value
+// 所有SQL在init()里预编译一次，之后只做bind/step/reset，参数一律走bind，不再手拼SQL.
+// 读操作带一层按key缓存的整行数据，PRAGMA data_version变化(别的连接提交过修改)时整体作废.
 class SettingsSqlite : public Settings {
 public:
     SettingsSqlite(const std::string& path);
@@ -87,16 +86,69 @@ public:
     auto getUpdateTime(const std::string& key) -> std::optional<int64_t> override;
     auto getKeysStartWith(const std::string& prefix) -> std::vector<std::string> override;
     void deleteKey(const std::string& key) override;
+    void batch(const std::function<void()>& writes) override;
+
+private:
+    enum Statement : size_t {
+        kSelectRow,
+        kUpsertBool,
+        kUpsertInt,
+        kUpsertStr,
+        kSelectUpdateTime,
+        kSelectKeysWithPrefix,
+        kDeleteKey,
+        kDataVersion,
+        kBegin,
+        kCommit,
+        kStatementCount,
+    };
+    // 一行kv_settings在内存里的样子，found=false表示数据库里没有这个key
+    struct Row {
+        bool found = false;
+        std::optional<bool> bool_val;
+        std::optional<int64_t> int_val;
+        std::optional<std::string> str_val;
+    };
+    // 离开作用域时reset语句，下次可以直接重新bind
+    class StmtGuard {
+    public:
+        StmtGuard(sqlite3_stmt* stmt)
+            : stmt_{stmt} {}
+        ~StmtGuard() {
+            sqlite3_reset(stmt_);
+            sqlite3_clear_bindings(stmt_);
+        }
+        sqlite3_stmt* get() const { return stmt_; }
+
+    private:
+        sqlite3_stmt* stmt_;
+    };
+
+private:
+    const Row& loadRow(const std::string& key);
+    void invalidateCacheIfChanged();
+    bool step(Statement stmt, const std::string& key, const char* func);
+    template <typename Func> void updateCachedRow(const std::string& key, Func&& func);
 
 private:
     sqlite3* db_ = nullptr;
     std::string filepath_;
+    std::array<sqlite3_stmt*, kStatementCount> stmts_{};
+    // batch期间一直持有，里面的set/get会重入
+    std::recursive_mutex mutex_;
+    std::unordered_map<std::string, Row> cache_;
+    int64_t data_version_ = -1;
+    int batch_depth_ = 0;
 };
 
 SettingsSqlite::SettingsSqlite(const std::string& path)
     : filepath_{path} {}
 
 SettingsSqlite::~SettingsSqlite() {
+    for (sqlite3_stmt* stmt : stmts_) {
+        // 对nullptr调用是无害的
+        sqlite3_finalize(stmt);
+    }
     if (db_ != nullptr) {
         sqlite3_close(db_);
     }
@@ -121,11 +173,29 @@ BEGIN
     UPDATE kv_settings SET updated_at = CURRENT_TIMESTAMP WHERE id=OLD.id;
 END;
 )";
+    // 顺序与Statement一一对应
+    const std::array<const char*, kStatementCount> kStatementSQLs = {
+        "SELECT bool_val, int_val, str_val FROM kv_settings WHERE name = ?1;",
+        "INSERT INTO kv_settings (name, bool_val) VALUES (?1, ?2) "
+        "ON CONFLICT(name) DO UPDATE SET bool_val = excluded.bool_val;",
+        "INSERT INTO kv_settings (name, int_val) VALUES (?1, ?2) "
+        "ON CONFLICT(name) DO UPDATE SET int_val = excluded.int_val;",
+        "INSERT INTO kv_settings (name, str_val) VALUES (?1, ?2) "
+        "ON CONFLICT(name) DO UPDATE SET str_val = excluded.str_val;",
+        "SELECT strftime('%s', updated_at) FROM kv_settings WHERE name = ?1;",
+        "SELECT name FROM kv_settings WHERE name LIKE ?1 || '%';",
+        "DELETE FROM kv_settings WHERE name = ?1;",
+        "PRAGMA data_version;",
+        "BEGIN IMMEDIATE;",
+        "COMMIT;",
+    };
     int ret = sqlite3_open(filepath_.c_str(), &db_);
     if (ret != SQLITE_OK) {
         LOG(ERR) << "sqlite3_open failed with " << ret;
         return false;
     }
+    // 多个进程共用同一个数据库文件，写锁被别人拿着时等一会，而不是直接SQLITE_BUSY
+    sqlite3_busy_timeout(db_, 1000);
     char* errmsg = nullptr;
     ret = sqlite3_exec(db_, kCreateTableSQL, nullptr, nullptr, &errmsg);
     if (ret != SQLITE_OK) {
@@ -133,27 +203,95 @@ END;
         sqlite3_free(errmsg);
         return false;
     }
+    for (size_t i = 0; i < kStatementCount; i++) {
+        ret = sqlite3_prepare_v3(db_, kStatementSQLs[i], -1, SQLITE_PREPARE_PERSISTENT,
+                                 &stmts_[i], nullptr);
+        if (ret != SQLITE_OK) {
+            LOGF(ERR, "Prepare '%s' failed: %s", kStatementSQLs[i], sqlite3_errmsg(db_));
+            return false;
+        }
+    }
     return true;
 }
 
-void SettingsSqlite::setBoolean(const std::string& key, bool value) {
-    if (!validateStr(key)) {
+void SettingsSqlite::invalidateCacheIfChanged() {
+    // data_version只在"别的连接"提交修改后变化，自己的写入由updateCachedRow()维护
+    StmtGuard guard{stmts_[kDataVersion]};
+    if (sqlite3_step(guard.get()) != SQLITE_ROW) {
+        LOGF(ERR, "PRAGMA data_version failed: %s", sqlite3_errmsg(db_));
+        cache_.clear();
         return;
     }
-    const char sql[] = R"(INSERT OR IGNORE INTO kv_settings (name, bool_val) VALUES ('%s', %d);
-UPDATE kv_settings SET bool_val = %d WHERE name='%s';
-)";
-    std::array<char, 512> buff = {0};
-    if (key.size() * 2 + sizeof(sql) > buff.size()) {
-        LOG(ERR) << "setBoolean failed, key too long";
+    int64_t version = sqlite3_column_int64(guard.get(), 0);
+    if (version != data_version_) {
+        cache_.clear();
+        data_version_ = version;
+    }
+}
+
+const SettingsSqlite::Row& SettingsSqlite::loadRow(const std::string& key) {
+    invalidateCacheIfChanged();
+    auto iter = cache_.find(key);
+    if (iter != cache_.end()) {
+        return iter->second;
+    }
+    Row row;
+    StmtGuard guard{stmts_[kSelectRow]};
+    sqlite3_stmt* stmt = guard.get();
+    sqlite3_bind_text(stmt, 1, key.c_str(), static_cast<int>(key.size()), SQLITE_STATIC);
+    int ret = sqlite3_step(stmt);
+    if (ret == SQLITE_ROW) {
+        row.found = true;
+        if (sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+            row.bool_val = sqlite3_column_int(stmt, 0) != 0;
+        }
+        if (sqlite3_column_type(stmt, 1) != SQLITE_NULL) {
+            row.int_val = sqlite3_column_int64(stmt, 1);
+        }
+        if (sqlite3_column_type(stmt, 2) != SQLITE_NULL) {
+            auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+            row.str_val = std::string(text, sqlite3_column_bytes(stmt, 2));
+        }
+    }
+    else if (ret != SQLITE_DONE) {
+        LOGF(ERR, "SELECT '%s' failed: %s", key.c_str(), sqlite3_errmsg(db_));
+        // 查询失败不缓存，下次重试
+        static const Row kEmptyRow;
+        return kEmptyRow;
+    }
+    return cache_.emplace(key, std::move(row)).first->second;
+}
+
+bool SettingsSqlite::step(Statement stmt, const std::string& key, const char* func) {
+    int ret = sqlite3_step(stmts_[stmt]);
+    if (ret != SQLITE_DONE) {
+        LOGF(ERR, "%s '%s' failed: %s", func, key.c_str(), sqlite3_errmsg(db_));
+        // 写入结果未知，不能再相信缓存
+        cache_.erase(key);
+        return false;
+    }
+    return true;
+}
+
+template <typename Func> void SettingsSqlite::updateCachedRow(const std::string& key, Func&& func) {
+    // 缓存里没有的key不插入，因为不知道同一行其它列的值，等下次读的时候再加载
+    auto iter = cache_.find(key);
+    if (iter != cache_.end()) {
+        iter->second.found = true;
+        func(iter->second);
+    }
+}
+
+void SettingsSqlite::setBoolean(const std::string& key, bool value) {
+    if (!validateStr(key)) {
         return;
     }
-    snprintf(buff.data(), buff.size(), sql, key.c_str(), value ? 1 : 0, value ? 1 : 0, key.c_str());
-    char* errmsg = nullptr;
-    int ret = sqlite3_exec(db_, buff.data(), nullptr, nullptr, &errmsg);
-    if (ret != SQLITE_OK) {
-        LOGF(ERR, "setBoolean '%s' failed, sqlite3_exec: %s", key.c_str(), errmsg);
-        sqlite3_free(errmsg);
+    std::lock_guard lock{mutex_};
+    StmtGuard guard{stmts_[kUpsertBool]};
+    sqlite3_bind_text(guard.get(), 1, key.c_str(), static_cast<int>(key.size()), SQLITE_STATIC);
+    sqlite3_bind_int(guard.get(), 2, value ? 1 : 0);
+    if (step(kUpsertBool, key, "setBoolean")) {
+        updateCachedRow(key, [value](Row& row) { row.bool_val = value; });
     }
 }
 
@@ -161,52 +299,20 @@ auto SettingsSqlite::getBoolean(const std::string& key) -> std::optional<bool> {
     if (!validateStr(key)) {
         return std::nullopt;
     }
-    const char sql[] = R"(SELECT bool_val FROM kv_settings WHERE name='%s';)";
-    std::array<char, 128> buff = {0};
-    if (key.size() + sizeof(sql) > buff.size()) {
-        LOG(ERR) << "getBoolean failed, key too long";
-        return std::nullopt;
-    }
-    snprintf(buff.data(), buff.size(), sql, key.c_str());
-    char* errmsg = nullptr;
-    std::optional<bool> result;
-    int ret = sqlite3_exec(
-        db_, buff.data(),
-        [](void* op, int argc, char** argv, char**) -> int { // 回调返回值有什么用?
-            std::optional<bool>* result = reinterpret_cast<std::optional<bool>*>(op);
-            if (argc != 1 || argv[0] == nullptr) {
-                LOG(ERR) << "SELECT bool_val failed";
-                return 0;
-            }
-            int val = std::atoi(argv[0]);
-            (*result) = val != 0;
-            return 0;
-        },
-        &result, &errmsg);
-    if (ret != SQLITE_OK) {
-        LOGF(ERR, "getBoolean '%s' failed, sqlite3_exec: %s", key.c_str(), errmsg);
-        sqlite3_free(errmsg);
-    }
-    return result;
+    std::lock_guard lock{mutex_};
+    return loadRow(key).bool_val;
 }
 
 void SettingsSqlite::setInteger(const std::string& key, int64_t value) {
     if (!validateStr(key)) {
         return;
     }
-    const char sql[] = "INSERT OR IGNORE INTO kv_settings (name, int_val) VALUES ('%s', %" PRId64
-                       "); UPDATE kv_settings SET int_val = %" PRId64 " WHERE name = '%s';";
-    std::array<char, 512> buff = {0};
-    if (key.size() * 2 + sizeof(sql) > buff.size()) {
-        LOG(ERR) << "setInteger failed, key too long";
-        return;
-    }
-    snprintf(buff.data(), buff.size(), sql, key.c_str(), value, value, key.c_str());
-    char* errmsg = nullptr;
-    int ret = sqlite3_exec(db_, buff.data(), nullptr, nullptr, &errmsg);
-    if (ret != SQLITE_OK) {
-        LOGF(ERR, "setInteger '%s' failed, sqlite3_exec: %s", key.c_str(), errmsg);
-        sqlite3_free(errmsg);
+    std::lock_guard lock{mutex_};
+    StmtGuard guard{stmts_[kUpsertInt]};
+    sqlite3_bind_text(guard.get(), 1, key.c_str(), static_cast<int>(key.size()), SQLITE_STATIC);
+    sqlite3_bind_int64(guard.get(), 2, value);
+    if (step(kUpsertInt, key, "setInteger")) {
+        updateCachedRow(key, [value](Row& row) { row.int_val = value; });
     }
 }
 
@@ -214,57 +320,22 @@ auto SettingsSqlite::getInteger(const std::string& key) -> std::optional<int64_t
     if (!validateStr(key)) {
         return std::nullopt;
     }
-    const char sql[] = R"(SELECT int_val FROM kv_settings WHERE name='%s';)";
-    std::array<char, 128> buff = {0};
-    if (key.size() + sizeof(sql) > buff.size()) {
-        LOG(ERR) << "getInteger failed, key too long";
-        return std::nullopt;
-    }
-    snprintf(buff.data(), buff.size(), sql, key.c_str());
-    char* errmsg = nullptr;
-    std::optional<int64_t> result;
-    int ret = sqlite3_exec(
-        db_, buff.data(),
-        [](void* op, int argc, char** argv, char**) -> int { // 回调返回值有什么用?
-            std::optional<int64_t>* result = reinterpret_cast<std::optional<int64_t>*>(op);
-            if (argc != 1 || argv[0] == nullptr) {
-                LOG(ERR) << "SELECT int_val failed";
-                return 0;
-            }
-            int64_t val = std::atoll(argv[0]);
-            (*result) = val;
-            return 0;
-        },
-        &result, &errmsg);
-    if (ret != SQLITE_OK) {
-        LOGF(ERR, "getInteger '%s' failed, sqlite3_exec: %s", key.c_str(), errmsg);
-        sqlite3_free(errmsg);
-    }
-    return result;
+    std::lock_guard lock{mutex_};
+    return loadRow(key).int_val;
 }
 
 void SettingsSqlite::setString(const std::string& key, const std::string& value) {
     if (!validateStr(key)) {
         return;
     }
+    std::lock_guard lock{mutex_};
+    StmtGuard guard{stmts_[kUpsertStr]};
+    sqlite3_bind_text(guard.get(), 1, key.c_str(), static_cast<int>(key.size()), SQLITE_STATIC);
     // 允许空字符串
-    if (!value.empty() && !validateStr(value)) {
-        return;
-    }
-    const char sql[] = R"(INSERT OR IGNORE INTO kv_settings (name, str_val) VALUES ('%s', '%s');
-UPDATE kv_settings SET str_val='%s' WHERE name='%s';
-)";
-    std::array<char, 512> buff = {0};
-    if (key.size() * 2 + value.size() * 2 + sizeof(sql) > buff.size()) {
-        LOG(ERR) << "setString failed, key too long";
-        return;
-    }
-    snprintf(buff.data(), buff.size(), sql, key.c_str(), value.c_str(), value.c_str(), key.c_str());
-    char* errmsg = nullptr;
-    int ret = sqlite3_exec(db_, buff.data(), nullptr, nullptr, &errmsg);
-    if (ret != SQLITE_OK) {
-        LOGF(ERR, "setString '%s' failed, sqlite3_exec: %s", key.c_str(), errmsg);
-        sqlite3_free(errmsg);
+    sqlite3_bind_text(guard.get(), 2, value.c_str(), static_cast<int>(value.size()),
+                      SQLITE_STATIC);
+    if (step(kUpsertStr, key, "setString")) {
+        updateCachedRow(key, [&value](Row& row) { row.str_val = value; });
     }
 }
 
@@ -272,96 +343,45 @@ auto SettingsSqlite::getString(const std::string& key) -> std::optional<std::str
     if (!validateStr(key)) {
         return std::nullopt;
     }
-    const char sql[] = R"(SELECT str_val FROM kv_settings WHERE name='%s';)";
-    std::array<char, 128> buff = {0};
-    if (key.size() + sizeof(sql) > buff.size()) {
-        LOG(ERR) << "getString failed, key too long";
-        return std::nullopt;
-    }
-    snprintf(buff.data(), buff.size(), sql, key.c_str());
-    char* errmsg = nullptr;
-    std::optional<std::string> result;
-    int ret = sqlite3_exec(
-        db_, buff.data(),
-        [](void* op, int argc, char** argv, char**) -> int { // 回调返回值有什么用?
-            std::optional<std::string>* result = reinterpret_cast<std::optional<std::string>*>(op);
-            if (argc != 1 || argv[0] == nullptr) {
-                LOG(ERR) << "SELECT str_val failed";
-                return 0;
-            }
-            std::string val = argv[0];
-            (*result) = val;
-            return 0;
-        },
-        &result, &errmsg);
-    if (ret != SQLITE_OK) {
-        LOGF(ERR, "getString '%s' failed, sqlite3_exec: %s", key.c_str(), errmsg);
-        sqlite3_free(errmsg);
-    }
-    return result;
+    std::lock_guard lock{mutex_};
+    return loadRow(key).str_val;
 }
 
 auto SettingsSqlite::getUpdateTime(const std::string& key) -> std::optional<int64_t> {
     if (!validateStr(key)) {
         return std::nullopt;
     }
-    const char sql[] = "SELECT strftime('%%s', updated_at) FROM kv_settings WHERE name = '%s';";
-    std::array<char, 128> buff = {0};
-    if (key.size() + sizeof(sql) > buff.size()) {
-        LOG(ERR) << "getString failed, key too long";
-        return std::nullopt;
+    std::lock_guard lock{mutex_};
+    StmtGuard guard{stmts_[kSelectUpdateTime]};
+    sqlite3_bind_text(guard.get(), 1, key.c_str(), static_cast<int>(key.size()), SQLITE_STATIC);
+    int ret = sqlite3_step(guard.get());
+    if (ret == SQLITE_ROW && sqlite3_column_type(guard.get(), 0) != SQLITE_NULL) {
+        return sqlite3_column_int64(guard.get(), 0);
     }
-    snprintf(buff.data(), buff.size(), sql, key.c_str());
-    char* errmsg = nullptr;
-    std::optional<int64_t> result;
-    int ret = sqlite3_exec(
-        db_, buff.data(),
-        [](void* op, int argc, char** argv, char**) -> int {
-            std::optional<int64_t>* result = reinterpret_cast<std::optional<int64_t>*>(op);
-            if (argc != 1 || argv[0] == nullptr) {
-                LOG(ERR) << "SELECT updated_at failed";
-                return 0;
-            }
-            int64_t val = std::atoll(argv[0]);
-            (*result) = val;
-            return 0;
-        },
-        &result, &errmsg);
-    if (ret != SQLITE_OK) {
-        LOGF(ERR, "getUpdateTime '%s' failed, sqlite3_exec: %s", key.c_str(), errmsg);
-        sqlite3_free(errmsg);
+    if (ret != SQLITE_DONE && ret != SQLITE_ROW) {
+        LOGF(ERR, "getUpdateTime '%s' failed: %s", key.c_str(), sqlite3_errmsg(db_));
     }
-    return result;
+    return std::nullopt;
 }
 
 auto SettingsSqlite::getKeysStartWith(const std::string& prefix) -> std::vector<std::string> {
     if (!validateStr(prefix)) {
         return {};
     }
-    const char sql[] = "SELECT name FROM kv_settings WHERE name LIKE '%s%%';";
-    std::array<char, 128> buff = {0};
-    if (prefix.size() + sizeof(sql) > buff.size()) {
-        LOG(ERR) << "getKeysStartWith failed, prefix too long";
-        return {};
-    }
-    snprintf(buff.data(), buff.size(), sql, prefix.c_str());
+    std::lock_guard lock{mutex_};
+    StmtGuard guard{stmts_[kSelectKeysWithPrefix]};
+    sqlite3_bind_text(guard.get(), 1, prefix.c_str(), static_cast<int>(prefix.size()),
+                      SQLITE_STATIC);
     std::vector<std::string> keys;
-    char* errmsg = nullptr;
-    int ret = sqlite3_exec(
-        db_, buff.data(),
-        [](void* op, int argc, char** argv, char**) -> int {
-            auto result = reinterpret_cast<std::vector<std::string>*>(op);
-            for (int i = 0; i < argc; i++) {
-                if (argv[i]) {
-                    result->push_back(argv[i]);
-                }
-            }
-            return 0;
-        },
-        &keys, &errmsg);
-    if (ret != SQLITE_OK) {
-        LOGF(ERR, "getKeysStartWith '%s' failed, sqlite3_exec: %s", prefix.c_str(), errmsg);
-        sqlite3_free(errmsg);
+    int ret = SQLITE_ROW;
+    while ((ret = sqlite3_step(guard.get())) == SQLITE_ROW) {
+        auto name = reinterpret_cast<const char*>(sqlite3_column_text(guard.get(), 0));
+        if (name != nullptr) {
+            keys.push_back(name);
+        }
+    }
+    if (ret != SQLITE_DONE) {
+        LOGF(ERR, "getKeysStartWith '%s' failed: %s", prefix.c_str(), sqlite3_errmsg(db_));
     }
     return keys;
 }
@@ -370,19 +390,32 @@ void SettingsSqlite::deleteKey(const std::string& key) {
     if (!validateStr(key)) {
         return;
     }
-    const char sql[] = "DELETE FROM kv_settings WHERE name = '%s';";
-    std::array<char, 128> buff = {0};
-    if (key.size() + sizeof(sql) > buff.size()) {
-        LOG(ERR) << "deleteKey failed, key too long";
-        return;
+    std::lock_guard lock{mutex_};
+    StmtGuard guard{stmts_[kDeleteKey]};
+    sqlite3_bind_text(guard.get(), 1, key.c_str(), static_cast<int>(key.size()), SQLITE_STATIC);
+    if (step(kDeleteKey, key, "deleteKey")) {
+        cache_[key] = Row{};
     }
-    snprintf(buff.data(), buff.size(), sql, key.c_str());
-    char* errmsg = nullptr;
-    int ret = sqlite3_exec(
-        db_, buff.data(), [](void*, int, char**, char**) -> int { return 0; }, nullptr, &errmsg);
-    if (ret != SQLITE_OK) {
-        LOGF(ERR, "deleteKey '%s' failed, sqlite3_exec: %s", key.c_str(), errmsg);
-        sqlite3_free(errmsg);
+}
+
+void SettingsSqlite::batch(const std::function<void()>& writes) {
+    // 嵌套的batch直接并入最外层的事务.
+    // 整个batch期间持有mutex_，别的线程的读写要等事务提交，不会混进这个事务
+    std::lock_guard lock{mutex_};
+    bool outermost = false;
+    if (batch_depth_++ == 0) {
+        StmtGuard guard{stmts_[kBegin]};
+        outermost = step(kBegin, "", "BEGIN");
+    }
+    writes();
+    batch_depth_--;
+    if (outermost) {
+        StmtGuard guard{stmts_[kCommit]};
+        if (!step(kCommit, "", "COMMIT")) {
+            // COMMIT失败时事务可能已被回滚，缓存里的值不再可信
+            sqlite3_exec(db_, "ROLLBACK;", nullptr, nullptr, nullptr);
+            cache_.clear();
+        }
     }
 }
 
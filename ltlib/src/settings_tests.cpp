@@ -1,6 +1,15 @@
+#include <cstdio>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <string>
+#include <thread>
+
 #include <gtest/gtest.h>
 #include <ltlib/settings.h>
 #include <ltlib/times.h>
+#include <sqlite3.h>
 
 static const char* DBName = "SettingsSqlite.db";
 
@@ -68,4 +77,121 @@ TEST_F(SettingsSqliteTest, UpdateTime) {
     auto updated_at = settings_->getUpdateTime("int_key");
     ASSERT_TRUE(updated_at.has_value());
     EXPECT_TRUE(updated_at.value() >= now - 1 && updated_at.value() <= now + 1);
+}
+
+TEST_F(SettingsSqliteTest, QuoteInKeyAndValue) {
+    settings_->setString("it's a key", "it's a 'value'");
+    EXPECT_EQ(settings_->getString("it's a key"), "it's a 'value'");
+    auto keys = settings_->getKeysStartWith("it's");
+    ASSERT_EQ(keys.size(), 1u);
+    EXPECT_EQ(keys[0], "it's a key");
+}
+
+TEST_F(SettingsSqliteTest, DeleteKey) {
+    settings_->setInteger("int_key", 1);
+    EXPECT_EQ(settings_->getInteger("int_key"), 1);
+    settings_->deleteKey("int_key");
+    EXPECT_EQ(settings_->getInteger("int_key"), std::nullopt);
+    settings_->setInteger("int_key", 2);
+    EXPECT_EQ(settings_->getInteger("int_key"), 2);
+}
+
+TEST_F(SettingsSqliteTest, CacheInvalidatedByOtherConnection) {
+    // 另一个连接相当于另一个进程
+    auto other = ltlib::Settings::createWithPathForTest(ltlib::Settings::Storage::Sqlite, DBName);
+    ASSERT_NE(other, nullptr);
+    settings_->setInteger("int_key", 1);
+    settings_->setBoolean("bool_key", true);
+    EXPECT_EQ(settings_->getInteger("int_key"), 1);
+    EXPECT_EQ(other->getInteger("int_key"), 1);
+
+    other->setInteger("int_key", 2);
+    other->deleteKey("bool_key");
+    EXPECT_EQ(settings_->getInteger("int_key"), 2);
+    EXPECT_EQ(settings_->getBoolean("bool_key"), std::nullopt);
+
+    other->batch([&other]() { other->setString("str_key", "batched"); });
+    EXPECT_EQ(settings_->getString("str_key"), "batched");
+}
+
+TEST_F(SettingsSqliteTest, Batch) {
+    settings_->batch([this]() {
+        settings_->setBoolean("bool_key", true);
+        settings_->setInteger("int_key", 1234);
+        settings_->batch([this]() { settings_->setString("str_key", "nested"); });
+        EXPECT_EQ(settings_->getInteger("int_key"), 1234);
+    });
+    EXPECT_EQ(settings_->getBoolean("bool_key"), true);
+    EXPECT_EQ(settings_->getInteger("int_key"), 1234);
+    EXPECT_EQ(settings_->getString("str_key"), "nested");
+}
+
+TEST_F(SettingsSqliteTest, BatchBlocksOtherThreads) {
+    std::thread writer;
+    settings_->batch([this, &writer]() {
+        settings_->setInteger("int_key", 1);
+        writer = std::thread([this]() { settings_->setInteger("int_key", 2); });
+        // 另一个线程的写入要等这个batch提交
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        EXPECT_EQ(settings_->getInteger("int_key"), 1);
+    });
+    writer.join();
+    EXPECT_EQ(settings_->getInteger("int_key"), 2);
+}
+
+// 不是正确性测试: 对比旧的"snprintf拼SQL+sqlite3_exec"写法与当前实现的吞吐，结果只打印不断言
+TEST_F(SettingsSqliteTest, Benchmark) {
+    constexpr int kWrites = 200;
+    constexpr int kReads = 20000;
+    auto opsPerSec = [](int count, int64_t start_us) {
+        int64_t elapsed = std::max<int64_t>(ltlib::steady_now_us() - start_us, 1);
+        return static_cast<double>(count) * 1000'000 / elapsed;
+    };
+
+    sqlite3* db = nullptr;
+    ASSERT_EQ(sqlite3_open(DBName, &db), SQLITE_OK);
+    std::array<char, 256> sql{};
+    int64_t start = ltlib::steady_now_us();
+    for (int i = 0; i < kWrites; i++) {
+        snprintf(sql.data(), sql.size(),
+                 "INSERT OR IGNORE INTO kv_settings (name, int_val) VALUES ('legacy_%d', %d);"
+                 "UPDATE kv_settings SET int_val = %d WHERE name = 'legacy_%d';",
+                 i, i, i, i);
+        sqlite3_exec(db, sql.data(), nullptr, nullptr, nullptr);
+    }
+    double legacy_write = opsPerSec(kWrites, start);
+    start = ltlib::steady_now_us();
+    for (int i = 0; i < kReads; i++) {
+        snprintf(sql.data(), sql.size(), "SELECT int_val FROM kv_settings WHERE name='legacy_%d';",
+                 i % kWrites);
+        sqlite3_exec(
+            db, sql.data(), [](void*, int, char**, char**) -> int { return 0; }, nullptr, nullptr);
+    }
+    double legacy_read = opsPerSec(kReads, start);
+    sqlite3_close(db);
+
+    start = ltlib::steady_now_us();
+    for (int i = 0; i < kWrites; i++) {
+        settings_->setInteger("prepared_" + std::to_string(i), i);
+    }
+    double prepared_write = opsPerSec(kWrites, start);
+    start = ltlib::steady_now_us();
+    settings_->batch([this]() {
+        for (int i = 0; i < kWrites; i++) {
+            settings_->setInteger("batched_" + std::to_string(i), i);
+        }
+    });
+    double batched_write = opsPerSec(kWrites, start);
+    start = ltlib::steady_now_us();
+    for (int i = 0; i < kReads; i++) {
+        settings_->getInteger("prepared_" + std::to_string(i % kWrites));
+    }
+    double cached_read = opsPerSec(kReads, start);
+
+    printf("legacy exec write:   %10.0f ops/s\n", legacy_write);
+    printf("prepared write:      %10.0f ops/s\n", prepared_write);
+    printf("batched write:       %10.0f ops/s\n", batched_write);
+    printf("legacy exec read:    %10.0f ops/s\n", legacy_read);
+    printf("cached read:         %10.0f ops/s\n", cached_read);
+    EXPECT_EQ(settings_->getInteger("batched_" + std::to_string(kWrites - 1)), kWrites - 1);
 }
\ No newline at end of file
@@ -0,0 +1,394 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ltlib/shared_memory_ring.h>
+
+#if defined(LT_WINDOWS)
+#include <Windows.h>
+#include <sddl.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // LT_WINDOWS
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+#include <ltlib/logging.h>
+#include <ltlib/strings.h>
+
+namespace {
+
+constexpr uint32_t kMagic = 0x4C545247; // LTRG
+constexpr uint32_t kWrapMarker = 0xFFFFFFFF;
+constexpr uint32_t kAlignment = 8;
+
+uint32_t alignUp(uint32_t size) {
+    return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+std::string platformName(const std::string& name, const char* suffix) {
+#if defined(LT_WINDOWS)
+    // service跑在session 0，worker跑在用户session，需要放在Global命名空间
+    return "Global\\" + name + suffix;
+#else
+    return "/" + name + suffix;
+#endif // LT_WINDOWS
+}
+
+#if defined(LT_WINDOWS)
+std::wstring currentUserSid() {
+    HANDLE token = NULL;
+    if (!::OpenProcessToken(::GetCurrentProcess(), TOKEN_QUERY, &token)) {
+        return {};
+    }
+    std::wstring result;
+    DWORD size = 0;
+    ::GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+    std::vector<uint8_t> buff(size);
+    if (size != 0 && ::GetTokenInformation(token, TokenUser, buff.data(), size, &size)) {
+        LPWSTR sid = nullptr;
+        if (::ConvertSidToStringSidW(reinterpret_cast<TOKEN_USER*>(buff.data())->User.Sid, &sid)) {
+            result = sid;
+            ::LocalFree(sid);
+        }
+    }
+    ::CloseHandle(token);
+    return result;
+}
+
+// 共享内存和Event放在Global命名空间，默认DACL取决于创建者的token，不可控.
+// 这里显式只允许SYSTEM和创建者自己的账户访问: service以SYSTEM运行，worker是用service的token
+// 复制出来、改了session id启动的，也是SYSTEM. 用户session里的普通进程打不开
+class RingSecurityAttributes {
+public:
+    RingSecurityAttributes() {
+        std::wstring user_sid = currentUserSid();
+        if (user_sid.empty()) {
+            return;
+        }
+        std::wstring sddl = L"D:P(A;;GA;;;SY)(A;;GA;;;" + user_sid + L")";
+        if (!::ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl.c_str(), SDDL_REVISION_1,
+                                                                  &sd_, nullptr)) {
+            sd_ = nullptr;
+            return;
+        }
+        sa_.nLength = sizeof(sa_);
+        sa_.lpSecurityDescriptor = sd_;
+        sa_.bInheritHandle = FALSE;
+    }
+    ~RingSecurityAttributes() {
+        if (sd_ != nullptr) {
+            ::LocalFree(sd_);
+        }
+    }
+    SECURITY_ATTRIBUTES* get() { return sd_ == nullptr ? nullptr : &sa_; }
+
+private:
+    PSECURITY_DESCRIPTOR sd_ = nullptr;
+    SECURITY_ATTRIBUTES sa_{};
+};
+#endif // LT_WINDOWS
+
+} // namespace
+
+namespace ltlib {
+
+struct SharedMemoryRing::Header {
+    uint32_t magic;
+    uint32_t capacity;
+    alignas(64) std::atomic<uint64_t> write_pos;
+    alignas(64) std::atomic<uint64_t> read_pos;
+};
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::create(const std::string& name,
+                                                           uint32_t capacity) {
+    if (capacity == 0 || capacity % kAlignment != 0) {
+        LOG(ERR) << "Invalid SharedMemoryRing capacity " << capacity;
+        return nullptr;
+    }
+    std::unique_ptr<SharedMemoryRing> ring{new SharedMemoryRing};
+    if (!ring->map(name, capacity, true)) {
+        return nullptr;
+    }
+    Header* header = ring->header();
+    ring->capacity_ = capacity;
+    header->capacity = capacity;
+    header->write_pos.store(0);
+    header->read_pos.store(0);
+    header->magic = kMagic;
+    return ring;
+}
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::open(const std::string& name) {
+    std::unique_ptr<SharedMemoryRing> ring{new SharedMemoryRing};
+    if (!ring->map(name, 0, false)) {
+        return nullptr;
+    }
+    if (ring->header()->magic != kMagic) {
+        LOG(ERR) << "SharedMemoryRing " << name << " not initialized";
+        return nullptr;
+    }
+    ring->capacity_ = ring->header()->capacity;
+    return ring;
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+    unmap();
+}
+
+bool SharedMemoryRing::write(std::initializer_list<std::span<const uint8_t>> parts) {
+    uint32_t payload_size = 0;
+    for (const auto& part : parts) {
+        payload_size += static_cast<uint32_t>(part.size());
+    }
+    Header* hdr = header();
+    const uint32_t capacity = capacity_;
+    const uint32_t record_size = alignUp(sizeof(uint32_t) + payload_size);
+    if (record_size > capacity / 2) {
+        LOG(WARNING) << "Record size " << payload_size << " too large for SharedMemoryRing";
+        return false;
+    }
+    uint64_t write_pos = hdr->write_pos.load(std::memory_order_relaxed);
+    uint64_t read_pos = hdr->read_pos.load(std::memory_order_acquire);
+    uint32_t offset = static_cast<uint32_t>(write_pos % capacity);
+    // 记录不跨越缓冲区末尾，剩余空间不够就写一个回绕标记，从头开始
+    uint32_t skip = capacity - offset < record_size ? capacity - offset : 0;
+    if (write_pos + skip + record_size - read_pos > capacity) {
+        return false;
+    }
+    if (skip != 0) {
+        memcpy(data() + offset, &kWrapMarker, sizeof(kWrapMarker));
+        write_pos += skip;
+        offset = 0;
+    }
+    uint8_t* dst = data() + offset;
+    memcpy(dst, &payload_size, sizeof(payload_size));
+    dst += sizeof(payload_size);
+    for (const auto& part : parts) {
+        memcpy(dst, part.data(), part.size());
+        dst += part.size();
+    }
+    hdr->write_pos.store(write_pos + record_size, std::memory_order_release);
+    doorbell_.notify();
+    return true;
+}
+
+bool SharedMemoryRing::read(const std::function<void(std::span<const uint8_t>)>& consumer) {
+    // 消费者的权限一般比生产者高(service vs worker)，共享内存里生产者能改的东西都不能信任:
+    // capacity和read_pos用自己保存的，write_pos和记录长度要先检查再用
+    Header* hdr = header();
+    const uint32_t capacity = capacity_;
+    uint64_t write_pos = hdr->write_pos.load(std::memory_order_acquire);
+    if (read_pos_ == write_pos) {
+        return false;
+    }
+    if (write_pos < read_pos_ || write_pos - read_pos_ > capacity) {
+        return reset(write_pos, "invalid write position");
+    }
+    uint64_t read_pos = read_pos_;
+    uint32_t offset = static_cast<uint32_t>(read_pos % capacity);
+    uint32_t payload_size;
+    memcpy(&payload_size, data() + offset, sizeof(payload_size));
+    if (payload_size == kWrapMarker) {
+        read_pos += capacity - offset;
+        offset = 0;
+        if (read_pos >= write_pos) {
+            return reset(write_pos, "invalid wrap marker");
+        }
+        memcpy(&payload_size, data() + offset, sizeof(payload_size));
+    }
+    if (payload_size > capacity - offset - sizeof(uint32_t)) {
+        return reset(write_pos, "invalid record size");
+    }
+    const uint64_t record_end = read_pos + alignUp(sizeof(uint32_t) + payload_size);
+    if (record_end > write_pos) {
+        return reset(write_pos, "record exceeds write position");
+    }
+    consumer(std::span<const uint8_t>{data() + offset + sizeof(payload_size), payload_size});
+    read_pos_ = record_end;
+    hdr->read_pos.store(read_pos_, std::memory_order_release);
+    return true;
+}
+
+bool SharedMemoryRing::hasData() {
+    return header()->write_pos.load(std::memory_order_acquire) != read_pos_;
+}
+
+bool SharedMemoryRing::reset(uint64_t write_pos, const char* reason) {
+    LOG(ERR) << "SharedMemoryRing " << name_ << " corrupted: " << reason << ", read_pos "
+             << read_pos_ << " write_pos " << write_pos << ", dropping unread data";
+    read_pos_ = write_pos;
+    header()->read_pos.store(read_pos_, std::memory_order_release);
+    return false;
+}
+
+Event::WaitResult SharedMemoryRing::waitForData(uint32_t ms) {
+    return doorbell_.waitFor(ms);
+}
+
+void SharedMemoryRing::wakeup() {
+    doorbell_.notify();
+}
+
+uint32_t SharedMemoryRing::capacity() const {
+    return capacity_;
+}
+
+SharedMemoryRing::Header* SharedMemoryRing::header() {
+    return reinterpret_cast<Header*>(address_);
+}
+
+uint8_t* SharedMemoryRing::data() {
+    return reinterpret_cast<uint8_t*>(address_) + sizeof(Header);
+}
+
+#if defined(LT_WINDOWS)
+
+bool SharedMemoryRing::map(const std::string& name, uint32_t capacity, bool is_creator) {
+    name_ = platformName(name, "_shm");
+    is_creator_ = is_creator;
+    std::wstring wname = utf8To16(name_);
+    HANDLE mapping = NULL;
+    RingSecurityAttributes sa;
+    if (is_creator) {
+        if (sa.get() == nullptr) {
+            LOG(ERR) << "Build security descriptor for " << name_ << " failed: " << ::GetLastError();
+            return false;
+        }
+        mapped_size_ = sizeof(Header) + capacity;
+        mapping = ::CreateFileMappingW(INVALID_HANDLE_VALUE, sa.get(), PAGE_READWRITE, 0,
+                                       static_cast<DWORD>(mapped_size_), wname.c_str());
+        if (mapping != NULL && ::GetLastError() == ERROR_ALREADY_EXISTS) {
+            LOG(ERR) << "SharedMemoryRing " << name_ << " already exists";
+            ::CloseHandle(mapping);
+            return false;
+        }
+    }
+    else {
+        mapping = ::OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, wname.c_str());
+    }
+    if (mapping == NULL) {
+        LOG(ERR) << "Create/Open file mapping " << name_ << " failed: " << ::GetLastError();
+        return false;
+    }
+    mapping_ = mapping;
+    address_ = ::MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (address_ == nullptr) {
+        LOG(ERR) << "MapViewOfFile " << name_ << " failed: " << ::GetLastError();
+        return false;
+    }
+    if (is_creator) {
+        doorbell_ = Event{platformName(name, "_doorbell"), sa.get()};
+        // 和共享内存一样，抢先创建的同名Event不是我们设置的DACL，不能用
+        if (doorbell_.getHandle() != nullptr && !doorbell_.isOwner()) {
+            LOG(ERR) << "SharedMemoryRing doorbell for " << name_ << " already exists";
+            return false;
+        }
+    }
+    else {
+        doorbell_ = Event{platformName(name, "_doorbell")};
+    }
+    return doorbell_.getHandle() != nullptr;
+}
+
+void SharedMemoryRing::unmap() {
+    if (address_ != nullptr) {
+        ::UnmapViewOfFile(address_);
+        address_ = nullptr;
+    }
+    if (mapping_ != nullptr) {
+        ::CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+}
+
+#else // LT_WINDOWS
+
+bool SharedMemoryRing::map(const std::string& name, uint32_t capacity, bool is_creator) {
+    name_ = platformName(name, "_shm");
+    int fd = -1;
+    if (is_creator) {
+        fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd >= 0) {
+            // 先标记为创建者，后面失败了也要unlink
+            is_creator_ = true;
+            mapped_size_ = sizeof(Header) + capacity;
+            if (ftruncate(fd, static_cast<off_t>(mapped_size_)) != 0) {
+                LOG(ERR) << "ftruncate " << name_ << " failed: " << errno;
+                ::close(fd);
+                return false;
+            }
+        }
+    }
+    else {
+        fd = shm_open(name_.c_str(), O_RDWR, 0600);
+        struct stat st {};
+        if (fd >= 0 && fstat(fd, &st) == 0) {
+            mapped_size_ = static_cast<size_t>(st.st_size);
+        }
+    }
+    if (fd < 0) {
+        LOG(ERR) << "shm_open " << name_ << " failed: " << errno;
+        return false;
+    }
+    if (mapped_size_ <= sizeof(Header)) {
+        LOG(ERR) << "SharedMemoryRing " << name_ << " has invalid size " << mapped_size_;
+        ::close(fd);
+        return false;
+    }
+    void* address = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        LOG(ERR) << "mmap " << name_ << " failed: " << errno;
+        return false;
+    }
+    address_ = address;
+    doorbell_ = Event{platformName(name, "_doorbell")};
+    return doorbell_.getHandle() != nullptr;
+}
+
+void SharedMemoryRing::unmap() {
+    if (address_ != nullptr) {
+        munmap(address_, mapped_size_);
+        address_ = nullptr;
+    }
+    if (is_creator_) {
+        shm_unlink(name_.c_str());
+        is_creator_ = false;
+    }
+}
+
+#endif // LT_WINDOWS
+
+} // namespace ltlib
@@ -0,0 +1,103 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ltlib/startup_tasks.h>
+
+#include <algorithm>
+#include <sstream>
+
+#include <ltlib/times.h>
+
+namespace ltlib {
+
+StartupTasks::StartupTasks(const std::string& name)
+    : name_{name}
+    , begin_us_{steady_now_us()} {}
+
+StartupTasks::~StartupTasks() {
+    wait();
+}
+
+void StartupTasks::run(const std::string& phase, const std::function<bool()>& task) {
+    threads_.emplace_back([this, phase, task]() { measure(phase, task); });
+}
+
+bool StartupTasks::measure(const std::string& phase, const std::function<bool()>& task) {
+    // 开始时就占位，嵌套的阶段排在外层后面
+    size_t index = 0;
+    {
+        std::lock_guard lock{mutex_};
+        index = phases_.size();
+        phases_.push_back(Phase{phase, steady_now_us(), 0, false});
+    }
+    const bool success = task();
+    std::lock_guard lock{mutex_};
+    phases_[index].end_us = steady_now_us();
+    phases_[index].success = success;
+    return success;
+}
+
+bool StartupTasks::wait() {
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+    std::lock_guard lock{mutex_};
+    return std::all_of(phases_.cbegin(), phases_.cend(),
+                       [](const Phase& phase) { return phase.success; });
+}
+
+std::string StartupTasks::report() const {
+    std::vector<Phase> phases;
+    {
+        std::lock_guard lock{mutex_};
+        phases = phases_;
+    }
+    std::stable_sort(phases.begin(), phases.end(),
+                     [](const Phase& a, const Phase& b) { return a.start_us < b.start_us; });
+    int64_t end_us = begin_us_;
+    bool success = true;
+    for (const auto& phase : phases) {
+        end_us = std::max(end_us, phase.end_us);
+        success = success && phase.success;
+    }
+    std::ostringstream oss;
+    oss << "startup(" << name_ << ") " << (end_us - begin_us_) / 1000 << "ms "
+        << (success ? "ok" : "failed");
+    for (const auto& phase : phases) {
+        oss << " | " << phase.name << " +" << (phase.start_us - begin_us_) / 1000 << "ms "
+            << (phase.end_us - phase.start_us) / 1000 << "ms " << (phase.success ? "ok" : "failed");
+    }
+    return oss.str();
+}
+
+} // namespace ltlib
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+#include <ltlib/startup_tasks.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+TEST(StartupTasks, RunsTasksConcurrently) {
+    using namespace std::chrono_literals;
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<int> done{0};
+    ltlib::StartupTasks startup{"test"};
+    for (int i = 0; i < 4; i++) {
+        startup.run("sleep" + std::to_string(i), [&done]() {
+            std::this_thread::sleep_for(100ms);
+            done++;
+            return true;
+        });
+    }
+    EXPECT_TRUE(startup.wait());
+    EXPECT_EQ(done.load(), 4);
+    // 串行要400ms
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 300ms);
+}
+
+TEST(StartupTasks, FailureIsReported) {
+    ltlib::StartupTasks startup{"test"};
+    startup.run("good", []() { return true; });
+    EXPECT_FALSE(startup.measure("bad", []() { return false; }));
+    EXPECT_FALSE(startup.wait());
+    std::string report = startup.report();
+    EXPECT_EQ(report.find("startup(test) "), 0u);
+    EXPECT_NE(report.find("failed"), std::string::npos);
+    EXPECT_NE(report.find("| good +"), std::string::npos);
+    EXPECT_NE(report.find("| bad +"), std::string::npos);
+}
+
+TEST(StartupTasks, MeasureInsideRunAddsNestedPhase) {
+    ltlib::StartupTasks startup{"test"};
+    startup.run("outer", [&startup]() {
+        return startup.measure("inner", []() { return true; });
+    });
+    EXPECT_TRUE(startup.wait());
+    std::string report = startup.report();
+    EXPECT_NE(report.find(" ok | "), std::string::npos);
+    // 按开始时间排序，外层先开始
+    EXPECT_LT(report.find("| outer"), report.find("| inner"));
+}
@@ -45,6 +45,7 @@
 
 #include <filesystem>
 #include <functional>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -160,6 +161,9 @@ std::string getProgramFullpath() {
 }
 
 std::string getConfigPath(bool is_service) {
+    // 启动时可能被多个线程同时调用(比如client读设置和创建管道)
+    static std::mutex mutex;
+    std::lock_guard lock{mutex};
     static std::string appdata_path;
     if (!appdata_path.empty()) {
         return appdata_path;
@@ -331,6 +335,8 @@ std::string getProgramPath() {
 
 std::string getConfigPath(bool is_service) {
     (void)is_service;
+    static std::mutex mutex;
+    std::lock_guard lock{mutex};
     static std::string config_path;
     if (!config_path.empty()) {
         return config_path;
@@ -0,0 +1,295 @@
+// 进程内的mbedtls服务端和客户端，通过内存管道握手. bench_tls_reconnect和test_tls_resumption共用.
+// 服务端证书是现生成的自签名证书，客户端配置和client_secure_layer.cpp里的TlsClientConfig一致.
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/ecp.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/error.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ssl_cache.h>
+#include <mbedtls/ssl_ticket.h>
+#include <mbedtls/x509_crt.h>
+
+namespace tls_loopback {
+
+constexpr const char* kHostname = "localhost";
+
+// 初始化阶段的失败没有恢复的必要，直接退出
+inline void check(int ret, const char* what) {
+    if (ret != 0) {
+        char err[256];
+        mbedtls_strerror(ret, err, sizeof(err));
+        printf("%s failed: -0x%04x %s\n", what, -ret, err);
+        exit(-1);
+    }
+}
+
+class Server {
+public:
+    Server() {
+        mbedtls_entropy_init(&entropy_);
+        mbedtls_ctr_drbg_init(&drbg_);
+        mbedtls_pk_init(&key_);
+        mbedtls_x509_crt_init(&cert_);
+        mbedtls_ssl_cache_init(&cache_);
+        mbedtls_ssl_ticket_init(&ticket_);
+        mbedtls_ssl_config_init(&cache_cfg_);
+        mbedtls_ssl_config_init(&ticket_cfg_);
+        mbedtls_ssl_config_init(&client_cfg_);
+        mbedtls_x509_crt_init(&client_ca_);
+    }
+    ~Server() {
+        mbedtls_x509_crt_free(&client_ca_);
+        mbedtls_ssl_config_free(&client_cfg_);
+        mbedtls_ssl_config_free(&ticket_cfg_);
+        mbedtls_ssl_config_free(&cache_cfg_);
+        mbedtls_ssl_ticket_free(&ticket_);
+        mbedtls_ssl_cache_free(&cache_);
+        mbedtls_x509_crt_free(&cert_);
+        mbedtls_pk_free(&key_);
+        mbedtls_ctr_drbg_free(&drbg_);
+        mbedtls_entropy_free(&entropy_);
+    }
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    void init() {
+        const char* pers = "tls_loopback";
+        check(mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_,
+                                    reinterpret_cast<const unsigned char*>(pers), strlen(pers)),
+              "mbedtls_ctr_drbg_seed");
+        createCert();
+        initServerConfig(cache_cfg_);
+        mbedtls_ssl_conf_session_cache(&cache_cfg_, this, &Server::cacheGet, &Server::cacheSet);
+        initServerConfig(ticket_cfg_);
+        check(mbedtls_ssl_ticket_setup(&ticket_, mbedtls_ctr_drbg_random, &drbg_,
+                                       MBEDTLS_CIPHER_AES_256_GCM, 86400),
+              "mbedtls_ssl_ticket_setup");
+        mbedtls_ssl_conf_session_tickets_cb(&ticket_cfg_, &Server::ticketWrite,
+                                            &Server::ticketParse, this);
+        initClientConfig(client_cfg_, client_ca_);
+    }
+
+    // 与client_secure_layer.cpp里TlsClientConfig的配置一致
+    void initClientConfig(mbedtls_ssl_config& cfg, mbedtls_x509_crt& ca) {
+        check(mbedtls_ssl_config_defaults(&cfg, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT),
+              "mbedtls_ssl_config_defaults(client)");
+        mbedtls_ssl_conf_renegotiation(&cfg, MBEDTLS_SSL_RENEGOTIATION_ENABLED);
+        mbedtls_ssl_conf_authmode(&cfg, MBEDTLS_SSL_VERIFY_REQUIRED);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        mbedtls_ssl_conf_session_tickets(&cfg, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+        mbedtls_ssl_conf_rng(&cfg, mbedtls_ctr_drbg_random, &drbg_);
+        check(mbedtls_x509_crt_parse(&ca,
+                                     reinterpret_cast<const unsigned char*>(cert_pem_.c_str()),
+                                     cert_pem_.size() + 1),
+              "mbedtls_x509_crt_parse(client)");
+        mbedtls_ssl_conf_ca_chain(&cfg, &ca, nullptr);
+    }
+
+    // 只开session cache，靠session id恢复
+    mbedtls_ssl_config& cacheConfig() { return cache_cfg_; }
+    // 只开session ticket
+    mbedtls_ssl_config& ticketConfig() { return ticket_cfg_; }
+    mbedtls_ssl_config& clientConfig() { return client_cfg_; }
+    // 自签名证书，同时也是客户端信任的CA，可以直接作为MbedtlsCTransport的cert参数
+    const std::string& certPem() const { return cert_pem_; }
+    // 服务端命中session cache或者解开ticket的次数，用来确认确实走了恢复流程
+    int cacheHits() const { return cache_hits_; }
+    int ticketHits() const { return ticket_hits_; }
+
+private:
+    static int cacheGet(void* ctx, const unsigned char* session_id, size_t session_id_len,
+                        mbedtls_ssl_session* session) {
+        auto that = reinterpret_cast<Server*>(ctx);
+        int ret = mbedtls_ssl_cache_get(&that->cache_, session_id, session_id_len, session);
+        if (ret == 0) {
+            that->cache_hits_++;
+        }
+        return ret;
+    }
+
+    static int cacheSet(void* ctx, const unsigned char* session_id, size_t session_id_len,
+                        const mbedtls_ssl_session* session) {
+        auto that = reinterpret_cast<Server*>(ctx);
+        return mbedtls_ssl_cache_set(&that->cache_, session_id, session_id_len, session);
+    }
+
+    static int ticketWrite(void* ctx, const mbedtls_ssl_session* session, unsigned char* start,
+                           const unsigned char* end, size_t* tlen, uint32_t* lifetime) {
+        auto that = reinterpret_cast<Server*>(ctx);
+        return mbedtls_ssl_ticket_write(&that->ticket_, session, start, end, tlen, lifetime);
+    }
+
+    static int ticketParse(void* ctx, mbedtls_ssl_session* session, unsigned char* buf,
+                           size_t len) {
+        auto that = reinterpret_cast<Server*>(ctx);
+        int ret = mbedtls_ssl_ticket_parse(&that->ticket_, session, buf, len);
+        if (ret == 0) {
+            that->ticket_hits_++;
+        }
+        return ret;
+    }
+
+    void createCert() {
+        check(mbedtls_pk_setup(&key_, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)),
+              "mbedtls_pk_setup");
+        check(mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(key_),
+                                  mbedtls_ctr_drbg_random, &drbg_),
+              "mbedtls_ecp_gen_key");
+        mbedtls_x509write_cert writer;
+        mbedtls_mpi serial;
+        mbedtls_x509write_crt_init(&writer);
+        mbedtls_mpi_init(&serial);
+        check(mbedtls_mpi_lset(&serial, 1), "mbedtls_mpi_lset");
+        mbedtls_x509write_crt_set_version(&writer, MBEDTLS_X509_CRT_VERSION_3);
+        mbedtls_x509write_crt_set_md_alg(&writer, MBEDTLS_MD_SHA256);
+        mbedtls_x509write_crt_set_subject_key(&writer, &key_);
+        mbedtls_x509write_crt_set_issuer_key(&writer, &key_);
+        check(mbedtls_x509write_crt_set_subject_name(&writer, "CN=localhost"),
+              "mbedtls_x509write_crt_set_subject_name");
+        check(mbedtls_x509write_crt_set_issuer_name(&writer, "CN=localhost"),
+              "mbedtls_x509write_crt_set_issuer_name");
+        check(mbedtls_x509write_crt_set_serial(&writer, &serial),
+              "mbedtls_x509write_crt_set_serial");
+        check(mbedtls_x509write_crt_set_validity(&writer, "20230101000000", "20991231235959"),
+              "mbedtls_x509write_crt_set_validity");
+        check(mbedtls_x509write_crt_set_basic_constraints(&writer, 1, -1),
+              "mbedtls_x509write_crt_set_basic_constraints");
+        std::vector<unsigned char> pem(4096);
+        check(mbedtls_x509write_crt_pem(&writer, pem.data(), pem.size(), mbedtls_ctr_drbg_random,
+                                        &drbg_),
+              "mbedtls_x509write_crt_pem");
+        cert_pem_ = reinterpret_cast<const char*>(pem.data());
+        mbedtls_mpi_free(&serial);
+        mbedtls_x509write_crt_free(&writer);
+        check(mbedtls_x509_crt_parse(&cert_,
+                                     reinterpret_cast<const unsigned char*>(cert_pem_.c_str()),
+                                     cert_pem_.size() + 1),
+              "mbedtls_x509_crt_parse(server)");
+    }
+
+    void initServerConfig(mbedtls_ssl_config& cfg) {
+        check(mbedtls_ssl_config_defaults(&cfg, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT),
+              "mbedtls_ssl_config_defaults(server)");
+        mbedtls_ssl_conf_rng(&cfg, mbedtls_ctr_drbg_random, &drbg_);
+        check(mbedtls_ssl_conf_own_cert(&cfg, &cert_, &key_), "mbedtls_ssl_conf_own_cert");
+    }
+
+private:
+    mbedtls_entropy_context entropy_;
+    mbedtls_ctr_drbg_context drbg_;
+    mbedtls_pk_context key_;
+    mbedtls_x509_crt cert_;
+    std::string cert_pem_;
+    mbedtls_ssl_cache_context cache_;
+    mbedtls_ssl_ticket_context ticket_;
+    mbedtls_ssl_config cache_cfg_;
+    mbedtls_ssl_config ticket_cfg_;
+    mbedtls_ssl_config client_cfg_;
+    mbedtls_x509_crt client_ca_;
+    int cache_hits_ = 0;
+    int ticket_hits_ = 0;
+};
+
+// 一对通过内存管道相连的ssl_context，reset()后可以反复握手，相当于断线重连
+class Connection {
+public:
+    Connection(mbedtls_ssl_config& client_cfg, mbedtls_ssl_config& server_cfg)
+        : client_peer_{&to_client_, &to_server_}
+        , server_peer_{&to_server_, &to_client_} {
+        mbedtls_ssl_init(&client_);
+        mbedtls_ssl_init(&server_);
+        check(mbedtls_ssl_setup(&client_, &client_cfg), "mbedtls_ssl_setup(client)");
+        check(mbedtls_ssl_setup(&server_, &server_cfg), "mbedtls_ssl_setup(server)");
+        check(mbedtls_ssl_set_hostname(&client_, kHostname), "mbedtls_ssl_set_hostname");
+        mbedtls_ssl_set_bio(&client_, &client_peer_, &Connection::send, &Connection::recv,
+                            nullptr);
+        mbedtls_ssl_set_bio(&server_, &server_peer_, &Connection::send, &Connection::recv,
+                            nullptr);
+    }
+    ~Connection() {
+        mbedtls_ssl_free(&server_);
+        mbedtls_ssl_free(&client_);
+    }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    void reset() {
+        check(mbedtls_ssl_session_reset(&client_), "mbedtls_ssl_session_reset(client)");
+        check(mbedtls_ssl_session_reset(&server_), "mbedtls_ssl_session_reset(server)");
+        to_client_.clear();
+        to_server_.clear();
+    }
+
+    // 两端交替推进，直到都完成. 返回客户端最后一次的错误码
+    int handshake() {
+        bool client_done = false;
+        bool server_done = false;
+        for (int round = 0; !client_done || !server_done; round++) {
+            if (round > 100) {
+                return MBEDTLS_ERR_SSL_TIMEOUT;
+            }
+            int ret = mbedtls_ssl_handshake(&client_);
+            if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                return ret;
+            }
+            client_done = ret == 0;
+            ret = mbedtls_ssl_handshake(&server_);
+            if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                return ret;
+            }
+            server_done = ret == 0;
+        }
+        return 0;
+    }
+
+    mbedtls_ssl_context& client() { return client_; }
+
+private:
+    struct Peer {
+        std::deque<uint8_t>* in;
+        std::deque<uint8_t>* out;
+    };
+
+    static int send(void* ctx, const unsigned char* buf, size_t len) {
+        auto peer = reinterpret_cast<Peer*>(ctx);
+        peer->out->insert(peer->out->end(), buf, buf + len);
+        return static_cast<int>(len);
+    }
+
+    static int recv(void* ctx, unsigned char* buf, size_t len) {
+        auto peer = reinterpret_cast<Peer*>(ctx);
+        if (peer->in->empty()) {
+            return MBEDTLS_ERR_SSL_WANT_READ;
+        }
+        size_t n = std::min(len, peer->in->size());
+        std::copy_n(peer->in->begin(), n, buf);
+        peer->in->erase(peer->in->begin(), peer->in->begin() + n);
+        return static_cast<int>(n);
+    }
+
+private:
+    std::deque<uint8_t> to_server_;
+    std::deque<uint8_t> to_client_;
+    Peer client_peer_;
+    Peer server_peer_;
+    mbedtls_ssl_context client_;
+    mbedtls_ssl_context server_;
+};
+
+} // namespace tls_loopback
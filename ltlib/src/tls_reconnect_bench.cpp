@@ -0,0 +1,72 @@
+// MbedtlsCTransport重连耗时基准.
+// 进程内生成自签名证书，起一个mbedtls服务端，客户端用和MbedtlsCTransport相同的配置，通过内存管道握手，
+// 分别统计: 每次重新解析证书/初始化配置的开销、完整握手、session id恢复、session ticket恢复.
+//   bench_tls_reconnect [iterations]
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+
+#include <ltlib/times.h>
+
+#include "tls_loopback.h"
+
+namespace {
+
+using tls_loopback::check;
+
+// 改动前每个MbedtlsCTransport都要做一遍的事情
+double clientSetupUS(tls_loopback::Server& server, int iterations) {
+    int64_t start = ltlib::steady_now_us();
+    for (int i = 0; i < iterations; i++) {
+        mbedtls_ssl_config cfg;
+        mbedtls_x509_crt ca;
+        mbedtls_ssl_config_init(&cfg);
+        mbedtls_x509_crt_init(&ca);
+        server.initClientConfig(cfg, ca);
+        mbedtls_x509_crt_free(&ca);
+        mbedtls_ssl_config_free(&cfg);
+    }
+    return (ltlib::steady_now_us() - start) / static_cast<double>(iterations);
+}
+
+double handshakeUS(tls_loopback::Server& server, mbedtls_ssl_config& server_cfg, bool resume,
+                   int iterations) {
+    tls_loopback::Connection conn{server.clientConfig(), server_cfg};
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (resume) {
+        // 先完整握手一次拿到session，相当于断线前的那次连接
+        check(conn.handshake(), "handshake");
+        check(mbedtls_ssl_get_session(&conn.client(), &session), "mbedtls_ssl_get_session");
+    }
+    int64_t start = ltlib::steady_now_us();
+    for (int i = 0; i < iterations; i++) {
+        conn.reset();
+        if (resume) {
+            check(mbedtls_ssl_set_session(&conn.client(), &session), "mbedtls_ssl_set_session");
+        }
+        check(conn.handshake(), "handshake");
+    }
+    double us = (ltlib::steady_now_us() - start) / static_cast<double>(iterations);
+    mbedtls_ssl_session_free(&session);
+    return us;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? std::max(1, atoi(argv[1])) : 200;
+    tls_loopback::Server server;
+    server.init();
+    printf("iterations:%d\n", iterations);
+    printf("client config + cert parse:  %10.1f us/conn\n", clientSetupUS(server, iterations));
+    printf("full handshake:              %10.1f us\n",
+           handshakeUS(server, server.cacheConfig(), false, iterations));
+    printf("resumed (session id):        %10.1f us (server cache hits %d)\n",
+           handshakeUS(server, server.cacheConfig(), true, iterations), server.cacheHits());
+    printf("resumed (session ticket):    %10.1f us (tickets accepted %d)\n",
+           handshakeUS(server, server.ticketConfig(), true, iterations), server.ticketHits());
+    return 0;
+}
@@ -0,0 +1,280 @@
+#include <gtest/gtest.h>
+
+#include "tls_loopback.h"
+
+#if LT_LINUX
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+
+#include <g3log/logworker.hpp>
+
+#include <ltlib/io/ioloop.h>
+#include <ltlib/times.h>
+
+#include "io/client_secure_layer.h"
+#endif // LT_LINUX
+
+namespace {
+
+#if LT_LINUX
+constexpr int kTimeoutMS = 5000;
+
+struct StdoutSink {
+    void receive(g3::LogMessageMover message) { printf("%s", message.get().toString().c_str()); }
+};
+
+int fdSend(void* ctx, const unsigned char* buf, size_t len) {
+    ssize_t ret = ::send(*reinterpret_cast<int*>(ctx), buf, len, MSG_NOSIGNAL);
+    return ret < 0 ? MBEDTLS_ERR_SSL_INTERNAL_ERROR : static_cast<int>(ret);
+}
+
+int fdRecv(void* ctx, unsigned char* buf, size_t len) {
+    ssize_t ret = ::recv(*reinterpret_cast<int*>(ctx), buf, len, 0);
+    return ret <= 0 ? MBEDTLS_ERR_SSL_CONN_EOF : static_cast<int>(ret);
+}
+
+// 跑在单独线程的阻塞式TLS服务端: 第一个连接握手完就直接断开，逼MbedtlsCTransport重连，
+// 第二个连接握手完一直保持到析构
+class TcpServer {
+public:
+    explicit TcpServer(mbedtls_ssl_config& cfg)
+        : cfg_{cfg} {
+        mbedtls_ssl_init(&ssl_);
+    }
+    ~TcpServer() {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        mbedtls_ssl_free(&ssl_);
+        if (conn_fd_ >= 0) {
+            ::close(conn_fd_);
+        }
+        if (listen_fd_ >= 0) {
+            ::close(listen_fd_);
+        }
+    }
+    TcpServer(const TcpServer&) = delete;
+    TcpServer& operator=(const TcpServer&) = delete;
+
+    bool listen() {
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+            ::listen(listen_fd_, 1) != 0 ||
+            ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+            return false;
+        }
+        port_ = ntohs(addr.sin_port);
+        return true;
+    }
+
+    // 线程结束时给出第二次握手的结果
+    std::future<int> run() {
+        auto future = result_.get_future();
+        thread_ = std::thread{[this]() { result_.set_value(serve()); }};
+        return future;
+    }
+
+    uint16_t port() const { return port_; }
+
+private:
+    int serve() {
+        int ret = mbedtls_ssl_setup(&ssl_, &cfg_);
+        for (int i = 0; ret == 0 && i < 2; i++) {
+            if (i != 0) {
+                // 不发close_notify，和网络断线一样
+                ::close(conn_fd_);
+                conn_fd_ = -1;
+                ret = mbedtls_ssl_session_reset(&ssl_);
+                if (ret != 0) {
+                    break;
+                }
+            }
+            pollfd pfd{listen_fd_, POLLIN, 0};
+            if (::poll(&pfd, 1, kTimeoutMS) != 1) {
+                return MBEDTLS_ERR_SSL_TIMEOUT;
+            }
+            conn_fd_ = ::accept(listen_fd_, nullptr, nullptr);
+            if (conn_fd_ < 0) {
+                return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+            }
+            timeval tv{kTimeoutMS / 1000, 0};
+            ::setsockopt(conn_fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            mbedtls_ssl_set_bio(&ssl_, &conn_fd_, fdSend, fdRecv, nullptr);
+            ret = mbedtls_ssl_handshake(&ssl_);
+        }
+        return ret;
+    }
+
+private:
+    mbedtls_ssl_config& cfg_;
+    mbedtls_ssl_context ssl_;
+    int listen_fd_ = -1;
+    int conn_fd_ = -1;
+    uint16_t port_ = 0;
+    std::thread thread_;
+    std::promise<int> result_;
+};
+#endif // LT_LINUX
+
+class TlsResumptionTest : public testing::Test {
+protected:
+    static void SetUpTestSuite() {
+#if LT_LINUX
+        log_worker_ = g3::LogWorker::createLogWorker().release();
+        log_worker_->addSink(std::make_unique<StdoutSink>(), &StdoutSink::receive);
+        g3::initializeLogging(log_worker_);
+#endif // LT_LINUX
+        server_ = new tls_loopback::Server;
+        server_->init();
+    }
+    static void TearDownTestSuite() {
+        delete server_;
+        server_ = nullptr;
+#if LT_LINUX
+        delete log_worker_;
+        log_worker_ = nullptr;
+#endif // LT_LINUX
+    }
+
+    // 完整握手一次拿到session，断线重连时带上它再握手一次
+    void reconnect(mbedtls_ssl_config& server_cfg, bool offer_session) {
+        tls_loopback::Connection conn{server_->clientConfig(), server_cfg};
+        ASSERT_EQ(conn.handshake(), 0);
+        mbedtls_ssl_session session;
+        mbedtls_ssl_session_init(&session);
+        ASSERT_EQ(mbedtls_ssl_get_session(&conn.client(), &session), 0);
+        conn.reset();
+        if (offer_session) {
+            ASSERT_EQ(mbedtls_ssl_set_session(&conn.client(), &session), 0);
+        }
+        EXPECT_EQ(conn.handshake(), 0);
+        mbedtls_ssl_session_free(&session);
+    }
+
+#if LT_LINUX
+    // 走MbedtlsCTransport+libuv的完整路径: 服务端断开后由传输层自己重连，返回从on_reconnecting
+    // 到第二次on_connected的耗时，失败返回-1
+    int64_t transportReconnect(mbedtls_ssl_config& server_cfg) {
+        TcpServer tcp{server_cfg};
+        if (!tcp.listen()) {
+            ADD_FAILURE() << "Listen failed";
+            return -1;
+        }
+        auto server_result = tcp.run();
+        // 下面几个只在ioloop线程里访问
+        std::unique_ptr<ltlib::MbedtlsCTransport> transport;
+        int connects = 0;
+        int64_t reconnecting_at_us = 0;
+        int64_t reconnect_us = -1;
+        std::promise<void> reconnected;
+
+        auto ioloop = ltlib::IOLoop::create();
+        ltlib::CTransport::Params params{};
+        params.stype = ltlib::StreamType::TCP;
+        params.ioloop = ioloop.get();
+        params.host = tls_loopback::kHostname;
+        params.port = tcp.port();
+        params.cert = server_->certPem();
+        params.on_connected = [&]() {
+            if (++connects == 2) {
+                reconnect_us = ltlib::steady_now_us() - reconnecting_at_us;
+                reconnected.set_value();
+            }
+            return true;
+        };
+        params.on_reconnecting = [&]() { reconnecting_at_us = ltlib::steady_now_us(); };
+        params.on_closed = []() {};
+        params.on_read = [](const ltlib::Buffer&) { return true; };
+        // transport要在ioloop线程里创建和析构
+        ioloop->post([&transport, params]() {
+            transport = std::make_unique<ltlib::MbedtlsCTransport>(params);
+            if (!transport->init()) {
+                transport.reset();
+            }
+        });
+        std::thread loop_thread{[&ioloop]() { ioloop->run([]() {}); }};
+
+        const bool success = reconnected.get_future().wait_for(
+                                 std::chrono::milliseconds{kTimeoutMS}) == std::future_status::ready;
+        EXPECT_TRUE(success) << "MbedtlsCTransport did not reconnect";
+        // 服务端线程最晚kTimeoutMS后也会退出
+        EXPECT_EQ(server_result.get(), 0);
+        std::promise<void> destroyed;
+        ioloop->post([&transport, &destroyed]() {
+            transport.reset();
+            destroyed.set_value();
+        });
+        destroyed.get_future().wait();
+        ioloop.reset();
+        loop_thread.join();
+        return success ? reconnect_us : -1;
+    }
+
+    static g3::LogWorker* log_worker_;
+#endif // LT_LINUX
+
+    static tls_loopback::Server* server_;
+};
+
+tls_loopback::Server* TlsResumptionTest::server_ = nullptr;
+#if LT_LINUX
+g3::LogWorker* TlsResumptionTest::log_worker_ = nullptr;
+#endif // LT_LINUX
+
+} // namespace
+
+TEST_F(TlsResumptionTest, ResumeWithSessionID) {
+    int hits = server_->cacheHits();
+    reconnect(server_->cacheConfig(), true);
+    EXPECT_EQ(server_->cacheHits(), hits + 1);
+}
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+TEST_F(TlsResumptionTest, ResumeWithSessionTicket) {
+    int hits = server_->ticketHits();
+    reconnect(server_->ticketConfig(), true);
+    EXPECT_EQ(server_->ticketHits(), hits + 1);
+}
+#endif // MBEDTLS_SSL_SESSION_TICKETS
+
+TEST_F(TlsResumptionTest, FullHandshakeWithoutSession) {
+    int cache_hits = server_->cacheHits();
+    int ticket_hits = server_->ticketHits();
+    reconnect(server_->cacheConfig(), false);
+    reconnect(server_->ticketConfig(), false);
+    EXPECT_EQ(server_->cacheHits(), cache_hits);
+    EXPECT_EQ(server_->ticketHits(), ticket_hits);
+}
+
+#if LT_LINUX
+// 服务端只开session cache，MbedtlsCTransport重连时带上的session id必须命中
+TEST_F(TlsResumptionTest, TransportReconnectResumesWithSessionID) {
+    int hits = server_->cacheHits();
+    int64_t us = transportReconnect(server_->cacheConfig());
+    EXPECT_GE(us, 0);
+    EXPECT_EQ(server_->cacheHits(), hits + 1);
+    printf("MbedtlsCTransport reconnect with session id: %lldus\n", static_cast<long long>(us));
+}
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+TEST_F(TlsResumptionTest, TransportReconnectResumesWithSessionTicket) {
+    int hits = server_->ticketHits();
+    int64_t us = transportReconnect(server_->ticketConfig());
+    EXPECT_GE(us, 0);
+    EXPECT_EQ(server_->ticketHits(), hits + 1);
+    printf("MbedtlsCTransport reconnect with session ticket: %lldus\n",
+           static_cast<long long>(us));
+}
+#endif // MBEDTLS_SSL_SESSION_TICKETS
+#endif // LT_LINUX
@@ -0,0 +1,323 @@
+// MbedtlsCTransport收发吞吐与每MB的CPU开销.
+// 进程内起一个阻塞式的mbedtls服务端线程(自签名证书，127.0.0.1)，客户端走完整的MbedtlsCTransport+libuv路径.
+//   发: 客户端连续发送kTotalBytes，每条消息和ClientImpl一样分成包头、payload两段
+//   收: 服务端连续写kTotalBytes，客户端解密后丢掉
+// CPU只统计客户端ioloop线程.
+//   bench_tls_transport [message_size]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <g3log/logworker.hpp>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/ecp.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+
+#include <ltlib/io/ioloop.h>
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+#include "io/client_secure_layer.h"
+
+namespace {
+
+constexpr size_t kTotalBytes = 256 * 1024 * 1024;
+// 客户端已提交但还没写完的数据上限，避免一次把所有数据都塞进uv
+constexpr size_t kMaxInflightBytes = 4 * 1024 * 1024;
+constexpr uint32_t kHeaderSize = 8;
+
+struct NullSink {
+    void receive(g3::LogMessageMover message) { (void)message; }
+};
+
+void check(int ret, const char* what) {
+    if (ret != 0) {
+        printf("%s failed: -0x%04x\n", what, -ret);
+        exit(-1);
+    }
+}
+
+int64_t threadCpuUS() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1'000'000LL + ts.tv_nsec / 1000;
+}
+
+int fdSend(void* ctx, const unsigned char* buf, size_t len) {
+    ssize_t ret = ::send(*reinterpret_cast<int*>(ctx), buf, len, MSG_NOSIGNAL);
+    return ret < 0 ? MBEDTLS_ERR_SSL_INTERNAL_ERROR : static_cast<int>(ret);
+}
+
+int fdRecv(void* ctx, unsigned char* buf, size_t len) {
+    ssize_t ret = ::recv(*reinterpret_cast<int*>(ctx), buf, len, 0);
+    return ret <= 0 ? MBEDTLS_ERR_SSL_CONN_EOF : static_cast<int>(ret);
+}
+
+// 阻塞式的TLS服务端: 先收kTotalBytes，再发kTotalBytes
+class Server {
+public:
+    Server() {
+        mbedtls_entropy_init(&entropy_);
+        mbedtls_ctr_drbg_init(&drbg_);
+        mbedtls_pk_init(&key_);
+        mbedtls_x509_crt_init(&cert_);
+        mbedtls_ssl_config_init(&cfg_);
+    }
+    ~Server() {
+        mbedtls_ssl_config_free(&cfg_);
+        mbedtls_x509_crt_free(&cert_);
+        mbedtls_pk_free(&key_);
+        mbedtls_ctr_drbg_free(&drbg_);
+        mbedtls_entropy_free(&entropy_);
+    }
+
+    void init() {
+        const char* pers = "bench_tls_transport";
+        check(mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_,
+                                    reinterpret_cast<const unsigned char*>(pers), strlen(pers)),
+              "mbedtls_ctr_drbg_seed");
+        createCert();
+        check(mbedtls_ssl_config_defaults(&cfg_, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT),
+              "mbedtls_ssl_config_defaults");
+        mbedtls_ssl_conf_rng(&cfg_, mbedtls_ctr_drbg_random, &drbg_);
+        check(mbedtls_ssl_conf_own_cert(&cfg_, &cert_, &key_), "mbedtls_ssl_conf_own_cert");
+
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd_, 1) != 0 ||
+            ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+            printf("Listen failed\n");
+            exit(-1);
+        }
+        port_ = ntohs(addr.sin_port);
+    }
+
+    void run() {
+        thread_ = std::thread{[this]() { serve(); }};
+    }
+
+    uint16_t port() const { return port_; }
+    const std::string& certPem() const { return cert_pem_; }
+    std::promise<void>& received() { return received_; }
+    int64_t sendStartUS() const { return send_start_us_; }
+
+private:
+    void createCert() {
+        check(mbedtls_pk_setup(&key_, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)),
+              "mbedtls_pk_setup");
+        check(mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(key_),
+                                  mbedtls_ctr_drbg_random, &drbg_),
+              "mbedtls_ecp_gen_key");
+        mbedtls_x509write_cert writer;
+        mbedtls_mpi serial;
+        mbedtls_x509write_crt_init(&writer);
+        mbedtls_mpi_init(&serial);
+        check(mbedtls_mpi_lset(&serial, 1), "mbedtls_mpi_lset");
+        mbedtls_x509write_crt_set_version(&writer, MBEDTLS_X509_CRT_VERSION_3);
+        mbedtls_x509write_crt_set_md_alg(&writer, MBEDTLS_MD_SHA256);
+        mbedtls_x509write_crt_set_subject_key(&writer, &key_);
+        mbedtls_x509write_crt_set_issuer_key(&writer, &key_);
+        check(mbedtls_x509write_crt_set_subject_name(&writer, "CN=127.0.0.1"),
+              "mbedtls_x509write_crt_set_subject_name");
+        check(mbedtls_x509write_crt_set_issuer_name(&writer, "CN=127.0.0.1"),
+              "mbedtls_x509write_crt_set_issuer_name");
+        check(mbedtls_x509write_crt_set_serial(&writer, &serial),
+              "mbedtls_x509write_crt_set_serial");
+        check(mbedtls_x509write_crt_set_validity(&writer, "20230101000000", "20991231235959"),
+              "mbedtls_x509write_crt_set_validity");
+        check(mbedtls_x509write_crt_set_basic_constraints(&writer, 1, -1),
+              "mbedtls_x509write_crt_set_basic_constraints");
+        std::vector<unsigned char> pem(4096);
+        check(mbedtls_x509write_crt_pem(&writer, pem.data(), pem.size(), mbedtls_ctr_drbg_random,
+                                        &drbg_),
+              "mbedtls_x509write_crt_pem");
+        cert_pem_ = reinterpret_cast<const char*>(pem.data());
+        mbedtls_mpi_free(&serial);
+        mbedtls_x509write_crt_free(&writer);
+        check(mbedtls_x509_crt_parse(&cert_,
+                                     reinterpret_cast<const unsigned char*>(cert_pem_.c_str()),
+                                     cert_pem_.size() + 1),
+              "mbedtls_x509_crt_parse");
+    }
+
+    void serve() {
+        int fd = ::accept(listen_fd_, nullptr, nullptr);
+        mbedtls_ssl_context ssl;
+        mbedtls_ssl_init(&ssl);
+        check(mbedtls_ssl_setup(&ssl, &cfg_), "mbedtls_ssl_setup");
+        mbedtls_ssl_set_bio(&ssl, &fd, fdSend, fdRecv, nullptr);
+        check(mbedtls_ssl_handshake(&ssl), "mbedtls_ssl_handshake");
+        std::vector<unsigned char> buffer(16 * 1024);
+        size_t received = 0;
+        while (received < kTotalBytes) {
+            int ret = mbedtls_ssl_read(&ssl, buffer.data(), buffer.size());
+            if (ret <= 0) {
+                printf("Server read failed: -0x%04x\n", -ret);
+                exit(-1);
+            }
+            received += ret;
+        }
+        received_.set_value();
+        send_start_us_ = ltlib::steady_now_us();
+        for (size_t sent = 0; sent < kTotalBytes;) {
+            int ret = mbedtls_ssl_write(&ssl, buffer.data(),
+                                        std::min(buffer.size(), kTotalBytes - sent));
+            if (ret <= 0) {
+                printf("Server write failed: -0x%04x\n", -ret);
+                exit(-1);
+            }
+            sent += ret;
+        }
+        // 连接跟着进程退出
+    }
+
+private:
+    mbedtls_entropy_context entropy_;
+    mbedtls_ctr_drbg_context drbg_;
+    mbedtls_pk_context key_;
+    mbedtls_x509_crt cert_;
+    mbedtls_ssl_config cfg_;
+    std::string cert_pem_;
+    int listen_fd_ = -1;
+    uint16_t port_ = 0;
+    std::thread thread_;
+    std::promise<void> received_;
+    std::atomic<int64_t> send_start_us_{0};
+};
+
+// 只在ioloop线程里访问
+struct Client {
+    std::unique_ptr<ltlib::MbedtlsCTransport> transport;
+    uint32_t message_size = 0;
+    std::vector<char> header;
+    std::vector<char> payload;
+    size_t submitted = 0;
+    size_t written = 0;
+    size_t received = 0;
+    int64_t connected_cpu_us = 0;
+    int64_t written_cpu_us = 0;
+    int64_t received_cpu_us = 0;
+    int64_t received_at_us = 0;
+    std::promise<void> all_written;
+    std::promise<void> all_received;
+
+    void pump() {
+        while (submitted < kTotalBytes && submitted - written < kMaxInflightBytes) {
+            ltlib::Buffer buff[2] = {{header.data(), kHeaderSize},
+                                     {payload.data(), message_size - kHeaderSize}};
+            if (!transport->send(buff, 2, [this]() { onWritten(); })) {
+                printf("Client send failed\n");
+                exit(-1);
+            }
+            submitted += message_size;
+        }
+    }
+
+    void onWritten() {
+        written += message_size;
+        if (written >= kTotalBytes) {
+            written_cpu_us = threadCpuUS();
+            all_written.set_value();
+            return;
+        }
+        pump();
+    }
+
+    bool onRead(const ltlib::Buffer& buff) {
+        received += buff.len;
+        if (received == kTotalBytes) {
+            received_cpu_us = threadCpuUS();
+            received_at_us = ltlib::steady_now_us();
+            all_received.set_value();
+        }
+        return true;
+    }
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto worker = g3::LogWorker::createLogWorker();
+    worker->addSink(std::make_unique<NullSink>(), &NullSink::receive);
+    g3::initializeLogging(worker.get());
+
+    Client client;
+    client.message_size = argc > 1 ? static_cast<uint32_t>(std::max(16, atoi(argv[1]))) : 256;
+    client.header.resize(kHeaderSize);
+    client.payload.resize(client.message_size - kHeaderSize, 'x');
+
+    Server server;
+    server.init();
+    server.run();
+
+    auto ioloop = ltlib::IOLoop::create();
+    ltlib::CTransport::Params params{};
+    params.stype = ltlib::StreamType::TCP;
+    params.ioloop = ioloop.get();
+    params.host = "127.0.0.1";
+    params.port = server.port();
+    params.cert = server.certPem();
+    params.on_connected = [&client]() {
+        client.connected_cpu_us = threadCpuUS();
+        client.pump();
+        return true;
+    };
+    params.on_closed = []() {
+        printf("Connection closed\n");
+        exit(-1);
+    };
+    params.on_reconnecting = []() {
+        printf("Connection lost\n");
+        exit(-1);
+    };
+    params.on_read = [&client](const ltlib::Buffer& buff) { return client.onRead(buff); };
+    // transport要在ioloop线程里创建
+    ioloop->post([&client, params]() {
+        client.transport = std::make_unique<ltlib::MbedtlsCTransport>(params);
+        if (!client.transport->init()) {
+            printf("Init MbedtlsCTransport failed\n");
+            exit(-1);
+        }
+    });
+    std::thread loop_thread{[&ioloop]() { ioloop->run([]() {}); }};
+
+    int64_t start = ltlib::steady_now_us();
+    client.all_written.get_future().get();
+    server.received().get_future().get();
+    int64_t send_us = ltlib::steady_now_us() - start;
+    client.all_received.get_future().get();
+    int64_t recv_us = client.received_at_us - server.sendStartUS();
+
+    constexpr double kMB = 1024.0 * 1024.0;
+    printf("message size:%u total:%.0fMB\n", client.message_size, kTotalBytes / kMB);
+    printf("send: %8.1f MB/s, client cpu %6.2f ms/MB\n", kTotalBytes / kMB / (send_us / 1e6),
+           (client.written_cpu_us - client.connected_cpu_us) / 1e3 / (kTotalBytes / kMB));
+    printf("recv: %8.1f MB/s, client cpu %6.2f ms/MB\n", kTotalBytes / kMB / (recv_us / 1e6),
+           (client.received_cpu_us - client.written_cpu_us) / 1e3 / (kTotalBytes / kMB));
+    fflush(stdout);
+    loop_thread.detach();
+    std::quick_exit(0);
+}
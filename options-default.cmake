@@ -14,6 +14,8 @@ set(LT_CRASH_ON_THREAD_HANGS ON)
 set(LT_ENABLE_TEST ON)
 set(LT_ENABLE_CODE_ANALYSIS ON)
 set(LT_ENABLE_SELF_CONNECT OFF)
+# 0:DEBUG 1:INFO 2:WARNING 3:ERROR, 低于这个级别的LOG_FAST/LOGB在编译期被删掉
+set(LT_LOG_MIN_LEVEL 0)
 set(LT_VERSION_MAJOR 0)
 set(LT_VERSION_MINOR 1)
 set(LT_VERSION_PATCH 8)
@@ -41,6 +41,8 @@ struct RTC2_API VideoFrame {
     const uint8_t* data;
     uint32_t size;
     bool is_keyframe;
+    uint32_t width;  // 传输精度uint16
+    uint32_t height; // 传输精度uint16
     uint64_t encode_timestamp_us; // 传输精度1ms
     uint64_t encode_duration_us;  // 传输精度150us
 };
@@ -0,0 +1,173 @@
+// rtc2中继服务器转发基准.
+// 进程内启动RelayServer，kPairs对客户端各自加入一个allocation，kSenders个线程用sendmmsg往中继狂发，
+// 统计服务器每秒转发的包数，以及平均到每个worker线程(每个核)的包数.
+//   bench_relay [threads]
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <g3log/logworker.hpp>
+
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+#include <modules/p2p/relay_protocol.h>
+
+#include "relay_server.h"
+
+namespace {
+
+constexpr uint32_t kPairs = 16;
+constexpr uint32_t kSenders = 2;
+constexpr uint32_t kPacketSize = 1200;
+constexpr uint32_t kBatch = 64;
+constexpr auto kDuration = std::chrono::seconds{3};
+
+struct NullSink {
+    void receive(g3::LogMessageMover message) { (void)message; }
+};
+
+int createSocket() {
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int buffer_size = 4 * 1024 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+    timeval timeout{1, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        printf("Create client socket failed\n");
+        exit(-1);
+    }
+    return fd;
+}
+
+void join(int fd, const sockaddr_in& relay, const std::string& allocation) {
+    rtc2::relay::JoinRequest req{};
+    req.tsx_id[0] = static_cast<uint8_t>(fd);
+    req.timestamp_ms = ltlib::utc_now_ms();
+    req.member_id[0] = static_cast<uint8_t>(fd);
+    req.allocation = allocation;
+    req.username = "bench";
+    auto request = rtc2::relay::encode_join_request(req, "bench");
+    ::sendto(fd, request.data(), request.size(), 0, reinterpret_cast<const sockaddr*>(&relay),
+             sizeof(relay));
+    uint8_t buffer[64];
+    ssize_t size = ::recv(fd, buffer, sizeof(buffer), 0);
+    auto response = size > 0 ? rtc2::relay::decode_join_response(buffer, size) : std::nullopt;
+    if (!response.has_value() || response->status != rtc2::relay::Status::Success) {
+        printf("Join relay failed\n");
+        exit(-1);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto worker = g3::LogWorker::createLogWorker();
+    worker->addSink(std::make_unique<NullSink>(), &NullSink::receive);
+    g3::initializeLogging(worker.get());
+
+    rtc2::relay::RelayServer::Params params{};
+    params.bind_ip = "127.0.0.1";
+    params.threads = argc > 1 ? static_cast<uint32_t>(std::max(1, atoi(argv[1]))) : 1;
+    params.users["bench"] = "bench";
+    // 测的是转发能力，不限速
+    params.rate_limit_kbps = 0;
+    auto server = rtc2::relay::RelayServer::create(params);
+    if (server == nullptr) {
+        printf("Create relay server failed\n");
+        return -1;
+    }
+    sockaddr_in relay{};
+    relay.sin_family = AF_INET;
+    relay.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    relay.sin_port = htons(server->port());
+
+    std::vector<int> senders;
+    std::vector<int> receivers;
+    for (uint32_t i = 0; i < kPairs; i++) {
+        senders.push_back(createSocket());
+        receivers.push_back(createSocket());
+        join(senders[i], relay, "bench_" + std::to_string(i));
+        join(receivers[i], relay, "bench_" + std::to_string(i));
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> received{0};
+    std::vector<std::thread> threads;
+    for (uint32_t s = 0; s < kSenders; s++) {
+        threads.emplace_back([&, s]() {
+            std::vector<uint8_t> payload(kPacketSize, 0x80);
+            std::vector<iovec> iovs(kBatch, iovec{payload.data(), kPacketSize});
+            std::vector<mmsghdr> msgs(kBatch);
+            for (uint32_t i = 0; i < kBatch; i++) {
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_name = &relay;
+                msgs[i].msg_hdr.msg_namelen = sizeof(relay);
+            }
+            for (uint32_t i = s; !stop; i = (i + kSenders) % kPairs) {
+                ::sendmmsg(senders[i], msgs.data(), kBatch, 0);
+            }
+        });
+    }
+    threads.emplace_back([&]() {
+        std::vector<uint8_t> buffer(kBatch * kPacketSize);
+        std::vector<iovec> iovs(kBatch);
+        std::vector<mmsghdr> msgs(kBatch);
+        for (uint32_t i = 0; i < kBatch; i++) {
+            iovs[i] = iovec{buffer.data() + i * kPacketSize, kPacketSize};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        while (!stop) {
+            for (int fd : receivers) {
+                int count = ::recvmmsg(fd, msgs.data(), kBatch, MSG_DONTWAIT, nullptr);
+                if (count > 0) {
+                    received += count;
+                }
+            }
+        }
+    });
+
+    auto before = server->stats();
+    int64_t start = ltlib::steady_now_us();
+    std::this_thread::sleep_for(kDuration);
+    auto after = server->stats();
+    int64_t end = ltlib::steady_now_us();
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    server->stop();
+
+    double seconds = (end - start) / 1e6;
+    double forwarded = static_cast<double>(after.forwarded_packets - before.forwarded_packets);
+    printf("relay threads:%u pairs:%u packet:%uB\n", params.threads, kPairs, kPacketSize);
+    printf("received by relay:%.0f pkts/s forwarded:%.0f pkts/s (%.0f pkts/s per core, %.1f "
+           "Mbps) delivered:%.0f pkts/s\n",
+           (after.received_packets - before.received_packets) / seconds, forwarded / seconds,
+           forwarded / seconds / params.threads, forwarded * kPacketSize * 8 / seconds / 1e6,
+           received.load() / seconds);
+    fflush(stdout);
+    for (size_t i = 0; i < senders.size(); i++) {
+        ::close(senders[i]);
+        ::close(receivers[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// 独立的中继服务器进程:
+//   rtc2-relay -ip 0.0.0.0 -port 3479 -threads 4 -user name1:pass1,name2:pass2 -rate_kbps 20000
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <g3log/logworker.hpp>
+
+#include <ltlib/logging.h>
+#include <ltlib/system.h>
+
+#include "relay_server.h"
+
+namespace {
+
+std::map<std::string, std::string> parseOptions(int argc, char* argv[]) {
+    std::vector<std::string> args;
+    std::map<std::string, std::string> options;
+    for (int i = 0; i < argc; i++) {
+        args.push_back(argv[i]);
+    }
+    for (size_t i = 0; i < args.size(); ++i) {
+        if ('-' != args[i][0]) {
+            continue;
+        }
+        if (i >= args.size() - 1) {
+            break;
+        }
+        if ('-' != args[i + 1][0]) {
+            options.insert({args[i], args[i + 1]});
+            ++i;
+        }
+    }
+    return options;
+}
+
+std::string getOption(const std::map<std::string, std::string>& options, const std::string& key,
+                      const std::string& default_value) {
+    auto iter = options.find(key);
+    return iter == options.end() ? default_value : iter->second;
+}
+
+// "name1:pass1,name2:pass2"
+std::map<std::string, std::string> parseUsers(const std::string& str) {
+    std::map<std::string, std::string> users;
+    size_t start = 0;
+    while (start < str.size()) {
+        size_t end = str.find(',', start);
+        if (end == std::string::npos) {
+            end = str.size();
+        }
+        std::string item = str.substr(start, end - start);
+        size_t colon = item.find(':');
+        if (colon != std::string::npos && colon != 0) {
+            users[item.substr(0, colon)] = item.substr(colon + 1);
+        }
+        start = end + 1;
+    }
+    return users;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    auto options = parseOptions(argc, argv);
+    std::filesystem::path log_dir = ltlib::getProgramPath();
+    log_dir = log_dir / "log" / "relay";
+    std::error_code ec;
+    std::filesystem::create_directories(log_dir, ec);
+    auto log_worker = g3::LogWorker::createLogWorker();
+    log_worker->addSink(std::make_unique<ltlib::LogSink>("relay", log_dir.string()),
+                        &ltlib::LogSink::fileWrite);
+    g3::log_levels::disable(DEBUG);
+    g3::only_change_at_initialization::addLogLevel(ERR);
+    g3::initializeLogging(log_worker.get());
+
+    rtc2::relay::RelayServer::Params params{};
+    params.bind_ip = getOption(options, "-ip", "0.0.0.0");
+    params.bind_port = static_cast<uint16_t>(std::atoi(getOption(options, "-port", "0").c_str()));
+    std::string threads = getOption(options, "-threads",
+                                    std::to_string(std::thread::hardware_concurrency()));
+    params.threads = static_cast<uint32_t>(std::atoi(threads.c_str()));
+    params.users = parseUsers(getOption(options, "-user", ""));
+    // 不指定就用Params里的默认限速，显式传0才是不限速
+    std::string rate_kbps =
+        getOption(options, "-rate_kbps", std::to_string(params.rate_limit_kbps));
+    params.rate_limit_kbps = static_cast<uint32_t>(std::atoi(rate_kbps.c_str()));
+    if (params.users.empty()) {
+        printf("Usage: %s -user name:pass[,name:pass] [-ip ip] [-port port] [-threads n] "
+               "[-rate_kbps kbps]\n",
+               argv[0]);
+        return -1;
+    }
+    auto server = rtc2::relay::RelayServer::create(params);
+    if (server == nullptr) {
+        printf("Start relay server failed, see logs in %s\n", log_dir.string().c_str());
+        return -1;
+    }
+    printf("Relay server listening on %s:%u\n", params.bind_ip.c_str(), server->port());
+    fflush(stdout);
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::minutes{1});
+        auto stats = server->stats();
+        LOGF(INFO, "Allocations:%zu received:%llu forwarded:%llu dropped:%llu rate_limited:%llu",
+             server->allocation_count(), static_cast<unsigned long long>(stats.received_packets),
+             static_cast<unsigned long long>(stats.forwarded_packets),
+             static_cast<unsigned long long>(stats.dropped_packets),
+             static_cast<unsigned long long>(stats.rate_limited_packets));
+    }
+    return 0;
+}
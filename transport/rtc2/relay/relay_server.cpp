@@ -0,0 +1,527 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "relay_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <algorithm>
+
+#include <ltlib/logging.h>
+#include <ltlib/times.h>
+
+#include <modules/p2p/relay_protocol.h>
+
+namespace {
+
+constexpr uint32_t kBatchSize = 64;
+constexpr uint32_t kMaxPacketSize = 2048;
+constexpr int64_t kSweepIntervalUS = 5'000'000;
+// 令牌桶最多攒这么久的额度，允许短时间的突发
+constexpr int64_t kBurstUS = 250'000;
+
+uint64_t encode_addr(const sockaddr_in& addr) {
+    return (static_cast<uint64_t>(ntohl(addr.sin_addr.s_addr)) << 16) | ntohs(addr.sin_port);
+}
+
+void decode_addr(uint64_t key, sockaddr_in& addr) {
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(static_cast<uint32_t>(key >> 16));
+    addr.sin_port = htons(static_cast<uint16_t>(key & 0xFFFF));
+}
+
+std::string addr_to_str(uint64_t key) {
+    uint32_t ip = static_cast<uint32_t>(key >> 16);
+    return std::to_string(ip >> 24) + "." + std::to_string((ip >> 16) & 0xFF) + "." +
+           std::to_string((ip >> 8) & 0xFF) + "." + std::to_string(ip & 0xFF) + ":" +
+           std::to_string(key & 0xFFFF);
+}
+
+} // namespace
+
+namespace rtc2 {
+
+namespace relay {
+
+class RelayServer::Worker {
+public:
+    Worker(RelayServer* server, int fd, int epfd);
+    ~Worker();
+    void start();
+    void stop();
+    void add_stats(Stats& stats) const;
+
+private:
+    struct TokenBucket {
+        int64_t tokens = 0;
+        int64_t last_us = 0;
+    };
+    struct Member {
+        std::string allocation_name;
+        std::shared_ptr<Allocation> allocation;
+        uint32_t slot = 0;
+        int64_t last_seen_us = 0;
+        TokenBucket bucket;
+    };
+
+    void loop();
+    void handle_batch(uint32_t count, int64_t now_us);
+    void handle_join(uint32_t index, uint64_t src, int64_t now_us);
+    bool consume(TokenBucket& bucket, uint32_t bytes, int64_t now_us);
+    void queue(const void* data, uint32_t size, uint64_t dst);
+    void flush();
+    void sweep(int64_t now_us);
+
+private:
+    RelayServer* server_;
+    const int fd_;
+    const int epfd_;
+    std::thread thread_;
+    std::atomic<bool> stoped_{false};
+    std::unordered_map<uint64_t, Member> members_;
+    int64_t last_sweep_us_ = 0;
+    // 收发用的缓冲区都在构造时分配好，转发路径上不再分配内存
+    std::vector<std::array<uint8_t, kMaxPacketSize>> buffers_;
+    std::vector<iovec> recv_iovs_;
+    std::vector<sockaddr_in> recv_addrs_;
+    std::vector<mmsghdr> recv_msgs_;
+    std::vector<std::array<uint8_t, kJoinResponseLen>> responses_;
+    uint32_t response_count_ = 0;
+    std::vector<iovec> send_iovs_;
+    std::vector<sockaddr_in> send_addrs_;
+    std::vector<mmsghdr> send_msgs_;
+    uint32_t send_count_ = 0;
+    // 只有本线程写，其它线程读
+    std::atomic<uint64_t> received_packets_{0};
+    std::atomic<uint64_t> forwarded_packets_{0};
+    std::atomic<uint64_t> forwarded_bytes_{0};
+    std::atomic<uint64_t> dropped_packets_{0};
+    std::atomic<uint64_t> rate_limited_packets_{0};
+};
+
+RelayServer::Worker::Worker(RelayServer* server, int fd, int epfd)
+    : server_{server}
+    , fd_{fd}
+    , epfd_{epfd}
+    , buffers_(kBatchSize)
+    , recv_iovs_(kBatchSize)
+    , recv_addrs_(kBatchSize)
+    , recv_msgs_(kBatchSize)
+    , responses_(kBatchSize)
+    , send_iovs_(kBatchSize)
+    , send_addrs_(kBatchSize)
+    , send_msgs_(kBatchSize) {
+    for (uint32_t i = 0; i < kBatchSize; i++) {
+        recv_iovs_[i].iov_base = buffers_[i].data();
+        recv_iovs_[i].iov_len = kMaxPacketSize;
+        recv_msgs_[i].msg_hdr.msg_iov = &recv_iovs_[i];
+        recv_msgs_[i].msg_hdr.msg_iovlen = 1;
+        recv_msgs_[i].msg_hdr.msg_name = &recv_addrs_[i];
+        send_msgs_[i].msg_hdr.msg_iov = &send_iovs_[i];
+        send_msgs_[i].msg_hdr.msg_iovlen = 1;
+        send_msgs_[i].msg_hdr.msg_name = &send_addrs_[i];
+        send_msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    }
+}
+
+RelayServer::Worker::~Worker() {
+    stop();
+    ::close(epfd_);
+    ::close(fd_);
+}
+
+void RelayServer::Worker::start() {
+    thread_ = std::thread{[this]() { loop(); }};
+}
+
+void RelayServer::Worker::stop() {
+    stoped_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void RelayServer::Worker::add_stats(Stats& stats) const {
+    stats.received_packets += received_packets_.load(std::memory_order_relaxed);
+    stats.forwarded_packets += forwarded_packets_.load(std::memory_order_relaxed);
+    stats.forwarded_bytes += forwarded_bytes_.load(std::memory_order_relaxed);
+    stats.dropped_packets += dropped_packets_.load(std::memory_order_relaxed);
+    stats.rate_limited_packets += rate_limited_packets_.load(std::memory_order_relaxed);
+}
+
+void RelayServer::Worker::loop() {
+    epoll_event event{};
+    while (!stoped_) {
+        // 超时用来检查stoped_和清理过期成员
+        int ret = epoll_wait(epfd_, &event, 1, 500);
+        int64_t now_us = ltlib::steady_now_us();
+        if (now_us - last_sweep_us_ >= kSweepIntervalUS) {
+            sweep(now_us);
+        }
+        if (ret <= 0) {
+            continue;
+        }
+        while (true) {
+            for (uint32_t i = 0; i < kBatchSize; i++) {
+                recv_msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            }
+            int count = recvmmsg(fd_, recv_msgs_.data(), kBatchSize, MSG_DONTWAIT, nullptr);
+            if (count <= 0) {
+                break;
+            }
+            handle_batch(static_cast<uint32_t>(count), now_us);
+            if (static_cast<uint32_t>(count) < kBatchSize) {
+                break;
+            }
+            now_us = ltlib::steady_now_us();
+        }
+    }
+}
+
+void RelayServer::Worker::handle_batch(uint32_t count, int64_t now_us) {
+    uint64_t forwarded_bytes = 0;
+    uint32_t forwarded = 0;
+    uint32_t dropped = 0;
+    uint32_t rate_limited = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t* data = buffers_[i].data();
+        const uint32_t size = recv_msgs_[i].msg_len;
+        const uint64_t src = encode_addr(recv_addrs_[i]);
+        if (recv_msgs_[i].msg_hdr.msg_namelen != sizeof(sockaddr_in) ||
+            (recv_msgs_[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+            dropped++;
+            continue;
+        }
+        if (peek_type(data, size) == MsgType::JoinRequest) {
+            handle_join(i, src, now_us);
+            continue;
+        }
+        auto iter = members_.find(src);
+        if (iter == members_.end()) {
+            dropped++;
+            continue;
+        }
+        Member& member = iter->second;
+        member.last_seen_us = now_us;
+        uint64_t dst =
+            member.allocation->peers[1 - member.slot].load(std::memory_order_acquire);
+        if (dst == 0) {
+            dropped++;
+            continue;
+        }
+        if (!consume(member.bucket, size, now_us)) {
+            rate_limited++;
+            continue;
+        }
+        queue(data, size, dst);
+        forwarded++;
+        forwarded_bytes += size;
+    }
+    flush();
+    received_packets_.fetch_add(count, std::memory_order_relaxed);
+    forwarded_packets_.fetch_add(forwarded, std::memory_order_relaxed);
+    forwarded_bytes_.fetch_add(forwarded_bytes, std::memory_order_relaxed);
+    dropped_packets_.fetch_add(dropped, std::memory_order_relaxed);
+    rate_limited_packets_.fetch_add(rate_limited, std::memory_order_relaxed);
+}
+
+void RelayServer::Worker::handle_join(uint32_t index, uint64_t src, int64_t now_us) {
+    const uint8_t* data = buffers_[index].data();
+    const uint32_t size = recv_msgs_[index].msg_len;
+    auto request = decode_join_request(data, size);
+    if (!request.has_value()) {
+        return;
+    }
+    Status status = Status::Success;
+    const int64_t utc_now_ms = ltlib::utc_now_ms();
+    auto user = server_->params_.users.find(request->username);
+    auto iter = members_.find(src);
+    if (user == server_->params_.users.end() || !verify_join_request(data, size, user->second)) {
+        status = Status::AuthFailed;
+    }
+    else if (request->timestamp_ms < utc_now_ms - kMaxClockSkewMS ||
+             request->timestamp_ms > utc_now_ms + kMaxClockSkewMS ||
+             !server_->check_replay(request->tsx_id, now_us)) {
+        status = Status::Stale;
+    }
+    else if (iter != members_.end() && iter->second.allocation_name == request->allocation &&
+             iter->second.allocation->peers[iter->second.slot].load() == src) {
+        // 刷新
+        iter->second.last_seen_us = now_us;
+    }
+    else {
+        // 换了allocation，或者这个位置已经被同一个member_id从新地址顶替过
+        if (iter != members_.end()) {
+            server_->leave(iter->second.allocation_name, src, iter->second.slot);
+            members_.erase(iter);
+        }
+        Member member{};
+        if (server_->join(request->allocation, src, request->member_id, member.allocation,
+                          member.slot)) {
+            member.allocation_name = request->allocation;
+            member.last_seen_us = now_us;
+            member.bucket.last_us = now_us;
+            members_.emplace(src, std::move(member));
+            LOG(INFO) << "Relay " << addr_to_str(src) << " joined allocation "
+                      << request->allocation;
+        }
+        else {
+            status = Status::AllocationFull;
+        }
+    }
+    uint8_t* response = responses_[response_count_++].data();
+    uint32_t len = static_cast<uint32_t>(encode_join_response(request->tsx_id, status, response));
+    queue(response, len, src);
+}
+
+bool RelayServer::Worker::consume(TokenBucket& bucket, uint32_t bytes, int64_t now_us) {
+    const uint32_t kbps = server_->params_.rate_limit_kbps;
+    if (kbps == 0) {
+        return true;
+    }
+    // kbps * us / 8000 = bytes
+    const int64_t burst = std::max<int64_t>(kbps * kBurstUS / 8000, kMaxPacketSize);
+    int64_t elapsed_us = std::min(now_us - bucket.last_us, kBurstUS);
+    bucket.tokens = std::min(burst, bucket.tokens + elapsed_us * kbps / 8000);
+    bucket.last_us = now_us;
+    if (bucket.tokens < bytes) {
+        return false;
+    }
+    bucket.tokens -= bytes;
+    return true;
+}
+
+void RelayServer::Worker::queue(const void* data, uint32_t size, uint64_t dst) {
+    send_iovs_[send_count_].iov_base = const_cast<void*>(data);
+    send_iovs_[send_count_].iov_len = size;
+    decode_addr(dst, send_addrs_[send_count_]);
+    send_count_++;
+}
+
+void RelayServer::Worker::flush() {
+    uint32_t sent = 0;
+    while (sent < send_count_) {
+        int ret = sendmmsg(fd_, send_msgs_.data() + sent, send_count_ - sent, MSG_DONTWAIT);
+        if (ret <= 0) {
+            // 发送缓冲区满或者目标不可达，UDP直接丢掉剩下的
+            dropped_packets_.fetch_add(send_count_ - sent, std::memory_order_relaxed);
+            break;
+        }
+        sent += static_cast<uint32_t>(ret);
+    }
+    send_count_ = 0;
+    response_count_ = 0;
+}
+
+void RelayServer::Worker::sweep(int64_t now_us) {
+    last_sweep_us_ = now_us;
+    const int64_t timeout_us = server_->params_.allocation_timeout_ms * int64_t{1000};
+    for (auto iter = members_.begin(); iter != members_.end();) {
+        if (now_us - iter->second.last_seen_us < timeout_us) {
+            ++iter;
+            continue;
+        }
+        LOG(INFO) << "Relay " << addr_to_str(iter->first) << " left allocation "
+                  << iter->second.allocation_name << " (timeout)";
+        server_->leave(iter->second.allocation_name, iter->first, iter->second.slot);
+        iter = members_.erase(iter);
+    }
+}
+
+std::unique_ptr<RelayServer> RelayServer::create(const Params& params) {
+    if (params.users.empty()) {
+        LOG(ERR) << "RelayServer requires at least one user";
+        return nullptr;
+    }
+    if (params.threads == 0) {
+        LOG(ERR) << "RelayServer threads == 0";
+        return nullptr;
+    }
+    std::unique_ptr<RelayServer> server{new RelayServer(params)};
+    if (!server->init()) {
+        return nullptr;
+    }
+    return server;
+}
+
+RelayServer::RelayServer(const Params& params)
+    : params_{params} {}
+
+RelayServer::~RelayServer() {
+    stop();
+}
+
+uint16_t RelayServer::port() const {
+    return port_;
+}
+
+RelayServer::Stats RelayServer::stats() const {
+    Stats stats{};
+    for (const auto& worker : workers_) {
+        worker->add_stats(stats);
+    }
+    return stats;
+}
+
+size_t RelayServer::allocation_count() {
+    std::lock_guard lock{mutex_};
+    return allocations_.size();
+}
+
+void RelayServer::stop() {
+    for (auto& worker : workers_) {
+        worker->stop();
+    }
+}
+
+bool RelayServer::init() {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(params_.bind_port);
+    if (inet_pton(AF_INET, params_.bind_ip.c_str(), &addr.sin_addr) != 1) {
+        LOG(ERR) << "Invalid bind ip " << params_.bind_ip;
+        return false;
+    }
+    for (uint32_t i = 0; i < params_.threads; i++) {
+        int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            LOG(ERR) << "Create udp socket failed: " << strerror(errno);
+            return false;
+        }
+        int on = 1;
+        int buffer_size = 4 * 1024 * 1024;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+        ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            LOG(ERR) << "Bind " << params_.bind_ip << ":" << ntohs(addr.sin_port)
+                     << " failed: " << strerror(errno);
+            ::close(fd);
+            return false;
+        }
+        if (i == 0) {
+            // bind_port为0时，后面的socket要绑到第一个socket拿到的端口上
+            socklen_t len = sizeof(addr);
+            ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+            port_ = ntohs(addr.sin_port);
+        }
+        int epfd = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        if (epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            LOG(ERR) << "Create epoll failed: " << strerror(errno);
+            if (epfd >= 0) {
+                ::close(epfd);
+            }
+            ::close(fd);
+            return false;
+        }
+        workers_.push_back(std::make_unique<Worker>(this, fd, epfd));
+    }
+    for (auto& worker : workers_) {
+        worker->start();
+    }
+    LOG(INFO) << "RelayServer listening on " << params_.bind_ip << ":" << port_ << " with "
+              << params_.threads << " threads";
+    return true;
+}
+
+bool RelayServer::check_replay(const TsxID& tsx_id, int64_t now_us) {
+    // 时间戳前后各允许kMaxClockSkewMS，按收到的时间记住两倍窗口就够了
+    const int64_t window_us = 2 * kMaxClockSkewMS * 1000;
+    std::lock_guard lock{mutex_};
+    while (!recent_tsx_queue_.empty() && now_us - recent_tsx_queue_.front().first > window_us) {
+        recent_tsx_ids_.erase(recent_tsx_queue_.front().second);
+        recent_tsx_queue_.pop_front();
+    }
+    if (!recent_tsx_ids_.insert(tsx_id).second) {
+        return false;
+    }
+    recent_tsx_queue_.emplace_back(now_us, tsx_id);
+    return true;
+}
+
+bool RelayServer::join(const std::string& name, uint64_t addr, const MemberID& member_id,
+                       std::shared_ptr<Allocation>& allocation, uint32_t& slot) {
+    std::lock_guard lock{mutex_};
+    auto& alloc = allocations_[name];
+    if (alloc == nullptr) {
+        alloc = std::make_shared<Allocation>();
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        // NAT重新映射后端口变了，同一个成员从新地址加入，顶替旧地址.
+        // 旧地址在它所在Worker的表里等超时，leave()时地址对不上不会清掉新地址
+        uint64_t old_addr = alloc->peers[i].load();
+        if (old_addr != 0 && alloc->members[i] == member_id) {
+            alloc->peers[i].store(addr, std::memory_order_release);
+            allocation = alloc;
+            slot = i;
+            LOG(INFO) << "Relay allocation " << name << " member moved from "
+                      << addr_to_str(old_addr) << " to " << addr_to_str(addr);
+            return true;
+        }
+    }
+    for (uint32_t i = 0; i < 2; i++) {
+        if (alloc->peers[i].load() == 0) {
+            alloc->members[i] = member_id;
+            alloc->peers[i].store(addr, std::memory_order_release);
+            allocation = alloc;
+            slot = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void RelayServer::leave(const std::string& name, uint64_t addr, uint32_t slot) {
+    std::lock_guard lock{mutex_};
+    auto iter = allocations_.find(name);
+    if (iter == allocations_.end()) {
+        return;
+    }
+    auto& peers = iter->second->peers;
+    if (peers[slot].load() == addr) {
+        peers[slot].store(0, std::memory_order_release);
+        iter->second->members[slot] = MemberID{};
+    }
+    if (peers[0].load() == 0 && peers[1].load() == 0) {
+        allocations_.erase(iter);
+    }
+}
+
+} // namespace relay
+
+} // namespace rtc2
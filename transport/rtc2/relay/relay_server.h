@@ -0,0 +1,115 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <modules/p2p/relay_protocol.h>
+
+namespace rtc2 {
+
+namespace relay {
+
+// 轻量UDP中继服务器，给RelayEndpoint用，协议见modules/p2p/relay_protocol.h.
+// 两个地址用同一个allocation加入后互相转发，未加入的地址发来的包直接丢弃.
+// 每个线程一个SO_REUSEPORT的UDP socket加一个epoll，用recvmmsg/sendmmsg批量收发，
+// 转发路径上只查线程私有的表，不加锁不分配内存. 仅支持Linux和IPv4.
+class RelayServer {
+public:
+    struct Params {
+        std::string bind_ip = "0.0.0.0";
+        uint16_t bind_port = 0;
+        uint32_t threads = 1;
+        // username -> password，不能为空
+        std::map<std::string, std::string> users;
+        // 每个地址单方向的限速，0表示不限. 默认值够一路高码率串流，又不至于让一个账号占满带宽
+        uint32_t rate_limit_kbps = 50'000;
+        // 超过这么久没收到包就把这个地址从allocation里移除
+        uint32_t allocation_timeout_ms = 30'000;
+    };
+    struct Stats {
+        uint64_t received_packets = 0;
+        uint64_t forwarded_packets = 0;
+        uint64_t forwarded_bytes = 0;
+        uint64_t dropped_packets = 0;
+        uint64_t rate_limited_packets = 0;
+    };
+
+public:
+    static std::unique_ptr<RelayServer> create(const Params& params);
+    ~RelayServer();
+    uint16_t port() const;
+    Stats stats() const;
+    size_t allocation_count();
+    void stop();
+
+private:
+    // 两个成员的地址，编码成(ip << 16 | port)，0表示空位
+    struct Allocation {
+        std::array<std::atomic<uint64_t>, 2> peers{};
+        // 由RelayServer::mutex_保护
+        std::array<MemberID, 2> members{};
+    };
+    class Worker;
+
+    RelayServer(const Params& params);
+    bool init();
+    // 同一个tsx_id只接受一次
+    bool check_replay(const TsxID& tsx_id, int64_t now_us);
+    bool join(const std::string& name, uint64_t addr, const MemberID& member_id,
+              std::shared_ptr<Allocation>& allocation, uint32_t& slot);
+    void leave(const std::string& name, uint64_t addr, uint32_t slot);
+
+private:
+    const Params params_;
+    uint16_t port_ = 0;
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Allocation>> allocations_;
+    // 最近见过的tsx_id，超过时间窗口的请求本来就会被拒绝，只需要记住窗口内的
+    std::set<TsxID> recent_tsx_ids_;
+    std::deque<std::pair<int64_t, TsxID>> recent_tsx_queue_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+} // namespace relay
+
+} // namespace rtc2
@@ -54,7 +54,7 @@ ReliableMessageChannel::~ReliableMessageChannel() {
 }
 
 bool ReliableMessageChannel::sendData(const uint8_t* data, uint32_t size) {
-    LOG(DEBUG) << "reliable senddata " << size;
+    LOGB(DEBUG, "reliable senddata {}", size);
     int ret = ikcp_send(kcp_, reinterpret_cast<const char*>(data), static_cast<int>(size));
     return ret >= 0;
 }
@@ -78,7 +78,7 @@ void ReliableMessageChannel::periodicUpdate() {
 
 int ReliableMessageChannel::onKcpOutput(const char* buf, int len, ikcpcb* kcp, void* user) {
     (void)kcp;
-    LOG(DEBUG) << "kcp output " << len;
+    LOGB(DEBUG, "kcp output {}", len);
     auto that = reinterpret_cast<ReliableMessageChannel*>(user);
     that->send_to_network_(reinterpret_cast<const uint8_t*>(buf), static_cast<uint32_t>(len));
     return len;
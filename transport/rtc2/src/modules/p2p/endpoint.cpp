@@ -143,6 +143,9 @@ void Endpoint::on_read(std::weak_ptr<Endpoint> weak_this, const uint8_t* data, u
         LOG(WARNING) << "shared_this<Endpoint> == nullptr";
         return;
     }
+    if (on_control_packet(data, size, remote_addr)) {
+        return;
+    }
     StunMessage msg{reinterpret_cast<const uint8_t*>(data),
                     reinterpret_cast<const uint8_t*>(data) + size};
     if (msg.verify()) {
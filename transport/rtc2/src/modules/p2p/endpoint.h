@@ -77,6 +77,13 @@ protected:
 
 private:
     void maybe_connected();
+    // 在STUN解析之前调用，返回true表示这个包已经被子类消费掉，例如中继服务器的控制包
+    virtual bool on_control_packet(const uint8_t* data, uint32_t size, const Address& remote_addr) {
+        (void)data;
+        (void)size;
+        (void)remote_addr;
+        return false;
+    }
     void on_read(std::weak_ptr<Endpoint> weak_this, const uint8_t* data, uint32_t size,
                  const Address& remote_addr, const int64_t& packet_time_us);
     virtual void on_binding_request(const StunMessage& msg, const Address& remote_addr,
@@ -83,7 +83,13 @@ void P2P::add_remote_info(const EndpointInfo& info) {
         LOG(WARNING) << "Unsupported EndpointType " << to_str(info.type).c_str();
         break;
     case EndpointType::Relay:
-        LOG(WARNING) << "Unsupported EndpointType " << to_str(info.type).c_str();
+        // 客户端不主动连中继，收到对端的中继地址才创建
+        if (relay_ == nullptr) {
+            create_relay_endpoint();
+        }
+        if (relay_ != nullptr) {
+            relay_->add_remote_info(info);
+        }
         break;
     default:
         LOG(FATAL) << "Unknown EndpointType " << (int)info.type;
@@ -144,14 +150,35 @@ void P2P::create_wan_endpoint() {
 }
 
 void P2P::create_relay_endpoint_after_3s() {
-    // network_channel_->postDelay(3000 /*ms*/, std::bind(&P2P::create_relay_endpoint, this));
+    if (relay_addr_.family() == -1) {
+        return;
+    }
+    post_delayed_task(3000 /*ms*/, [this]() {
+        if (connected_ep_ != nullptr || relay_ != nullptr) {
+            return;
+        }
+        create_relay_endpoint();
+    });
 }
 
 void P2P::create_relay_endpoint() {
-    // if (connected_) {
-    //     return;
-    // }
-    // relay_ = RelayEndpoint::create();
+    LOG(INFO) << "create_relay_endpoint";
+    if (relay_addr_.family() == -1) {
+        LOG(WARNING) << "Relay server not configured";
+        return;
+    }
+    // 两端的username、password相同，由它们推导出中继服务器上的allocation
+    RelayEndpoint::Params params{};
+    params.relay_addr = relay_addr_;
+    params.allocation = relay::make_allocation(username_, password_);
+    params.username = relay_username_;
+    params.password = relay_password_;
+    params.network_channel = network_channel_;
+    params.on_connected = std::bind(&P2P::on_connected, this, std::placeholders::_1);
+    params.on_endpoint_info = std::bind(&P2P::on_endpoint_info, this, std::placeholders::_1);
+    params.on_read = std::bind(&P2P::on_read, this, std::placeholders::_1, std::placeholders::_2,
+                               std::placeholders::_3, std::placeholders::_4);
+    relay_ = RelayEndpoint::create(params);
 }
 
 void P2P::on_endpoint_info(const EndpointInfo& info) {
@@ -0,0 +1,155 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "relay_endpoint.h"
+
+#include <cstring>
+
+#include <ltlib/logging.h>
+#include <ltlib/strings.h>
+#include <ltlib/times.h>
+
+namespace {
+
+// 加入成功前每秒重试，成功后定时刷新，避免中继服务器把allocation当成超时回收
+constexpr uint32_t kJoinRetryIntervalMS = 1000;
+constexpr uint32_t kJoinRefreshIntervalMS = 10'000;
+
+} // namespace
+
+namespace rtc2 {
+
+std::shared_ptr<RelayEndpoint> RelayEndpoint::create(const Params& params) {
+    if (params.relay_addr.family() != AF_INET) {
+        LOG(WARNING) << "Relay server only supports IPv4, relay address "
+                     << params.relay_addr.to_string();
+        return nullptr;
+    }
+    if (params.allocation.empty() || params.allocation.size() > 255 ||
+        params.username.size() > 255) {
+        LOG(WARNING) << "Invalid relay allocation or username";
+        return nullptr;
+    }
+    auto udp_socket = params.network_channel->createUDPSocket(Address{IPv4{"0.0.0.0"}, 0});
+    if (udp_socket == nullptr) {
+        return nullptr;
+    }
+    std::shared_ptr<RelayEndpoint> ep{new RelayEndpoint(params, std::move(udp_socket))};
+    ep->init();
+    EndpointInfo info{};
+    info.address = params.relay_addr;
+    info.type = EndpointType::Relay;
+    ep->set_local_info(info);
+    ep->send_join_request();
+    return ep;
+}
+
+int32_t RelayEndpoint::send(std::vector<std::span<const uint8_t>> spans) {
+    return sock()->sendmsg(spans, relay_addr_);
+}
+
+EndpointType RelayEndpoint::type() const {
+    return EndpointType::Relay;
+}
+
+RelayEndpoint::RelayEndpoint(const Params& params, std::unique_ptr<UDPSocket>&& socket)
+    : Endpoint{std::move(socket), params.network_channel, params.on_connected, params.on_read}
+    , relay_addr_{params.relay_addr}
+    , allocation_{params.allocation}
+    , username_{params.username}
+    , password_{params.password}
+    , on_endpoint_info_{params.on_endpoint_info} {
+    std::string id = ltlib::randomStr(relay::kMemberIDLen);
+    memcpy(member_id_.data(), id.data(), relay::kMemberIDLen);
+}
+
+void RelayEndpoint::send_join_request() {
+    std::string id = ltlib::randomStr(relay::kTsxIDLen);
+    memcpy(tsx_id_.data(), id.data(), relay::kTsxIDLen);
+    relay::JoinRequest request{};
+    request.tsx_id = tsx_id_;
+    request.timestamp_ms = ltlib::utc_now_ms();
+    request.member_id = member_id_;
+    request.allocation = allocation_;
+    request.username = username_;
+    auto packet = relay::encode_join_request(request, password_);
+    if (sock()->sendmsg({{packet.data(), packet.size()}}, relay_addr_) < 0) {
+        LOG(ERR) << "Send relay join request to " << relay_addr_.to_string()
+                 << " failed with error " << sock()->error();
+    }
+    post_delayed_task(joined_ ? kJoinRefreshIntervalMS : kJoinRetryIntervalMS,
+                      std::bind(&RelayEndpoint::send_join_request, this));
+}
+
+bool RelayEndpoint::on_control_packet(const uint8_t* data, uint32_t size,
+                                      const Address& remote_addr) {
+    if (remote_addr != relay_addr_ || !relay::is_control_packet(data, size)) {
+        return false;
+    }
+    auto response = relay::decode_join_response(data, size);
+    if (!response.has_value() || response->tsx_id != tsx_id_) {
+        return true;
+    }
+    if (response->status != relay::Status::Success) {
+        LOG(WARNING) << "Join relay " << relay_addr_.to_string()
+                     << " failed: " << relay::to_str(response->status);
+        return true;
+    }
+    if (!joined_) {
+        LOG(INFO) << "Joined relay " << relay_addr_.to_string();
+        joined_ = true;
+        on_endpoint_info_(local_info());
+    }
+    return true;
+}
+
+void RelayEndpoint::on_binding_request(const StunMessage& msg, const Address& remote_addr,
+                                       const int64_t& packet_time_us) {
+    (void)packet_time_us;
+    LOG(INFO) << "on_binding_request";
+    if (remote_addr != relay_addr_ || remote_info().type != EndpointType::Relay) {
+        return;
+    }
+    set_received_request();
+    send_binding_response(remote_addr, msg.id());
+}
+
+void RelayEndpoint::on_binding_response(const StunMessage& msg, const Address& remote_addr,
+                                        const int64_t& packet_time_us) {
+    (void)msg;
+    (void)packet_time_us;
+    LOG(INFO) << "on_binding_response";
+    if (remote_addr != relay_addr_ || remote_info().type != EndpointType::Relay) {
+        return;
+    }
+    set_received_response();
+}
+
+} // namespace rtc2
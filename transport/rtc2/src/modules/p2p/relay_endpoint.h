@@ -31,18 +31,49 @@
 #pragma once
 #include <modules/p2p/endpoint.h>
 
+#include <modules/p2p/relay_protocol.h>
+
 namespace rtc2 {
 
+// 通过中继服务器转发. 两端用同一个allocation加入中继服务器，之后的STUN和数据包都发给中继服务器，
+// 由它转给另一端. 对端看到的地址就是中继服务器地址，所以local/remote info都是relay_addr.
 class RelayEndpoint : public Endpoint {
 public:
-    int32_t send(std::vector<std::span<const uint8_t>>) override { return 0; };
-    EndpointType type() const override { return EndpointType::Relay; }
+    struct Params {
+        Address relay_addr;
+        std::string allocation;
+        std::string username;
+        std::string password;
+        std::function<void(const EndpointInfo&)> on_endpoint_info;
+        std::function<void(Endpoint*)> on_connected;
+        std::function<void(Endpoint*, const uint8_t*, uint32_t, int64_t)> on_read;
+        NetworkChannel* network_channel;
+    };
+
+public:
+    static std::shared_ptr<RelayEndpoint> create(const Params& params);
+    int32_t send(std::vector<std::span<const uint8_t>> spans) override;
+    EndpointType type() const override;
 
 private:
+    RelayEndpoint(const Params& params, std::unique_ptr<UDPSocket>&& socket);
+    void send_join_request();
+    bool on_control_packet(const uint8_t* data, uint32_t size, const Address& remote_addr) override;
     void on_binding_request(const StunMessage& msg, const Address& remote_addr,
                             const int64_t& packet_time_us) override;
     void on_binding_response(const StunMessage& msg, const Address& remote_addr,
                              const int64_t& packet_time_us) override;
+
+private:
+    const Address relay_addr_;
+    const std::string allocation_;
+    const std::string username_;
+    const std::string password_;
+    std::function<void(const EndpointInfo&)> on_endpoint_info_;
+    relay::TsxID tsx_id_{};
+    // 整个生命周期不变，NAT重新映射后中继服务器靠它认出是同一个成员
+    relay::MemberID member_id_{};
+    bool joined_ = false;
 };
 
-} // namespace rtc2
\ No newline at end of file
+} // namespace rtc2
@@ -0,0 +1,199 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <modules/p2p/relay_protocol.h>
+
+#include <cstring>
+
+#include <modules/p2p/stuns/hmac_sha1.h>
+
+namespace {
+
+constexpr uint8_t kMagic[3] = {'L', 'T', 'R'};
+// 除了allocation和username以外的部分
+constexpr size_t kFixedJoinRequestLen = rtc2::relay::kHeaderLen + rtc2::relay::kTsxIDLen + 8 +
+                                        rtc2::relay::kMemberIDLen + 2 + rtc2::relay::kHmacLen;
+
+std::array<uint8_t, rtc2::relay::kHmacLen> hmac(const uint8_t* data, size_t size,
+                                               const std::string& password) {
+    std::array<uint8_t, rtc2::relay::kHmacLen> digest{};
+    HMAC_SHA1_CTX ctx;
+    HMAC_SHA1_Init(&ctx, reinterpret_cast<const uint8_t*>(password.data()), password.size());
+    HMAC_SHA1_Update(&ctx, data, size);
+    HMAC_SHA1_Final(digest.data(), &ctx);
+    return digest;
+}
+
+} // namespace
+
+namespace rtc2 {
+
+namespace relay {
+
+bool is_control_packet(const uint8_t* data, size_t size) {
+    return size >= kHeaderLen + kTsxIDLen && memcmp(data, kMagic, sizeof(kMagic)) == 0;
+}
+
+std::optional<MsgType> peek_type(const uint8_t* data, size_t size) {
+    if (!is_control_packet(data, size)) {
+        return std::nullopt;
+    }
+    switch (static_cast<MsgType>(data[3])) {
+    case MsgType::JoinRequest:
+        return MsgType::JoinRequest;
+    case MsgType::JoinResponse:
+        return MsgType::JoinResponse;
+    default:
+        return std::nullopt;
+    }
+}
+
+std::string make_allocation(const std::string& ice_username, const std::string& ice_password) {
+    const std::string label = "lanthing-relay-allocation|" + ice_username;
+    auto digest =
+        hmac(reinterpret_cast<const uint8_t*>(label.data()), label.size(), ice_password);
+    static const char kHex[] = "0123456789abcdef";
+    std::string allocation;
+    for (uint8_t byte : digest) {
+        allocation.push_back(kHex[byte >> 4]);
+        allocation.push_back(kHex[byte & 0x0F]);
+    }
+    return allocation;
+}
+
+std::vector<uint8_t> encode_join_request(const JoinRequest& request,
+                                         const std::string& password) {
+    const std::string& allocation = request.allocation;
+    const std::string& username = request.username;
+    if (allocation.empty() || allocation.size() > 255 || username.size() > 255) {
+        return {};
+    }
+    std::vector<uint8_t> packet;
+    packet.reserve(kFixedJoinRequestLen + allocation.size() + username.size());
+    packet.insert(packet.end(), kMagic, kMagic + sizeof(kMagic));
+    packet.push_back(static_cast<uint8_t>(MsgType::JoinRequest));
+    packet.insert(packet.end(), request.tsx_id.begin(), request.tsx_id.end());
+    const uint64_t timestamp = static_cast<uint64_t>(request.timestamp_ms);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        packet.push_back(static_cast<uint8_t>(timestamp >> shift));
+    }
+    packet.insert(packet.end(), request.member_id.begin(), request.member_id.end());
+    packet.push_back(static_cast<uint8_t>(allocation.size()));
+    packet.insert(packet.end(), allocation.begin(), allocation.end());
+    packet.push_back(static_cast<uint8_t>(username.size()));
+    packet.insert(packet.end(), username.begin(), username.end());
+    auto digest = hmac(packet.data(), packet.size(), password);
+    packet.insert(packet.end(), digest.begin(), digest.end());
+    return packet;
+}
+
+std::optional<JoinRequest> decode_join_request(const uint8_t* data, size_t size) {
+    if (peek_type(data, size) != MsgType::JoinRequest) {
+        return std::nullopt;
+    }
+    JoinRequest request{};
+    size_t pos = kHeaderLen;
+    memcpy(request.tsx_id.data(), data + pos, kTsxIDLen);
+    pos += kTsxIDLen;
+    if (size < kFixedJoinRequestLen) {
+        return std::nullopt;
+    }
+    uint64_t timestamp = 0;
+    for (size_t i = 0; i < 8; i++) {
+        timestamp = (timestamp << 8) | data[pos + i];
+    }
+    request.timestamp_ms = static_cast<int64_t>(timestamp);
+    pos += 8;
+    memcpy(request.member_id.data(), data + pos, kMemberIDLen);
+    pos += kMemberIDLen;
+    for (std::string* field : {&request.allocation, &request.username}) {
+        if (pos + 1 > size || pos + 1 + data[pos] > size) {
+            return std::nullopt;
+        }
+        field->assign(reinterpret_cast<const char*>(data + pos + 1), data[pos]);
+        pos += 1 + data[pos];
+    }
+    if (pos + kHmacLen != size || request.allocation.empty()) {
+        return std::nullopt;
+    }
+    return request;
+}
+
+bool verify_join_request(const uint8_t* data, size_t size, const std::string& password) {
+    if (size < kHeaderLen + kTsxIDLen + kHmacLen) {
+        return false;
+    }
+    auto digest = hmac(data, size - kHmacLen, password);
+    // 逐字节比较完，不提前返回
+    uint8_t diff = 0;
+    for (size_t i = 0; i < kHmacLen; i++) {
+        diff |= digest[i] ^ data[size - kHmacLen + i];
+    }
+    return diff == 0;
+}
+
+size_t encode_join_response(const TsxID& tsx_id, Status status, uint8_t* out) {
+    memcpy(out, kMagic, sizeof(kMagic));
+    out[3] = static_cast<uint8_t>(MsgType::JoinResponse);
+    memcpy(out + kHeaderLen, tsx_id.data(), kTsxIDLen);
+    out[kHeaderLen + kTsxIDLen] = static_cast<uint8_t>(status);
+    return kJoinResponseLen;
+}
+
+std::optional<JoinResponse> decode_join_response(const uint8_t* data, size_t size) {
+    if (peek_type(data, size) != MsgType::JoinResponse || size != kJoinResponseLen) {
+        return std::nullopt;
+    }
+    JoinResponse response{};
+    memcpy(response.tsx_id.data(), data + kHeaderLen, kTsxIDLen);
+    response.status = static_cast<Status>(data[kHeaderLen + kTsxIDLen]);
+    return response;
+}
+
+const char* to_str(Status status) {
+    switch (status) {
+    case Status::Success:
+        return "success";
+    case Status::AuthFailed:
+        return "auth failed";
+    case Status::AllocationFull:
+        return "allocation full";
+    case Status::BadRequest:
+        return "bad request";
+    case Status::Stale:
+        return "stale request";
+    default:
+        return "unknown";
+    }
+}
+
+} // namespace relay
+
+} // namespace rtc2
@@ -0,0 +1,109 @@
+/*
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2023 Zhennan Tu <zhennan.tu@gmail.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace rtc2 {
+
+// RelayEndpoint与中继服务器之间的控制协议. 只有控制包带头部，数据包原样转发.
+// 控制包以"LTR"开头，不会和STUN(首字节0~3)、DTLS(20~63)、RTP/RTCP(128~191)冲突.
+//   JoinRequest:  'L' 'T' 'R' 1 | tsx_id(12) | timestamp_ms(8) | member_id(8) |
+//                 alloc_len(1) alloc | user_len(1) user | hmac(20)
+//   JoinResponse: 'L' 'T' 'R' 2 | tsx_id(12) | status(1)
+// hmac是以password为key，对hmac之前所有字节做的HMAC-SHA1. timestamp_ms是发送时的UTC毫秒，
+// 大端序，服务器只接受时间差在kMaxClockSkewMS以内、且tsx_id没见过的请求，防止重放.
+// member_id是每个端点随机生成的，NAT重新映射后同一个member_id从新地址加入会顶替旧地址.
+// 两端用同一个allocation加入后，中继服务器在这两个地址之间互相转发，JoinRequest同时充当保活.
+namespace relay {
+
+constexpr size_t kHeaderLen = 4;
+constexpr size_t kTsxIDLen = 12;
+constexpr size_t kMemberIDLen = 8;
+constexpr size_t kHmacLen = 20;
+constexpr int64_t kMaxClockSkewMS = 60'000;
+constexpr size_t kJoinResponseLen = kHeaderLen + kTsxIDLen + 1;
+
+enum class MsgType : uint8_t {
+    JoinRequest = 1,
+    JoinResponse = 2,
+};
+
+enum class Status : uint8_t {
+    Success = 0,
+    AuthFailed = 1,
+    AllocationFull = 2,
+    BadRequest = 3,
+    Stale = 4,
+};
+
+using TsxID = std::array<uint8_t, kTsxIDLen>;
+using MemberID = std::array<uint8_t, kMemberIDLen>;
+
+struct JoinRequest {
+    TsxID tsx_id;
+    int64_t timestamp_ms;
+    MemberID member_id;
+    std::string allocation;
+    std::string username;
+};
+
+struct JoinResponse {
+    TsxID tsx_id;
+    Status status;
+};
+
+bool is_control_packet(const uint8_t* data, size_t size);
+std::optional<MsgType> peek_type(const uint8_t* data, size_t size);
+
+// 中继服务器的账号是大家共用的，allocation不能用ICE username这种会在STUN包里明文出现的东西.
+// 用只有通信双方知道的ICE password推导，别人猜不到
+std::string make_allocation(const std::string& ice_username, const std::string& ice_password);
+
+std::vector<uint8_t> encode_join_request(const JoinRequest& request, const std::string& password);
+std::optional<JoinRequest> decode_join_request(const uint8_t* data, size_t size);
+// 用username对应的password校验整个JoinRequest包
+bool verify_join_request(const uint8_t* data, size_t size, const std::string& password);
+
+// 写到out里，out至少kJoinResponseLen字节，返回写入的长度. 不分配内存，给服务器的热路径用
+size_t encode_join_response(const TsxID& tsx_id, Status status, uint8_t* out);
+std::optional<JoinResponse> decode_join_response(const uint8_t* data, size_t size);
+
+const char* to_str(Status status);
+
+} // namespace relay
+
+} // namespace rtc2
@@ -0,0 +1,107 @@
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <modules/p2p/relay_protocol.h>
+
+using namespace rtc2::relay;
+
+namespace {
+
+JoinRequest makeRequest() {
+    JoinRequest request{};
+    for (size_t i = 0; i < kTsxIDLen; i++) {
+        request.tsx_id[i] = static_cast<uint8_t>(i + 1);
+    }
+    for (size_t i = 0; i < kMemberIDLen; i++) {
+        request.member_id[i] = static_cast<uint8_t>(0xA0 + i);
+    }
+    request.timestamp_ms = 1'700'000'000'123;
+    request.allocation = "allocation";
+    request.username = "user";
+    return request;
+}
+
+} // namespace
+
+TEST(RelayProtocolTest, JoinRequestRoundTrip) {
+    JoinRequest request = makeRequest();
+    auto packet = encode_join_request(request, "password");
+    ASSERT_FALSE(packet.empty());
+    EXPECT_TRUE(is_control_packet(packet.data(), packet.size()));
+    EXPECT_EQ(peek_type(packet.data(), packet.size()), MsgType::JoinRequest);
+    auto decoded = decode_join_request(packet.data(), packet.size());
+    ASSERT_TRUE(decoded.has_value());
+    EXPECT_EQ(decoded->tsx_id, request.tsx_id);
+    EXPECT_EQ(decoded->timestamp_ms, request.timestamp_ms);
+    EXPECT_EQ(decoded->member_id, request.member_id);
+    EXPECT_EQ(decoded->allocation, request.allocation);
+    EXPECT_EQ(decoded->username, request.username);
+}
+
+TEST(RelayProtocolTest, EncodeRejectsInvalidFields) {
+    JoinRequest request = makeRequest();
+    request.allocation.clear();
+    EXPECT_TRUE(encode_join_request(request, "password").empty());
+    request.allocation = std::string(256, 'a');
+    EXPECT_TRUE(encode_join_request(request, "password").empty());
+    request.allocation = "allocation";
+    request.username = std::string(256, 'u');
+    EXPECT_TRUE(encode_join_request(request, "password").empty());
+}
+
+TEST(RelayProtocolTest, VerifyJoinRequest) {
+    auto packet = encode_join_request(makeRequest(), "password");
+    EXPECT_TRUE(verify_join_request(packet.data(), packet.size(), "password"));
+    EXPECT_FALSE(verify_join_request(packet.data(), packet.size(), "wrong"));
+    // 改动被签名覆盖的任何一个字节都要校验失败，包括时间戳和member_id
+    for (size_t i = 0; i < packet.size(); i++) {
+        auto tampered = packet;
+        tampered[i] ^= 0x01;
+        EXPECT_FALSE(verify_join_request(tampered.data(), tampered.size(), "password"))
+            << "byte " << i;
+    }
+    EXPECT_FALSE(verify_join_request(packet.data(), kHeaderLen + kTsxIDLen, "password"));
+}
+
+TEST(RelayProtocolTest, DecodeRejectsMalformed) {
+    auto packet = encode_join_request(makeRequest(), "password");
+    for (size_t size = 0; size < packet.size(); size++) {
+        EXPECT_FALSE(decode_join_request(packet.data(), size).has_value()) << "size " << size;
+    }
+    auto longer = packet;
+    longer.push_back(0);
+    EXPECT_FALSE(decode_join_request(longer.data(), longer.size()).has_value());
+    // RTP包首字节是0x80，不是控制包
+    std::vector<uint8_t> rtp(64, 0x80);
+    EXPECT_FALSE(is_control_packet(rtp.data(), rtp.size()));
+    EXPECT_FALSE(peek_type(rtp.data(), rtp.size()).has_value());
+}
+
+TEST(RelayProtocolTest, JoinResponseRoundTrip) {
+    TsxID tsx_id = makeRequest().tsx_id;
+    uint8_t buffer[kJoinResponseLen];
+    for (Status status : {Status::Success, Status::AuthFailed, Status::AllocationFull,
+                          Status::BadRequest, Status::Stale}) {
+        ASSERT_EQ(encode_join_response(tsx_id, status, buffer), kJoinResponseLen);
+        EXPECT_EQ(peek_type(buffer, kJoinResponseLen), MsgType::JoinResponse);
+        auto decoded = decode_join_response(buffer, kJoinResponseLen);
+        ASSERT_TRUE(decoded.has_value());
+        EXPECT_EQ(decoded->tsx_id, tsx_id);
+        EXPECT_EQ(decoded->status, status);
+    }
+    EXPECT_FALSE(decode_join_response(buffer, kJoinResponseLen - 1).has_value());
+    EXPECT_FALSE(decode_join_request(buffer, kJoinResponseLen).has_value());
+}
+
+TEST(RelayProtocolTest, MakeAllocation) {
+    std::string allocation = make_allocation("ice_user", "ice_pass");
+    EXPECT_EQ(allocation, make_allocation("ice_user", "ice_pass"));
+    EXPECT_EQ(allocation.size(), kHmacLen * 2);
+    EXPECT_EQ(allocation.find("ice_user"), std::string::npos);
+    EXPECT_NE(allocation, make_allocation("ice_user", "other_pass"));
+    EXPECT_NE(allocation, make_allocation("other_user", "ice_pass"));
+}
@@ -40,6 +40,8 @@ constexpr uint8_t kFirstPacketInFrame = 0b0000'0001;
 constexpr uint8_t kLastPacketInFrame = 0b0000'0010;
 constexpr uint8_t kKeyFrame = 0b0000'0100;
 constexpr uint8_t kRetransmit = 0b0000'1000;
+// 旧版本的LtFrameInfo只有frame_id和encode_duration，没有宽高
+constexpr size_t kLegacyFrameInfoSize = 4;
 
 } // namespace
 
@@ -78,15 +80,24 @@ bool LtPacketInfoExtension::write_to_buff(Buffer buff, const LtPacketInfo& info)
 }
 
 bool LtFrameInfoExtension::read_from_buff(Buffer buff, LtFrameInfo& info) {
-    if (buff.size() < value_size(info)) {
+    if (buff.size() < kLegacyFrameInfoSize) {
         return false;
     }
     auto span = buff.spans()[0];
-    if (span.empty()) {
+    if (span.size() < kLegacyFrameInfoSize) {
         return false;
     }
     info.set_frame_id(*(uint16_t*)(span.data() + 0));
     info.set_encode_duration(*(uint16_t*)(span.data() + 2));
+    if (span.size() >= value_size(info)) {
+        info.set_width(*(uint16_t*)(span.data() + 4));
+        info.set_height(*(uint16_t*)(span.data() + 6));
+    }
+    else {
+        // 对端是旧版本，宽高为0表示不知道，接收端按没有变化处理
+        info.set_width(0);
+        info.set_height(0);
+    }
     return true;
 }
 
@@ -100,6 +111,8 @@ bool LtFrameInfoExtension::write_to_buff(Buffer buff, const LtFrameInfo& info) {
     }
     *(uint16_t*)(span.data() + 0) = info.frame_id();
     *(uint16_t*)(span.data() + 2) = info.encode_duration();
+    *(uint16_t*)(span.data() + 4) = info.width();
+    *(uint16_t*)(span.data() + 6) = info.height();
     return true;
 }
 
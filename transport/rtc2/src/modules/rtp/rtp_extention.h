@@ -110,9 +110,19 @@ public:
 
     void set_encode_duration(uint16_t duration) { encode_duration_ = duration; }
 
+    uint16_t width() const { return width_; }
+
+    void set_width(uint16_t width) { width_ = width; }
+
+    uint16_t height() const { return height_; }
+
+    void set_height(uint16_t height) { height_ = height; }
+
 private:
     uint16_t frame_id_ = 0;
     uint16_t encode_duration_ = 0;
+    uint16_t width_ = 0;
+    uint16_t height_ = 0;
 };
 
 class LtFrameInfoExtension {
@@ -123,7 +133,7 @@ public:
 
     static const char* uri() { return "lanthing-frame-info"; }
 
-    static uint8_t value_size(const LtFrameInfo&) { return 4; }
+    static uint8_t value_size(const LtFrameInfo&) { return 8; }
 
     static bool read_from_buff(Buffer buff, LtFrameInfo& info);
 
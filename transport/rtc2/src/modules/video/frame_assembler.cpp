@@ -61,6 +61,11 @@ FrameAssembler::InsertResult FrameAssembler::insert(const VideoPacket& packet) {
     update_missing_packets(seq_num);
 
     result.packets = find_frames(seq_num);
+    for (const auto& pkt : result.packets) {
+        if (result.first_packet_time_us == 0 || pkt.arrival_time_us < result.first_packet_time_us) {
+            result.first_packet_time_us = pkt.arrival_time_us;
+        }
+    }
     return result;
 }
 
@@ -186,6 +191,8 @@ VideoPacket::VideoPacket(const RtpPacket& rtp_packet) {
     if (rtp_packet.get_extension<LtFrameInfoExtension>(frame_info)) {
         encode_duration = frame_info.encode_duration();
         frame_id = frame_info.frame_id();
+        width = frame_info.width();
+        height = frame_info.height();
     }
     LtPacketInfo packet_info{};
     if (rtp_packet.get_extension<LtPacketInfoExtension>(packet_info)) {
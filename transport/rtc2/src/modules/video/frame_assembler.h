@@ -32,6 +32,10 @@ struct VideoPacket {
     std::optional<uint16_t> global_sequence_number;
     std::optional<uint16_t> frame_id;
     std::optional<uint16_t> encode_duration;
+    std::optional<uint16_t> width;
+    std::optional<uint16_t> height;
+    // 网络线程收到这个包的时间
+    int64_t arrival_time_us = 0;
 };
 
 class FrameAssembler {
@@ -39,6 +43,8 @@ public:
     struct InsertResult {
         std::vector<VideoPacket> packets;
         bool buffer_cleared = false;
+        // packets里最早到达的包的时间，用于FrameTracer的FirstPacket打点
+        int64_t first_packet_time_us = 0;
     };
 
 public:
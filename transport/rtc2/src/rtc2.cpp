@@ -62,6 +62,8 @@ std::unique_ptr<Client> Client::create(const Params& params) {
         video_frame.ltframe_id = frame.frame_id;
         video_frame.data = frame.data;
         video_frame.size = frame.size;
+        video_frame.width = frame.width;
+        video_frame.height = frame.height;
         video_frame.start_encode_timestamp_us =
             frame.encode_timestamp_us; // 这个timestamp取编码前还是编码后比较合理？
         video_frame.end_encode_timestamp_us = frame.encode_duration_us + frame.encode_timestamp_us;
@@ -186,6 +188,8 @@ bool Server::sendVideo(const lt::VideoFrame& frame) {
     rtc2::VideoFrame video_frame{};
     video_frame.frame_id = frame.ltframe_id;
     video_frame.is_keyframe = frame.is_keyframe;
+    video_frame.width = frame.width;
+    video_frame.height = frame.height;
     // video_frame.encode_timestamp_us = frame.
     video_frame.encode_duration_us =
         frame.end_encode_timestamp_us - frame.start_encode_timestamp_us;
@@ -32,6 +32,7 @@
 
 #include <cstring>
 
+#include <ltlib/frame_trace.h>
 #include <ltlib/logging.h>
 
 #include <rtc2/video_frame.h>
@@ -73,8 +74,8 @@ void VideoReceiveStream::onRtpPacket(const uint8_t* data, uint32_t size, int64_t
 }
 
 void VideoReceiveStream::onUnprotectedRtpPacket(const RtpPacket& packet, int64_t time_us) {
-    (void)time_us;
     VideoPacket video_packet{packet};
+    video_packet.arrival_time_us = time_us;
     auto result = frame_assembler_.insert(video_packet);
     if (result.buffer_cleared) {
         // TODO:请求I帧
@@ -95,6 +96,11 @@ void VideoReceiveStream::onUnprotectedRtpPacket(const RtpPacket& packet, int64_t
                 video_frame.frame_id = frame_id_unwrapper_.Unwrap(pkt.frame_id.value());
                 video_frame.encode_duration_us =
                     static_cast<uint64_t>(pkt.encode_duration.value()) * 150;
+                video_frame.width = pkt.width.value_or(0);
+                video_frame.height = pkt.height.value_or(0);
+            }
+            if (pkt.key_frame.has_value()) {
+                video_frame.is_keyframe = pkt.key_frame.value();
             }
             // 理论上spans.size() == 1
             auto spans = pkt.rtp.buff().spans();
@@ -105,6 +111,9 @@ void VideoReceiveStream::onUnprotectedRtpPacket(const RtpPacket& packet, int64_t
         }
         video_frame.data = data.data();
         video_frame.size = size;
+        // 组帧完成的Arrival由上层打点，这里只补首包到达时间
+        ltlib::FrameTracer::instance()->stamp(
+            video_frame.frame_id, ltlib::FrameTracer::Stage::FirstPacket, result.first_packet_time_us);
         on_decodable_frame_(video_frame);
     }
 }
@@ -30,6 +30,8 @@
 
 #include <cassert>
 
+#include <ltlib/frame_trace.h>
+
 #include <rtc2/video_frame.h>
 
 #include "video_send_stream.h"
@@ -60,6 +62,8 @@ void VideoSendStream::sendFrame(const VideoFrame& frame) {
             finfo.set_frame_id(frame.frame_id & 0xFFFF);
             // 最小时间单位150us，uint16能表示最大时间为 65535 * 150us = 9830250us = 9.83s
             finfo.set_encode_duration(static_cast<uint16_t>(frame.encode_duration_us / 150));
+            finfo.set_width(static_cast<uint16_t>(frame.width));
+            finfo.set_height(static_cast<uint16_t>(frame.height));
             packets[i].rtp.set_extension<LtFrameInfoExtension>(finfo);
         }
         if (i == packets.size() - 1) {
@@ -102,6 +106,8 @@ std::vector<PacedPacket> VideoSendStream::packetize(const VideoFrame& frame) {
             LtFrameInfo frame_info{};
             frame_info.set_encode_duration(static_cast<uint16_t>(frame.encode_duration_us / 150));
             frame_info.set_frame_id(static_cast<uint16_t>(frame.frame_id & 0xFFFF));
+            frame_info.set_width(static_cast<uint16_t>(frame.width));
+            frame_info.set_height(static_cast<uint16_t>(frame.height));
             pk.rtp.set_extension<LtFrameInfoExtension>(frame_info);
             packet_info.set_first_packet_in_frame(true);
             first_packet = false;
@@ -120,7 +126,12 @@ std::vector<PacedPacket> VideoSendStream::packetize(const VideoFrame& frame) {
             static_cast<uint32_t>(frame.encode_timestamp_us / 1000)); // 没有必要搞一层采样率
         pk.rtp.set_payload_type(125);
         pk.rtp.set_payload(span);
-        pk.send_func = std::bind(&VideoSendStream::onPcedPacket, this, std::placeholders ::_1);
+        std::optional<uint64_t> frame_id;
+        if (offset == 0) {
+            frame_id = frame.frame_id;
+        }
+        pk.send_func = std::bind(&VideoSendStream::onPcedPacket, this, std::placeholders ::_1,
+                                 frame_id);
         packets.push_back(std::move(pk));
         offset += packet_size;
     }
@@ -128,17 +139,21 @@ std::vector<PacedPacket> VideoSendStream::packetize(const VideoFrame& frame) {
 }
 
 // 跑在pacer/cc线程
-void VideoSendStream::onPcedPacket(RtpPacket& packet) {
+void VideoSendStream::onPcedPacket(RtpPacket& packet, std::optional<uint64_t> frame_id) {
     // TODO: cc
     packet.set_sequence_number(rtp_seq_++); // TODO: retransmit用独立的seq
     network_channel_->post(
-        std::bind(&VideoSendStream::protectAndSendPacket, this, std::move(packet)));
+        std::bind(&VideoSendStream::protectAndSendPacket, this, std::move(packet), frame_id));
 }
 
 // 跑在网络线程
-void VideoSendStream::protectAndSendPacket(const RtpPacket& packet) {
+void VideoSendStream::protectAndSendPacket(const RtpPacket& packet,
+                                           std::optional<uint64_t> frame_id) {
     // TODO: protect...
     network_channel_->sendPacket(packet.buff().spans());
+    if (frame_id.has_value()) {
+        ltlib::FrameTracer::instance()->stamp(frame_id.value(), ltlib::FrameTracer::Stage::Send);
+    }
 }
 
 } // namespace rtc2
\ No newline at end of file
@@ -30,6 +30,7 @@
 
 #pragma once
 #include <memory>
+#include <optional>
 
 #include <rtc2/connection.h>
 #include <rtc2/video_frame.h>
@@ -55,8 +56,9 @@ public:
 
 private:
     std::vector<PacedPacket> packetize(const VideoFrame& frame);
-    void onPcedPacket(RtpPacket& packet);
-    void protectAndSendPacket(const RtpPacket& packet);
+    // frame_id只有每帧首包才带，用于FrameTracer的Send打点
+    void onPcedPacket(RtpPacket& packet, std::optional<uint64_t> frame_id);
+    void protectAndSendPacket(const RtpPacket& packet, std::optional<uint64_t> frame_id);
 
 private:
     uint32_t ssrc_;